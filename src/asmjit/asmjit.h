@@ -204,6 +204,8 @@
 //!   - \ref asmjit::PodVector<T> - A simple array-like container for storing
 //!     POD data.
 //!   - \ref asmjit::PodList<T> - A single linked list.
+//!   - \ref asmjit::ZoneVector<T> - Like `PodVector<T>`, but allocated by
+//!     \ref asmjit::Zone and freed in bulk with it.
 //!   - \ref asmjit::StringBuilder - A string builder that can append strings
 //!     and integers.
 //!
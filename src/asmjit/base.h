@@ -12,6 +12,7 @@
 #include "./build.h"
 
 #include "./base/assembler.h"
+#include "./base/codecache.h"
 #include "./base/constpool.h"
 #include "./base/containers.h"
 #include "./base/cpuinfo.h"
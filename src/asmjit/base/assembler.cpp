@@ -99,15 +99,18 @@ Assembler::Assembler(Runtime* runtime) noexcept
     _lastError(runtime ? kErrorOk : kErrorNotInitialized),
     _exIdGenerator(0),
     _exCountAttached(0),
+    _allocator(nullptr),
     _zoneAllocator(8192 - Zone::kZoneOverhead),
     _buffer(nullptr),
     _end(nullptr),
     _cursor(nullptr),
     _trampolinesSize(0),
+    _sectionId(0),
     _comment(nullptr),
     _unusedLinks(nullptr),
-    _labels(),
-    _relocations() {}
+    _labels(&_zoneAllocator),
+    _relocations(&_zoneAllocator),
+    _relaxItems(&_zoneAllocator) {}
 
 Assembler::~Assembler() noexcept {
   reset(true);
@@ -116,6 +119,51 @@ Assembler::~Assembler() noexcept {
     _errorHandler->release();
 }
 
+// ============================================================================
+// [asmjit::Assembler - Helpers]
+// ============================================================================
+
+//! \internal
+//!
+//! Store the code-buffer to the current section and load the section `id`.
+static void Assembler_swapSection(Assembler* self, uint32_t id) noexcept {
+  Assembler::Section* current = self->_sections[self->_sectionId];
+  Assembler::Section* section = self->_sections[id];
+
+  size_t offset = (size_t)(self->_cursor - self->_buffer);
+  current->content.data = self->_buffer;
+  current->content.capacity = (size_t)(self->_end - self->_buffer);
+  current->content.length = offset;
+  current->content.offset = offset;
+
+  self->_buffer = section->content.data;
+  self->_end = section->content.data + section->content.capacity;
+  self->_cursor = section->content.data + section->content.offset;
+  self->_sectionId = id;
+}
+
+//! \internal
+//!
+//! Patch a label displacement at `offset`, its size is stored in the first
+//! byte of the placeholder emitted by the architecture specific assembler.
+static Error Assembler_patchDisplacement(Assembler* self, intptr_t offset, int32_t value) noexcept {
+  // Size of the value we are going to patch. Only BYTE/DWORD is allowed.
+  uint32_t size = self->readU8At(offset);
+  ASMJIT_ASSERT(size == 1 || size == 4);
+
+  if (size == 4) {
+    self->writeI32At(offset, value);
+  }
+  else {
+    ASMJIT_ASSERT(size == 1);
+    if (!Utils::isInt8(value))
+      return kErrorIllegalDisplacement;
+    self->writeU8At(offset, static_cast<uint32_t>(value) & 0xFF);
+  }
+
+  return kErrorOk;
+}
+
 // ============================================================================
 // [asmjit::Assembler - Reset]
 // ============================================================================
@@ -127,10 +175,36 @@ void Assembler::reset(bool releaseMemory) noexcept {
   _exIdGenerator = 0;
   _exCountAttached = 0;
 
+  // Sections other than `.text` are kept with their buffers, unless the
+  // memory is released, `.text` becomes the current section.
+  size_t sectionsCount = _sections.getLength();
+  if (sectionsCount != 0) {
+    if (_sectionId != 0)
+      Assembler_swapSection(this, 0);
+
+    for (size_t i = 1; i < sectionsCount; i++) {
+      Section* section = _sections[i];
+      if (releaseMemory) {
+        if (section->content.data != nullptr)
+          MemUtil::release(_allocator, section->content.data);
+        MemUtil::release(_allocator, section);
+      }
+      else {
+        section->content.length = 0;
+        section->content.offset = 0;
+      }
+    }
+
+    if (releaseMemory) {
+      MemUtil::release(_allocator, _sections[0]);
+      _sections.reset(true);
+    }
+  }
+
   _zoneAllocator.reset(releaseMemory);
 
   if (releaseMemory && _buffer != nullptr) {
-    ASMJIT_FREE(_buffer);
+    MemUtil::release(_allocator, _buffer);
     _buffer = nullptr;
     _end = nullptr;
   }
@@ -141,9 +215,25 @@ void Assembler::reset(bool releaseMemory) noexcept {
   _comment = nullptr;
   _unusedLinks = nullptr;
 
-  _sections.reset(releaseMemory);
-  _labels.reset(releaseMemory);
-  _relocations.reset(releaseMemory);
+  _labels.reset();
+  _relocations.reset();
+  _relaxItems.reset();
+}
+
+// ============================================================================
+// [asmjit::Assembler - Allocator]
+// ============================================================================
+
+Error Assembler::setAllocator(Allocator* allocator) noexcept {
+  if (_exCountAttached != 0)
+    return kErrorInvalidState;
+
+  reset(true);
+
+  _allocator = allocator;
+  _zoneAllocator.setAllocator(allocator);
+  _sections.setAllocator(allocator);
+  return kErrorOk;
 }
 
 // ============================================================================
@@ -243,9 +333,9 @@ Error Assembler::_reserve(size_t n) noexcept {
 
   uint8_t* newBuffer;
   if (_buffer == nullptr)
-    newBuffer = static_cast<uint8_t*>(ASMJIT_ALLOC(n));
+    newBuffer = static_cast<uint8_t*>(MemUtil::alloc(_allocator, n));
   else
-    newBuffer = static_cast<uint8_t*>(ASMJIT_REALLOC(_buffer, n));
+    newBuffer = static_cast<uint8_t*>(MemUtil::realloc(_allocator, _buffer, n));
 
   if (newBuffer == nullptr)
     return setLastError(kErrorNoHeapMemory);
@@ -268,6 +358,7 @@ Error Assembler::_newLabelId() noexcept {
 
   data->offset = -1;
   data->links = nullptr;
+  data->sectionId = 0;
   data->exId = 0;
   data->exData = nullptr;
 
@@ -298,6 +389,7 @@ LabelLink* Assembler::_newLabelLink() noexcept {
   link->offset = 0;
   link->displacement = 0;
   link->relocId = -1;
+  link->sectionId = _sectionId;
 
   return link;
 }
@@ -314,7 +406,9 @@ Error Assembler::bind(const Label& label) noexcept {
 #if !defined(ASMJIT_DISABLE_LOGGER)
   if (_logger) {
     StringBuilderTmp<256> sb;
-    sb.setFormat("L%u:", index);
+    sb.appendChar('L');
+    sb.appendUInt(index);
+    sb.appendChar(':');
 
     size_t binSize = 0;
     if (!_logger->hasOption(Logger::kOptionBinaryForm))
@@ -329,55 +423,48 @@ Error Assembler::bind(const Label& label) noexcept {
   size_t pos = getOffset();
 
   LabelLink* link = data->links;
-  LabelLink* prev = nullptr;
+  LabelLink* pending = nullptr;
 
   while (link) {
-    intptr_t offset = link->offset;
+    LabelLink* next = link->prev;
 
-    if (link->relocId != -1) {
-      // Handle RelocData - We have to update RelocData information instead of
-      // patching the displacement in LabelData.
-      _relocations[link->relocId].data += static_cast<Ptr>(pos);
+    if (link->sectionId != _sectionId) {
+      // Linked from another section, patched by `mergeSections()`.
+      link->prev = pending;
+      pending = link;
     }
     else {
-      // Not using relocId, this means that we are overwriting a real
-      // displacement in the binary stream.
-      int32_t patchedValue = static_cast<int32_t>(
-        static_cast<intptr_t>(pos) - offset + link->displacement);
-
-      // Size of the value we are going to patch. Only BYTE/DWORD is allowed.
-      uint32_t size = readU8At(offset);
-      ASMJIT_ASSERT(size == 1 || size == 4);
-
-      if (size == 4) {
-        writeI32At(offset, patchedValue);
+      if (link->relocId != -1) {
+        // Handle RelocData - We have to update RelocData information instead of
+        // patching the displacement in LabelData.
+        _relocations[link->relocId].data += static_cast<Ptr>(pos);
       }
       else {
-        ASMJIT_ASSERT(size == 1);
-        if (Utils::isInt8(patchedValue))
-          writeU8At(offset, static_cast<uint32_t>(patchedValue) & 0xFF);
-        else
-          error = kErrorIllegalDisplacement;
+        // Not using relocId, this means that we are overwriting a real
+        // displacement in the binary stream.
+        int32_t patchedValue = static_cast<int32_t>(
+          static_cast<intptr_t>(pos) - link->offset + link->displacement);
+
+        Error patchError = Assembler_patchDisplacement(this, link->offset, patchedValue);
+        if (patchError != kErrorOk)
+          error = patchError;
       }
-    }
-
-    prev = link->prev;
-    link = prev;
-  }
 
-  // Chain unused links.
-  link = data->links;
-  if (link) {
-    if (prev == nullptr)
-      prev = link;
+      // Chain unused links.
+      link->prev = _unusedLinks;
+      _unusedLinks = link;
+    }
 
-    prev->prev = _unusedLinks;
-    _unusedLinks = link;
+    link = next;
   }
 
-  // Set as bound (offset is zero or greater and no links).
+  // Set as bound (offset is zero or greater and only links from other sections).
   data->offset = pos;
-  data->links = nullptr;
+  data->links = pending;
+  data->sectionId = _sectionId;
+
+  if (hasAsmOption(kOptionRelaxJumps) && error == kErrorOk)
+    error = _addRelaxItem(kRelaxLabel, 0, 0, index, static_cast<intptr_t>(pos), 0);
 
   if (error != kErrorOk)
     return setLastError(error);
@@ -419,13 +506,291 @@ size_t Assembler::relocCode(void* dst, Ptr baseAddress) const noexcept {
   return _relocCode(dst, baseAddress);
 }
 
+// ============================================================================
+// [asmjit::Assembler - Section]
+// ============================================================================
+
+uint32_t Assembler::findSection(const char* name) const noexcept {
+  size_t count = _sections.getLength();
+  if (count == 0)
+    return ::strcmp(name, ".text") == 0 ? static_cast<uint32_t>(0) : static_cast<uint32_t>(kInvalidValue);
+
+  for (size_t i = 0; i < count; i++)
+    if (::strcmp(_sections[i]->name, name) == 0)
+      return static_cast<uint32_t>(i);
+
+  return kInvalidValue;
+}
+
+static Assembler::Section* Assembler_newSection(Assembler* self, const char* name, uint32_t flags, uint32_t alignment) noexcept {
+  Assembler::Section* section = static_cast<Assembler::Section*>(
+    MemUtil::alloc(self->_allocator, sizeof(Assembler::Section)));
+
+  if (section == nullptr)
+    return nullptr;
+
+  section->id = static_cast<uint32_t>(self->_sections.getLength());
+  section->flags = flags;
+  ::strcpy(section->name, name);
+  section->alignment = alignment;
+
+  section->content.data = nullptr;
+  section->content.capacity = 0;
+  section->content.length = 0;
+  section->content.offset = 0;
+
+  if (self->_sections.append(section) != kErrorOk) {
+    MemUtil::release(self->_allocator, section);
+    return nullptr;
+  }
+
+  return section;
+}
+
+uint32_t Assembler::newSection(const char* name, uint32_t flags, uint32_t alignment) noexcept {
+  if (name == nullptr || ::strlen(name) >= sizeof(static_cast<Section*>(nullptr)->name) ||
+      (alignment != 0 && (!Utils::isPowerOf2(alignment) || alignment > 64))) {
+    setLastError(kErrorInvalidArgument);
+    return kInvalidValue;
+  }
+
+  // The implicit `.text` section becomes real when the first section is added.
+  if (_sections.isEmpty() && Assembler_newSection(this, ".text", kSectionFlagExec, 0) == nullptr) {
+    setLastError(kErrorNoHeapMemory);
+    return kInvalidValue;
+  }
+
+  Section* section = Assembler_newSection(this, name, flags, alignment);
+  if (section == nullptr) {
+    setLastError(kErrorNoHeapMemory);
+    return kInvalidValue;
+  }
+
+  return section->id;
+}
+
+Error Assembler::switchSection(uint32_t id) noexcept {
+  if (id >= getSectionsCount())
+    return setLastError(kErrorInvalidArgument);
+
+  if (id == _sectionId)
+    return kErrorOk;
+
+#if !defined(ASMJIT_DISABLE_LOGGER)
+  if (_logger)
+    _logger->logFormat(Logger::kStyleDirective,
+      "%s.section %s\n", _logger->getIndentation(), _sections[id]->name);
+#endif // !ASMJIT_DISABLE_LOGGER
+
+  Assembler_swapSection(this, id);
+  return kErrorOk;
+}
+
+Error Assembler::mergeSections() noexcept {
+  size_t sectionsCount = _sections.getLength();
+  if (sectionsCount == 0)
+    return kErrorOk;
+
+  if (_sectionId != 0)
+    Assembler_swapSection(this, 0);
+
+  size_t i;
+  intptr_t* bases = _zoneAllocator.allocT<intptr_t>(sectionsCount * sizeof(intptr_t));
+
+  if (bases == nullptr)
+    return setLastError(kErrorNoHeapMemory);
+
+  // [Layout]
+  //
+  // Empty sections don't add any padding, labels bound in them are placed at
+  // the end of the previous section.
+  size_t codeSize = getOffset();
+  bases[0] = 0;
+
+  for (i = 1; i < sectionsCount; i++) {
+    const Section* section = _sections[i];
+
+    if (section->content.offset != 0) {
+      codeSize = Utils::alignTo<size_t>(codeSize, section->alignment != 0 ? section->alignment : 1);
+      bases[i] = static_cast<intptr_t>(codeSize);
+      codeSize += section->content.offset;
+    }
+    else {
+      bases[i] = static_cast<intptr_t>(codeSize);
+    }
+  }
+
+  // [Merge]
+  if (getCapacity() < codeSize)
+    ASMJIT_PROPAGATE_ERROR(_reserve(codeSize));
+
+  // Relax items are reordered to keep them sorted by offset and the padding
+  // before each section is recorded as an align.
+  size_t itemsCount = _relaxItems.getLength();
+  RelaxItem* items = nullptr;
+  bool relax = hasAsmOption(kOptionRelaxJumps);
+
+  if (itemsCount != 0) {
+    items = _zoneAllocator.allocT<RelaxItem>(itemsCount * sizeof(RelaxItem));
+    if (items == nullptr)
+      return setLastError(kErrorNoHeapMemory);
+
+    ::memcpy(items, _relaxItems.getData(), itemsCount * sizeof(RelaxItem));
+    _relaxItems.reset();
+  }
+
+  size_t end = getOffset();
+  for (i = 0; i < sectionsCount; i++) {
+    Section* section = _sections[i];
+    size_t size = section->content.offset;
+
+    if (i != 0 && size != 0) {
+      size_t base = static_cast<size_t>(bases[i]);
+
+      if (relax && section->alignment > 1)
+        ASMJIT_PROPAGATE_ERROR(_addRelaxItem(kRelaxAlign, static_cast<uint32_t>(base - end), kAlignZero, section->alignment, static_cast<intptr_t>(end), 0));
+
+      ::memset(_buffer + end, 0, base - end);
+      ::memcpy(_buffer + base, section->content.data, size);
+
+      section->content.length = 0;
+      section->content.offset = 0;
+      end = base + size;
+    }
+
+    for (size_t j = 0; j < itemsCount; j++) {
+      RelaxItem& item = items[j];
+      if (item.sectionId != i)
+        continue;
+
+      item.offset += bases[i];
+      item.sectionId = 0;
+
+      if (_relaxItems.append(item) != kErrorOk)
+        return setLastError(kErrorNoHeapMemory);
+    }
+  }
+
+  ASMJIT_ASSERT(end == codeSize);
+  _cursor = _buffer + codeSize;
+
+  // [Relocations]
+  size_t relocCount = _relocations.getLength();
+  for (i = 0; i < relocCount; i++) {
+    RelocData& rd = _relocations[i];
+    intptr_t base = bases[rd.sectionId];
+
+    rd.from += static_cast<Ptr>(base);
+    if (rd.type == kRelocRelToAbs)
+      rd.data += static_cast<Ptr>(base);
+    rd.sectionId = 0;
+  }
+
+  // [Labels]
+  size_t labelsCount = _labels.getLength();
+  for (i = 0; i < labelsCount; i++) {
+    LabelData* label = _labels[i];
+    if (label->offset != -1)
+      label->offset += bases[label->sectionId];
+    label->sectionId = 0;
+  }
+
+  // Links kept by `bind()` reference labels bound in other sections.
+  Error error = kErrorOk;
+
+  for (i = 0; i < labelsCount; i++) {
+    LabelData* label = _labels[i];
+    LabelLink* link = label->links;
+    LabelLink* pending = nullptr;
+
+    while (link) {
+      LabelLink* next = link->prev;
+      intptr_t base = bases[link->sectionId];
+
+      link->offset += base;
+      link->sectionId = 0;
+
+      if (label->offset == -1) {
+        // The relocation data got the base of its section above, `bind()`
+        // adds the offset of the label in the merged code.
+        if (link->relocId != -1)
+          _relocations[link->relocId].data -= static_cast<Ptr>(base);
+
+        link->prev = pending;
+        pending = link;
+      }
+      else {
+        if (link->relocId != -1) {
+          _relocations[link->relocId].data += static_cast<Ptr>(label->offset - base);
+        }
+        else {
+          int32_t patchedValue = static_cast<int32_t>(label->offset - link->offset + link->displacement);
+          Error patchError = Assembler_patchDisplacement(this, link->offset, patchedValue);
+
+          if (patchError != kErrorOk)
+            error = patchError;
+        }
+
+        link->prev = _unusedLinks;
+        _unusedLinks = link;
+      }
+
+      link = next;
+    }
+
+    label->links = pending;
+  }
+
+  if (error != kErrorOk)
+    return setLastError(error);
+
+  return kErrorOk;
+}
+
+Error Assembler::layout() noexcept {
+  ASMJIT_PROPAGATE_ERROR(mergeSections());
+
+  if (hasAsmOption(kOptionRelaxJumps))
+    ASMJIT_PROPAGATE_ERROR(relax());
+
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::Assembler - Relax]
+// ============================================================================
+
+Error Assembler::relax() noexcept {
+  // Only architecture specific assemblers know how to shorten jumps.
+  _relaxItems.reset();
+  return kErrorOk;
+}
+
+Error Assembler::_addRelaxItem(uint32_t type, uint32_t size, uint32_t info, uint32_t id, intptr_t offset, intptr_t displacement) noexcept {
+  RelaxItem item;
+
+  item.type = static_cast<uint8_t>(type);
+  item.size = static_cast<uint8_t>(size);
+  item.info = static_cast<uint8_t>(info);
+  item.isLong = 0;
+  item.id = id;
+  item.sectionId = _sectionId;
+  item.offset = offset;
+  item.displacement = displacement;
+
+  if (_relaxItems.append(item) != kErrorOk)
+    return setLastError(kErrorNoHeapMemory);
+
+  return kErrorOk;
+}
+
 // ============================================================================
 // [asmjit::Assembler - Make]
 // ============================================================================
 
 void* Assembler::make() noexcept {
   // Do nothing on error condition or if no instruction has been emitted.
-  if (_lastError != kErrorOk || getCodeSize() == 0)
+  if (_lastError != kErrorOk || layout() != kErrorOk || getCodeSize() == 0)
     return nullptr;
 
   void* p;
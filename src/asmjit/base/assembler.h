@@ -158,6 +158,38 @@ ASMJIT_ENUM(RelocMode) {
   kRelocTrampoline = 3
 };
 
+// ============================================================================
+// [asmjit::SectionFlags]
+// ============================================================================
+
+//! Flags of `Assembler::Section`.
+ASMJIT_ENUM(SectionFlags) {
+  //! Section contains executable code.
+  kSectionFlagExec = 0x00000001,
+  //! Section contains read-only data.
+  kSectionFlagConst = 0x00000002
+};
+
+// ============================================================================
+// [asmjit::RelaxType]
+// ============================================================================
+
+//! \internal
+//!
+//! Type of `RelaxItem`.
+ASMJIT_ENUM(RelaxType) {
+  //! Jump that can use either a short or a long form.
+  kRelaxJump = 0,
+  //! Label-relative displacement of a fixed size.
+  kRelaxDisp = 1,
+  //! Alignment padding.
+  kRelaxAlign = 2,
+  //! Label bound at the offset.
+  kRelaxLabel = 3,
+  //! Relocation of a label address.
+  kRelaxReloc = 4
+};
+
 // ============================================================================
 // [asmjit::LabelLink]
 // ============================================================================
@@ -174,6 +206,8 @@ struct LabelLink {
   intptr_t displacement;
   //! RelocId in case the link has to be absolute after relocated.
   intptr_t relocId;
+  //! Section of the linked displacement.
+  uint32_t sectionId;
 };
 
 // ============================================================================
@@ -187,7 +221,12 @@ struct LabelData {
   //! Label offset.
   intptr_t offset;
   //! Label links chain.
+  //!
+  //! Links of a bound label reference it from other sections, they are
+  //! patched when the sections are merged.
   LabelLink* links;
+  //! Section where the label is bound.
+  uint32_t sectionId;
 
   //! External tool ID, if linked to any.
   uint64_t exId;
@@ -216,6 +255,8 @@ struct RelocData {
   uint32_t type;
   //! Size of relocation (4 or 8 bytes).
   uint32_t size;
+  //! Section of `from`, relative addresses in `data` use the same section.
+  uint32_t sectionId;
 
   //! Offset from the initial code address.
   Ptr from;
@@ -223,6 +264,34 @@ struct RelocData {
   Ptr data;
 };
 
+// ============================================================================
+// [asmjit::RelaxItem]
+// ============================================================================
+
+//! \internal
+//!
+//! Position dependent code recorded when `Assembler::kOptionRelaxJumps` is
+//! turned on, used by `Assembler::relax()` to move the code.
+struct RelaxItem {
+  //! Type of the item, see \ref RelaxType.
+  uint8_t type;
+  //! Size of the jump, displacement or align padding as emitted.
+  uint8_t size;
+  //! Opcode of the short jump or the align mode.
+  uint8_t info;
+  //! Whether the jump has to use the long form.
+  uint8_t isLong;
+  //! Label id or alignment.
+  uint32_t id;
+  //! Section of the item.
+  uint32_t sectionId;
+
+  //! Offset of the jump, displacement, align padding, label or relocation.
+  intptr_t offset;
+  //! Displacement added to the label or `RelocData` index.
+  intptr_t displacement;
+};
+
 // ============================================================================
 // [asmjit::ErrorHandler]
 // ============================================================================
@@ -449,7 +518,20 @@ class ASMJIT_VIRTAPI Assembler {
     //! This feature is disabled by default, because the only processor that
     //! used to take into consideration prediction hints was P4. Newer processors
     //! implement heuristics for branch prediction that ignores any static hints.
-    kOptionPredictedJumps = 1
+    kOptionPredictedJumps = 1,
+    //! Pick the shortest jump encodings when the code is made (`Assembler` only).
+    //!
+    //! Default `false`.
+    //!
+    //! Jumps to labels that don't use `kInstOptionShortForm` or
+    //! `kInstOptionLongForm` are emitted in their long form and all position
+    //! dependent code is recorded. `relax()`, which is called by `make()`,
+    //! then shortens every jump that fits and moves the code accordingly.
+    //!
+    //! The logger shows the code as emitted, before it's relaxed. Code that
+    //! uses RIP-relative displacements not based on a label or moves the
+    //! cursor backwards can't be relaxed.
+    kOptionRelaxJumps = 2
   };
 
   // --------------------------------------------------------------------------
@@ -473,6 +555,10 @@ class ASMJIT_VIRTAPI Assembler {
   // --------------------------------------------------------------------------
 
   //! Code or data section.
+  //!
+  //! The `.text` section (id 0) always exists. Other sections are created by
+  //! `newSection()` and merged after `.text` in the order of creation, each
+  //! one aligned to its `alignment`, by `mergeSections()`.
   struct Section {
     //! Section id.
     uint32_t id;
@@ -513,6 +599,20 @@ class ASMJIT_VIRTAPI Assembler {
   //! NOTE: Runtime is persistent across `reset()` calls.
   ASMJIT_INLINE Runtime* getRuntime() const noexcept { return _runtime; }
 
+  // --------------------------------------------------------------------------
+  // [Allocator]
+  // --------------------------------------------------------------------------
+
+  //! Get the allocator used by the assembler (nullptr if default).
+  ASMJIT_INLINE Allocator* getAllocator() const noexcept { return _allocator; }
+
+  //! Set the allocator used by the assembler to allocate the code buffer,
+  //! labels, relocations and other data.
+  //!
+  //! All memory is released by `reset(true)` first, so the allocator should be
+  //! set before any code is generated. `ExternalTool`s can't be attached.
+  ASMJIT_API Error setAllocator(Allocator* allocator) noexcept;
+
   // --------------------------------------------------------------------------
   // [Architecture]
   // --------------------------------------------------------------------------
@@ -797,6 +897,69 @@ class ASMJIT_VIRTAPI Assembler {
   //! and the current depends on `alignMode`, see \ref AlignMode.
   virtual Error align(uint32_t alignMode, uint32_t offset) noexcept = 0;
 
+  // --------------------------------------------------------------------------
+  // [Section]
+  // --------------------------------------------------------------------------
+
+  //! Get the number of sections, including `.text`.
+  ASMJIT_INLINE size_t getSectionsCount() const noexcept {
+    size_t count = _sections.getLength();
+    return count != 0 ? count : 1;
+  }
+
+  //! Get the current section id.
+  ASMJIT_INLINE uint32_t getSectionId() const noexcept {
+    return _sectionId;
+  }
+
+  //! Get section of `id` or nullptr if only `.text` exists.
+  //!
+  //! The content of the current section is only valid after switching to
+  //! another section, use `getBuffer()` and `getOffset()` instead.
+  ASMJIT_INLINE const Section* getSection(uint32_t id) const noexcept {
+    ASMJIT_ASSERT(id < getSectionsCount());
+    return _sections.isEmpty() ? nullptr : _sections[id];
+  }
+
+  //! Get whether all code is in `.text`, which is required by `relocCode()`.
+  ASMJIT_INLINE bool isMerged() const noexcept {
+    if (_sectionId != 0)
+      return false;
+
+    for (size_t i = 1; i < _sections.getLength(); i++)
+      if (_sections[i]->content.offset != 0)
+        return false;
+
+    return true;
+  }
+
+  //! Get id of a section called `name` or `kInvalidValue` if there is none.
+  ASMJIT_API uint32_t findSection(const char* name) const noexcept;
+
+  //! Create a new section and return its id, `kInvalidValue` on error.
+  //!
+  //! Sections are kept by `reset(false)`, only their content is discarded.
+  ASMJIT_API uint32_t newSection(const char* name, uint32_t flags, uint32_t alignment) noexcept;
+
+  //! Switch the code-buffer to the section `id`.
+  //!
+  //! Labels bound in other sections can be used, they are always linked as
+  //! if they were not bound yet and patched by `mergeSections()`.
+  ASMJIT_API Error switchSection(uint32_t id) noexcept;
+
+  //! Merge the content of all sections into `.text`.
+  //!
+  //! Called by `make()`, has to be called explicitly before `getCodeSize()`
+  //! and `relocCode()` if the code is relocated manually. Other sections are
+  //! kept, but empty, `.text` becomes the current section.
+  ASMJIT_API Error mergeSections() noexcept;
+
+  //! Merge the sections and relax jumps if `kOptionRelaxJumps` is turned on.
+  //!
+  //! Called by `make()` and `Runtime` implementations, it's a no-op if the
+  //! code has already been laid out.
+  ASMJIT_API Error layout() noexcept;
+
   // --------------------------------------------------------------------------
   // [Label]
   // --------------------------------------------------------------------------
@@ -840,6 +1003,14 @@ class ASMJIT_VIRTAPI Assembler {
     return _labels[id]->offset;
   }
 
+  //! \internal
+  //!
+  //! Get whether `label` is bound in the current section, labels bound in
+  //! other sections have to be linked.
+  ASMJIT_INLINE bool _isBoundInSection(const LabelData* label) const noexcept {
+    return label->offset != -1 && label->sectionId == _sectionId;
+  }
+
   //! Get `LabelData` by `label`.
   ASMJIT_INLINE LabelData* getLabelData(const Label& label) const noexcept {
     return getLabelData(label.getId());
@@ -896,6 +1067,21 @@ class ASMJIT_VIRTAPI Assembler {
   //! Reloc code.
   virtual size_t _relocCode(void* dst, Ptr baseAddress) const noexcept = 0;
 
+  // --------------------------------------------------------------------------
+  // [Relax]
+  // --------------------------------------------------------------------------
+
+  //! Shorten jumps emitted with `kOptionRelaxJumps` turned on.
+  //!
+  //! Called by `layout()` after the sections are merged. Labels, relocations
+  //! and aligns are updated to match the new layout.
+  ASMJIT_API virtual Error relax() noexcept;
+
+  //! \internal
+  //!
+  //! Record a position dependent `RelaxItem`.
+  ASMJIT_API Error _addRelaxItem(uint32_t type, uint32_t size, uint32_t info, uint32_t id, intptr_t offset, intptr_t displacement) noexcept;
+
   // --------------------------------------------------------------------------
   // [Make]
   // --------------------------------------------------------------------------
@@ -968,6 +1154,8 @@ class ASMJIT_VIRTAPI Assembler {
   //! Count of external tools currently attached.
   size_t _exCountAttached;
 
+  //! Heap allocator (nullptr if default).
+  Allocator* _allocator;
   //! General purpose zone allocator.
   Zone _zoneAllocator;
 
@@ -980,18 +1168,22 @@ class ASMJIT_VIRTAPI Assembler {
 
   //! Size of all possible trampolines.
   uint32_t _trampolinesSize;
+  //! Current section id.
+  uint32_t _sectionId;
 
   //! Inline comment that will be logged by the next instruction and set to nullptr.
   const char* _comment;
   //! Unused `LabelLink` structures pool.
   LabelLink* _unusedLinks;
 
-  //! Assembler sections.
+  //! Assembler sections, empty if only `.text` exists.
   PodVectorTmp<Section*, 4> _sections;
   //! Assembler labels.
-  PodVectorTmp<LabelData*, 16> _labels;
+  ZoneVector<LabelData*> _labels;
   //! Table of relocations.
-  PodVector<RelocData> _relocations;
+  ZoneVector<RelocData> _relocations;
+  //! Position dependent code recorded by `kOptionRelaxJumps`.
+  ZoneVector<RelaxItem> _relaxItems;
 };
 
 //! \}
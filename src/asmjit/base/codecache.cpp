@@ -0,0 +1,618 @@
+// [AsmJit]
+// Complete x86/x64 JIT and Remote Assembler for C++.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Export]
+#define ASMJIT_EXPORTS
+
+// [Dependencies]
+#include "../base/assembler.h"
+#include "../base/codecache.h"
+#include "../base/runtime.h"
+
+#if ASMJIT_OS_POSIX
+# include <sys/types.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif // ASMJIT_OS_POSIX
+
+#include <stdio.h>
+
+// The test needs an assembler that can generate code for the host.
+#if defined(ASMJIT_TEST) && (ASMJIT_ARCH_X86 || ASMJIT_ARCH_X64) && \
+   (defined(ASMJIT_BUILD_X86) || defined(ASMJIT_BUILD_X64))
+# include "../x86/x86assembler.h"
+#endif // ASMJIT_TEST
+
+// [Api-Begin]
+#include "../apibegin.h"
+
+namespace asmjit {
+
+// ============================================================================
+// [asmjit::CodeCache - Helpers]
+// ============================================================================
+
+//! \internal
+//!
+//! Get the size of data of an entry.
+static ASMJIT_INLINE size_t codeCacheGetDataSize(size_t codeSize, size_t relocCount, size_t labelCount) noexcept {
+  return relocCount * sizeof(CodeCacheReloc) +
+         labelCount * sizeof(int64_t) +
+         Utils::alignTo<size_t>(codeSize, 8);
+}
+
+//! \internal
+//!
+//! Get the size of the header and all entries.
+static ASMJIT_INLINE size_t codeCacheGetIndexSize(size_t entryCount) noexcept {
+  return sizeof(CodeCacheHeader) + entryCount * sizeof(CodeCacheEntry);
+}
+
+//! \internal
+//!
+//! Get whether a relocation targets an absolute address (rebased by the
+//! image base).
+static ASMJIT_INLINE bool codeCacheIsAbsTarget(uint32_t type) noexcept {
+  return type == kRelocAbsToRel || type == kRelocTrampoline;
+}
+
+//! \internal
+//!
+//! Get the index of the first entry which key is not less than `key`.
+static ASMJIT_INLINE size_t codeCacheLowerBound(const CodeCacheEntry* entries, size_t count, uint64_t key) noexcept {
+  size_t lo = 0;
+  size_t hi = count;
+
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (entries[mid].key < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+// ============================================================================
+// [asmjit::CodeCacheWriter - Construction / Destruction]
+// ============================================================================
+
+CodeCacheWriter::CodeCacheWriter(const CpuInfo& cpuInfo) noexcept
+  : _arch(kArchNone),
+    _imageBase(nullptr) {
+  ::memcpy(_features, cpuInfo._features, sizeof(_features));
+}
+
+CodeCacheWriter::~CodeCacheWriter() noexcept {}
+
+// ============================================================================
+// [asmjit::CodeCacheWriter - Reset]
+// ============================================================================
+
+void CodeCacheWriter::reset() noexcept {
+  _arch = kArchNone;
+  _entries.reset(true);
+  _data.clear();
+}
+
+// ============================================================================
+// [asmjit::CodeCacheWriter - Accessors]
+// ============================================================================
+
+Error CodeCacheWriter::setImageBase(const void* imageBase) noexcept {
+  if (!_entries.isEmpty())
+    return kErrorInvalidState;
+
+  _imageBase = imageBase;
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::CodeCacheWriter - Add]
+// ============================================================================
+
+Error CodeCacheWriter::add(uint64_t key, const Assembler* assembler) noexcept {
+  uint32_t arch = assembler->getArch();
+  if (_arch != kArchNone && _arch != arch)
+    return kErrorInvalidArch;
+
+  // Sections have to be merged by `Assembler::layout()` first.
+  if (!assembler->isMerged())
+    return kErrorInvalidState;
+
+  size_t codeSize = assembler->getOffset();
+  if (codeSize == 0)
+    return kErrorNoCodeGenerated;
+
+  size_t relocCount = assembler->_relocations.getLength();
+  size_t labelCount = assembler->getLabelsCount();
+
+  const RelocData* relocs = assembler->_relocations.getData();
+  size_t i;
+
+  // A label that is used, but not bound, would be never patched.
+  for (i = 0; i < labelCount; i++) {
+    const LabelData* label = assembler->getLabelData(static_cast<uint32_t>(i));
+    if (label->offset == -1 && label->links != nullptr)
+      return kErrorInvalidState;
+  }
+
+  // Relative displacements of X64 code generated for a known base address
+  // can't be relocated anywhere else.
+  for (i = 0; i < relocCount; i++) {
+    if (arch == kArchX64 && relocs[i].type == kRelocAbsToRel)
+      return kErrorInvalidState;
+  }
+
+  size_t index = codeCacheLowerBound(_entries.getData(), _entries.getLength(), key);
+  if (index < _entries.getLength() && _entries[index].key == key)
+    return kErrorInvalidArgument;
+
+  size_t offset = _data.getLength();
+  if (!_data.reserve(offset + codeCacheGetDataSize(codeSize, relocCount, labelCount)))
+    return kErrorNoHeapMemory;
+
+  CodeCacheEntry entry;
+  entry.key = key;
+  entry.offset = offset;
+  entry.codeSize = static_cast<uint32_t>(codeSize);
+  entry.trampolinesSize = static_cast<uint32_t>(assembler->getTrampolinesSize());
+  entry.relocCount = static_cast<uint32_t>(relocCount);
+  entry.labelCount = static_cast<uint32_t>(labelCount);
+  ASMJIT_PROPAGATE_ERROR(_entries.insert(index, entry));
+
+  // The data is reserved, appending can't fail from now.
+  Ptr imageBase = static_cast<Ptr>(reinterpret_cast<uintptr_t>(_imageBase));
+
+  for (i = 0; i < relocCount; i++) {
+    const RelocData& rd = relocs[i];
+    CodeCacheReloc reloc;
+
+    reloc.type = rd.type;
+    reloc.size = rd.size;
+    reloc.from = static_cast<uint64_t>(rd.from);
+    reloc.data = static_cast<uint64_t>(codeCacheIsAbsTarget(rd.type) ? rd.data - imageBase : rd.data);
+
+    _data.appendString(reinterpret_cast<const char*>(&reloc), sizeof(CodeCacheReloc));
+  }
+
+  for (i = 0; i < labelCount; i++) {
+    int64_t labelOffset = static_cast<int64_t>(assembler->getLabelOffset(static_cast<uint32_t>(i)));
+    _data.appendString(reinterpret_cast<const char*>(&labelOffset), sizeof(int64_t));
+  }
+
+  _data.appendString(reinterpret_cast<const char*>(assembler->getBuffer()), codeSize);
+  _data.appendChars('\0', Utils::alignTo<size_t>(codeSize, 8) - codeSize);
+
+  _arch = arch;
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::CodeCacheWriter - Serialize]
+// ============================================================================
+
+size_t CodeCacheWriter::getSize() const noexcept {
+  return codeCacheGetIndexSize(_entries.getLength()) + _data.getLength();
+}
+
+Error CodeCacheWriter::serialize(void* dst, size_t size) const noexcept {
+  size_t entryCount = _entries.getLength();
+  size_t indexSize = codeCacheGetIndexSize(entryCount);
+
+  if (size < indexSize + _data.getLength())
+    return kErrorInvalidArgument;
+
+  uint8_t* p = static_cast<uint8_t*>(dst);
+  CodeCacheHeader* header = reinterpret_cast<CodeCacheHeader*>(p);
+
+  header->magic = kCodeCacheMagic;
+  header->version = kCodeCacheVersion;
+  header->arch = _arch;
+  header->flags = _imageBase != nullptr ? kCodeCacheFlagImageRelative : 0;
+  ::memcpy(header->features, _features, sizeof(_features));
+  header->entryCount = entryCount;
+  header->size = indexSize + _data.getLength();
+
+  // Offsets of entries are relative to the data, make them absolute.
+  CodeCacheEntry* entries = reinterpret_cast<CodeCacheEntry*>(p + sizeof(CodeCacheHeader));
+  for (size_t i = 0; i < entryCount; i++) {
+    entries[i] = _entries[i];
+    entries[i].offset += indexSize;
+  }
+
+  ::memcpy(p + indexSize, _data.getData(), _data.getLength());
+  return kErrorOk;
+}
+
+Error CodeCacheWriter::writeToFile(const char* fileName) const noexcept {
+  size_t size = getSize();
+  void* data = ASMJIT_ALLOC(size);
+
+  if (data == nullptr)
+    return kErrorNoHeapMemory;
+
+  Error error = serialize(data, size);
+  if (error == kErrorOk) {
+    FILE* file = ::fopen(fileName, "wb");
+    if (file == nullptr) {
+      error = kErrorInvalidArgument;
+    }
+    else {
+      if (::fwrite(data, 1, size, file) != size)
+        error = kErrorInvalidState;
+      if (::fclose(file) != 0)
+        error = kErrorInvalidState;
+    }
+  }
+
+  ASMJIT_FREE(data);
+  return error;
+}
+
+// ============================================================================
+// [asmjit::CodeCacheReader - Construction / Destruction]
+// ============================================================================
+
+CodeCacheReader::CodeCacheReader() noexcept
+  : _header(nullptr),
+    _imageBase(nullptr),
+    _mapped(nullptr),
+    _mappedSize(0) {}
+
+CodeCacheReader::~CodeCacheReader() noexcept {
+  close();
+}
+
+// ============================================================================
+// [asmjit::CodeCacheReader - Open / Close]
+// ============================================================================
+
+Error CodeCacheReader::open(const void* data, size_t size, const CpuInfo& cpuInfo) noexcept {
+  close();
+
+  // Entries are accessed in place, they have to be aligned.
+  if (!Utils::isAligned<uintptr_t>(reinterpret_cast<uintptr_t>(data), 8))
+    return kErrorInvalidArgument;
+
+  const CodeCacheHeader* header = static_cast<const CodeCacheHeader*>(data);
+  if (size < sizeof(CodeCacheHeader) ||
+      header->magic != kCodeCacheMagic ||
+      header->version != kCodeCacheVersion ||
+      header->size > size ||
+      header->entryCount > (size - sizeof(CodeCacheHeader)) / sizeof(CodeCacheEntry))
+    return kErrorInvalidState;
+
+  if (header->arch != cpuInfo.getArch())
+    return kErrorInvalidArch;
+
+  // The code can use only features the CPU has.
+  for (size_t i = 0; i < ASMJIT_ARRAY_SIZE(header->features); i++) {
+    if ((header->features[i] & ~cpuInfo._features[i]) != 0)
+      return kErrorInvalidArch;
+  }
+
+  _header = header;
+  return kErrorOk;
+}
+
+#if ASMJIT_OS_WINDOWS
+Error CodeCacheReader::openFile(const char* fileName, const CpuInfo& cpuInfo) noexcept {
+  close();
+
+  HANDLE hFile = ::CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (hFile == INVALID_HANDLE_VALUE)
+    return kErrorInvalidArgument;
+
+  LARGE_INTEGER fileSize;
+  if (!::GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0 ||
+      static_cast<uint64_t>(fileSize.QuadPart) > static_cast<uint64_t>(~static_cast<size_t>(0))) {
+    ::CloseHandle(hFile);
+    return kErrorInvalidState;
+  }
+
+  HANDLE hMapping = ::CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  ::CloseHandle(hFile);
+
+  if (hMapping == nullptr)
+    return kErrorInvalidState;
+
+  // The view keeps the mapping object alive.
+  void* mapped = ::MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+  ::CloseHandle(hMapping);
+
+  if (mapped == nullptr)
+    return kErrorInvalidState;
+
+  size_t size = static_cast<size_t>(fileSize.QuadPart);
+  Error error = open(mapped, size, cpuInfo);
+
+  if (error != kErrorOk) {
+    ::UnmapViewOfFile(mapped);
+    return error;
+  }
+
+  _mapped = mapped;
+  _mappedSize = size;
+  return kErrorOk;
+}
+
+void CodeCacheReader::close() noexcept {
+  if (_mapped != nullptr)
+    ::UnmapViewOfFile(_mapped);
+
+  _header = nullptr;
+  _mapped = nullptr;
+  _mappedSize = 0;
+}
+#endif // ASMJIT_OS_WINDOWS
+
+#if ASMJIT_OS_POSIX
+Error CodeCacheReader::openFile(const char* fileName, const CpuInfo& cpuInfo) noexcept {
+  close();
+
+  int fd = ::open(fileName, O_RDONLY);
+  if (fd == -1)
+    return kErrorInvalidArgument;
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    return kErrorInvalidState;
+  }
+
+  // Pages are mapped lazily, only the index is touched by `open()`.
+  size_t size = static_cast<size_t>(st.st_size);
+  void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (mapped == MAP_FAILED)
+    return kErrorInvalidState;
+
+  Error error = open(mapped, size, cpuInfo);
+  if (error != kErrorOk) {
+    ::munmap(mapped, size);
+    return error;
+  }
+
+  _mapped = mapped;
+  _mappedSize = size;
+  return kErrorOk;
+}
+
+void CodeCacheReader::close() noexcept {
+  if (_mapped != nullptr)
+    ::munmap(_mapped, _mappedSize);
+
+  _header = nullptr;
+  _mapped = nullptr;
+  _mappedSize = 0;
+}
+#endif // ASMJIT_OS_POSIX
+
+// ============================================================================
+// [asmjit::CodeCacheReader - Accessors]
+// ============================================================================
+
+const CodeCacheEntry* CodeCacheReader::getEntry(uint64_t key) const noexcept {
+  const CodeCacheHeader* header = _header;
+  if (header == nullptr)
+    return nullptr;
+
+  const CodeCacheEntry* entries = reinterpret_cast<const CodeCacheEntry*>(header + 1);
+  size_t count = static_cast<size_t>(header->entryCount);
+  size_t index = codeCacheLowerBound(entries, count, key);
+
+  if (index == count || entries[index].key != key)
+    return nullptr;
+
+  return &entries[index];
+}
+
+// ============================================================================
+// [asmjit::CodeCacheReader - Load]
+// ============================================================================
+
+Error CodeCacheReader::load(uint64_t key, Assembler* assembler) const noexcept {
+  const CodeCacheEntry* entry = getEntry(key);
+  if (entry == nullptr)
+    return kErrorInvalidArgument;
+
+  const CodeCacheHeader* header = _header;
+  if (assembler->getArch() != header->arch)
+    return kErrorInvalidArch;
+
+  // Don't trust the entry, the code cache could be truncated or corrupted.
+  size_t dataSize = codeCacheGetDataSize(entry->codeSize, entry->relocCount, entry->labelCount);
+  if (entry->offset > header->size || header->size - entry->offset < dataSize)
+    return kErrorInvalidState;
+
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(header) + static_cast<size_t>(entry->offset);
+  const CodeCacheReloc* relocs = reinterpret_cast<const CodeCacheReloc*>(data);
+  const int64_t* labelOffsets = reinterpret_cast<const int64_t*>(relocs + entry->relocCount);
+  const uint8_t* code = reinterpret_cast<const uint8_t*>(labelOffsets + entry->labelCount);
+
+  // Relocations are applied without further checks by `relocCode()`, so only
+  // those the assembler emits itself are accepted. A trampoline replaces the
+  // opcode and the byte before it, and needs 8 bytes after the code on X64.
+  uint32_t i;
+  uint64_t trampolineCount = 0;
+
+  for (i = 0; i < entry->relocCount; i++) {
+    const CodeCacheReloc& reloc = relocs[i];
+
+    if (reloc.type > kRelocTrampoline || (reloc.size != 4 && reloc.size != 8))
+      return kErrorInvalidState;
+
+    if (reloc.from > entry->codeSize || reloc.size > entry->codeSize - reloc.from)
+      return kErrorInvalidState;
+
+    if (reloc.type == kRelocTrampoline) {
+      if (header->arch != kArchX64 || reloc.size != 4 || reloc.from < 2)
+        return kErrorInvalidState;
+      trampolineCount++;
+    }
+  }
+
+  if (entry->trampolinesSize < trampolineCount * 8)
+    return kErrorInvalidState;
+
+  assembler->reset(false);
+  ASMJIT_PROPAGATE_ERROR(assembler->embed(code, entry->codeSize));
+
+  for (i = 0; i < entry->labelCount; i++) {
+    uint32_t id = assembler->_newLabelId();
+    if (id == kInvalidValue)
+      return kErrorNoHeapMemory;
+
+    assembler->getLabelData(id)->offset = static_cast<intptr_t>(labelOffsets[i]);
+  }
+
+  Ptr imageBase = 0;
+  if (header->flags & kCodeCacheFlagImageRelative)
+    imageBase = static_cast<Ptr>(reinterpret_cast<uintptr_t>(_imageBase));
+
+  ASMJIT_PROPAGATE_ERROR(assembler->_relocations._reserve(entry->relocCount));
+  for (i = 0; i < entry->relocCount; i++) {
+    const CodeCacheReloc& reloc = relocs[i];
+    RelocData rd;
+
+    rd.type = reloc.type;
+    rd.size = reloc.size;
+    rd.sectionId = 0;
+    rd.from = static_cast<Ptr>(reloc.from);
+    rd.data = static_cast<Ptr>(reloc.data);
+
+    if (codeCacheIsAbsTarget(rd.type))
+      rd.data += imageBase;
+
+    assembler->_relocations.append(rd);
+  }
+
+  assembler->_trampolinesSize = entry->trampolinesSize;
+  return kErrorOk;
+}
+
+Error CodeCacheReader::add(uint64_t key, Assembler* assembler, Runtime* runtime, void** dst) const noexcept {
+  *dst = nullptr;
+
+  ASMJIT_PROPAGATE_ERROR(load(key, assembler));
+  return runtime->add(dst, assembler);
+}
+
+} // asmjit namespace
+
+// ============================================================================
+// [asmjit::CodeCache - Test]
+// ============================================================================
+
+#if defined(ASMJIT_TEST) && (ASMJIT_ARCH_X86 || ASMJIT_ARCH_X64) && \
+   (defined(ASMJIT_BUILD_X86) || defined(ASMJIT_BUILD_X64))
+namespace asmjit {
+
+static int CodeCacheTest_get41() { return 41; }
+
+UNIT(base_codecache) {
+  JitRuntime runtime;
+  X86Assembler a(&runtime);
+
+  // Calls a host function (a trampoline relocation) and jumps over a label.
+  Label L_Exit = a.newLabel();
+
+  if (a.getArch() == kArchX64)
+    a.sub(x86::rsp, 40);
+  a.call(imm_ptr(&CodeCacheTest_get41));
+  a.jmp(L_Exit);
+  a.int3();
+  a.bind(L_Exit);
+  a.add(x86::eax, 1);
+  if (a.getArch() == kArchX64)
+    a.add(x86::rsp, 40);
+  a.ret();
+
+  CodeCacheWriter writer;
+  EXPECT(writer.setImageBase(reinterpret_cast<const void*>(&CodeCacheTest_get41)) == kErrorOk,
+    "Failed to set the image base.");
+  EXPECT(writer.add(1, &a) == kErrorOk,
+    "Failed to add code to the code cache.");
+  EXPECT(writer.add(1, &a) == kErrorInvalidArgument,
+    "Adding the same key twice should fail.");
+
+  size_t size = writer.getSize();
+  void* data = ASMJIT_ALLOC(size);
+  EXPECT(data != nullptr,
+    "Couldn't allocate %u bytes on heap.", static_cast<unsigned int>(size));
+  EXPECT(writer.serialize(data, size) == kErrorOk,
+    "Failed to serialize the code cache.");
+  INFO("Serialized %u bytes.", static_cast<unsigned int>(size));
+
+  CodeCacheReader reader;
+  reader.setImageBase(reinterpret_cast<const void*>(&CodeCacheTest_get41));
+
+  EXPECT(reader.open(data, size) == kErrorOk,
+    "Failed to open the code cache.");
+  EXPECT(reader.getEntryCount() == 1 && reader.hasEntry(1) && !reader.hasEntry(2),
+    "The code cache should contain only the key 1.");
+
+  typedef int (*Func)(void);
+  Func func;
+
+  X86Assembler b(&runtime);
+  EXPECT(reader.add(1, &b, &runtime, reinterpret_cast<void**>(&func)) == kErrorOk,
+    "Failed to add code loaded from the code cache.");
+  EXPECT(b.getLabelOffset(L_Exit) == a.getLabelOffset(L_Exit),
+    "Labels should keep their offsets.");
+
+  int result = func();
+  EXPECT(result == 42,
+    "Code loaded from the code cache returned %d.", result);
+
+  runtime.release(reinterpret_cast<void*>(func));
+  reader.close();
+
+  INFO("Loading corrupted relocations...");
+  CodeCacheEntry* entry = reinterpret_cast<CodeCacheEntry*>(static_cast<uint8_t*>(data) + sizeof(CodeCacheHeader));
+  CodeCacheReloc* relocs = reinterpret_cast<CodeCacheReloc*>(static_cast<uint8_t*>(data) + static_cast<size_t>(entry->offset));
+
+  EXPECT(entry->relocCount != 0,
+    "The entry should have relocations.");
+
+  CodeCacheReloc savedReloc = relocs[0];
+  uint32_t savedTrampolinesSize = entry->trampolinesSize;
+
+  for (uint32_t i = 0; i < 4; i++) {
+    relocs[0] = savedReloc;
+    entry->trampolinesSize = savedTrampolinesSize;
+
+    switch (i) {
+      case 0: relocs[0].type = kRelocTrampoline + 1; break;
+      case 1: relocs[0].size = 2; break;
+      case 2: relocs[0].from = ~static_cast<uint64_t>(0) - 1; break;
+      case 3:
+        // Only X64 uses trampolines, there is no room for them on X86 either.
+        relocs[0].type = kRelocTrampoline;
+        entry->trampolinesSize = 0;
+        break;
+    }
+
+    EXPECT(reader.open(data, size) == kErrorOk,
+      "Failed to open the code cache.");
+    EXPECT(reader.load(1, &b) == kErrorInvalidState,
+      "Loading a corrupted relocation #%u should fail.", i);
+    reader.close();
+  }
+
+  ASMJIT_FREE(data);
+}
+
+} // asmjit namespace
+#endif // ASMJIT_TEST
+
+// [Api-End]
+#include "../apiend.h"
@@ -0,0 +1,306 @@
+// [AsmJit]
+// Complete x86/x64 JIT and Remote Assembler for C++.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Guard]
+#ifndef _ASMJIT_BASE_CODECACHE_H
+#define _ASMJIT_BASE_CODECACHE_H
+
+// [Dependencies]
+#include "../base/containers.h"
+#include "../base/cpuinfo.h"
+#include "../base/podvector.h"
+
+// [Api-Begin]
+#include "../apibegin.h"
+
+namespace asmjit {
+
+// ============================================================================
+// [Forward Declarations]
+// ============================================================================
+
+class Assembler;
+class Runtime;
+
+//! \addtogroup asmjit_base
+//! \{
+
+// ============================================================================
+// [asmjit::CodeCacheFormat]
+// ============================================================================
+
+//! \internal
+ASMJIT_ENUM(CodeCacheFormat) {
+  //! Magic number of a code cache ('AJCC').
+  kCodeCacheMagic = 0x43434A41,
+  //! Version of the code cache format.
+  kCodeCacheVersion = 1,
+
+  //! Targets of `kRelocTrampoline` relocations are relative to the image base.
+  kCodeCacheFlagImageRelative = 0x00000001
+};
+
+//! \internal
+//!
+//! Header of a serialized code cache.
+//!
+//! The header is followed by `entryCount` entries sorted by key and by data
+//! of all entries. All offsets are from the start of the code cache and all
+//! fields use the byte order of the host that wrote the cache.
+struct CodeCacheHeader {
+  //! Magic number, see \ref kCodeCacheMagic.
+  uint32_t magic;
+  //! Format version, see \ref kCodeCacheVersion.
+  uint32_t version;
+  //! Architecture of the code, see \ref Arch.
+  uint32_t arch;
+  //! Flags, see \ref CodeCacheFormat.
+  uint32_t flags;
+  //! CPU features the code was generated for.
+  uint32_t features[8];
+  //! Count of entries.
+  uint64_t entryCount;
+  //! Size of the whole code cache in bytes.
+  uint64_t size;
+};
+
+//! \internal
+//!
+//! Entry of a serialized code cache.
+//!
+//! Data of an entry consist of `relocCount` relocations, `labelCount` label
+//! offsets (`int64_t`, -1 if not bound) and `codeSize` bytes of code.
+struct CodeCacheEntry {
+  //! User-provided key (hash) of the entry.
+  uint64_t key;
+  //! Offset of the entry data.
+  uint64_t offset;
+  //! Size of the code (without trampolines).
+  uint32_t codeSize;
+  //! Size of all possible trampolines.
+  uint32_t trampolinesSize;
+  //! Count of relocations.
+  uint32_t relocCount;
+  //! Count of labels.
+  uint32_t labelCount;
+};
+
+//! \internal
+//!
+//! Relocation of a serialized code cache entry, see \ref RelocData.
+struct CodeCacheReloc {
+  //! Type of relocation.
+  uint32_t type;
+  //! Size of relocation (4 or 8 bytes).
+  uint32_t size;
+  //! Offset from the start of the code.
+  uint64_t from;
+  //! Relocation data.
+  uint64_t data;
+};
+
+// ============================================================================
+// [asmjit::CodeCacheWriter]
+// ============================================================================
+
+//! Serializes relocatable code of `Assembler`s, see \ref CodeCacheReader.
+//!
+//! Each entry captures the code buffer, relocations and labels of a single
+//! `Assembler` before it's relocated, so the code can be relocated to any
+//! address later without generating it again. Entries are identified by a
+//! user-provided key, which should be a hash of everything the code depends
+//! on. The whole cache is bound to CPU features it's written for (the host
+//! CPU by default).
+//!
+//! Absolute addresses embedded in the code itself (immediates, memory operands)
+//! are serialized as is. Absolute targets of `call` and `jmp` are relocations
+//! and are serialized relative to the image base if it's set by
+//! `setImageBase()`, which allows to call functions of a host binary loaded
+//! at a different address.
+class CodeCacheWriter {
+ public:
+  ASMJIT_NO_COPY(CodeCacheWriter)
+
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! Create a new `CodeCacheWriter` for code generated for `cpuInfo`.
+  ASMJIT_API CodeCacheWriter(const CpuInfo& cpuInfo = CpuInfo::getHost()) noexcept;
+  //! Destroy the `CodeCacheWriter`.
+  ASMJIT_API ~CodeCacheWriter() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Reset]
+  // --------------------------------------------------------------------------
+
+  //! Remove all entries.
+  ASMJIT_API void reset() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get the count of entries.
+  ASMJIT_INLINE size_t getEntryCount() const noexcept { return _entries.getLength(); }
+
+  //! Get the image base.
+  ASMJIT_INLINE const void* getImageBase() const noexcept { return _imageBase; }
+  //! Set the image base, see \ref CodeCacheReader::setImageBase().
+  //!
+  //! The image base can only be changed if there are no entries.
+  ASMJIT_API Error setImageBase(const void* imageBase) noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Add]
+  // --------------------------------------------------------------------------
+
+  //! Add the code of `assembler` as `key`.
+  //!
+  //! The code has to be complete, `kErrorInvalidState` is returned if it uses
+  //! a label that is not bound or if it was generated for a known base address.
+  //! All entries have to be generated for the same architecture.
+  ASMJIT_API Error add(uint64_t key, const Assembler* assembler) noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Serialize]
+  // --------------------------------------------------------------------------
+
+  //! Get the size of serialized code cache in bytes.
+  ASMJIT_API size_t getSize() const noexcept;
+
+  //! Serialize the code cache to `dst`, which has to be at least `getSize()`
+  //! bytes long.
+  ASMJIT_API Error serialize(void* dst, size_t size) const noexcept;
+
+  //! Serialize the code cache to a file `fileName`.
+  ASMJIT_API Error writeToFile(const char* fileName) const noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! CPU features the code is generated for.
+  uint32_t _features[8];
+  //! Architecture of all entries (`kArchNone` if there are no entries).
+  uint32_t _arch;
+
+  //! Image base.
+  const void* _imageBase;
+
+  //! Entries sorted by key, offsets are relative to `_data`.
+  PodVector<CodeCacheEntry> _entries;
+  //! Data of all entries.
+  StringBuilder _data;
+};
+
+// ============================================================================
+// [asmjit::CodeCacheReader]
+// ============================================================================
+
+//! Loads code serialized by \ref CodeCacheWriter.
+//!
+//! The reader doesn't copy the code cache, only the header is checked when
+//! it's opened and the index is searched by a binary search, so a code cache
+//! of thousands of entries mapped by `openFile()` is loaded lazily page by
+//! page. Loaded code is relocated by `Assembler::relocCode()` as usual, so it
+//! can be added to any `Runtime`.
+class CodeCacheReader {
+ public:
+  ASMJIT_NO_COPY(CodeCacheReader)
+
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! Create a new `CodeCacheReader`.
+  ASMJIT_API CodeCacheReader() noexcept;
+  //! Destroy the `CodeCacheReader` and unmap the file if mapped.
+  ASMJIT_API ~CodeCacheReader() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Open / Close]
+  // --------------------------------------------------------------------------
+
+  //! Open a code cache stored at `data`, which has to be `size` bytes long
+  //! and kept alive until the reader is closed.
+  //!
+  //! Returns `kErrorInvalidState` if `data` is not a valid code cache and
+  //! `kErrorInvalidArch` if the code was generated for a different architecture
+  //! or for CPU features `cpuInfo` doesn't have.
+  ASMJIT_API Error open(const void* data, size_t size, const CpuInfo& cpuInfo = CpuInfo::getHost()) noexcept;
+
+  //! Map a code cache file `fileName` and open it, see \ref open().
+  ASMJIT_API Error openFile(const char* fileName, const CpuInfo& cpuInfo = CpuInfo::getHost()) noexcept;
+
+  //! Close the code cache.
+  ASMJIT_API void close() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get whether a code cache is open.
+  ASMJIT_INLINE bool isOpen() const noexcept { return _header != nullptr; }
+
+  //! Get the count of entries.
+  ASMJIT_INLINE size_t getEntryCount() const noexcept {
+    return _header ? static_cast<size_t>(_header->entryCount) : 0;
+  }
+
+  //! Get the image base.
+  ASMJIT_INLINE const void* getImageBase() const noexcept { return _imageBase; }
+  //! Set the image base.
+  //!
+  //! If the code cache was written with an image base, targets of `call` and
+  //! `jmp` are rebased to this one. Use an address that moves together with
+  //! called functions, for example the address of a function of the binary.
+  ASMJIT_INLINE void setImageBase(const void* imageBase) noexcept { _imageBase = imageBase; }
+
+  //! Get the entry of `key` or nullptr if there is no such entry.
+  ASMJIT_API const CodeCacheEntry* getEntry(uint64_t key) const noexcept;
+
+  //! Get whether the code cache contains `key`.
+  ASMJIT_INLINE bool hasEntry(uint64_t key) const noexcept { return getEntry(key) != nullptr; }
+
+  // --------------------------------------------------------------------------
+  // [Load]
+  // --------------------------------------------------------------------------
+
+  //! Load the code of `key` into `assembler`, which is reset first.
+  //!
+  //! Labels are recreated with the same IDs and offsets, so the offset of a
+  //! label can be queried by `Assembler::getLabelOffset()`. Returns
+  //! `kErrorInvalidArgument` if there is no such entry.
+  ASMJIT_API Error load(uint64_t key, Assembler* assembler) const noexcept;
+
+  //! Load the code of `key` into `assembler` and add it to `runtime`.
+  ASMJIT_API Error add(uint64_t key, Assembler* assembler, Runtime* runtime, void** dst) const noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! Header of the code cache, nullptr if not open.
+  const CodeCacheHeader* _header;
+  //! Image base.
+  const void* _imageBase;
+
+  //! Mapped file, nullptr if not mapped by `openFile()`.
+  void* _mapped;
+  //! Size of the mapped file.
+  size_t _mappedSize;
+};
+
+//! \}
+
+} // asmjit namespace
+
+// [Api-End]
+#include "../apiend.h"
+
+// [Guard]
+#endif // _ASMJIT_BASE_CODECACHE_H
@@ -32,6 +32,19 @@ namespace asmjit {
 static const char noName[1] = { '\0' };
 enum { kCompilerDefaultLookAhead = 64 };
 
+// ============================================================================
+// [asmjit::EdgeProfile - Reset]
+// ============================================================================
+
+void EdgeProfile::reset() noexcept {
+  if (_runtime != nullptr)
+    _runtime->releaseCounters(_counters);
+
+  _runtime = nullptr;
+  _counters = nullptr;
+  _jccCount = 0;
+}
+
 // ============================================================================
 // [asmjit::Compiler - Construction / Destruction]
 // ============================================================================
@@ -39,6 +52,7 @@ enum { kCompilerDefaultLookAhead = 64 };
 Compiler::Compiler() noexcept
   : _features(0),
     _maxLookAhead(kCompilerDefaultLookAhead),
+    _profile(nullptr),
     _instOptions(0),
     _tokenGenerator(0),
     _nodeFlowId(0),
@@ -52,8 +66,10 @@ Compiler::Compiler() noexcept
     _varAllocator(4096 - Zone::kZoneOverhead),
     _stringAllocator(4096 - Zone::kZoneOverhead),
     _constAllocator(4096 - Zone::kZoneOverhead),
+    _varList(&_varAllocator),
     _localConstPool(&_constAllocator),
-    _globalConstPool(&_zoneAllocator) {}
+    _globalConstPool(&_constAllocator),
+    _deferredPools(nullptr) {}
 Compiler::~Compiler() noexcept {}
 
 // ============================================================================
@@ -72,6 +88,7 @@ void Compiler::reset(bool releaseMemory) noexcept {
 
   _features = 0;
   _maxLookAhead = kCompilerDefaultLookAhead;
+  _profile = nullptr;
 
   _instOptions = 0;
   _tokenGenerator = 0;
@@ -90,13 +107,106 @@ void Compiler::reset(bool releaseMemory) noexcept {
 
   _localConstPoolLabel.reset();
   _globalConstPoolLabel.reset();
+  _deferredPools = nullptr;
 
   _zoneAllocator.reset(releaseMemory);
   _varAllocator.reset(releaseMemory);
   _stringAllocator.reset(releaseMemory);
   _constAllocator.reset(releaseMemory);
 
-  _varList.reset(releaseMemory);
+  _varList.reset();
+}
+
+// ============================================================================
+// [asmjit::Compiler - Allocator]
+// ============================================================================
+
+Error Compiler::setAllocator(Allocator* allocator) noexcept {
+  if (getAssembler() != nullptr)
+    return kErrorInvalidState;
+
+  reset(true);
+
+  _zoneAllocator.setAllocator(allocator);
+  _varAllocator.setAllocator(allocator);
+  _stringAllocator.setAllocator(allocator);
+  _constAllocator.setAllocator(allocator);
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::Compiler - State]
+// ============================================================================
+
+void Compiler::saveState(State* state) const noexcept {
+  Assembler* assembler = getAssembler();
+
+  state->cursor = _cursor;
+  state->func = _func;
+
+  state->varData = _varList._data;
+  state->varCount = _varList.getLength();
+  state->varCapacity = _varList.getCapacity();
+  state->labelCount = assembler ? assembler->getLabelsCount() : 0;
+  state->tokenGenerator = _tokenGenerator;
+
+  state->localConstPoolLabel = _localConstPoolLabel;
+  state->globalConstPoolLabel = _globalConstPoolLabel;
+  state->deferredPools = _deferredPools;
+
+  state->zoneState = _zoneAllocator.saveState();
+  state->varState = _varAllocator.saveState();
+  state->stringState = _stringAllocator.saveState();
+}
+
+Error Compiler::restoreState(const State& state) noexcept {
+  // Remove all nodes added after the saved cursor. This has to be done before
+  // the zones are restored as removing jumps updates labels they refer to.
+  if (_cursor != state.cursor) {
+    HLNode* first = state.cursor ? state.cursor->getNext() : _firstNode;
+    HLNode* node = first;
+
+    while (node != _cursor) {
+      if (node == nullptr)
+        return kErrorInvalidState;
+      node = node->getNext();
+    }
+
+    removeNodes(first, _cursor);
+  }
+
+  // Detach labels created after the state has been saved, their nodes are
+  // going to be overwritten. The assembler keeps their ids.
+  Assembler* assembler = getAssembler();
+  if (assembler != nullptr) {
+    size_t labelCount = assembler->getLabelsCount();
+    for (size_t i = state.labelCount; i < labelCount; i++) {
+      LabelData* ld = assembler->getLabelData(static_cast<uint32_t>(i));
+      if (ld->exId == _exId) {
+        ld->exId = 0;
+        ld->exData = nullptr;
+      }
+    }
+  }
+
+  _cursor = state.cursor;
+  _func = state.func;
+
+  // The variable list could have been reallocated by `_varAllocator`.
+  _varList._data = state.varData;
+  _varList._length = state.varCount;
+  _varList._capacity = state.varCapacity;
+  _tokenGenerator = state.tokenGenerator;
+
+  _localConstPoolLabel = state.localConstPoolLabel;
+  _globalConstPoolLabel = state.globalConstPoolLabel;
+  _deferredPools = state.deferredPools;
+
+  _zoneAllocator.restoreState(state.zoneState);
+  _varAllocator.restoreState(state.varState);
+  _stringAllocator.restoreState(state.stringState);
+
+  return kErrorOk;
 }
 
 // ============================================================================
@@ -328,7 +438,7 @@ void Compiler::removeNodes(HLNode* first, HLNode* last) noexcept {
   HLNode* node = first;
   for (;;) {
     HLNode* next = node->getNext();
-    ASMJIT_ASSERT(next != nullptr);
+    ASMJIT_ASSERT(node == last || next != nullptr);
 
     node->_prev = nullptr;
     node->_next = nullptr;
@@ -432,6 +542,29 @@ Error Compiler::embedConstPool(const Label& label, const ConstPool& pool) noexce
   return kErrorOk;
 }
 
+Error Compiler::deferConstPool(const Label& label, const ConstPool& pool) noexcept {
+  if (label.getId() == kInvalidValue)
+    return kErrorInvalidState;
+
+  size_t size = pool.getSize();
+  DeferredPool* deferred = _zoneAllocator.allocT<DeferredPool>();
+  uint8_t* data = static_cast<uint8_t*>(_zoneAllocator.alloc(size));
+
+  if (deferred == nullptr || data == nullptr)
+    return setLastError(kErrorNoHeapMemory);
+
+  pool.fill(data);
+
+  deferred->next = _deferredPools;
+  deferred->labelId = label.getId();
+  deferred->alignment = static_cast<uint32_t>(pool.getAlignment());
+  deferred->data = data;
+  deferred->size = size;
+
+  _deferredPools = deferred;
+  return kErrorOk;
+}
+
 // ============================================================================
 // [asmjit::Compiler - Comment]
 // ============================================================================
@@ -512,6 +645,7 @@ VarData* Compiler::_newVd(const VarInfo& vi, const char* name) noexcept {
 
   vd->_memOffset = 0;
   vd->_memCell = nullptr;
+  vd->_weight = 0;
 
   vd->rReadCount = 0;
   vd->rWriteCount = 0;
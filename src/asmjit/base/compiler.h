@@ -18,7 +18,6 @@
 #include "../base/containers.h"
 #include "../base/hlstream.h"
 #include "../base/operand.h"
-#include "../base/podvector.h"
 #include "../base/utils.h"
 #include "../base/zone.h"
 
@@ -57,7 +56,32 @@ ASMJIT_ENUM(CompilerFeatures) {
   //! are allocated so it doesn't change count of register allocs/spills.
   //!
   //! This feature is highly experimental and untested.
-  kCompilerFeatureEnableScheduler = 0
+  kCompilerFeatureEnableScheduler = 0,
+
+  //! Instrument conditional jumps by edge counters (`Compiler` only).
+  //!
+  //! Default `false`. When enabled `finalize()` allocates counters from the
+  //! `JitRuntime` the assembler is attached to and stores them to the profile
+  //! set by `Compiler::setProfile()`, see \ref EdgeProfile.
+  kCompilerFeatureInstrumentEdges = 1,
+
+  //! Place constant pools into the `.rodata` section (`Compiler` only).
+  //!
+  //! Default `false` - a local pool is embedded after the function that uses
+  //! it and the global pool after all the code. When enabled `finalize()`
+  //! collects all pools into `.rodata` of the attached assembler. The code has
+  //! to be published by `Assembler::make()` or `Runtime::add()` then, or laid
+  //! out by `Assembler::layout()` before `getCodeSize()` and `relocCode()`.
+  kCompilerFeatureConstSection = 2,
+
+  //! Move cold blocks into the `.text.unlikely` section (`Compiler` only).
+  //!
+  //! Default `false` - blocks stay where they were emitted. When enabled a
+  //! block reached only by jumps hinted by `kInstOptionNotTaken` is moved to
+  //! `.text.unlikely` of the attached assembler, and `EdgeProfile` can flip
+  //! mostly taken jumps to create such blocks. The same rules as for
+  //! `kCompilerFeatureConstSection` apply to relocating the code.
+  kCompilerFeatureColdSection = 3
 };
 
 // ============================================================================
@@ -72,6 +96,99 @@ ASMJIT_ENUM(ConstScope) {
   kConstScopeGlobal = 1
 };
 
+// ============================================================================
+// [asmjit::EdgeProfile]
+// ============================================================================
+
+//! Execution counts of conditional jumps of code generated by `Compiler`.
+//!
+//! Profile guided compilation has two phases:
+//!
+//!   1. The code is compiled with `kCompilerFeatureInstrumentEdges` and the
+//!      profile set by `Compiler::setProfile()`. Each conditional jump gets
+//!      two counters, allocated by `JitRuntime::newCounters()`, that count
+//!      how many times the jump was executed and how many times it fell
+//!      through. The instrumented code is then called as usual.
+//!
+//!   2. The same code is generated again and compiled with the profile, but
+//!      without the feature. Jumps that are rarely or mostly taken are hinted
+//!      by `kInstOptionNotTaken` or `kInstOptionTaken`, which drives the branch
+//!      polarity and the register allocator, and the block placement if
+//!      `kCompilerFeatureColdSection` is enabled.
+//!
+//! Conditional jumps are matched by their order, so both phases have to
+//! generate the same code. Jumps that already have a hint are not changed.
+//!
+//! Counters are incremented by a plain load, `lea` and store (not a locked
+//! instruction, which would clobber flags), so increments done by threads
+//! calling the instrumented code concurrently can be lost and the counts are
+//! only approximate then.
+struct EdgeProfile {
+  ASMJIT_NO_COPY(EdgeProfile)
+
+  // --------------------------------------------------------------------------
+  // [Constants]
+  // --------------------------------------------------------------------------
+
+  ASMJIT_ENUM(Limits) {
+    //! Minimum count of executions of a jump to use its counters.
+    kMinExecCount = 32,
+    //! Jump is considered rare if it's taken or falls through at most in
+    //! `1 / (1 << kRareShift)` of its executions.
+    kRareShift = 4
+  };
+
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  ASMJIT_INLINE EdgeProfile() noexcept
+    : _runtime(nullptr),
+      _counters(nullptr),
+      _jccCount(0) {}
+  ASMJIT_INLINE ~EdgeProfile() noexcept { reset(); }
+
+  // --------------------------------------------------------------------------
+  // [Reset]
+  // --------------------------------------------------------------------------
+
+  //! Release the counters, the instrumented code must not be called anymore.
+  ASMJIT_API void reset() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get whether the profile has counters.
+  ASMJIT_INLINE bool hasCounters() const noexcept { return _counters != nullptr; }
+
+  //! Get count of instrumented conditional jumps.
+  ASMJIT_INLINE uint32_t getJccCount() const noexcept { return _jccCount; }
+
+  //! Get how many times the conditional jump at `index` was executed.
+  ASMJIT_INLINE uintptr_t getExecCount(uint32_t index) const noexcept {
+    ASMJIT_ASSERT(index < _jccCount);
+    return _counters[index * 2 + 0];
+  }
+
+  //! Get how many times the conditional jump at `index` was taken.
+  ASMJIT_INLINE uintptr_t getTakenCount(uint32_t index) const noexcept {
+    ASMJIT_ASSERT(index < _jccCount);
+    return _counters[index * 2 + 0] - _counters[index * 2 + 1];
+  }
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! Runtime that owns `_counters`.
+  JitRuntime* _runtime;
+  //! Counters, two per conditional jump - executed and fall-through.
+  uintptr_t* _counters;
+  //! Count of instrumented conditional jumps.
+  uint32_t _jccCount;
+};
+
 // ============================================================================
 // [asmjit::VarInfo]
 // ============================================================================
@@ -142,6 +259,53 @@ class ASMJIT_VIRTAPI Compiler : public ExternalTool {
  public:
   ASMJIT_NO_COPY(Compiler)
 
+  //! Constant pool copied by `deferConstPool()`, embedded by `finalize()`.
+  struct DeferredPool {
+    //! Next deferred pool (created before this one).
+    DeferredPool* next;
+    //! Label id of the start of the pool.
+    uint32_t labelId;
+    //! Alignment of the pool.
+    uint32_t alignment;
+    //! Pool data.
+    uint8_t* data;
+    //! Pool size.
+    size_t size;
+  };
+
+  //! State of `Compiler`, see \ref saveState() and \ref restoreState().
+  struct State {
+    //! Current node.
+    HLNode* cursor;
+    //! Current function.
+    HLFunc* func;
+
+    //! Buffer of the variable list.
+    void* varData;
+    //! Count of variables.
+    size_t varCount;
+    //! Capacity of the variable list.
+    size_t varCapacity;
+    //! Count of labels of the attached `Assembler`.
+    size_t labelCount;
+    //! Processing token generator.
+    uint32_t tokenGenerator;
+
+    //! Label to start of the local constant pool.
+    Label localConstPoolLabel;
+    //! Label to start of the global constant pool.
+    Label globalConstPoolLabel;
+    //! Deferred constant pools.
+    DeferredPool* deferredPools;
+
+    //! State of `_zoneAllocator`.
+    Zone::State zoneState;
+    //! State of `_varAllocator`.
+    Zone::State varState;
+    //! State of `_stringAllocator`.
+    Zone::State stringState;
+  };
+
   // --------------------------------------------------------------------------
   // [Construction / Destruction]
   // --------------------------------------------------------------------------
@@ -158,6 +322,45 @@ class ASMJIT_VIRTAPI Compiler : public ExternalTool {
   //! \override
   ASMJIT_API virtual void reset(bool releaseMemory) noexcept;
 
+  // --------------------------------------------------------------------------
+  // [Allocator]
+  // --------------------------------------------------------------------------
+
+  //! Get the allocator used by the compiler (nullptr if default).
+  ASMJIT_INLINE Allocator* getAllocator() const noexcept { return _zoneAllocator.getAllocator(); }
+
+  //! Set the allocator used by the compiler to allocate nodes, variables and
+  //! all data used by the register allocator.
+  //!
+  //! The compiler is reset and all its memory is released first, so it can't
+  //! be attached to an `Assembler` when this is called.
+  ASMJIT_API Error setAllocator(Allocator* allocator) noexcept;
+
+  // --------------------------------------------------------------------------
+  // [State]
+  // --------------------------------------------------------------------------
+
+  //! Save the current state of the `Compiler` to `state`.
+  //!
+  //! The state can be used to discard speculatively generated code. Nodes,
+  //! labels and variables created after the state has been saved are removed
+  //! by \ref restoreState() and the memory they used is reused.
+  ASMJIT_API void saveState(State* state) const noexcept;
+
+  //! Restore the `Compiler` to `state` previously saved by `saveState()`.
+  //!
+  //! All nodes added after the state has been saved must be in a sequence
+  //! that follows the saved cursor and ends at the current cursor, which is
+  //! what happens when the code is simply emitted and the cursor is not moved.
+  //! Labels and variables created after the state has been saved can't be
+  //! used anymore. Constants are kept in constant pools. The current function
+  //! must not be ended between saving and restoring the state, but any count
+  //! of complete functions can be discarded.
+  //!
+  //! Returns `kErrorInvalidState` if the current cursor doesn't follow the
+  //! saved one, the `Compiler` is not changed in such case.
+  ASMJIT_API Error restoreState(const State& state) noexcept;
+
   // --------------------------------------------------------------------------
   // [Compiler Features]
   // --------------------------------------------------------------------------
@@ -193,6 +396,15 @@ class ASMJIT_VIRTAPI Compiler : public ExternalTool {
     _maxLookAhead = val;
   }
 
+  //! Get the edge profile used by `finalize()`, see \ref EdgeProfile.
+  ASMJIT_INLINE EdgeProfile* getProfile() const noexcept {
+    return _profile;
+  }
+  //! Set the edge profile used by `finalize()`, see \ref EdgeProfile.
+  ASMJIT_INLINE void setProfile(EdgeProfile* profile) noexcept {
+    _profile = profile;
+  }
+
   // --------------------------------------------------------------------------
   // [Token ID]
   // --------------------------------------------------------------------------
@@ -389,6 +601,15 @@ class ASMJIT_VIRTAPI Compiler : public ExternalTool {
   //!   3. Constant pool data.
   ASMJIT_API Error embedConstPool(const Label& label, const ConstPool& pool) noexcept;
 
+  //! Copy a constant pool data to be embedded by `finalize()`.
+  //!
+  //! Unlike `embedConstPool()` nothing is added to the code, the copy is
+  //! discarded by `restoreState()` if the state was saved before.
+  ASMJIT_API Error deferConstPool(const Label& label, const ConstPool& pool) noexcept;
+
+  //! Get deferred constant pools, the last deferred pool is the first.
+  ASMJIT_INLINE DeferredPool* getDeferredPools() const noexcept { return _deferredPools; }
+
   // --------------------------------------------------------------------------
   // [Comment]
   // --------------------------------------------------------------------------
@@ -496,6 +717,8 @@ class ASMJIT_VIRTAPI Compiler : public ExternalTool {
   //! Maximum count of nodes to look ahead when allocating/spilling
   //! registers.
   uint32_t _maxLookAhead;
+  //! Edge profile to instrument or to use, see \ref EdgeProfile.
+  EdgeProfile* _profile;
 
   //! Options affecting the next instruction.
   uint32_t _instOptions;
@@ -529,11 +752,11 @@ class ASMJIT_VIRTAPI Compiler : public ExternalTool {
   Zone _varAllocator;
   //! String/data zone.
   Zone _stringAllocator;
-  //! Local constant pool zone.
+  //! Constant pool zone (not restored by `restoreState()`).
   Zone _constAllocator;
 
   //! VarData list.
-  PodVector<VarData*> _varList;
+  ZoneVector<VarData*> _varList;
 
   //! Local constant pool, flushed at the end of each function.
   ConstPool _localConstPool;
@@ -544,6 +767,8 @@ class ASMJIT_VIRTAPI Compiler : public ExternalTool {
   Label _localConstPoolLabel;
   //! Label to start of the global constant pool.
   Label _globalConstPoolLabel;
+  //! Deferred constant pools (allocated by `_zoneAllocator`).
+  DeferredPool* _deferredPools;
 };
 
 //! \}
@@ -560,10 +785,10 @@ ASMJIT_INLINE HLNode::HLNode(Compiler* compiler, uint32_t type) noexcept {
   _flags = static_cast<uint16_t>(compiler->_nodeFlags);
   _flowId = compiler->_nodeFlowId;
   _tokenId = 0;
-  _comment = nullptr;
   _map = nullptr;
-  _liveness = nullptr;
   _state = nullptr;
+  _liveness = nullptr;
+  _comment = nullptr;
 }
 
 } // asmjit namespace
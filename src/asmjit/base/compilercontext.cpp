@@ -26,9 +26,11 @@ namespace asmjit {
 
 Context::Context(Compiler* compiler) :
   _compiler(compiler),
-  _zoneAllocator(8192 - Zone::kZoneOverhead),
+  _zoneAllocator(8192 - Zone::kZoneOverhead, compiler->getAllocator()),
   _traceNode(nullptr),
-  _varMapToVaListOffset(0) {
+  _varMapToVaListOffset(0),
+  _contextVd(&_zoneAllocator),
+  _loops(&_zoneAllocator) {
 
   Context::reset();
 }
@@ -50,7 +52,8 @@ void Context::reset(bool releaseMemory) {
   _unreachableList.reset();
   _returningList.reset();
   _jccList.reset();
-  _contextVd.reset(releaseMemory);
+  _contextVd.reset();
+  _loops.reset();
 
   _memVarCells = nullptr;
   _memStackCells = nullptr;
@@ -332,6 +335,193 @@ Error Context::removeUnreachableCode() {
   return kErrorOk;
 }
 
+// ============================================================================
+// [asmjit::Context - Liveness]
+// ============================================================================
+
+//! \internal
+//!
+//! Iterates over indexes of bits set in a `BitArray` in ascending order.
+struct LivenessBitIterator {
+  ASMJIT_INLINE LivenessBitIterator(const BitArray* bits, uint32_t len) noexcept
+    : _data(bits->data),
+      _end(bits->data + len),
+      _base(0),
+      _current(len ? bits->data[0] : 0) {}
+
+  //! Get the next index or `kInvalidIndex` if there are no more bits.
+  ASMJIT_INLINE uint32_t next() noexcept {
+    while (_current == 0) {
+      if (++_data >= _end)
+        return static_cast<uint32_t>(kInvalidIndex);
+
+      _base += BitArray::kEntityBits;
+      _current = *_data;
+    }
+
+#if ASMJIT_ARCH_64BIT
+    uint32_t lo = static_cast<uint32_t>(_current);
+    uint32_t bit = lo ? Utils::findFirstBit(lo)
+                      : Utils::findFirstBit(static_cast<uint32_t>(_current >> 32)) + 32;
+#else
+    uint32_t bit = Utils::findFirstBit(static_cast<uint32_t>(_current));
+#endif
+
+    _current &= _current - 1;
+    return _base + bit;
+  }
+
+  const uintptr_t* _data;
+  const uintptr_t* _end;
+  uint32_t _base;
+  uintptr_t _current;
+};
+
+static uint32_t Context_countBits(const BitArray* bits, uint32_t len) noexcept {
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < len; i++) {
+    uintptr_t t = bits->data[i];
+#if ASMJIT_ARCH_64BIT
+    count += Utils::bitCount(static_cast<uint32_t>(t >> 32));
+#endif
+    count += Utils::bitCount(static_cast<uint32_t>(t));
+  }
+  return count;
+}
+
+// Sparse liveness is used as long as the index array is smaller than bits.
+static ASMJIT_INLINE bool Context_isSparseLiveness(uint32_t count, uint32_t len) noexcept {
+  return static_cast<size_t>(count) * sizeof(uint32_t) < static_cast<size_t>(len) * BitArray::kEntitySize;
+}
+
+HybridBitArray* Context::newLiveness(const BitArray* bits, uint32_t len) {
+  uint32_t count = Context_countBits(bits, len);
+
+  if (Context_isSparseLiveness(count, len)) {
+    HybridBitArray* set = _zoneAllocator.allocT<HybridBitArray>(
+      sizeof(HybridBitArray) + static_cast<size_t>(count) * sizeof(uint32_t));
+
+    if (set == nullptr)
+      return nullptr;
+
+    set->_type = HybridBitArray::kTypeSparse;
+    set->_length = count;
+    set->_capacity = count;
+    set->_indexes = reinterpret_cast<uint32_t*>(set + 1);
+
+    LivenessBitIterator it(bits, len);
+    for (uint32_t i = 0; i < count; i++)
+      set->_indexes[i] = it.next();
+    return set;
+  }
+  else {
+    HybridBitArray* set = _zoneAllocator.allocT<HybridBitArray>(
+      sizeof(HybridBitArray) + static_cast<size_t>(len) * BitArray::kEntitySize);
+
+    if (set == nullptr)
+      return nullptr;
+
+    set->_type = HybridBitArray::kTypeDense;
+    set->_length = len;
+    set->_capacity = 0;
+    set->_bits = reinterpret_cast<BitArray*>(set + 1);
+    set->_bits->copyBits(bits, len);
+    return set;
+  }
+}
+
+HybridBitArray* Context::cloneLiveness(const HybridBitArray* src, uint32_t len) {
+  size_t dataSize = src->isSparse()
+    ? static_cast<size_t>(src->_length) * sizeof(uint32_t)
+    : static_cast<size_t>(len) * BitArray::kEntitySize;
+
+  HybridBitArray* set = _zoneAllocator.allocT<HybridBitArray>(sizeof(HybridBitArray) + dataSize);
+  if (set == nullptr)
+    return nullptr;
+
+  set->_type = src->_type;
+  set->_length = src->_length;
+  set->_capacity = src->isSparse() ? src->_length : 0;
+  set->_indexes = reinterpret_cast<uint32_t*>(set + 1);
+  ::memcpy(set->_indexes, src->_indexes, dataSize);
+  return set;
+}
+
+Error Context::addLiveness(HybridBitArray* dst, const BitArray* bits, uint32_t len) {
+  if (dst->isDense()) {
+    dst->_bits->addBits(bits, len);
+    return kErrorOk;
+  }
+
+  uint32_t oldCount = dst->_length;
+  uint32_t addCount = Context_countBits(bits, len);
+  uint32_t newCount = oldCount + addCount;
+
+  // Too many bits, convert to dense.
+  if (!Context_isSparseLiveness(newCount, len)) {
+    BitArray* newBits = static_cast<BitArray*>(
+      _zoneAllocator.alloc(static_cast<size_t>(len) * BitArray::kEntitySize));
+
+    if (newBits == nullptr)
+      return kErrorNoHeapMemory;
+
+    dst->copyTo(newBits, len);
+    newBits->addBits(bits, len);
+
+    dst->_type = HybridBitArray::kTypeDense;
+    dst->_length = len;
+    dst->_capacity = 0;
+    dst->_bits = newBits;
+    return kErrorOk;
+  }
+
+  uint32_t* src = dst->_indexes;
+  uint32_t* dstIndexes = src;
+
+  if (newCount > dst->_capacity) {
+    // Grow geometrically, liveness of loops is patched more times.
+    uint32_t capacity = Utils::iMax<uint32_t>(newCount, oldCount * 2);
+    dstIndexes = static_cast<uint32_t*>(
+      _zoneAllocator.alloc(static_cast<size_t>(capacity) * sizeof(uint32_t)));
+
+    if (dstIndexes == nullptr)
+      return kErrorNoHeapMemory;
+
+    dst->_capacity = capacity;
+  }
+  else {
+    // Merge in place, the old indexes are moved to the end of the array so
+    // the merged ones never overwrite indexes not read yet.
+    ::memmove(src + addCount, src, static_cast<size_t>(oldCount) * sizeof(uint32_t));
+    src += addCount;
+  }
+
+  LivenessBitIterator it(bits, len);
+  uint32_t addIndex = it.next();
+
+  uint32_t i = 0;
+  uint32_t j = 0;
+
+  while (j < oldCount) {
+    if (addIndex < src[j]) {
+      dstIndexes[i++] = addIndex;
+      addIndex = it.next();
+    }
+    else {
+      dstIndexes[i++] = src[j++];
+    }
+  }
+
+  while (i < newCount) {
+    dstIndexes[i++] = addIndex;
+    addIndex = it.next();
+  }
+
+  dst->_length = newCount;
+  dst->_indexes = dstIndexes;
+  return kErrorOk;
+}
+
 // ============================================================================
 // [asmjit::Context - Liveness Analysis]
 // ============================================================================
@@ -361,6 +551,15 @@ Error Context::livenessAnalysis() {
   LivenessTarget* ltCur = nullptr;
   LivenessTarget* ltUnused = nullptr;
 
+  // Liveness of the last visited node if it has no map, the next visited node
+  // shares it if it has no map as well (both have liveness equal to `bCur`).
+  HybridBitArray* lastSet = nullptr;
+
+  // Liveness patched last and its patched version. Patching doesn't stop in
+  // the middle of nodes that share a liveness, so they are just updated.
+  HybridBitArray* patchOld = nullptr;
+  HybridBitArray* patchNew = nullptr;
+
   PodList<HLNode*>::Link* retPtr = _returningList.getFirst();
   ASMJIT_ASSERT(retPtr != nullptr);
 
@@ -374,43 +573,49 @@ Error Context::livenessAnalysis() {
 
   // Allocate bits for code visited first time.
 _OnVisit:
+  lastSet = nullptr;
+
   for (;;) {
     if (node->hasLiveness()) {
-      if (bCur->_addBitsDelSource(node->getLiveness(), bCur, bLen))
+      if (node->getLiveness()->delFrom(bCur, bLen))
         goto _OnPatch;
       else
         goto _OnDone;
     }
 
-    BitArray* bTmp = copyBits(bCur, bLen);
-    if (bTmp == nullptr)
-      goto _NoMemory;
-
-    node->setLiveness(bTmp);
     VarMap* map = node->getMap();
 
     if (map != nullptr) {
       uint32_t vaCount = map->getVaCount();
       VarAttr* vaList = reinterpret_cast<VarAttr*>(((uint8_t*)map) + varMapToVaListOffset);
 
+      // All variables used by the node are alive, write-only ones are dead
+      // before the node.
+      for (uint32_t i = 0; i < vaCount; i++)
+        bCur->setBit(vaList[i].getVd()->getLocalId());
+
+      HybridBitArray* bTmp = newLiveness(bCur, bLen);
+      if (bTmp == nullptr)
+        goto _NoMemory;
+      node->setLiveness(bTmp);
+
       for (uint32_t i = 0; i < vaCount; i++) {
         VarAttr* va = &vaList[i];
-        VarData* vd = va->getVd();
-
         uint32_t flags = va->getFlags();
-        uint32_t localId = vd->getLocalId();
-
-        if ((flags & kVarAttrWAll) && !(flags & kVarAttrRAll)) {
-          // Write-Only.
-          bTmp->setBit(localId);
-          bCur->delBit(localId);
-        }
-        else {
-          // Read-Only or Read/Write.
-          bTmp->setBit(localId);
-          bCur->setBit(localId);
-        }
+
+        if ((flags & kVarAttrWAll) && !(flags & kVarAttrRAll))
+          bCur->delBit(va->getVd()->getLocalId());
       }
+
+      lastSet = nullptr;
+    }
+    else {
+      if (lastSet == nullptr) {
+        lastSet = newLiveness(bCur, bLen);
+        if (lastSet == nullptr)
+          goto _NoMemory;
+      }
+      node->setLiveness(lastSet);
     }
 
     if (node->getType() == HLNode::kTypeLabel)
@@ -425,12 +630,34 @@ _OnVisit:
 
   // Patch already generated liveness bits.
 _OnPatch:
+  patchOld = nullptr;
+  patchNew = nullptr;
+
   for (;;) {
     ASMJIT_ASSERT(node->hasLiveness());
-    BitArray* bNode = node->getLiveness();
+    HybridBitArray* bNode = node->getLiveness();
 
-    if (!bNode->_addBitsDelSource(bCur, bLen))
-      goto _OnDone;
+    if (bNode == patchOld) {
+      node->setLiveness(patchNew);
+    }
+    else {
+      if (!bNode->delFrom(bCur, bLen))
+        goto _OnDone;
+
+      // Copy on write if the liveness is shared with the next node, which
+      // is not patched.
+      patchOld = bNode;
+      if (node->getNext() != nullptr && node->getNext()->getLiveness() == bNode) {
+        bNode = cloneLiveness(bNode, bLen);
+        if (bNode == nullptr)
+          goto _NoMemory;
+        node->setLiveness(bNode);
+      }
+
+      patchNew = bNode;
+      if (addLiveness(bNode, bCur, bLen) != kErrorOk)
+        goto _NoMemory;
+    }
 
     if (node->getType() == HLNode::kTypeLabel)
       goto _OnTarget;
@@ -475,7 +702,7 @@ _OnTarget:
     // Visit/Patch.
     do {
       ltCur->from = from;
-      bCur->copyBits(node->getLiveness(), bLen);
+      node->getLiveness()->copyTo(bCur, bLen);
 
       if (!from->hasLiveness()) {
         node = from;
@@ -485,7 +712,7 @@ _OnTarget:
       // Issue #25: Moved '_OnJumpNext' here since it's important to patch
       // code again if there are more live variables than before.
 _OnJumpNext:
-      if (bCur->delBits(from->getLiveness(), bLen)) {
+      if (from->getLiveness()->delFrom(bCur, bLen)) {
         node = from;
         goto _OnPatch;
       }
@@ -503,7 +730,7 @@ _OnJumpNext:
     }
   }
 
-  bCur->copyBits(node->getLiveness(), bLen);
+  node->getLiveness()->copyTo(bCur, bLen);
   node = node->getPrev();
 
   if (node->isJmp() || !node->isFetched())
@@ -512,7 +739,7 @@ _OnJumpNext:
   if (!node->hasLiveness())
     goto _OnVisit;
 
-  if (bCur->delBits(node->getLiveness(), bLen))
+  if (node->getLiveness()->delFrom(bCur, bLen))
     goto _OnPatch;
 
 _OnDone:
@@ -535,6 +762,123 @@ _NoMemory:
   return setLastError(kErrorNoHeapMemory);
 }
 
+// ============================================================================
+// [asmjit::Context - Loops]
+// ============================================================================
+
+//! \internal
+//!
+//! Loop depth at which the weight of a use stops growing.
+enum { kContextMaxLoopWeightDepth = 4 };
+
+Error Context::loopAnalysis() {
+  VarData** vdArray = _contextVd.getData();
+  size_t vdLength = _contextVd.getLength();
+  size_t i;
+
+  for (i = 0; i < vdLength; i++)
+    vdArray[i]->setWeight(0);
+
+  HLNode* node;
+  HLNode* stop = getStop();
+
+  uint32_t headToken = _compiler->_generateUniqueToken();
+  uint32_t seenToken = _compiler->_generateUniqueToken();
+
+  _loops.clear();
+
+  // Find back edges. Labels are marked when passed, so a jump to a marked
+  // label is a back edge. Heads of found loops are marked by `headToken`.
+  for (node = getFunc(); node != stop; node = node->getNext()) {
+    if (node->getType() == HLNode::kTypeLabel) {
+      node->setTokenId(seenToken);
+      continue;
+    }
+
+    if (!node->isJmpOrJcc())
+      continue;
+
+    HLLabel* head = static_cast<HLJump*>(node)->getTarget();
+    if (head == nullptr)
+      continue;
+
+    if (head->hasTokenId(headToken)) {
+      getLoop(head)->tail = node;
+    }
+    else if (head->hasTokenId(seenToken)) {
+      LoopData loop;
+      loop.head = head;
+      loop.tail = node;
+      loop.depth = 0;
+
+      if (_loops.append(loop) != kErrorOk)
+        goto _NoMemory;
+      head->setTokenId(headToken);
+    }
+  }
+
+  if (_loops.isEmpty()) {
+    // Without loops the weight is just a count of uses.
+    for (node = getFunc(); node != stop; node = node->getNext()) {
+      VarMap* map = node->getMap();
+      if (map == nullptr)
+        continue;
+
+      uint32_t vaCount = map->getVaCount();
+      VarAttr* vaList = reinterpret_cast<VarAttr*>(((uint8_t*)map) + _varMapToVaListOffset);
+
+      for (uint32_t j = 0; j < vaCount; j++)
+        vaList[j].getVd()->addWeight(1);
+    }
+    return kErrorOk;
+  }
+
+  {
+    // Tails of loops that contain the current node, their count is the depth.
+    size_t loopsLength = _loops.getLength();
+    HLNode** tails = _zoneAllocator.allocT<HLNode*>(loopsLength * sizeof(HLNode*));
+
+    if (tails == nullptr)
+      goto _NoMemory;
+
+    size_t depth = 0;
+
+    for (node = getFunc(); node != stop; node = node->getNext()) {
+      if (node->hasTokenId(headToken)) {
+        LoopData* loop = getLoop(node);
+        tails[depth++] = loop->tail;
+        loop->depth = static_cast<uint32_t>(depth);
+      }
+
+      VarMap* map = node->getMap();
+      if (map != nullptr) {
+        uint32_t vaCount = map->getVaCount();
+        VarAttr* vaList = reinterpret_cast<VarAttr*>(((uint8_t*)map) + _varMapToVaListOffset);
+
+        size_t weightDepth = Utils::iMin<size_t>(depth, kContextMaxLoopWeightDepth);
+        uint32_t weight = static_cast<uint32_t>(1) << (weightDepth * 3);
+
+        for (uint32_t j = 0; j < vaCount; j++)
+          vaList[j].getVd()->addWeight(weight);
+      }
+
+      // Leave all loops that end here.
+      i = 0;
+      while (i < depth) {
+        if (tails[i] == node)
+          tails[i] = tails[--depth];
+        else
+          i++;
+      }
+    }
+  }
+
+  return kErrorOk;
+
+_NoMemory:
+  return setLastError(kErrorNoHeapMemory);
+}
+
 // ============================================================================
 // [asmjit::Context - Annotate]
 // ============================================================================
@@ -555,7 +899,7 @@ Error Context::formatInlineComment(StringBuilder& dst, HLNode* node) {
     dst.appendChars(' ', vdCount);
     dst.appendChar(']');
 
-    BitArray* liveness = node->getLiveness();
+    HybridBitArray* liveness = node->getLiveness();
     VarMap* map = node->getMap();
 
     uint32_t i;
@@ -607,7 +951,8 @@ void Context::cleanup() {
     vd->resetRegIndex();
   }
 
-  _contextVd.reset(false);
+  _contextVd.clear();
+  _loops.clear();
   _extraBlock = nullptr;
 }
 
@@ -626,6 +971,7 @@ Error Context::compile(HLFunc* func) {
   ASMJIT_PROPAGATE_ERROR(fetch());
   ASMJIT_PROPAGATE_ERROR(removeUnreachableCode());
   ASMJIT_PROPAGATE_ERROR(livenessAnalysis());
+  ASMJIT_PROPAGATE_ERROR(loopAnalysis());
 
   Compiler* compiler = getCompiler();
 
@@ -13,7 +13,6 @@
 
 // [Dependencies]
 #include "../base/compiler.h"
-#include "../base/podvector.h"
 #include "../base/zone.h"
 
 // [Api-Begin]
@@ -215,6 +214,15 @@ struct VarData {
     _priority = static_cast<uint8_t>(priority);
   }
 
+  //! Get count of uses weighted by loop depth, see `Context::loopAnalysis()`.
+  ASMJIT_INLINE uint32_t getWeight() const { return _weight; }
+  //! Set weight.
+  ASMJIT_INLINE void setWeight(uint32_t weight) { _weight = weight; }
+  //! Add `weight`, saturates at `0xFFFFFFFF` instead of wrapping around.
+  ASMJIT_INLINE void addWeight(uint32_t weight) {
+    _weight = (weight > ~_weight) ? ~static_cast<uint32_t>(0) : _weight + weight;
+  }
+
   // --------------------------------------------------------------------------
   // [Accessors - State]
   // --------------------------------------------------------------------------
@@ -356,6 +364,9 @@ struct VarData {
   //! Home memory cell, used by `Context` (initially nullptr).
   VarCell* _memCell;
 
+  //! Count of uses weighted by loop depth, used by `Context`.
+  uint32_t _weight;
+
   //! Register read access statistics.
   uint32_t rReadCount;
   //! Register write access statistics.
@@ -567,6 +578,20 @@ struct VarMap {
   uint32_t _vaCount;
 };
 
+// ============================================================================
+// [asmjit::LoopData]
+// ============================================================================
+
+//! Loop found by `Context::loopAnalysis()`.
+struct LoopData {
+  //! Loop head, the label targeted by back edges.
+  HLLabel* head;
+  //! The last back edge of the loop.
+  HLNode* tail;
+  //! Nesting depth, 1 if the loop is not nested.
+  uint32_t depth;
+};
+
 // ============================================================================
 // [asmjit::VarState]
 // ============================================================================
@@ -692,10 +717,17 @@ struct Context {
       _zoneAllocator.allocZeroed(static_cast<size_t>(len) * BitArray::kEntitySize));
   }
 
-  ASMJIT_INLINE BitArray* copyBits(const BitArray* src, uint32_t len) {
-    return static_cast<BitArray*>(
-      _zoneAllocator.dup(src, static_cast<size_t>(len) * BitArray::kEntitySize));
-  }
+  // --------------------------------------------------------------------------
+  // [Liveness]
+  // --------------------------------------------------------------------------
+
+  //! Create a new liveness that contains `bits` of `len` entities.
+  HybridBitArray* newLiveness(const BitArray* bits, uint32_t len);
+  //! Create a copy of `src` liveness.
+  HybridBitArray* cloneLiveness(const HybridBitArray* src, uint32_t len);
+  //! Add `bits` of `len` entities to `dst` liveness, the bits can't be already
+  //! set in `dst`.
+  Error addLiveness(HybridBitArray* dst, const BitArray* bits, uint32_t len);
 
   // --------------------------------------------------------------------------
   // [Fetch]
@@ -772,6 +804,29 @@ struct Context {
   //! repeats until all variables are resolved.
   virtual Error livenessAnalysis();
 
+  // --------------------------------------------------------------------------
+  // [Loops]
+  // --------------------------------------------------------------------------
+
+  //! Find loops and weight variables by loop depth of their uses.
+  //!
+  //! A loop is formed by back edges, which are jumps to a label placed before
+  //! them. It spans all nodes from the label to its last back edge. Each use
+  //! of a variable adds `8^depth` to its weight (the depth is capped), so the
+  //! register allocator prefers to spill variables that are not used in loops.
+  virtual Error loopAnalysis();
+
+  //! Get the loop that starts at `label`, nullptr if there is no such loop.
+  ASMJIT_INLINE LoopData* getLoop(HLNode* label) {
+    LoopData* loops = _loops.getData();
+    size_t length = _loops.getLength();
+
+    for (size_t i = 0; i < length; i++)
+      if (loops[i].head == label)
+        return &loops[i];
+    return nullptr;
+  }
+
   // --------------------------------------------------------------------------
   // [Annotate]
   // --------------------------------------------------------------------------
@@ -849,7 +904,9 @@ struct Context {
   PodList<HLNode*> _jccList;
 
   //! All variables used by the current function.
-  PodVector<VarData*> _contextVd;
+  ZoneVector<VarData*> _contextVd;
+  //! Loops of the current function.
+  ZoneVector<LoopData> _loops;
 
   //! Memory used to spill variables.
   VarCell* _memVarCells;
@@ -16,110 +16,95 @@
 
 namespace asmjit {
 
-// Binary tree code is based on Julienne Walker's "Andersson Binary Trees"
-// article and implementation. However, only three operations are implemented -
-// get, insert and traverse.
-
 // ============================================================================
-// [asmjit::ConstPool::Tree - Ops]
+// [asmjit::ConstPool::Table - Ops]
 // ============================================================================
 
-//! \internal
-//!
-//! Remove left horizontal links.
-static ASMJIT_INLINE ConstPool::Node* ConstPoolTree_skewNode(ConstPool::Node* node) noexcept {
-  ConstPool::Node* link = node->_link[0];
-  uint32_t level = node->_level;
+uint32_t ConstPool::Table::hash(const void* data, size_t dataSize) noexcept {
+  static const uint64_t kMul = ASMJIT_UINT64_C(0x9E3779B97F4A7C15);
 
-  if (level != 0 && link != nullptr && link->_level == level) {
-    node->_link[0] = link->_link[1];
-    link->_link[1] = node;
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  uint64_t h;
 
-    node = link;
+  if (dataSize >= 8) {
+    // Constants of 8, 16 and 32 bytes are hashed a qword at a time.
+    h = static_cast<uint64_t>(dataSize);
+    for (size_t i = 0; i < dataSize; i += 8) {
+      h = (h ^ Utils::readU64u(p + i)) * kMul;
+      h ^= h >> 29;
+    }
   }
-
-  return node;
-}
-
-//! \internal
-//!
-//! Remove consecutive horizontal links.
-static ASMJIT_INLINE ConstPool::Node* ConstPoolTree_splitNode(ConstPool::Node* node) noexcept {
-  ConstPool::Node* link = node->_link[1];
-  uint32_t level = node->_level;
-
-  if (level != 0 && link != nullptr && link->_link[1] != nullptr && link->_link[1]->_level == level) {
-    node->_link[1] = link->_link[0];
-    link->_link[0] = node;
-
-    node = link;
-    node->_level++;
+  else if (dataSize == 4) {
+    h = Utils::readU32u(p);
   }
-
-  return node;
-}
-
-ConstPool::Node* ConstPool::Tree::get(const void* data) noexcept {
-  ConstPool::Node* node = _root;
-  size_t dataSize = _dataSize;
-
-  while (node != nullptr) {
-    int c = ::memcmp(node->getData(), data, dataSize);
-    if (c == 0)
-      return node;
-    node = node->_link[c < 0];
+  else if (dataSize == 2) {
+    h = Utils::readU16u(p);
+  }
+  else {
+    h = p[0];
   }
 
-  return nullptr;
+  h *= kMul;
+  return static_cast<uint32_t>(h >> 32);
 }
 
-void ConstPool::Tree::put(ConstPool::Node* newNode) noexcept {
+ConstPool::Node* ConstPool::Table::get(const void* data, uint32_t hVal) const noexcept {
+  Node** slots = _slots;
+  size_t mask = _capacity - 1;
   size_t dataSize = _dataSize;
 
-  _length++;
-  if (_root == nullptr) {
-    _root = newNode;
-    return;
-  }
-
-  ConstPool::Node* node = _root;
-  ConstPool::Node* stack[kHeightLimit];
-
-  unsigned int top = 0;
-  unsigned int dir;
+  if (slots == nullptr)
+    return nullptr;
 
-  // Find a spot and save the stack.
+  size_t i = hVal & mask;
   for (;;) {
-    stack[top++] = node;
-    dir = ::memcmp(node->getData(), newNode->getData(), dataSize) < 0;
+    Node* node = slots[i];
+    if (node == nullptr)
+      return nullptr;
 
-    ConstPool::Node* link = node->_link[dir];
-    if (link == nullptr)
-      break;
+    if (node->_hVal == hVal && ::memcmp(node->getData(), data, dataSize) == 0)
+      return node;
 
-    node = link;
+    i = (i + 1) & mask;
   }
+}
 
-  // Link and rebalance.
-  node->_link[dir] = newNode;
+//! \internal
+//!
+//! Insert `node` to `slots` that are known to have a free slot.
+static ASMJIT_INLINE void ConstPoolTable_insert(ConstPool::Node** slots, size_t mask, ConstPool::Node* node) noexcept {
+  size_t i = node->_hVal & mask;
+  while (slots[i] != nullptr)
+    i = (i + 1) & mask;
+  slots[i] = node;
+}
 
-  while (top > 0) {
-    // Which child?
-    node = stack[--top];
+Error ConstPool::Table::put(Zone* zone, Node* node) noexcept {
+  // Keep the load factor at most 3/4 so probe sequences stay short.
+  if ((_length + 1) * 4 > _capacity * 3) {
+    size_t newCapacity = _capacity ? _capacity * 2 : static_cast<size_t>(kInitialCapacity);
+    Node** newSlots = static_cast<Node**>(zone->allocZeroed(newCapacity * sizeof(Node*)));
 
-    if (top != 0) {
-      dir = stack[top - 1]->_link[1] == node;
-    }
+    if (newSlots == nullptr)
+      return kErrorNoHeapMemory;
 
-    node = ConstPoolTree_skewNode(node);
-    node = ConstPoolTree_splitNode(node);
+    Node** oldSlots = _slots;
+    size_t oldCapacity = _capacity;
+    size_t newMask = newCapacity - 1;
 
-    // Fix the parent.
-    if (top != 0)
-      stack[top - 1]->_link[dir] = node;
-    else
-      _root = node;
+    for (size_t i = 0; i < oldCapacity; i++) {
+      if (oldSlots[i] != nullptr)
+        ConstPoolTable_insert(newSlots, newMask, oldSlots[i]);
+    }
+
+    _slots = newSlots;
+    _capacity = newCapacity;
   }
+
+  ConstPoolTable_insert(_slots, _capacity - 1, node);
+  _length++;
+
+  return kErrorOk;
 }
 
 // ============================================================================
@@ -130,8 +115,8 @@ ConstPool::ConstPool(Zone* zone) noexcept {
   _zone = zone;
 
   size_t dataSize = 1;
-  for (size_t i = 0; i < ASMJIT_ARRAY_SIZE(_tree); i++) {
-    _tree[i].setDataSize(dataSize);
+  for (size_t i = 0; i < ASMJIT_ARRAY_SIZE(_table); i++) {
+    _table[i].setDataSize(dataSize);
     _gaps[i] = nullptr;
     dataSize <<= 1;
   }
@@ -148,8 +133,8 @@ ConstPool::~ConstPool() noexcept {}
 // ============================================================================
 
 void ConstPool::reset() noexcept {
-  for (size_t i = 0; i < ASMJIT_ARRAY_SIZE(_tree); i++) {
-    _tree[i].reset();
+  for (size_t i = 0; i < ASMJIT_ARRAY_SIZE(_table); i++) {
+    _table[i].reset();
     _gaps[i] = nullptr;
   }
 
@@ -223,24 +208,25 @@ static void ConstPool_addGap(ConstPool* self, size_t offset, size_t length) noex
 }
 
 Error ConstPool::add(const void* data, size_t size, size_t& dstOffset) noexcept {
-  size_t treeIndex;
+  size_t tableIndex;
 
   if (size == 32)
-    treeIndex = kIndex32;
+    tableIndex = kIndex32;
   else if (size == 16)
-    treeIndex = kIndex16;
+    tableIndex = kIndex16;
   else if (size == 8)
-    treeIndex = kIndex8;
+    tableIndex = kIndex8;
   else if (size == 4)
-    treeIndex = kIndex4;
+    tableIndex = kIndex4;
   else if (size == 2)
-    treeIndex = kIndex2;
+    tableIndex = kIndex2;
   else if (size == 1)
-    treeIndex = kIndex1;
+    tableIndex = kIndex1;
   else
     return kErrorInvalidArgument;
 
-  ConstPool::Node* node = _tree[treeIndex].get(data);
+  uint32_t hVal = ConstPool::Table::hash(data, size);
+  ConstPool::Node* node = _table[tableIndex].get(data, hVal);
   if (node != nullptr) {
     dstOffset = node->_offset;
     return kErrorOk;
@@ -249,10 +235,10 @@ Error ConstPool::add(const void* data, size_t size, size_t& dstOffset) noexcept
   // Before incrementing the current offset try if there is a gap that can
   // be used for the requested data.
   size_t offset = ~static_cast<size_t>(0);
-  size_t gapIndex = treeIndex;
+  size_t gapIndex = tableIndex;
 
   while (gapIndex != kIndexCount - 1) {
-    ConstPool::Gap* gap = _gaps[treeIndex];
+    ConstPool::Gap* gap = _gaps[tableIndex];
 
     // Check if there is a gap.
     if (gap != nullptr) {
@@ -260,7 +246,7 @@ Error ConstPool::add(const void* data, size_t size, size_t& dstOffset) noexcept
       size_t gapLength = gap->_length;
 
       // Destroy the gap for now.
-      _gaps[treeIndex] = gap->_next;
+      _gaps[tableIndex] = gap->_next;
       ConstPool_freeGap(this, gap);
 
       offset = gapOffset;
@@ -289,11 +275,10 @@ Error ConstPool::add(const void* data, size_t size, size_t& dstOffset) noexcept
   }
 
   // Add the initial node to the right index.
-  node = ConstPool::Tree::_newNode(_zone, data, size, offset, false);
-  if (node == nullptr)
+  node = ConstPool::Table::_newNode(_zone, data, size, offset, false, hVal);
+  if (node == nullptr || _table[tableIndex].put(_zone, node) != kErrorOk)
     return kErrorNoHeapMemory;
 
-  _tree[treeIndex].put(node);
   _alignment = Utils::iMax<size_t>(_alignment, size);
 
   dstOffset = offset;
@@ -306,18 +291,22 @@ Error ConstPool::add(const void* data, size_t size, size_t& dstOffset) noexcept
     size >>= 1;
     pCount <<= 1;
 
-    ASMJIT_ASSERT(treeIndex != 0);
-    treeIndex--;
+    ASMJIT_ASSERT(tableIndex != 0);
+    tableIndex--;
 
+    // Shared constants are only an optimization, they are silently dropped
+    // if the zone runs out of memory.
     const uint8_t* pData = static_cast<const uint8_t*>(data);
     for (size_t i = 0; i < pCount; i++, pData += size) {
-      node = _tree[treeIndex].get(pData);
+      hVal = ConstPool::Table::hash(pData, size);
+      node = _table[tableIndex].get(pData, hVal);
 
       if (node != nullptr)
         continue;
 
-      node = ConstPool::Tree::_newNode(_zone, pData, size, offset + (i * size), true);
-      _tree[treeIndex].put(node);
+      node = ConstPool::Table::_newNode(_zone, pData, size, offset + (i * size), true, hVal);
+      if (node != nullptr)
+        _table[tableIndex].put(_zone, node);
     }
   }
 
@@ -347,8 +336,8 @@ void ConstPool::fill(void* dst) const noexcept {
   ::memset(dst, 0, _size);
 
   ConstPoolFill filler(static_cast<uint8_t*>(dst), 1);
-  for (size_t i = 0; i < ASMJIT_ARRAY_SIZE(_tree); i++) {
-    _tree[i].iterate(filler);
+  for (size_t i = 0; i < ASMJIT_ARRAY_SIZE(_table); i++) {
+    _table[i].iterate(filler);
     filler._dataSize <<= 1;
   }
 }
@@ -455,6 +444,42 @@ UNIT(base_constpool) {
       "pool.getAlignment() - Expected 8-byte alignment.");
   }
 
+  INFO("Checking 16 and 32 byte constants and their placement by fill().");
+  {
+    ConstPool vecPool(&zone);
+
+    uint32_t kVecCount = 1000;
+    uint32_t data[8];
+    size_t offset;
+
+    for (i = 0; i < kVecCount; i++) {
+      for (uint32_t j = 0; j < 8; j++)
+        data[j] = i * 8 + j;
+
+      EXPECT(vecPool.add(data, (i & 1) ? 32 : 16, offset) == kErrorOk,
+        "pool.add() - Returned error.");
+    }
+
+    uint8_t* buffer = static_cast<uint8_t*>(zone.alloc(vecPool.getSize()));
+    EXPECT(buffer != nullptr,
+      "zone.alloc() - Returned nullptr.");
+    vecPool.fill(buffer);
+
+    for (i = 0; i < kVecCount; i++) {
+      size_t size = (i & 1) ? 32 : 16;
+      for (uint32_t j = 0; j < 8; j++)
+        data[j] = i * 8 + j;
+
+      EXPECT(vecPool.add(data, size, offset) == kErrorOk && ::memcmp(buffer + offset, data, size) == 0,
+        "pool.fill() - Constant %u not found at its offset.", i);
+
+      // The 8-byte halves of the constant have to be shared.
+      size_t halfOffset;
+      EXPECT(vecPool.add(data + 2, 8, halfOffset) == kErrorOk && halfOffset == offset + 8,
+        "pool.add() - Should reuse a part of constant %u.", i);
+    }
+  }
+
   INFO("Checking reset functionality.");
   {
     pool.reset();
@@ -74,45 +74,49 @@ class ConstPool {
     // [Members]
     // --------------------------------------------------------------------------
 
-    //! Left/Right nodes.
-    Node* _link[2];
-    //! Horizontal level for balance.
-    uint32_t _level : 31;
+    //! Hash value of the data.
+    uint32_t _hVal;
     //! Whether this constant is shared with another.
     uint32_t _shared : 1;
     //! Data offset from the beginning of the pool.
-    uint32_t _offset;
+    uint32_t _offset : 31;
   };
 
   // --------------------------------------------------------------------------
-  // [Tree]
+  // [Table]
   // --------------------------------------------------------------------------
 
   //! \internal
   //!
-  //! Zone-allocated const-pool tree.
-  struct Tree {
+  //! Zone-allocated const-pool hash table.
+  //!
+  //! Contains nodes of the same data size in an open-addressed table that uses
+  //! linear probing. The table is never shrunk and it's grown when it becomes
+  //! 3/4 full, the old slots are abandoned in the zone.
+  struct Table {
     enum {
-      //! Maximum tree height == log2(1 << 64).
-      kHeightLimit = 64
+      //! Count of slots allocated by the first insertion.
+      kInitialCapacity = 16
     };
 
     // --------------------------------------------------------------------------
     // [Construction / Destruction]
     // --------------------------------------------------------------------------
 
-    ASMJIT_INLINE Tree(size_t dataSize = 0) noexcept
-      : _root(nullptr),
+    ASMJIT_INLINE Table(size_t dataSize = 0) noexcept
+      : _slots(nullptr),
+        _capacity(0),
         _length(0),
         _dataSize(dataSize) {}
-    ASMJIT_INLINE ~Tree() {}
+    ASMJIT_INLINE ~Table() {}
 
     // --------------------------------------------------------------------------
     // [Reset]
     // --------------------------------------------------------------------------
 
     ASMJIT_INLINE void reset() noexcept {
-      _root = nullptr;
+      _slots = nullptr;
+      _capacity = 0;
       _length = 0;
     }
 
@@ -132,8 +136,15 @@ class ConstPool {
     // [Ops]
     // --------------------------------------------------------------------------
 
-    ASMJIT_API Node* get(const void* data) noexcept;
-    ASMJIT_API void put(Node* node) noexcept;
+    //! Get a hash value of `data` having `dataSize` bytes.
+    static ASMJIT_API uint32_t hash(const void* data, size_t dataSize) noexcept;
+
+    //! Get a node that contains `data` having hash value `hVal`.
+    ASMJIT_API Node* get(const void* data, uint32_t hVal) const noexcept;
+    //! Put `node` to the table, it must not be there already.
+    //!
+    //! Can only fail if the table has to grow and `zone` is out of memory.
+    ASMJIT_API Error put(Zone* zone, Node* node) noexcept;
 
     // --------------------------------------------------------------------------
     // [Iterate]
@@ -141,34 +152,13 @@ class ConstPool {
 
     template<typename Visitor>
     ASMJIT_INLINE void iterate(Visitor& visitor) const noexcept {
-      Node* node = const_cast<Node*>(_root);
-      if (node == nullptr)
-        return;
-
-      Node* stack[kHeightLimit];
-      size_t top = 0;
+      Node** slots = _slots;
+      size_t capacity = _capacity;
 
-      for (;;) {
-        Node* left = node->_link[0];
-        if (left != nullptr) {
-          ASMJIT_ASSERT(top != kHeightLimit);
-          stack[top++] = node;
-
-          node = left;
-          continue;
-        }
-
-L_Visit:
-        visitor.visit(node);
-        node = node->_link[1];
+      for (size_t i = 0; i < capacity; i++) {
+        Node* node = slots[i];
         if (node != nullptr)
-          continue;
-
-        if (top == 0)
-          return;
-
-        node = stack[--top];
-        goto L_Visit;
+          visitor.visit(node);
       }
     }
 
@@ -176,14 +166,12 @@ L_Visit:
     // [Helpers]
     // --------------------------------------------------------------------------
 
-    static ASMJIT_INLINE Node* _newNode(Zone* zone, const void* data, size_t size, size_t offset, bool shared) noexcept {
+    static ASMJIT_INLINE Node* _newNode(Zone* zone, const void* data, size_t size, size_t offset, bool shared, uint32_t hVal) noexcept {
       Node* node = zone->allocT<Node>(sizeof(Node) + size);
       if (node == nullptr)
         return nullptr;
 
-      node->_link[0] = nullptr;
-      node->_link[1] = nullptr;
-      node->_level = 1;
+      node->_hVal = hVal;
       node->_shared = shared;
       node->_offset = static_cast<uint32_t>(offset);
 
@@ -195,9 +183,11 @@ L_Visit:
     // [Members]
     // --------------------------------------------------------------------------
 
-    //! Root of the tree
-    Node* _root;
-    //! Length of the tree (count of nodes).
+    //! Slots, each slot is either nullptr or a node.
+    Node** _slots;
+    //! Count of slots (always zero or a power of 2).
+    size_t _capacity;
+    //! Length of the table (count of nodes).
     size_t _length;
     //! Size of the data.
     size_t _dataSize;
@@ -259,8 +249,8 @@ L_Visit:
 
   //! Zone allocator.
   Zone* _zone;
-  //! Tree per size.
-  Tree _tree[kIndexCount];
+  //! Table per size.
+  Table _table[kIndexCount];
   //! Gaps per size.
   Gap* _gaps[kIndexCount];
   //! Gaps pool
@@ -9,13 +9,288 @@
 
 // [Dependencies]
 #include "../base/containers.h"
+#include "../base/cpuinfo.h"
 #include "../base/utils.h"
 
+// SSE2 is part of X64, X86 has to check the host CPU. AVX2 is only compiled
+// by compilers that support per-function targets (or don't need them).
+#if ASMJIT_ARCH_X86 || ASMJIT_ARCH_X64
+# define ASMJIT_BITARRAY_SSE2
+# include <emmintrin.h>
+# if ASMJIT_CC_MSC_GE(18, 0, 0) || ASMJIT_CC_GCC_GE(4, 9, 0) || ASMJIT_CC_CLANG_GE(3, 8, 0)
+#  define ASMJIT_BITARRAY_AVX2
+#  include <immintrin.h>
+# endif
+#endif
+
+#if ASMJIT_CC_GCC || ASMJIT_CC_CLANG
+# define ASMJIT_TARGET_SSE2 __attribute__((__target__("sse2")))
+# define ASMJIT_TARGET_AVX2 __attribute__((__target__("avx2")))
+#else
+# define ASMJIT_TARGET_SSE2
+# define ASMJIT_TARGET_AVX2
+#endif
+
 // [Api-Begin]
 #include "../apibegin.h"
 
 namespace asmjit {
 
+// ============================================================================
+// [asmjit::BitArray - Scalar]
+// ============================================================================
+
+static bool BitArray_addBitsScalar(uintptr_t* dst, const uintptr_t* s0, const uintptr_t* s1, uint32_t len) noexcept {
+  uintptr_t r = 0;
+  for (uint32_t i = 0; i < len; i++) {
+    uintptr_t t = s0[i] | s1[i];
+    dst[i] = t;
+    r |= t;
+  }
+  return r != 0;
+}
+
+static bool BitArray_andBitsScalar(uintptr_t* dst, const uintptr_t* s0, const uintptr_t* s1, uint32_t len) noexcept {
+  uintptr_t r = 0;
+  for (uint32_t i = 0; i < len; i++) {
+    uintptr_t t = s0[i] & s1[i];
+    dst[i] = t;
+    r |= t;
+  }
+  return r != 0;
+}
+
+static bool BitArray_delBitsScalar(uintptr_t* dst, const uintptr_t* s0, const uintptr_t* s1, uint32_t len) noexcept {
+  uintptr_t r = 0;
+  for (uint32_t i = 0; i < len; i++) {
+    uintptr_t t = s0[i] & ~s1[i];
+    dst[i] = t;
+    r |= t;
+  }
+  return r != 0;
+}
+
+static bool BitArray_addBitsDelSourceScalar(uintptr_t* dst, const uintptr_t* s0, uintptr_t* s1, uint32_t len) noexcept {
+  uintptr_t r = 0;
+  for (uint32_t i = 0; i < len; i++) {
+    uintptr_t a = s0[i];
+    uintptr_t b = s1[i];
+
+    dst[i] = a | b;
+    b &= ~a;
+
+    s1[i] = b;
+    r |= b;
+  }
+  return r != 0;
+}
+
+static const BitArrayFuncs BitArray_scalarFuncs = {
+  BitArray_addBitsScalar,
+  BitArray_andBitsScalar,
+  BitArray_delBitsScalar,
+  BitArray_addBitsDelSourceScalar
+};
+
+// ============================================================================
+// [asmjit::BitArray - SSE2]
+// ============================================================================
+
+// Vector loops process `kEntitiesPerVec` entities at a time and accumulate the
+// result in a register, which is only tested once at the end. The remaining
+// entities are processed by the scalar loop. `dst` is always stored before
+// `s1`, as `dst` and `s1` can alias (in that case `s1` wins).
+
+#if defined(ASMJIT_BITARRAY_SSE2)
+#define BITARRAY_SSE2_OP(NAME, EXPR, SCALAR) \
+  static ASMJIT_TARGET_SSE2 bool BitArray_##NAME##SSE2( \
+    uintptr_t* dst, const uintptr_t* s0, const uintptr_t* s1, uint32_t len) noexcept { \
+    \
+    const uint32_t kEntitiesPerVec = 16 / BitArray::kEntitySize; \
+    __m128i r = _mm_setzero_si128(); \
+    \
+    uint32_t i = 0; \
+    for (; i + kEntitiesPerVec <= len; i += kEntitiesPerVec) { \
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s0 + i)); \
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s1 + i)); \
+      __m128i t = EXPR; \
+      \
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), t); \
+      r = _mm_or_si128(r, t); \
+    } \
+    \
+    bool nonZero = _mm_movemask_epi8(_mm_cmpeq_epi8(r, _mm_setzero_si128())) != 0xFFFF; \
+    return SCALAR(dst + i, s0 + i, s1 + i, len - i) | nonZero; \
+  }
+
+BITARRAY_SSE2_OP(addBits, _mm_or_si128(a, b), BitArray_addBitsScalar)
+BITARRAY_SSE2_OP(andBits, _mm_and_si128(a, b), BitArray_andBitsScalar)
+BITARRAY_SSE2_OP(delBits, _mm_andnot_si128(b, a), BitArray_delBitsScalar)
+#undef BITARRAY_SSE2_OP
+
+static ASMJIT_TARGET_SSE2 bool BitArray_addBitsDelSourceSSE2(
+  uintptr_t* dst, const uintptr_t* s0, uintptr_t* s1, uint32_t len) noexcept {
+
+  const uint32_t kEntitiesPerVec = 16 / BitArray::kEntitySize;
+  __m128i r = _mm_setzero_si128();
+
+  uint32_t i = 0;
+  for (; i + kEntitiesPerVec <= len; i += kEntitiesPerVec) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s0 + i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s1 + i));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(a, b));
+    b = _mm_andnot_si128(a, b);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(s1 + i), b);
+    r = _mm_or_si128(r, b);
+  }
+
+  bool nonZero = _mm_movemask_epi8(_mm_cmpeq_epi8(r, _mm_setzero_si128())) != 0xFFFF;
+  return BitArray_addBitsDelSourceScalar(dst + i, s0 + i, s1 + i, len - i) | nonZero;
+}
+
+static const BitArrayFuncs BitArray_sse2Funcs = {
+  BitArray_addBitsSSE2,
+  BitArray_andBitsSSE2,
+  BitArray_delBitsSSE2,
+  BitArray_addBitsDelSourceSSE2
+};
+#endif // ASMJIT_BITARRAY_SSE2
+
+// ============================================================================
+// [asmjit::BitArray - AVX2]
+// ============================================================================
+
+#if defined(ASMJIT_BITARRAY_AVX2)
+#define BITARRAY_AVX2_OP(NAME, EXPR, SCALAR) \
+  static ASMJIT_TARGET_AVX2 bool BitArray_##NAME##AVX2( \
+    uintptr_t* dst, const uintptr_t* s0, const uintptr_t* s1, uint32_t len) noexcept { \
+    \
+    const uint32_t kEntitiesPerVec = 32 / BitArray::kEntitySize; \
+    __m256i r = _mm256_setzero_si256(); \
+    \
+    uint32_t i = 0; \
+    for (; i + kEntitiesPerVec <= len; i += kEntitiesPerVec) { \
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s0 + i)); \
+      __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s1 + i)); \
+      __m256i t = EXPR; \
+      \
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), t); \
+      r = _mm256_or_si256(r, t); \
+    } \
+    \
+    bool nonZero = !_mm256_testz_si256(r, r); \
+    _mm256_zeroupper(); \
+    return SCALAR(dst + i, s0 + i, s1 + i, len - i) | nonZero; \
+  }
+
+BITARRAY_AVX2_OP(addBits, _mm256_or_si256(a, b), BitArray_addBitsScalar)
+BITARRAY_AVX2_OP(andBits, _mm256_and_si256(a, b), BitArray_andBitsScalar)
+BITARRAY_AVX2_OP(delBits, _mm256_andnot_si256(b, a), BitArray_delBitsScalar)
+#undef BITARRAY_AVX2_OP
+
+static ASMJIT_TARGET_AVX2 bool BitArray_addBitsDelSourceAVX2(
+  uintptr_t* dst, const uintptr_t* s0, uintptr_t* s1, uint32_t len) noexcept {
+
+  const uint32_t kEntitiesPerVec = 32 / BitArray::kEntitySize;
+  __m256i r = _mm256_setzero_si256();
+
+  uint32_t i = 0;
+  for (; i + kEntitiesPerVec <= len; i += kEntitiesPerVec) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s0 + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s1 + i));
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_or_si256(a, b));
+    b = _mm256_andnot_si256(a, b);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(s1 + i), b);
+    r = _mm256_or_si256(r, b);
+  }
+
+  bool nonZero = !_mm256_testz_si256(r, r);
+  _mm256_zeroupper();
+  return BitArray_addBitsDelSourceScalar(dst + i, s0 + i, s1 + i, len - i) | nonZero;
+}
+
+static const BitArrayFuncs BitArray_avx2Funcs = {
+  BitArray_addBitsAVX2,
+  BitArray_andBitsAVX2,
+  BitArray_delBitsAVX2,
+  BitArray_addBitsDelSourceAVX2
+};
+#endif // ASMJIT_BITARRAY_AVX2
+
+// ============================================================================
+// [asmjit::BitArray - Funcs]
+// ============================================================================
+
+const BitArrayFuncs* BitArray::getFuncs(uint32_t impl) noexcept {
+  switch (impl) {
+    case kImplScalar:
+      return &BitArray_scalarFuncs;
+
+#if defined(ASMJIT_BITARRAY_SSE2)
+    case kImplSSE2:
+      if (ASMJIT_ARCH_X64 || CpuInfo::getHost().hasFeature(CpuInfo::kX86FeatureSSE2))
+        return &BitArray_sse2Funcs;
+      break;
+#endif // ASMJIT_BITARRAY_SSE2
+
+#if defined(ASMJIT_BITARRAY_AVX2)
+    case kImplAVX2:
+      if (CpuInfo::getHost().hasFeature(CpuInfo::kX86FeatureAVX2))
+        return &BitArray_avx2Funcs;
+      break;
+#endif // ASMJIT_BITARRAY_AVX2
+  }
+
+  return nullptr;
+}
+
+static const BitArrayFuncs* BitArray_detectHostFuncs() noexcept {
+  uint32_t impl = BitArray::kImplCount;
+  while (--impl != BitArray::kImplScalar) {
+    const BitArrayFuncs* funcs = BitArray::getFuncs(impl);
+    if (funcs != nullptr)
+      return funcs;
+  }
+  return &BitArray_scalarFuncs;
+}
+
+const BitArrayFuncs* BitArray::getHostFuncs() noexcept {
+  static const BitArrayFuncs* funcs = BitArray_detectHostFuncs();
+  return funcs;
+}
+
+// ============================================================================
+// [asmjit::HybridBitArray]
+// ============================================================================
+
+void HybridBitArray::copyTo(BitArray* dst, uint32_t len) const noexcept {
+  if (isDense()) {
+    dst->copyBits(_bits, len);
+    return;
+  }
+
+  ::memset(dst->data, 0, static_cast<size_t>(len) * BitArray::kEntitySize);
+  for (uint32_t i = 0; i < _length; i++)
+    dst->setBit(_indexes[i]);
+}
+
+bool HybridBitArray::delFrom(BitArray* dst, uint32_t len) const noexcept {
+  if (isDense())
+    return dst->delBits(_bits, len);
+
+  for (uint32_t i = 0; i < _length; i++)
+    dst->delBit(_indexes[i]);
+
+  uintptr_t r = 0;
+  for (uint32_t i = 0; i < len; i++)
+    r |= dst->data[i];
+  return r != 0;
+}
+
 // ============================================================================
 // [asmjit::StringBuilder - Construction / Destruction]
 // ============================================================================
@@ -23,15 +298,36 @@ namespace asmjit {
 // Should be placed in read-only memory.
 static const char StringBuilder_empty[4] = { 0 };
 
-StringBuilder::StringBuilder() noexcept
+StringBuilder::StringBuilder(Allocator* allocator) noexcept
   : _data(const_cast<char*>(StringBuilder_empty)),
     _length(0),
     _capacity(0),
-    _canFree(false) {}
+    _canFree(false),
+    _allocator(allocator) {}
 
 StringBuilder::~StringBuilder() noexcept {
   if (_canFree)
-    ASMJIT_FREE(_data);
+    MemUtil::release(_allocator, _data);
+}
+
+// ============================================================================
+// [asmjit::StringBuilder - Allocator]
+// ============================================================================
+
+void StringBuilder::setAllocator(Allocator* allocator) noexcept {
+  if (_canFree) {
+    MemUtil::release(_allocator, _data);
+
+    _data = const_cast<char*>(StringBuilder_empty);
+    _capacity = 0;
+    _canFree = false;
+  }
+  else if (_data != StringBuilder_empty) {
+    _data[0] = 0;
+  }
+
+  _length = 0;
+  _allocator = allocator;
 }
 
 // ============================================================================
@@ -62,14 +358,14 @@ char* StringBuilder::prepare(uint32_t op, size_t len) noexcept {
       if (to < 256 - sizeof(intptr_t))
         to = 256 - sizeof(intptr_t);
 
-      char* newData = static_cast<char*>(ASMJIT_ALLOC(to + sizeof(intptr_t)));
+      char* newData = static_cast<char*>(MemUtil::alloc(_allocator, to + sizeof(intptr_t)));
       if (newData == nullptr) {
         clear();
         return nullptr;
       }
 
       if (_canFree)
-        ASMJIT_FREE(_data);
+        MemUtil::release(_allocator, _data);
 
       _data = newData;
       _capacity = to + sizeof(intptr_t) - 1;
@@ -114,14 +410,14 @@ char* StringBuilder::prepare(uint32_t op, size_t len) noexcept {
       }
 
       to = Utils::alignTo<size_t>(to, sizeof(intptr_t));
-      char* newData = static_cast<char*>(ASMJIT_ALLOC(to + sizeof(intptr_t)));
+      char* newData = static_cast<char*>(MemUtil::alloc(_allocator, to + sizeof(intptr_t)));
 
       if (newData == nullptr)
         return nullptr;
 
       ::memcpy(newData, _data, _length);
       if (_canFree)
-        ASMJIT_FREE(_data);
+        MemUtil::release(_allocator, _data);
 
       _data = newData;
       _capacity = to + sizeof(intptr_t) - 1;
@@ -146,13 +442,13 @@ bool StringBuilder::reserve(size_t to) noexcept {
 
   to = Utils::alignTo<size_t>(to, sizeof(intptr_t));
 
-  char* newData = static_cast<char*>(ASMJIT_ALLOC(to + sizeof(intptr_t)));
+  char* newData = static_cast<char*>(MemUtil::alloc(_allocator, to + sizeof(intptr_t)));
   if (newData == nullptr)
     return false;
 
   ::memcpy(newData, _data, _length + 1);
   if (_canFree)
-    ASMJIT_FREE(_data);
+    MemUtil::release(_allocator, _data);
 
   _data = newData;
   _capacity = to + sizeof(intptr_t) - 1;
@@ -313,7 +609,201 @@ bool StringBuilder::_opHex(uint32_t op, const void* data, size_t len) noexcept {
   return true;
 }
 
+// Length modifiers of a format specification.
+enum StringFormatSize {
+  kStringFormatSizeInt = 0,
+  kStringFormatSizeLong = 1,
+  kStringFormatSizeLongLong = 2,
+  kStringFormatSizeSizeT = 3
+};
+
+// Get whether `fmt` only uses specifications `StringBuilder_vformat()` can
+// handle - `%%`, `%c`, `%s`, `%d`, `%i`, `%u`, `%x` and `%X` with optional '-'
+// and '0' flags, width, and 'h', 'hh', 'l', 'll' and 'z' length modifiers.
+static bool StringBuilder_canVFormat(const char* fmt) noexcept {
+  for (;;) {
+    char c = *fmt++;
+    if (c == '\0')
+      return true;
+
+    if (c != '%')
+      continue;
+
+    c = *fmt++;
+    while (c == '-' || c == '0')
+      c = *fmt++;
+
+    while (c >= '0' && c <= '9')
+      c = *fmt++;
+
+    if (c == 'h' || c == 'l') {
+      char first = c;
+      c = *fmt++;
+      if (c == first)
+        c = *fmt++;
+    }
+    else if (c == 'z') {
+      c = *fmt++;
+    }
+
+    switch (c) {
+      case '%': case 'c': case 's': case 'd': case 'i': case 'u': case 'x': case 'X':
+        break;
+      default:
+        return false;
+    }
+  }
+}
+
+// Append `fmt` formatted without `vsnprintf()`, see `StringBuilder_canVFormat()`.
+static bool StringBuilder_vformat(StringBuilder* self, const char* fmt, va_list ap) noexcept {
+  for (;;) {
+    const char* literal = fmt;
+    while (*fmt != '\0' && *fmt != '%')
+      fmt++;
+
+    if (fmt != literal && !self->appendString(literal, (size_t)(fmt - literal)))
+      return false;
+
+    if (*fmt == '\0')
+      return true;
+
+    fmt++;
+    if (*fmt == '%') {
+      fmt++;
+      if (!self->appendChar('%'))
+        return false;
+      continue;
+    }
+
+    // Flags.
+    bool leftAlign = false;
+    bool zeroPad = false;
+
+    for (;;) {
+      if (*fmt == '-')
+        leftAlign = true;
+      else if (*fmt == '0')
+        zeroPad = true;
+      else
+        break;
+      fmt++;
+    }
+
+    // Width.
+    size_t width = 0;
+    while (*fmt >= '0' && *fmt <= '9')
+      width = width * 10 + static_cast<size_t>(*fmt++ - '0');
+
+    // Length modifier, 'h' and 'hh' arguments are promoted to `int`.
+    uint32_t size = kStringFormatSizeInt;
+    if (*fmt == 'h') {
+      if (*++fmt == 'h')
+        fmt++;
+    }
+    else if (*fmt == 'l') {
+      size = kStringFormatSizeLong;
+      if (*++fmt == 'l') {
+        size = kStringFormatSizeLongLong;
+        fmt++;
+      }
+    }
+    else if (*fmt == 'z') {
+      size = kStringFormatSizeSizeT;
+      fmt++;
+    }
+
+    char conv = *fmt++;
+    char buf[32];
+
+    const char* str;
+    size_t len;
+
+    if (conv == 's' || conv == 'c') {
+      if (conv == 'c') {
+        buf[0] = static_cast<char>(va_arg(ap, int));
+        str = buf;
+        len = 1;
+      }
+      else {
+        str = va_arg(ap, const char*);
+        if (str == nullptr)
+          str = "(null)";
+        len = ::strlen(str);
+      }
+
+      zeroPad = false;
+    }
+    else {
+      uint64_t value;
+      bool negative = false;
+
+      if (conv == 'd' || conv == 'i') {
+        int64_t sValue;
+        switch (size) {
+          case kStringFormatSizeLong    : sValue = va_arg(ap, long); break;
+          case kStringFormatSizeLongLong: sValue = va_arg(ap, long long); break;
+          case kStringFormatSizeSizeT   : sValue = static_cast<intptr_t>(va_arg(ap, size_t)); break;
+          default                       : sValue = va_arg(ap, int); break;
+        }
+
+        negative = sValue < 0;
+        value = negative ? static_cast<uint64_t>(0) - static_cast<uint64_t>(sValue)
+                         : static_cast<uint64_t>(sValue);
+      }
+      else {
+        switch (size) {
+          case kStringFormatSizeLong    : value = va_arg(ap, unsigned long); break;
+          case kStringFormatSizeLongLong: value = va_arg(ap, unsigned long long); break;
+          case kStringFormatSizeSizeT   : value = va_arg(ap, size_t); break;
+          default                       : value = va_arg(ap, unsigned int); break;
+        }
+      }
+
+      const char* digits = conv == 'x' ? "0123456789abcdef" : StringBuilder_numbers;
+      uint32_t base = (conv == 'x' || conv == 'X') ? 16 : 10;
+
+      char* p = buf + ASMJIT_ARRAY_SIZE(buf);
+      do {
+        *--p = digits[value % base];
+        value /= base;
+      } while (value != 0);
+
+      // Zero padding goes between the sign and the digits.
+      if (negative) {
+        if (zeroPad && width > 0) {
+          if (!self->appendChar('-'))
+            return false;
+          width--;
+        }
+        else {
+          *--p = '-';
+        }
+      }
+
+      str = p;
+      len = (size_t)(buf + ASMJIT_ARRAY_SIZE(buf) - p);
+    }
+
+    size_t pad = width > len ? width - len : static_cast<size_t>(0);
+    if (pad != 0 && !leftAlign && !self->appendChars(zeroPad ? '0' : ' ', pad))
+      return false;
+
+    if (!self->appendString(str, len))
+      return false;
+
+    if (pad != 0 && leftAlign && !self->appendChars(' ', pad))
+      return false;
+  }
+}
+
 bool StringBuilder::_opVFormat(uint32_t op, const char* fmt, va_list ap) noexcept {
+  if (StringBuilder_canVFormat(fmt)) {
+    if (op == kStringOpSet)
+      clear();
+    return StringBuilder_vformat(this, fmt, ap);
+  }
+
   char buf[1024];
 
   vsnprintf(buf, ASMJIT_ARRAY_SIZE(buf), fmt, ap);
@@ -368,6 +858,111 @@ bool StringBuilder::eq(const char* str, size_t len) const noexcept {
   }
 }
 
+// ============================================================================
+// [asmjit::BitArray - Test]
+// ============================================================================
+
+#if defined(ASMJIT_TEST)
+UNIT(base_bitarray) {
+  enum { kMaxLen = 67 };
+
+  static const char* implNames[] = { "Scalar", "SSE2", "AVX2" };
+  const BitArrayFuncs* ref = BitArray::getFuncs(BitArray::kImplScalar);
+
+  uintptr_t s0[kMaxLen], s1[kMaxLen];
+  uintptr_t refDst[kMaxLen], refS1[kMaxLen];
+  uintptr_t dst[kMaxLen], tmpS1[kMaxLen];
+
+  uint32_t seed = 0x12345678U;
+  for (uint32_t impl = BitArray::kImplScalar + 1; impl < BitArray::kImplCount; impl++) {
+    const BitArrayFuncs* funcs = BitArray::getFuncs(impl);
+    if (funcs == nullptr) {
+      INFO("BitArray %s is not available.", implNames[impl]);
+      continue;
+    }
+
+    INFO("Comparing BitArray %s with scalar implementation.", implNames[impl]);
+    for (uint32_t len = 0; len < kMaxLen; len++) {
+      for (uint32_t i = 0; i < kMaxLen; i++) {
+        // Sparse data, so results are often zero when `len` is small.
+        seed = seed * 1103515245U + 12345U;
+        s0[i] = (seed & 0x3) ? static_cast<uintptr_t>(0) : static_cast<uintptr_t>(seed) << (seed & 0x7);
+        seed = seed * 1103515245U + 12345U;
+        s1[i] = (seed & 0x3) ? static_cast<uintptr_t>(0) : static_cast<uintptr_t>(seed) << (seed & 0x7);
+      }
+
+      size_t nBytes = len * sizeof(uintptr_t);
+
+      EXPECT(funcs->addBits(dst, s0, s1, len) == ref->addBits(refDst, s0, s1, len) &&
+             ::memcmp(dst, refDst, nBytes) == 0,
+        "BitArray %s addBits() doesn't match, len=%u.", implNames[impl], len);
+
+      EXPECT(funcs->andBits(dst, s0, s1, len) == ref->andBits(refDst, s0, s1, len) &&
+             ::memcmp(dst, refDst, nBytes) == 0,
+        "BitArray %s andBits() doesn't match, len=%u.", implNames[impl], len);
+
+      EXPECT(funcs->delBits(dst, s0, s1, len) == ref->delBits(refDst, s0, s1, len) &&
+             ::memcmp(dst, refDst, nBytes) == 0,
+        "BitArray %s delBits() doesn't match, len=%u.", implNames[impl], len);
+
+      ::memcpy(tmpS1, s1, nBytes);
+      ::memcpy(refS1, s1, nBytes);
+      EXPECT(funcs->addBitsDelSource(dst, s0, tmpS1, len) == ref->addBitsDelSource(refDst, s0, refS1, len) &&
+             ::memcmp(dst, refDst, nBytes) == 0 &&
+             ::memcmp(tmpS1, refS1, nBytes) == 0,
+        "BitArray %s addBitsDelSource() doesn't match, len=%u.", implNames[impl], len);
+
+      // Liveness analysis passes the same array as `dst` and `s1`.
+      ::memcpy(tmpS1, s1, nBytes);
+      ::memcpy(refS1, s1, nBytes);
+      EXPECT(funcs->addBitsDelSource(tmpS1, s0, tmpS1, len) == ref->addBitsDelSource(refS1, s0, refS1, len) &&
+             ::memcmp(tmpS1, refS1, nBytes) == 0,
+        "BitArray %s addBitsDelSource() doesn't match when aliased, len=%u.", implNames[impl], len);
+    }
+  }
+}
+#endif // ASMJIT_TEST
+
+// ============================================================================
+// [asmjit::StringBuilder - Test]
+// ============================================================================
+
+#if defined(ASMJIT_TEST)
+static bool StringBuilder_testFormat(StringBuilder& sb, const char* fmt, ...) {
+  char buf[256];
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(buf, ASMJIT_ARRAY_SIZE(buf), fmt, ap);
+  va_end(ap);
+
+  va_start(ap, fmt);
+  sb.setVFormat(fmt, ap);
+  va_end(ap);
+
+  EXPECT(::strcmp(sb.getData(), buf) == 0,
+    "StringBuilder::setFormat(\"%s\") produced \"%s\", expected \"%s\".", fmt, sb.getData(), buf);
+  return true;
+}
+
+UNIT(base_stringbuilder) {
+  StringBuilderTmp<64> sb;
+
+  INFO("Comparing StringBuilder::setFormat() with vsnprintf().");
+  sb.appendString("Content that has to be replaced");
+  StringBuilder_testFormat(sb, "L%u:", 123U);
+  StringBuilder_testFormat(sb, "%%|%c|%s|%s|", 'x', "str", static_cast<const char*>(nullptr));
+  StringBuilder_testFormat(sb, "%d %i %d %d", 0, -1, 2147483647, static_cast<int>(-2147483647 - 1));
+  StringBuilder_testFormat(sb, "%u %x %X %08X", 4294967295U, 0xDEADU, 0xBEEFU, 0xFFU);
+  StringBuilder_testFormat(sb, "[%5d][%-5d][%05d][%-05d][%05d]", 42, 42, 42, -42, -42);
+  StringBuilder_testFormat(sb, "[%8s][%-8s][%3s][%2c]", "ab", "cd", "long", 'z');
+  StringBuilder_testFormat(sb, "%ld %lu %lx", -1234567L, 1234567UL, 0xABCDEFUL);
+  StringBuilder_testFormat(sb, "%lld %llu %llX", -9223372036854775807LL - 1, 18446744073709551615ULL, 0x0123456789ABCDEFULL);
+  StringBuilder_testFormat(sb, "%zu %hd %hhu", static_cast<size_t>(77), 5, 6);
+  StringBuilder_testFormat(sb, "%.3f %p", 1.5, static_cast<void*>(nullptr));
+}
+#endif // ASMJIT_TEST
+
 } // asmjit namespace
 
 // [Api-End]
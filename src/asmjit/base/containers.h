@@ -19,13 +19,38 @@ namespace asmjit {
 //! \addtogroup asmjit_base
 //! \{
 
+// ============================================================================
+// [asmjit::BitArrayFuncs]
+// ============================================================================
+
+//! \internal
+//!
+//! Implementation of `BitArray` operations used for long arrays.
+//!
+//! Each function stores the result to `dst` and returns `true` if at least one
+//! bit of the result (or of `s1` in case of `addBitsDelSource`) is set.
+struct BitArrayFuncs {
+  typedef bool (*OpFunc)(uintptr_t* dst, const uintptr_t* s0, const uintptr_t* s1, uint32_t len);
+  typedef bool (*AddDelSourceFunc)(uintptr_t* dst, const uintptr_t* s0, uintptr_t* s1, uint32_t len);
+
+  //! `dst = s0 | s1`.
+  OpFunc addBits;
+  //! `dst = s0 & s1`.
+  OpFunc andBits;
+  //! `dst = s0 & ~s1`.
+  OpFunc delBits;
+  //! `dst = s0 | s1` and `s1 = s1 & ~s0`.
+  AddDelSourceFunc addBitsDelSource;
+};
+
 // ============================================================================
 // [asmjit::BitArray]
 // ============================================================================
 
 //! Fixed size bit-array.
 //!
-//! Used by variable liveness analysis.
+//! Used by variable liveness analysis. Short arrays are processed inline, long
+//! ones by `BitArrayFuncs` selected for the host CPU (SSE2 or AVX2 on X86/X64).
 struct BitArray {
   // --------------------------------------------------------------------------
   // [Enums]
@@ -33,9 +58,35 @@ struct BitArray {
 
   enum {
     kEntitySize = static_cast<int>(sizeof(uintptr_t)),
-    kEntityBits = kEntitySize * 8
+    kEntityBits = kEntitySize * 8,
+
+    //! Minimum length (in entities) processed by `BitArrayFuncs`.
+    kFuncsThreshold = 64 / kEntitySize
+  };
+
+  //! Implementation of `BitArrayFuncs`.
+  ASMJIT_ENUM(Impl) {
+    //! Portable implementation.
+    kImplScalar = 0,
+    //! SSE2 implementation (X86/X64).
+    kImplSSE2 = 1,
+    //! AVX2 implementation (X86/X64).
+    kImplAVX2 = 2,
+
+    //! Count of implementations.
+    kImplCount = 3
   };
 
+  // --------------------------------------------------------------------------
+  // [Funcs]
+  // --------------------------------------------------------------------------
+
+  //! Get functions of implementation `impl`, returns nullptr if `impl` isn't
+  //! compiled in or isn't supported by the host CPU.
+  static ASMJIT_API const BitArrayFuncs* getFuncs(uint32_t impl) noexcept;
+  //! Get functions of the best implementation supported by the host CPU.
+  static ASMJIT_API const BitArrayFuncs* getHostFuncs() noexcept;
+
   // --------------------------------------------------------------------------
   // [Accessors]
   // --------------------------------------------------------------------------
@@ -72,6 +123,9 @@ struct BitArray {
   }
 
   ASMJIT_INLINE bool addBits(const BitArray* s0, const BitArray* s1, uint32_t len) noexcept {
+    if (len >= kFuncsThreshold)
+      return getHostFuncs()->addBits(data, s0->data, s1->data, len);
+
     uintptr_t r = 0;
     for (uint32_t i = 0; i < len; i++) {
       uintptr_t t = s0->data[i] | s1->data[i];
@@ -86,6 +140,9 @@ struct BitArray {
   }
 
   ASMJIT_INLINE bool andBits(const BitArray* s0, const BitArray* s1, uint32_t len) noexcept {
+    if (len >= kFuncsThreshold)
+      return getHostFuncs()->andBits(data, s0->data, s1->data, len);
+
     uintptr_t r = 0;
     for (uint32_t i = 0; i < len; i++) {
       uintptr_t t = s0->data[i] & s1->data[i];
@@ -100,6 +157,9 @@ struct BitArray {
   }
 
   ASMJIT_INLINE bool delBits(const BitArray* s0, const BitArray* s1, uint32_t len) noexcept {
+    if (len >= kFuncsThreshold)
+      return getHostFuncs()->delBits(data, s0->data, s1->data, len);
+
     uintptr_t r = 0;
     for (uint32_t i = 0; i < len; i++) {
       uintptr_t t = s0->data[i] & ~s1->data[i];
@@ -114,6 +174,9 @@ struct BitArray {
   }
 
   ASMJIT_INLINE bool _addBitsDelSource(const BitArray* s0, BitArray* s1, uint32_t len) noexcept {
+    if (len >= kFuncsThreshold)
+      return getHostFuncs()->addBitsDelSource(data, s0->data, s1->data, len);
+
     uintptr_t r = 0;
     for (uint32_t i = 0; i < len; i++) {
       uintptr_t a = s0->data[i];
@@ -135,6 +198,102 @@ struct BitArray {
   uintptr_t data[1];
 };
 
+// ============================================================================
+// [asmjit::HybridBitArray]
+// ============================================================================
+
+//! Bit-array stored either as a sorted array of indexes (sparse) or as a
+//! `BitArray` (dense), whichever is smaller.
+//!
+//! Used to store variable liveness of `HLNode`s. Most nodes have only a few
+//! variables alive even if the function has thousands of them, and consecutive
+//! nodes that have the same liveness share the same instance. Instances are
+//! created and modified by the compiler's `Context`, which owns their memory.
+struct HybridBitArray {
+  // --------------------------------------------------------------------------
+  // [Enums]
+  // --------------------------------------------------------------------------
+
+  //! Storage type.
+  ASMJIT_ENUM(Type) {
+    //! Indexes are stored in a sorted `uint32_t` array.
+    kTypeSparse = 0,
+    //! Bits are stored in a `BitArray`.
+    kTypeDense = 1
+  };
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get storage type, see \ref Type.
+  ASMJIT_INLINE uint32_t getType() const noexcept { return _type; }
+  //! Get whether the indexes are stored in a sorted array.
+  ASMJIT_INLINE bool isSparse() const noexcept { return _type == kTypeSparse; }
+  //! Get whether the bits are stored in a `BitArray`.
+  ASMJIT_INLINE bool isDense() const noexcept { return _type == kTypeDense; }
+
+  //! Get count of indexes (sparse) or length of `BitArray` in entities (dense).
+  ASMJIT_INLINE uint32_t getLength() const noexcept { return _length; }
+  //! Get capacity of the index array (sparse).
+  ASMJIT_INLINE uint32_t getCapacity() const noexcept { return _capacity; }
+
+  //! Get sorted indexes (sparse).
+  ASMJIT_INLINE uint32_t* getIndexes() const noexcept { return _indexes; }
+  //! Get bits (dense).
+  ASMJIT_INLINE BitArray* getBits() const noexcept { return _bits; }
+
+  ASMJIT_INLINE uintptr_t getBit(uint32_t index) const noexcept {
+    if (isDense())
+      return _bits->getBit(index);
+
+    // Binary search.
+    const uint32_t* base = _indexes;
+    uint32_t n = _length;
+
+    while (n > 0) {
+      uint32_t half = n / 2;
+      if (base[half] < index) {
+        base += half + 1;
+        n -= half + 1;
+      }
+      else {
+        n = half;
+      }
+    }
+
+    return base != _indexes + _length && *base == index;
+  }
+
+  // --------------------------------------------------------------------------
+  // [Interface]
+  // --------------------------------------------------------------------------
+
+  //! Copy all bits to `dst` of `len` entities.
+  ASMJIT_API void copyTo(BitArray* dst, uint32_t len) const noexcept;
+  //! Clear all bits in `dst` of `len` entities, returns `true` if at least one
+  //! bit remains set in `dst`.
+  ASMJIT_API bool delFrom(BitArray* dst, uint32_t len) const noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! Storage type.
+  uint32_t _type;
+  //! Count of indexes (sparse) or length of `BitArray` in entities (dense).
+  uint32_t _length;
+  //! Capacity of the index array (sparse).
+  uint32_t _capacity;
+
+  union {
+    //! Sorted indexes (sparse).
+    uint32_t* _indexes;
+    //! Bits (dense).
+    BitArray* _bits;
+  };
+};
+
 // ============================================================================
 // [asmjit::PodList<T>]
 // ============================================================================
@@ -263,7 +422,8 @@ class StringBuilder {
   // [Construction / Destruction]
   // --------------------------------------------------------------------------
 
-  ASMJIT_API StringBuilder() noexcept;
+  //! Create a new `StringBuilder` that allocates by `allocator`.
+  explicit ASMJIT_API StringBuilder(Allocator* allocator = nullptr) noexcept;
   ASMJIT_API ~StringBuilder() noexcept;
 
   ASMJIT_INLINE StringBuilder(const _NoInit&) noexcept {}
@@ -282,6 +442,14 @@ class StringBuilder {
   //! Get null-terminated string data (const).
   ASMJIT_INLINE const char* getData() const noexcept { return _data; }
 
+  //! Get the allocator used to allocate the buffer (nullptr if default).
+  ASMJIT_INLINE Allocator* getAllocator() const noexcept { return _allocator; }
+  //! Set the allocator used to allocate the buffer.
+  //!
+  //! The current buffer is released by the previous allocator, the content is
+  //! cleared.
+  ASMJIT_API void setAllocator(Allocator* allocator) noexcept;
+
   // --------------------------------------------------------------------------
   // [Prepare / Reserve]
   // --------------------------------------------------------------------------
@@ -505,6 +673,8 @@ class StringBuilder {
   size_t _capacity;
   //! Whether the string can be freed.
   size_t _canFree;
+  //! Allocator used to allocate the buffer (nullptr if default).
+  Allocator* _allocator;
 };
 
 // ============================================================================
@@ -521,13 +691,14 @@ class StringBuilderTmp : public StringBuilder {
   // [Construction / Destruction]
   // --------------------------------------------------------------------------
 
-  ASMJIT_INLINE StringBuilderTmp() noexcept : StringBuilder(NoInit) {
+  explicit ASMJIT_INLINE StringBuilderTmp(Allocator* allocator = nullptr) noexcept : StringBuilder(NoInit) {
     _data = _embeddedData;
     _data[0] = 0;
 
     _length = 0;
     _capacity = N;
     _canFree = false;
+    _allocator = allocator;
   }
 
   // --------------------------------------------------------------------------
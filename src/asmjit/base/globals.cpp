@@ -15,6 +15,64 @@
 
 namespace asmjit {
 
+// ============================================================================
+// [asmjit::Allocator]
+// ============================================================================
+
+Allocator::Allocator() noexcept {}
+Allocator::~Allocator() noexcept {}
+
+void* Allocator::alloc(size_t size) noexcept { return ASMJIT_ALLOC(size); }
+void* Allocator::realloc(void* p, size_t size) noexcept { return ASMJIT_REALLOC(p, size); }
+void Allocator::release(void* p) noexcept { ASMJIT_FREE(p); }
+
+// ============================================================================
+// [asmjit::MemUtil]
+// ============================================================================
+
+#if defined(ASMJIT_TRACE_ALLOC)
+# if ASMJIT_CC_MSC
+#  define ASMJIT_MEM_TLS __declspec(thread)
+# else
+#  define ASMJIT_MEM_TLS __thread
+# endif
+
+//! \internal
+//!
+//! Count of allocations made by the current thread.
+static ASMJIT_MEM_TLS uint64_t memAllocCount;
+//! \internal
+//!
+//! Count of releases made by the current thread.
+static ASMJIT_MEM_TLS uint64_t memReleaseCount;
+
+void* MemUtil::alloc(size_t size) noexcept {
+  memAllocCount++;
+  return ::malloc(size);
+}
+
+void* MemUtil::realloc(void* p, size_t size) noexcept {
+  memAllocCount++;
+  return ::realloc(p, size);
+}
+
+void MemUtil::release(void* p) noexcept {
+  if (p != nullptr)
+    memReleaseCount++;
+  ::free(p);
+}
+
+uint64_t MemUtil::getAllocCount() noexcept { return memAllocCount; }
+uint64_t MemUtil::getReleaseCount() noexcept { return memReleaseCount; }
+#else
+void* MemUtil::alloc(size_t size) noexcept { return ::malloc(size); }
+void* MemUtil::realloc(void* p, size_t size) noexcept { return ::realloc(p, size); }
+void MemUtil::release(void* p) noexcept { ::free(p); }
+
+uint64_t MemUtil::getAllocCount() noexcept { return 0; }
+uint64_t MemUtil::getReleaseCount() noexcept { return 0; }
+#endif // ASMJIT_TRACE_ALLOC
+
 // ============================================================================
 // [asmjit::DebugUtils]
 // ============================================================================
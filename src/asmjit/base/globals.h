@@ -558,6 +558,97 @@ ASMJIT_ENUM(ErrorCode) {
 
 //! \}
 
+// ============================================================================
+// [asmjit::Allocator]
+// ============================================================================
+
+//! Heap memory allocator.
+//!
+//! AsmJit classes that allocate heap memory (`Zone`, `PodVector<T>`,
+//! `StringBuilder`, `Assembler`, `Compiler` and `VMemMgr`) can be bound to an
+//! `Allocator` instance, which makes it possible to route memory of each of
+//! them to a different arena or to account and limit it separately. Classes
+//! not bound to any allocator (nullptr, which is the default) use the
+//! `ASMJIT_ALLOC`, `ASMJIT_REALLOC` and `ASMJIT_FREE` macros.
+//!
+//! The default implementation of all functions uses these macros as well, so
+//! it's possible to override only some of them. An allocator that accounts
+//! memory has to remember sizes of allocated blocks by itself, as `release()`
+//! doesn't get the size. The allocator must outlive all objects bound to it
+//! and has to be thread-safe if it's shared by objects used by more threads.
+class ASMJIT_VIRTAPI Allocator {
+ public:
+  ASMJIT_NO_COPY(Allocator)
+
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! Create a new `Allocator` instance.
+  ASMJIT_API Allocator() noexcept;
+  //! Destroy the `Allocator` instance.
+  ASMJIT_API virtual ~Allocator() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Interface]
+  // --------------------------------------------------------------------------
+
+  //! Allocate `size` bytes of memory, returns nullptr on failure.
+  ASMJIT_API virtual void* alloc(size_t size) noexcept;
+  //! Reallocate `p` to `size` bytes of memory, returns nullptr on failure, in
+  //! which case `p` is still valid.
+  ASMJIT_API virtual void* realloc(void* p, size_t size) noexcept;
+  //! Release `p`, which is never nullptr.
+  ASMJIT_API virtual void release(void* p) noexcept;
+};
+
+// ============================================================================
+// [asmjit::MemUtil]
+// ============================================================================
+
+//! Heap memory used by AsmJit.
+//!
+//! If AsmJit is compiled with `ASMJIT_TRACE_ALLOC` these functions are used
+//! by the default `ASMJIT_ALLOC`, `ASMJIT_REALLOC` and `ASMJIT_FREE` and count
+//! calls made by each thread, so tests and benchmarks can check that a code
+//! path doesn't allocate. Nothing is counted otherwise.
+struct MemUtil {
+  //! Allocate `size` bytes of memory by `malloc()`.
+  static ASMJIT_API void* alloc(size_t size) noexcept;
+  //! Reallocate `p` to `size` bytes of memory by `realloc()`.
+  static ASMJIT_API void* realloc(void* p, size_t size) noexcept;
+  //! Release `p` by `free()`.
+  static ASMJIT_API void release(void* p) noexcept;
+
+  //! Allocate `size` bytes of memory by `allocator` or by `ASMJIT_ALLOC` if
+  //! `allocator` is nullptr.
+  static ASMJIT_INLINE void* alloc(Allocator* allocator, size_t size) noexcept {
+    return allocator ? allocator->alloc(size) : ASMJIT_ALLOC(size);
+  }
+
+  //! Reallocate `p` to `size` bytes of memory by `allocator` or by
+  //! `ASMJIT_REALLOC` if `allocator` is nullptr.
+  static ASMJIT_INLINE void* realloc(Allocator* allocator, void* p, size_t size) noexcept {
+    return allocator ? allocator->realloc(p, size) : ASMJIT_REALLOC(p, size);
+  }
+
+  //! Release `p` by `allocator` or by `ASMJIT_FREE` if `allocator` is nullptr,
+  //! does nothing if `p` is nullptr.
+  static ASMJIT_INLINE void release(Allocator* allocator, void* p) noexcept {
+    if (allocator == nullptr)
+      ASMJIT_FREE(p);
+    else if (p != nullptr)
+      allocator->release(p);
+  }
+
+  //! Get count of `alloc()` and `realloc()` calls made by the calling thread,
+  //! always zero if compiled without `ASMJIT_TRACE_ALLOC`.
+  static ASMJIT_API uint64_t getAllocCount() noexcept;
+  //! Get count of `release()` calls made by the calling thread, always zero
+  //! if compiled without `ASMJIT_TRACE_ALLOC`.
+  static ASMJIT_API uint64_t getReleaseCount() noexcept;
+};
+
 // ============================================================================
 // [asmjit::Init / NoInit]
 // ============================================================================
@@ -48,6 +48,11 @@ class HLSentinel;
 //!
 //! Every node represents an abstract instruction, directive, label, or macro
 //! instruction that can be serialized to `Assembler`.
+//!
+//! Nodes are allocated one after another from the compiler's zone and are
+//! visited by every pass, so members that all passes read (links, type, flags,
+//! flowId, map and state) are placed first and members used only by liveness
+//! analysis and logging are placed last.
 class HLNode {
  public:
   ASMJIT_NO_COPY(HLNode)
@@ -266,9 +271,9 @@ class HLNode {
   //! Get whether the node has variable liveness bits.
   ASMJIT_INLINE bool hasLiveness() const noexcept { return _liveness != nullptr; }
   //! Get variable liveness bits.
-  ASMJIT_INLINE BitArray* getLiveness() const noexcept { return _liveness; }
+  ASMJIT_INLINE HybridBitArray* getLiveness() const noexcept { return _liveness; }
   //! Set variable liveness bits.
-  ASMJIT_INLINE void setLiveness(BitArray* liveness) noexcept { _liveness = liveness; }
+  ASMJIT_INLINE void setLiveness(HybridBitArray* liveness) noexcept { _liveness = liveness; }
 
   // --------------------------------------------------------------------------
   // [Members]
@@ -301,21 +306,23 @@ class HLNode {
 
   // TODO: 32-bit gap
 
-  //! Inline comment string, initially set to nullptr.
-  const char* _comment;
-
   //! Variable mapping (VarAttr to VarData), initially nullptr, filled during
   //! fetch phase.
   VarMap* _map;
 
-  //! Variable liveness bits (initially nullptr, filled by analysis phase).
-  BitArray* _liveness;
-
   //! Saved state.
   //!
   //! Initially nullptr, not all nodes have saved state, only branch/flow control
   //! nodes.
   VarState* _state;
+
+  //! Variable liveness bits (initially nullptr, filled by analysis phase).
+  //!
+  //! Consecutive nodes that have the same liveness share the same instance.
+  HybridBitArray* _liveness;
+
+  //! Inline comment string, initially set to nullptr.
+  const char* _comment;
 };
 
 // ============================================================================
@@ -324,7 +331,9 @@ class HLNode {
 
 //! Instruction (HL).
 //!
-//! Wraps an instruction with its options and operands.
+//! Wraps an instruction with its options and operands. Operands are always
+//! allocated right after the node (after `HLJump` if the node is a jump), so
+//! the node only stores their offset.
 class HLInst : public HLNode {
  public:
   ASMJIT_NO_COPY(HLInst)
@@ -334,20 +343,34 @@ class HLInst : public HLNode {
   // --------------------------------------------------------------------------
 
   //! Create a new `HLInst` instance.
-  ASMJIT_INLINE HLInst(Compiler* compiler, uint32_t instId, uint32_t instOptions, Operand* opList, uint32_t opCount) noexcept
+  //!
+  //! `opCount` operands must be stored right after the node before it's
+  //! created, see `getOpList()`.
+  ASMJIT_INLINE HLInst(Compiler* compiler, uint32_t instId, uint32_t instOptions, uint32_t opCount) noexcept
     : HLNode(compiler, kTypeInst) {
+    _init(instId, instOptions, opCount, sizeof(HLInst));
+  }
+
+ protected:
+  //! Create a new `HLInst` instance of a derived node of `nodeSize` bytes,
+  //! which has operands stored right after it.
+  ASMJIT_INLINE HLInst(Compiler* compiler, uint32_t instId, uint32_t instOptions, uint32_t opCount, uint32_t nodeSize) noexcept
+    : HLNode(compiler, kTypeInst) {
+    _init(instId, instOptions, opCount, nodeSize);
+  }
 
+  ASMJIT_INLINE void _init(uint32_t instId, uint32_t instOptions, uint32_t opCount, uint32_t nodeSize) noexcept {
     orFlags(kFlagIsRemovable);
     _instId = static_cast<uint16_t>(instId);
-    _reserved = 0;
     _instOptions = instOptions;
 
     _opCount = static_cast<uint8_t>(opCount);
-    _opList = opList;
+    _opOffset = static_cast<uint8_t>(nodeSize);
 
     _updateMemOp();
   }
 
+ public:
   //! Destroy the `HLInst` instance.
   ASMJIT_INLINE ~HLInst() noexcept {}
 
@@ -383,9 +406,13 @@ class HLInst : public HLNode {
   //! Get operands count.
   ASMJIT_INLINE uint32_t getOpCount() const noexcept { return _opCount; }
   //! Get operands list.
-  ASMJIT_INLINE Operand* getOpList() noexcept { return _opList; }
+  ASMJIT_INLINE Operand* getOpList() noexcept {
+    return reinterpret_cast<Operand*>(reinterpret_cast<uint8_t*>(this) + _opOffset);
+  }
   //! \overload
-  ASMJIT_INLINE const Operand* getOpList() const noexcept { return _opList; }
+  ASMJIT_INLINE const Operand* getOpList() const noexcept {
+    return reinterpret_cast<const Operand*>(reinterpret_cast<const uint8_t*>(this) + _opOffset);
+  }
 
   //! Get whether the instruction contains a memory operand.
   ASMJIT_INLINE bool hasMemOp() const noexcept { return _memOpIndex != 0xFF; }
@@ -395,13 +422,13 @@ class HLInst : public HLNode {
   //! see `hasMemOp()`.
   ASMJIT_INLINE BaseMem* getMemOp() const noexcept {
     ASMJIT_ASSERT(hasMemOp());
-    return static_cast<BaseMem*>(&_opList[_memOpIndex]);
+    return static_cast<BaseMem*>(&const_cast<HLInst*>(this)->getOpList()[_memOpIndex]);
   }
   //! \overload
   template<typename T>
   ASMJIT_INLINE T* getMemOp() const noexcept {
     ASMJIT_ASSERT(hasMemOp());
-    return static_cast<T*>(&_opList[_memOpIndex]);
+    return static_cast<T*>(&const_cast<HLInst*>(this)->getOpList()[_memOpIndex]);
   }
 
   //! Set memory operand index, `0xFF` means no memory operand.
@@ -435,13 +462,11 @@ L_Update:
   uint16_t _instId;
   //! \internal
   uint8_t _memOpIndex;
-  //! \internal
-  uint8_t _reserved;
+  //! Offset of the operands list from the beginning of the node, which is
+  //! the size of the node.
+  uint8_t _opOffset;
   //! Instruction options, see `InstOptions`.
   uint32_t _instOptions;
-
-  //! Operands list.
-  Operand* _opList;
 };
 
 // ============================================================================
@@ -459,8 +484,12 @@ class HLJump : public HLInst {
   // [Construction / Destruction]
   // --------------------------------------------------------------------------
 
-  ASMJIT_INLINE HLJump(Compiler* compiler, uint32_t code, uint32_t options, Operand* opList, uint32_t opCount) noexcept
-    : HLInst(compiler, code, options, opList, opCount),
+  //! Create a new `HLJump` instance.
+  //!
+  //! `opCount` operands must be stored right after the node before it's
+  //! created, see `getOpList()`.
+  ASMJIT_INLINE HLJump(Compiler* compiler, uint32_t code, uint32_t options, uint32_t opCount) noexcept
+    : HLInst(compiler, code, options, opCount, sizeof(HLJump)),
       _target(nullptr),
       _jumpNext(nullptr) {}
   ASMJIT_INLINE ~HLJump() noexcept {}
@@ -482,6 +511,12 @@ class HLJump : public HLInst {
   HLJump* _jumpNext;
 };
 
+//! \internal
+//!
+//! Fails to compile if operands of `HLJump` can't be addressed by the 8-bit
+//! `HLInst::_opOffset`.
+typedef char HLJump_opOffsetCheck[sizeof(HLJump) <= 0xFF ? 1 : -1];
+
 // ============================================================================
 // [asmjit::HLData]
 // ============================================================================
@@ -92,18 +92,14 @@ Logger::~Logger() noexcept {}
 // ============================================================================
 
 void Logger::logFormat(uint32_t style, const char* fmt, ...) noexcept {
-  char buf[1024];
-  size_t len;
+  StringBuilderTmp<1024> sb;
 
   va_list ap;
   va_start(ap, fmt);
-  len = vsnprintf(buf, sizeof(buf), fmt, ap);
+  sb.appendVFormat(fmt, ap);
   va_end(ap);
 
-  if (len >= sizeof(buf))
-    len = sizeof(buf) - 1;
-
-  logString(style, buf, len);
+  logString(style, sb.getData(), sb.getLength());
 }
 
 void Logger::logBinary(uint32_t style, const void* data, size_t size) noexcept {
@@ -37,7 +37,7 @@ void PodVectorBase::reset(bool releaseMemory) noexcept {
     return;
 
   if (releaseMemory && !isDataStatic(this, d)) {
-    ASMJIT_FREE(d);
+    MemUtil::release(_allocator, d);
     _d = const_cast<Data*>(&_nullData);
     return;
   }
@@ -96,7 +96,7 @@ Error PodVectorBase::_reserve(size_t n, size_t sizeOfT) noexcept {
     return kErrorNoHeapMemory;
 
   if (d == &_nullData) {
-    d = static_cast<Data*>(ASMJIT_ALLOC(nBytes));
+    d = static_cast<Data*>(MemUtil::alloc(_allocator, nBytes));
     if (ASMJIT_UNLIKELY(d == nullptr))
       return kErrorNoHeapMemory;
     d->length = 0;
@@ -105,7 +105,7 @@ Error PodVectorBase::_reserve(size_t n, size_t sizeOfT) noexcept {
     if (isDataStatic(this, d)) {
       Data* oldD = d;
 
-      d = static_cast<Data*>(ASMJIT_ALLOC(nBytes));
+      d = static_cast<Data*>(MemUtil::alloc(_allocator, nBytes));
       if (ASMJIT_UNLIKELY(d == nullptr))
         return kErrorNoHeapMemory;
 
@@ -114,7 +114,7 @@ Error PodVectorBase::_reserve(size_t n, size_t sizeOfT) noexcept {
       ::memcpy(d->getData(), oldD->getData(), len * sizeOfT);
     }
     else {
-      d = static_cast<Data*>(ASMJIT_REALLOC(d, nBytes));
+      d = static_cast<Data*>(MemUtil::realloc(_allocator, d, nBytes));
       if (ASMJIT_UNLIKELY(d == nullptr))
         return kErrorNoHeapMemory;
     }
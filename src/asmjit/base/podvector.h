@@ -49,13 +49,17 @@ class PodVectorBase {
   // [Construction / Destruction]
   // --------------------------------------------------------------------------
 
-  //! Create a new instance of `PodVectorBase`.
-  ASMJIT_INLINE PodVectorBase() noexcept : _d(const_cast<Data*>(&_nullData)) {}
+  //! Create a new instance of `PodVectorBase` that allocates by `allocator`.
+  explicit ASMJIT_INLINE PodVectorBase(Allocator* allocator = nullptr) noexcept
+    : _d(const_cast<Data*>(&_nullData)),
+      _allocator(allocator) {}
   //! Destroy the `PodVectorBase` and its data.
   ASMJIT_INLINE ~PodVectorBase() noexcept { reset(true); }
 
 protected:
-  explicit ASMJIT_INLINE PodVectorBase(Data* d) noexcept : _d(d) {}
+  ASMJIT_INLINE PodVectorBase(Data* d, Allocator* allocator) noexcept
+    : _d(d),
+      _allocator(allocator) {}
 
   // --------------------------------------------------------------------------
   // [Reset]
@@ -68,6 +72,19 @@ public:
   //! system.
   ASMJIT_API void reset(bool releaseMemory = false) noexcept;
 
+  // --------------------------------------------------------------------------
+  // [Allocator]
+  // --------------------------------------------------------------------------
+
+  //! Get the allocator used to allocate the buffer (nullptr if default).
+  ASMJIT_INLINE Allocator* getAllocator() const noexcept { return _allocator; }
+
+  //! Set the allocator used to allocate the buffer, releases the buffer first.
+  ASMJIT_INLINE void setAllocator(Allocator* allocator) noexcept {
+    reset(true);
+    _allocator = allocator;
+  }
+
   // --------------------------------------------------------------------------
   // [Grow / Reserve]
   // --------------------------------------------------------------------------
@@ -82,6 +99,7 @@ protected:
 
 public:
   Data* _d;
+  Allocator* _allocator;
 };
 
 // ============================================================================
@@ -104,13 +122,13 @@ class PodVector : public PodVectorBase {
   // [Construction / Destruction]
   // --------------------------------------------------------------------------
 
-  //! Create a new instance of `PodVector<T>`.
-  ASMJIT_INLINE PodVector() noexcept {}
+  //! Create a new instance of `PodVector<T>` that allocates by `allocator`.
+  explicit ASMJIT_INLINE PodVector(Allocator* allocator = nullptr) noexcept : PodVectorBase(allocator) {}
   //! Destroy the `PodVector<T>` and its data.
   ASMJIT_INLINE ~PodVector() noexcept {}
 
 protected:
-  explicit ASMJIT_INLINE PodVector(Data* d) noexcept : PodVectorBase(d) {}
+  ASMJIT_INLINE PodVector(Data* d, Allocator* allocator) noexcept : PodVectorBase(d, allocator) {}
 
   // --------------------------------------------------------------------------
   // [Data]
@@ -168,7 +186,7 @@ public:
     }
 
     T* dst = static_cast<T*>(d->getData()) + index;
-    ::memmove(dst + 1, dst, d->length - index);
+    ::memmove(dst + 1, dst, (d->length - index) * sizeof(T));
     ::memcpy(dst, &item, sizeof(T));
 
     d->length++;
@@ -211,7 +229,13 @@ public:
 
     T* data = static_cast<T*>(d->getData()) + i;
     d->length--;
-    ::memmove(data, data + 1, d->length - i);
+    ::memmove(data, data + 1, (d->length - i) * sizeof(T));
+  }
+
+  //! Truncate the vector to at most `n` items.
+  ASMJIT_INLINE void truncate(size_t n) noexcept {
+    if (n < _d->length)
+      _d->length = n;
   }
 
   //! Swap this pod-vector with `other`.
@@ -255,8 +279,9 @@ class PodVectorTmp : public PodVector<T> {
   // [Construction / Destruction]
   // --------------------------------------------------------------------------
 
-  //! Create a new instance of `PodVectorTmp<T>`.
-  ASMJIT_INLINE PodVectorTmp() noexcept : PodVector<T>(&_staticData) {
+  //! Create a new instance of `PodVectorTmp<T>` that allocates by `allocator`
+  //! when it outgrows its static data.
+  explicit ASMJIT_INLINE PodVectorTmp(Allocator* allocator = nullptr) noexcept : PodVector<T>(&_staticData, allocator) {
     _staticData.capacity = N;
     _staticData.length = 0;
   }
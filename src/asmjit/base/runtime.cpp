@@ -54,6 +54,22 @@ static ASMJIT_INLINE uint32_t hostStackAlignment() noexcept {
   return alignment;
 }
 
+//! \internal
+//!
+//! Full memory barrier.
+static ASMJIT_INLINE void runtimeMemoryBarrier() noexcept {
+#if ASMJIT_CC_MSC
+  ::MemoryBarrier();
+#else
+  __sync_synchronize();
+#endif
+}
+
+//! \internal
+//!
+//! Byte used to fill the padding between functions, `int3` on X86/X64.
+static const uint8_t hostPaddingByte = (ASMJIT_ARCH_X86 || ASMJIT_ARCH_X64) ? 0xCC : 0x00;
+
 static ASMJIT_INLINE void hostFlushInstructionCache(void* p, size_t size) noexcept {
   // Only useful on non-x86 architectures.
 #if !ASMJIT_ARCH_X86 && !ASMJIT_ARCH_X64
@@ -122,6 +138,13 @@ StaticRuntime::~StaticRuntime() noexcept {}
 // ============================================================================
 
 Error StaticRuntime::add(void** dst, Assembler* assembler) noexcept {
+  // Code in other sections than `.text` has to be merged before relocation.
+  Error error = assembler->layout();
+  if (error != kErrorOk) {
+    *dst = nullptr;
+    return error;
+  }
+
   size_t codeSize = assembler->getCodeSize();
   size_t sizeLimit = _sizeLimit;
 
@@ -167,28 +190,48 @@ Error StaticRuntime::release(void* p) noexcept {
 // [asmjit::JitRuntime - Construction / Destruction]
 // ============================================================================
 
-JitRuntime::JitRuntime() noexcept {}
-JitRuntime::~JitRuntime() noexcept {}
+JitRuntime::JitRuntime() noexcept
+  : _epoch(1),
+    _readers(nullptr),
+    _counters(nullptr) {}
+
+JitRuntime::~JitRuntime() noexcept {
+  CounterBlock* block = _counters;
+  while (block != nullptr) {
+    CounterBlock* next = block->next;
+    MemUtil::release(block->allocator, block);
+    block = next;
+  }
+}
 
 // ============================================================================
 // [asmjit::JitRuntime - Interface]
 // ============================================================================
 
 Error JitRuntime::add(void** dst, Assembler* assembler) noexcept {
+  // Code in other sections than `.text` has to be merged before relocation.
+  Error error = assembler->layout();
+  if (error != kErrorOk) {
+    *dst = nullptr;
+    return error;
+  }
+
   size_t codeSize = assembler->getCodeSize();
   if (codeSize == 0) {
     *dst = nullptr;
     return kErrorNoCodeGenerated;
   }
 
-  void* p = _memMgr.alloc(codeSize, getAllocType());
+  void* rw;
+  void* p = _memMgr.alloc(codeSize, getAllocType(), &rw);
   if (p == nullptr) {
     *dst = nullptr;
     return kErrorNoVirtualMemory;
   }
 
-  // Relocate the code and release the unused memory back to `VMemMgr`.
-  size_t relocSize = assembler->relocCode(p);
+  // Relocate the code and release the unused memory back to `VMemMgr`. The
+  // code is written through `rw`, which differs from `p` if dual mapped.
+  size_t relocSize = assembler->relocCode(rw, static_cast<Ptr>((uintptr_t)p));
   if (relocSize == 0) {
     *dst = nullptr;
     _memMgr.release(p);
@@ -204,10 +247,317 @@ Error JitRuntime::add(void** dst, Assembler* assembler) noexcept {
   return kErrorOk;
 }
 
+Error JitRuntime::addBatch(void** dst, Assembler* const* assemblers, size_t count, uint32_t alignment) noexcept {
+  size_t i;
+
+  for (i = 0; i < count; i++)
+    dst[i] = nullptr;
+
+  if (count == 0)
+    return kErrorNoCodeGenerated;
+
+  // VMemMgr doesn't guarantee alignment greater than its block density, and
+  // permanent memory is aligned even less.
+  if (!Utils::isPowerOf2<uint32_t>(alignment) || alignment > _memMgr.getAlignment(getAllocType()))
+    return kErrorInvalidArgument;
+
+  // Calculate the maximum size of the batch, including all trampolines and
+  // the worst-case alignment padding.
+  size_t maxSize = 0;
+  for (i = 0; i < count; i++) {
+    ASMJIT_PROPAGATE_ERROR(assemblers[i]->layout());
+
+    size_t codeSize = assemblers[i]->getCodeSize();
+    if (codeSize == 0)
+      return kErrorNoCodeGenerated;
+
+    maxSize = Utils::alignTo<size_t>(maxSize, alignment) + codeSize;
+  }
+
+  void* rw;
+  void* p = _memMgr.alloc(maxSize, getAllocType(), &rw);
+  if (p == nullptr)
+    return kErrorNoVirtualMemory;
+
+  // Relocate all functions in one pass. Functions are packed by their real
+  // size as the relocator doesn't emit trampolines that are not needed.
+  size_t offset = 0;
+  for (i = 0; i < count; i++) {
+    size_t alignedOffset = Utils::alignTo<size_t>(offset, alignment);
+
+    ::memset(static_cast<uint8_t*>(rw) + offset, hostPaddingByte, alignedOffset - offset);
+    offset = alignedOffset;
+
+    uint8_t* fnRw = static_cast<uint8_t*>(rw) + offset;
+    uint8_t* fnRx = static_cast<uint8_t*>(p) + offset;
+
+    size_t relocSize = assemblers[i]->relocCode(fnRw, static_cast<Ptr>((uintptr_t)fnRx));
+    if (relocSize == 0) {
+      for (size_t j = 0; j < i; j++)
+        dst[j] = nullptr;
+
+      _memMgr.release(p);
+      return kErrorInvalidState;
+    }
+
+    dst[i] = fnRx;
+    offset += relocSize;
+  }
+
+  if (offset < maxSize)
+    _memMgr.shrink(p, offset);
+
+  flush(p, offset);
+  return kErrorOk;
+}
+
 Error JitRuntime::release(void* p) noexcept {
   return _memMgr.release(p);
 }
 
+// ============================================================================
+// [asmjit::JitRuntime - Deferred Release]
+// ============================================================================
+
+void JitRuntime::addReader(Reader* reader) noexcept {
+  AutoLock locked(_retireLock);
+
+  // The reader can't hold any code retired before it has been added.
+  reader->_epoch = _epoch;
+  reader->_next = _readers;
+  _readers = reader;
+}
+
+void JitRuntime::removeReader(Reader* reader) noexcept {
+  {
+    AutoLock locked(_retireLock);
+
+    Reader** pPrev = &_readers;
+    while (*pPrev != nullptr) {
+      if (*pPrev == reader) {
+        *pPrev = reader->_next;
+        break;
+      }
+      pPrev = &(*pPrev)->_next;
+    }
+  }
+
+  // The reader may have been the last one blocking the retired code.
+  reclaim();
+}
+
+void JitRuntime::quiescent(Reader* reader) noexcept {
+  // All accesses to the retired code must be done before the store.
+  runtimeMemoryBarrier();
+  reader->_epoch = _epoch;
+}
+
+Error JitRuntime::retire(void* p) noexcept {
+  if (p == nullptr)
+    return kErrorOk;
+
+  {
+    AutoLock locked(_retireLock);
+
+    RetiredCode rc;
+    rc.p = p;
+    rc.epoch = _epoch;
+
+    // Releasing `p` immediately wouldn't be safe if we are out of memory.
+    Error err = _retired.append(rc);
+    if (err != kErrorOk)
+      return err;
+
+    // Readers that observe the new epoch can't reach `p` anymore.
+    _epoch = rc.epoch + 1;
+  }
+
+  reclaim();
+  return kErrorOk;
+}
+
+size_t JitRuntime::reclaim() noexcept {
+  AutoLock locked(_retireLock);
+
+  size_t count = _retired.getLength();
+  if (count == 0)
+    return 0;
+
+  // Make sure we see the latest epochs stored by readers.
+  runtimeMemoryBarrier();
+
+  uintptr_t minEpoch = ~static_cast<uintptr_t>(0);
+  for (Reader* reader = _readers; reader != nullptr; reader = reader->_next) {
+    uintptr_t epoch = reader->_epoch;
+    if (epoch < minEpoch)
+      minEpoch = epoch;
+  }
+
+  // Retired code is ordered by epoch, release everything retired before the
+  // oldest epoch observed by all readers.
+  RetiredCode* data = _retired.getData();
+  size_t i = 0;
+
+  while (i < count && data[i].epoch < minEpoch) {
+    _memMgr.release(data[i].p);
+    i++;
+  }
+
+  if (i != 0) {
+    ::memmove(data, data + i, (count - i) * sizeof(RetiredCode));
+    _retired.truncate(count - i);
+  }
+
+  return i;
+}
+
+// ============================================================================
+// [asmjit::JitRuntime - Counters]
+// ============================================================================
+
+uintptr_t* JitRuntime::newCounters(size_t count) noexcept {
+  if (count > (~static_cast<size_t>(0) - sizeof(CounterBlock)) / sizeof(uintptr_t))
+    return nullptr;
+
+  // Counters are bookkeeping data of the memory manager, use its allocator.
+  Allocator* allocator = _memMgr.getAllocator();
+  size_t size = sizeof(CounterBlock) + count * sizeof(uintptr_t);
+  CounterBlock* block = static_cast<CounterBlock*>(MemUtil::alloc(allocator, size));
+
+  if (block == nullptr)
+    return nullptr;
+
+  ::memset(block, 0, size);
+  block->allocator = allocator;
+  block->count = count;
+
+  {
+    AutoLock locked(_retireLock);
+    block->next = _counters;
+    _counters = block;
+  }
+
+  return reinterpret_cast<uintptr_t*>(block + 1);
+}
+
+void JitRuntime::releaseCounters(uintptr_t* counters) noexcept {
+  if (counters == nullptr)
+    return;
+
+  CounterBlock* block = reinterpret_cast<CounterBlock*>(counters) - 1;
+  {
+    AutoLock locked(_retireLock);
+
+    CounterBlock** pPrev = &_counters;
+    while (*pPrev != nullptr) {
+      if (*pPrev == block) {
+        *pPrev = block->next;
+        break;
+      }
+      pPrev = &(*pPrev)->next;
+    }
+  }
+
+  MemUtil::release(block->allocator, block);
+}
+
+// ============================================================================
+// [asmjit::JitRuntime - Test]
+// ============================================================================
+
+#if defined(ASMJIT_TEST)
+UNIT(base_runtime_retire) {
+  JitRuntime runtime;
+  VMemMgr* memmgr = runtime.getMemMgr();
+
+  JitRuntime::Reader r0;
+  JitRuntime::Reader r1;
+
+  runtime.addReader(&r0);
+  runtime.addReader(&r1);
+
+  void* a = memmgr->alloc(128);
+  void* b = memmgr->alloc(128);
+  EXPECT(a != nullptr && b != nullptr,
+    "Couldn't allocate virtual memory.");
+
+  INFO("Retiring code while readers are active.");
+  EXPECT(runtime.retire(a) == kErrorOk, "Failed to retire %p.", a);
+  EXPECT(runtime.getRetiredCount() == 1,
+    "Code can't be released before readers pass a quiescent point.");
+
+  runtime.quiescent(&r0);
+  EXPECT(runtime.reclaim() == 0,
+    "Code can't be released before all readers pass a quiescent point.");
+
+  EXPECT(runtime.retire(b) == kErrorOk, "Failed to retire %p.", b);
+  runtime.quiescent(&r1);
+
+  EXPECT(runtime.reclaim() == 1,
+    "Only the code retired before the quiescent point of r0 can be released.");
+  EXPECT(runtime.getRetiredCount() == 1,
+    "There should be exactly one function waiting to be released.");
+
+  INFO("Removing the last reader that blocks the release.");
+  runtime.removeReader(&r0);
+  EXPECT(runtime.getRetiredCount() == 0,
+    "All retired code should be released.");
+  EXPECT(memmgr->getUsedBytes() == 0,
+    "All memory should be released.");
+
+  runtime.removeReader(&r1);
+}
+
+struct JitRuntimeTestAllocator : public Allocator {
+  JitRuntimeTestAllocator() noexcept : allocCount(0), releaseCount(0) {}
+
+  virtual void* alloc(size_t size) noexcept {
+    allocCount++;
+    return ::malloc(size);
+  }
+
+  virtual void* realloc(void* p, size_t size) noexcept {
+    if (p == nullptr)
+      allocCount++;
+    return ::realloc(p, size);
+  }
+
+  virtual void release(void* p) noexcept {
+    releaseCount++;
+    ::free(p);
+  }
+
+  size_t allocCount;
+  size_t releaseCount;
+};
+
+UNIT(base_runtime_counters) {
+  JitRuntimeTestAllocator allocator;
+  {
+    JitRuntime runtime;
+    EXPECT(runtime.getMemMgr()->setAllocator(&allocator) == kErrorOk,
+      "Failed to set the allocator.");
+
+    INFO("Allocating counters by the allocator of the memory manager.");
+    uintptr_t* a = runtime.newCounters(4);
+    uintptr_t* b = runtime.newCounters(8);
+
+    EXPECT(a != nullptr && b != nullptr && a[3] == 0 && b[7] == 0,
+      "Couldn't allocate zeroed counters.");
+    EXPECT(allocator.allocCount == 2,
+      "Counters should be allocated by the allocator, %u allocations made.",
+      static_cast<unsigned int>(allocator.allocCount));
+
+    runtime.releaseCounters(a);
+    EXPECT(allocator.releaseCount == 1,
+      "Counters should be released by the allocator.");
+  }
+
+  EXPECT(allocator.releaseCount == allocator.allocCount,
+    "Counters should be released by the allocator when the runtime is destroyed.");
+}
+#endif // ASMJIT_TEST
+
 } // asmjit namespace
 
 // [Api-End]
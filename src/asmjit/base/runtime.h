@@ -10,6 +10,7 @@
 
 // [Dependencies]
 #include "../base/cpuinfo.h"
+#include "../base/podvector.h"
 #include "../base/vmem.h"
 
 // [Api-Begin]
@@ -219,6 +220,44 @@ class ASMJIT_VIRTAPI JitRuntime : public HostRuntime {
  public:
   ASMJIT_NO_COPY(JitRuntime)
 
+  // --------------------------------------------------------------------------
+  // [Reader]
+  // --------------------------------------------------------------------------
+
+  //! Thread that calls code managed by the runtime, see `retire()`.
+  //!
+  //! The structure is owned by the caller, it must stay alive until it's
+  //! removed by `removeReader()`.
+  struct Reader {
+    //! Next reader (linked list of all readers).
+    Reader* _next;
+    //! The latest epoch observed by the reader at its quiescent point.
+    volatile uintptr_t _epoch;
+  };
+
+  //! \internal
+  //!
+  //! Code retired by `retire()` that has not been released yet.
+  struct RetiredCode {
+    //! Code to release.
+    void* p;
+    //! Epoch when the code has been retired.
+    uintptr_t epoch;
+  };
+
+  //! \internal
+  //!
+  //! Header of counters allocated by `newCounters()`.
+  struct CounterBlock {
+    //! Next block (linked list of all blocks).
+    CounterBlock* next;
+    //! Allocator of the block, the allocator of the memory manager when the
+    //! block was allocated.
+    Allocator* allocator;
+    //! Count of counters that follow the header.
+    size_t count;
+  };
+
   // --------------------------------------------------------------------------
   // [Construction / Destruction]
   // --------------------------------------------------------------------------
@@ -247,12 +286,90 @@ class ASMJIT_VIRTAPI JitRuntime : public HostRuntime {
   ASMJIT_API virtual Error add(void** dst, Assembler* assembler) noexcept;
   ASMJIT_API virtual Error release(void* p) noexcept;
 
+  //! Allocate a memory needed for a code generated by `count` assemblers and
+  //! relocate all of them to a single contiguous block.
+  //!
+  //! Functions are placed in the order of `assemblers`, each one aligned to
+  //! `alignment` bytes, and their addresses are stored to `dst[0..count-1]`.
+  //! The alignment has to be a power of 2 not greater than the alignment
+  //! guaranteed by `VMemMgr::getAlignment()` for the current allocation type.
+  //! The padding between functions is filled by `int3` on X86/X64. The memory
+  //! is allocated and the instruction cache flushed only once for the whole
+  //! batch, which is much cheaper than calling `add()` for each assembler and
+  //! keeps functions used together close to each other.
+  //!
+  //! The batch is a single allocation, it can only be released as a whole by
+  //! passing `dst[0]` to `release()`. On failure all `dst` are set to `nullptr`.
+  ASMJIT_API Error addBatch(void** dst, Assembler* const* assemblers, size_t count, uint32_t alignment = 16) noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Deferred Release]
+  // --------------------------------------------------------------------------
+
+  //! Register `reader` as a thread that calls code managed by the runtime.
+  ASMJIT_API void addReader(Reader* reader) noexcept;
+  //! Unregister `reader`, it doesn't have to announce quiescent points anymore.
+  ASMJIT_API void removeReader(Reader* reader) noexcept;
+
+  //! Announce that the thread of `reader` is at a quiescent point.
+  //!
+  //! A quiescent point is a place where the thread doesn't execute and doesn't
+  //! hold a pointer to any code that could be retired, for example between
+  //! two queries or at the top of a worker loop. This is lock-free and cheap,
+  //! it's just a store of the current epoch.
+  ASMJIT_API void quiescent(Reader* reader) noexcept;
+
+  //! Release memory allocated by `add` once it's safe.
+  //!
+  //! Unlike `release()` the memory is not released immediately, it's queued
+  //! and released in batches by `reclaim()` after every registered reader has
+  //! announced a quiescent point, so a function can be swapped while other
+  //! threads may still execute the old version without any reference counting
+  //! on the caller's side. If there are no readers the memory is released by
+  //! the next `reclaim()`, which is also called by `retire()` itself.
+  ASMJIT_API Error retire(void* p) noexcept;
+
+  //! Release all retired code that is not reachable by readers anymore.
+  //!
+  //! Returns the count of functions released.
+  ASMJIT_API size_t reclaim() noexcept;
+
+  //! Get the count of retired functions waiting to be released.
+  ASMJIT_INLINE size_t getRetiredCount() const noexcept { return _retired.getLength(); }
+
+  // --------------------------------------------------------------------------
+  // [Counters]
+  // --------------------------------------------------------------------------
+
+  //! Allocate `count` zeroed counters incremented by instrumented code, see
+  //! `EdgeProfile`.
+  //!
+  //! The counters are owned by the runtime and allocated by the allocator of
+  //! its memory manager, see `VMemMgr::setAllocator()`. They must outlive the
+  //! code that increments them and are released by `releaseCounters()` or when
+  //! the runtime is destroyed.
+  ASMJIT_API uintptr_t* newCounters(size_t count) noexcept;
+
+  //! Release counters allocated by `newCounters()`.
+  ASMJIT_API void releaseCounters(uintptr_t* counters) noexcept;
+
   // --------------------------------------------------------------------------
   // [Members]
   // --------------------------------------------------------------------------
 
   //! Virtual memory manager.
   VMemMgr _memMgr;
+
+  //! Lock that protects readers, retired code and counters.
+  Lock _retireLock;
+  //! Current epoch, incremented by each `retire()`.
+  volatile uintptr_t _epoch;
+  //! Registered readers.
+  Reader* _readers;
+  //! Retired code, ordered by epoch.
+  PodVector<RetiredCode> _retired;
+  //! Counters allocated by `newCounters()`.
+  CounterBlock* _counters;
 };
 
 //! \}
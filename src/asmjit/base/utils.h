@@ -1277,6 +1277,8 @@ struct Lock {
 
   //! Lock.
   ASMJIT_INLINE void lock() noexcept { EnterCriticalSection(&_handle); }
+  //! Try to lock, returns `true` if the lock has been acquired.
+  ASMJIT_INLINE bool tryLock() noexcept { return TryEnterCriticalSection(&_handle) != 0; }
   //! Unlock.
   ASMJIT_INLINE void unlock() noexcept { LeaveCriticalSection(&_handle); }
 #endif // ASMJIT_OS_WINDOWS
@@ -1295,6 +1297,8 @@ struct Lock {
 
   //! Lock.
   ASMJIT_INLINE void lock() noexcept { pthread_mutex_lock(&_handle); }
+  //! Try to lock, returns `true` if the lock has been acquired.
+  ASMJIT_INLINE bool tryLock() noexcept { return pthread_mutex_trylock(&_handle) == 0; }
   //! Unlock.
   ASMJIT_INLINE void unlock() noexcept { pthread_mutex_unlock(&_handle); }
 #endif // ASMJIT_OS_POSIX
@@ -14,9 +14,15 @@
 #if ASMJIT_OS_POSIX
 # include <sys/types.h>
 # include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
 # include <unistd.h>
 #endif // ASMJIT_OS_POSIX
 
+#if ASMJIT_OS_LINUX
+# include <sys/syscall.h>
+#endif // ASMJIT_OS_LINUX
+
 // [Api-Begin]
 #include "../apibegin.h"
 
@@ -150,6 +156,110 @@ Error VMemUtil::releaseProcessMemory(HANDLE hProcess, void* addr, size_t /* leng
     return kErrorInvalidState;
   return kErrorOk;
 }
+
+size_t VMemUtil::getHugePageSize() noexcept {
+  return static_cast<size_t>(::GetLargePageMinimum());
+}
+
+size_t VMemUtil::getTransparentHugePagesSize(void* addr, size_t length) noexcept {
+  // Windows doesn't have transparent huge pages.
+  ASMJIT_UNUSED(addr);
+  ASMJIT_UNUSED(length);
+  return 0;
+}
+
+void* VMemUtil::allocHugePages(size_t length, size_t* allocated, uint32_t flags, uint32_t* hugePages) noexcept {
+  *hugePages = kVMemHugePagesNone;
+
+  size_t hugePageSize = getHugePageSize();
+  if (hugePageSize == 0 || length == 0)
+    return alloc(length, allocated, flags);
+
+  DWORD protectFlags = 0;
+  if (flags & kVMemFlagExecutable)
+    protectFlags |= (flags & kVMemFlagWritable) ? PAGE_EXECUTE_READWRITE : PAGE_EXECUTE_READ;
+  else
+    protectFlags |= (flags & kVMemFlagWritable) ? PAGE_READWRITE : PAGE_READONLY;
+
+  // Large pages require `SeLockMemoryPrivilege`, fallback silently if the
+  // process doesn't have it.
+  size_t mSize = Utils::alignTo(length, hugePageSize);
+  LPVOID mBase = ::VirtualAlloc(nullptr, mSize, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, protectFlags);
+  if (mBase == nullptr)
+    return alloc(length, allocated, flags);
+
+  if (allocated != nullptr)
+    *allocated = mSize;
+
+  *hugePages = kVMemHugePagesExplicit;
+  return mBase;
+}
+
+void* VMemUtil::allocDualMapping(size_t length, size_t* allocated, void** rw) noexcept {
+  if (length == 0)
+    return nullptr;
+
+  const VMemLocal& vMem = vMemGet();
+  size_t mSize = Utils::alignTo(length, vMem.pageSize);
+
+  uint64_t mSize64 = static_cast<uint64_t>(mSize);
+  HANDLE hMapping = ::CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr,
+    PAGE_EXECUTE_READWRITE | SEC_COMMIT,
+    static_cast<DWORD>(mSize64 >> 32), static_cast<DWORD>(mSize64 & 0xFFFFFFFFU), nullptr);
+
+  if (hMapping == nullptr)
+    return nullptr;
+
+  void* rwBase = ::MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, mSize);
+  void* rxBase = ::MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_EXECUTE, 0, 0, mSize);
+
+  // Views keep the mapping object alive.
+  ::CloseHandle(hMapping);
+
+  if (rwBase == nullptr || rxBase == nullptr) {
+    if (rwBase) ::UnmapViewOfFile(rwBase);
+    if (rxBase) ::UnmapViewOfFile(rxBase);
+    return nullptr;
+  }
+
+  if (allocated != nullptr)
+    *allocated = mSize;
+
+  *rw = rwBase;
+  return rxBase;
+}
+
+Error VMemUtil::releaseDualMapping(void* rx, void* rw, size_t /* length */) noexcept {
+  bool ok = ::UnmapViewOfFile(rx) != 0;
+  ok &= ::UnmapViewOfFile(rw) != 0;
+  return ok ? kErrorOk : kErrorInvalidState;
+}
+
+//! \internal
+//!
+//! Try to reserve `length` bytes of address space at `addr`, the result can
+//! be nullptr or a different address if `addr` is not available.
+static void* vMemTryReserve(void* addr, size_t length) noexcept {
+  return ::VirtualAlloc(addr, length, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+Error VMemUtil::commit(void* addr, size_t length, uint32_t flags) noexcept {
+  DWORD protectFlags = 0;
+  if (flags & kVMemFlagExecutable)
+    protectFlags |= (flags & kVMemFlagWritable) ? PAGE_EXECUTE_READWRITE : PAGE_EXECUTE_READ;
+  else
+    protectFlags |= (flags & kVMemFlagWritable) ? PAGE_READWRITE : PAGE_READONLY;
+
+  if (::VirtualAlloc(addr, length, MEM_COMMIT, protectFlags) == nullptr)
+    return kErrorNoVirtualMemory;
+  return kErrorOk;
+}
+
+Error VMemUtil::decommit(void* addr, size_t length) noexcept {
+  if (!::VirtualFree(addr, length, MEM_DECOMMIT))
+    return kErrorInvalidState;
+  return kErrorOk;
+}
 #endif // ASMJIT_OS_WINDOWS
 
 // ============================================================================
@@ -167,16 +277,57 @@ Error VMemUtil::releaseProcessMemory(HANDLE hProcess, void* addr, size_t /* leng
 struct VMemLocal {
   size_t pageSize;
   size_t pageGranularity;
+  size_t hugePageSize;
 };
 static VMemLocal vMemLocal;
 
+#if ASMJIT_OS_LINUX
+//! \internal
+//!
+//! Get the first number following `key` in a file at `path`, zero on failure.
+static size_t vMemReadFileNumber(const char* path, const char* key) noexcept {
+  FILE* f = ::fopen(path, "r");
+  if (f == nullptr)
+    return 0;
+
+  char line[256];
+  size_t keyLength = ::strlen(key);
+  unsigned long value = 0;
+
+  while (::fgets(line, sizeof(line), f) != nullptr) {
+    if (::strncmp(line, key, keyLength) == 0) {
+      if (::sscanf(line + keyLength, " %lu", &value) != 1)
+        value = 0;
+      break;
+    }
+  }
+
+  ::fclose(f);
+  return static_cast<size_t>(value);
+}
+#endif // ASMJIT_OS_LINUX
+
 static const VMemLocal& vMemGet() noexcept {
   VMemLocal& vMem = vMemLocal;
 
   if (!vMem.pageSize) {
     size_t pageSize = ::getpagesize();
-    vMem.pageSize = pageSize;
+    size_t hugePageSize = 0;
+
+#if ASMJIT_OS_LINUX
+    // Size of a transparent huge page, or the default size of explicit huge
+    // pages if transparent huge pages are not compiled in (in kB).
+    hugePageSize = vMemReadFileNumber("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "");
+    if (hugePageSize == 0)
+      hugePageSize = vMemReadFileNumber("/proc/meminfo", "Hugepagesize:") * 1024;
+
+    if (!Utils::isPowerOf2<size_t>(hugePageSize) || hugePageSize <= pageSize)
+      hugePageSize = 0;
+#endif // ASMJIT_OS_LINUX
+
+    vMem.hugePageSize = hugePageSize;
     vMem.pageGranularity = Utils::iMax<size_t>(pageSize, 65536);
+    vMem.pageSize = pageSize;
   }
 
   return vMem;
@@ -215,8 +366,281 @@ Error VMemUtil::release(void* addr, size_t length) noexcept {
 
   return kErrorOk;
 }
+
+size_t VMemUtil::getHugePageSize() noexcept {
+  const VMemLocal& vMem = vMemGet();
+  return vMem.hugePageSize;
+}
+
+size_t VMemUtil::getTransparentHugePagesSize(void* addr, size_t length) noexcept {
+#if ASMJIT_OS_LINUX
+  FILE* f = ::fopen("/proc/self/smaps", "r");
+  if (f == nullptr)
+    return 0;
+
+  unsigned long rangeStart = static_cast<unsigned long>(reinterpret_cast<uintptr_t>(addr));
+  unsigned long rangeEnd = rangeStart + static_cast<unsigned long>(length);
+
+  char line[512];
+  bool inRange = false;
+  size_t result = 0;
+
+  while (::fgets(line, sizeof(line), f) != nullptr) {
+    unsigned long start;
+    unsigned long end;
+
+    // Each mapping starts with "start-end perms ...", followed by its fields.
+    if (::sscanf(line, "%lx-%lx", &start, &end) == 2) {
+      inRange = start < rangeEnd && end > rangeStart;
+      continue;
+    }
+
+    unsigned long kb;
+    if (inRange && ::sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+      result += static_cast<size_t>(kb) * 1024;
+  }
+
+  ::fclose(f);
+  return result;
+#else
+  ASMJIT_UNUSED(addr);
+  ASMJIT_UNUSED(length);
+  return 0;
+#endif // ASMJIT_OS_LINUX
+}
+
+void* VMemUtil::allocHugePages(size_t length, size_t* allocated, uint32_t flags, uint32_t* hugePages) noexcept {
+  *hugePages = kVMemHugePagesNone;
+
+  size_t hugePageSize = getHugePageSize();
+  if (hugePageSize == 0 || length == 0)
+    return alloc(length, allocated, flags);
+
+  size_t msize = Utils::alignTo<size_t>(length, hugePageSize);
+  int protection = PROT_READ;
+
+  if (flags & kVMemFlagWritable  ) protection |= PROT_WRITE;
+  if (flags & kVMemFlagExecutable) protection |= PROT_EXEC;
+
+#if defined(MAP_HUGETLB)
+  // Explicit huge pages, only succeeds if the system has them reserved.
+  void* mbase = ::mmap(nullptr, msize, protection, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (mbase != MAP_FAILED) {
+    if (allocated != nullptr)
+      *allocated = msize;
+
+    *hugePages = kVMemHugePagesExplicit;
+    return mbase;
+  }
+#endif // MAP_HUGETLB
+
+#if defined(MADV_HUGEPAGE)
+  // Transparent huge pages, the region must be aligned to the huge page size,
+  // so map more than needed and unmap the unaligned head and tail.
+  uint8_t* raw = static_cast<uint8_t*>(
+    ::mmap(nullptr, msize + hugePageSize, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+  if (raw != MAP_FAILED) {
+    uint8_t* aligned = reinterpret_cast<uint8_t*>(
+      Utils::alignTo<uintptr_t>(reinterpret_cast<uintptr_t>(raw), hugePageSize));
+
+    size_t head = (size_t)(aligned - raw);
+    size_t tail = hugePageSize - head;
+
+    if (head) ::munmap(raw, head);
+    if (tail) ::munmap(aligned + msize, tail);
+
+    // Pages are faulted in later, it's unknown whether they will be huge.
+    if (::madvise(aligned, msize, MADV_HUGEPAGE) == 0)
+      *hugePages = kVMemHugePagesAdvised;
+
+    if (allocated != nullptr)
+      *allocated = msize;
+    return aligned;
+  }
+#endif // MADV_HUGEPAGE
+
+  return alloc(length, allocated, flags);
+}
+
+//! \internal
+//!
+//! Create an anonymous file that is used to map the same memory twice.
+static int vMemCreateAnonymousFile() noexcept {
+#if ASMJIT_OS_LINUX && defined(SYS_memfd_create)
+  // MFD_CLOEXEC, the constant is not available in older headers.
+  int fd = static_cast<int>(::syscall(SYS_memfd_create, "asmjit", 1u));
+  if (fd >= 0)
+    return fd;
+#endif // ASMJIT_OS_LINUX && SYS_memfd_create
+
+  // Fallback to a POSIX shared memory object that is unlinked immediately.
+  static volatile uint32_t counter;
+  char name[64];
+
+  for (uint32_t attempt = 0; attempt < 16; attempt++) {
+    snprintf(name, ASMJIT_ARRAY_SIZE(name), "/asmjit-%u-%u",
+      static_cast<unsigned int>(::getpid()),
+      static_cast<unsigned int>(counter++));
+
+    int fd = ::shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd >= 0) {
+      ::shm_unlink(name);
+      return fd;
+    }
+  }
+
+  return -1;
+}
+
+void* VMemUtil::allocDualMapping(size_t length, size_t* allocated, void** rw) noexcept {
+  const VMemLocal& vMem = vMemGet();
+  size_t msize = Utils::alignTo<size_t>(length, vMem.pageSize);
+
+  if (msize == 0)
+    return nullptr;
+
+  int fd = vMemCreateAnonymousFile();
+  if (fd < 0)
+    return nullptr;
+
+  void* rwBase = MAP_FAILED;
+  void* rxBase = MAP_FAILED;
+
+  if (::ftruncate(fd, static_cast<off_t>(msize)) == 0) {
+    rwBase = ::mmap(nullptr, msize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    rxBase = ::mmap(nullptr, msize, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+  }
+
+  // Mappings keep the file alive.
+  ::close(fd);
+
+  if (rwBase == MAP_FAILED || rxBase == MAP_FAILED) {
+    if (rwBase != MAP_FAILED) ::munmap(rwBase, msize);
+    if (rxBase != MAP_FAILED) ::munmap(rxBase, msize);
+    return nullptr;
+  }
+
+  if (allocated != nullptr)
+    *allocated = msize;
+
+  *rw = rwBase;
+  return rxBase;
+}
+
+Error VMemUtil::releaseDualMapping(void* rx, void* rw, size_t length) noexcept {
+  bool ok = ::munmap(rx, length) == 0;
+  ok &= ::munmap(rw, length) == 0;
+  return ok ? kErrorOk : kErrorInvalidState;
+}
+
+//! \internal
+//!
+//! Try to reserve `length` bytes of address space at `addr`, the result can
+//! be nullptr or a different address if `addr` is not available.
+static void* vMemTryReserve(void* addr, size_t length) noexcept {
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_NORESERVE)
+  flags |= MAP_NORESERVE;
+#endif // MAP_NORESERVE
+
+  // The address is only a hint, the caller checks where the memory was mapped.
+  void* mbase = ::mmap(addr, length, PROT_NONE, flags, -1, 0);
+  return mbase != MAP_FAILED ? mbase : nullptr;
+}
+
+Error VMemUtil::commit(void* addr, size_t length, uint32_t flags) noexcept {
+  int protection = PROT_READ;
+
+  if (flags & kVMemFlagWritable  ) protection |= PROT_WRITE;
+  if (flags & kVMemFlagExecutable) protection |= PROT_EXEC;
+
+  if (::mprotect(addr, length, protection) != 0)
+    return kErrorNoVirtualMemory;
+  return kErrorOk;
+}
+
+Error VMemUtil::decommit(void* addr, size_t length) noexcept {
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+#if defined(MAP_NORESERVE)
+  flags |= MAP_NORESERVE;
+#endif // MAP_NORESERVE
+
+  // Mapping over the range drops its pages and keeps the address space.
+  if (::mmap(addr, length, PROT_NONE, flags, -1, 0) == MAP_FAILED)
+    return kErrorInvalidState;
+  return kErrorOk;
+}
 #endif // ASMJIT_OS_POSIX
 
+// ============================================================================
+// [asmjit::VMemUtil - Reserve]
+// ============================================================================
+
+void* VMemUtil::reserveNear(const void* target, size_t maxDistance, size_t length, size_t* reserved) noexcept {
+  if (length == 0 || length > maxDistance)
+    return nullptr;
+
+  size_t granularity = getPageGranularity();
+  length = Utils::alignTo<size_t>(length, granularity);
+
+  uintptr_t t = reinterpret_cast<uintptr_t>(target);
+  uintptr_t lo = t > maxDistance ? t - maxDistance : 0;
+  uintptr_t hi = ~static_cast<uintptr_t>(0) - t > maxDistance ? t + maxDistance : ~static_cast<uintptr_t>(0);
+
+  // Try addresses right below and right above `target` first and then move
+  // away in both directions, a step of 64MB keeps the count of tries low.
+  size_t step = Utils::alignTo<size_t>(64 * 1024 * 1024, granularity);
+  uintptr_t below = (t & ~static_cast<uintptr_t>(granularity - 1));
+  uintptr_t above = below + granularity;
+
+  for (;;) {
+    bool canBelow = below >= lo + length;
+    bool canAbove = above <= hi - length && above >= t;
+
+    if (!canBelow && !canAbove)
+      return nullptr;
+
+    for (int dir = 0; dir < 2; dir++) {
+      if (dir == 0 ? !canBelow : !canAbove)
+        continue;
+
+      uintptr_t addr = dir == 0 ? below - length : above;
+      uint8_t* mbase = static_cast<uint8_t*>(vMemTryReserve(reinterpret_cast<void*>(addr), length));
+
+      if (mbase == nullptr)
+        continue;
+
+      uintptr_t m = reinterpret_cast<uintptr_t>(mbase);
+      if (m >= lo && m <= hi - length) {
+        if (reserved != nullptr)
+          *reserved = length;
+        return mbase;
+      }
+
+      release(mbase, length);
+    }
+
+    below = below >= step ? below - step : 0;
+    above = above + step >= above ? above + step : ~static_cast<uintptr_t>(0);
+  }
+}
+
+// ============================================================================
+// [asmjit::VMemMover]
+// ============================================================================
+
+VMemMover::VMemMover() noexcept {}
+VMemMover::~VMemMover() noexcept {}
+
+bool VMemMover::move(void* dst, void* dstRw, const void* src, size_t size, void* userData) noexcept {
+  ASMJIT_UNUSED(dst);
+  ASMJIT_UNUSED(userData);
+
+  ::memcpy(dstRw, src, size);
+  return true;
+}
+
 // ============================================================================
 // [asmjit::VMemMgr - BitOps]
 // ============================================================================
@@ -259,6 +683,49 @@ static void _SetBits(size_t* buf, size_t index, size_t len) noexcept {
     *buf |= ((~(size_t)0) >> (kBitsPerEntity - len));
 }
 
+// ============================================================================
+// [asmjit::VMemMgr - Atomics]
+// ============================================================================
+
+#if ASMJIT_CC_MSC
+# define ASMJIT_VMEM_TLS __declspec(thread)
+#else
+# define ASMJIT_VMEM_TLS __thread
+#endif
+
+//! \internal
+//!
+//! Atomically replace `*dst` by `value` if it's equal to `expected`.
+static ASMJIT_INLINE bool vMemAtomicCas(void* volatile* dst, void* expected, void* value) noexcept {
+#if ASMJIT_CC_MSC
+  return ::InterlockedCompareExchangePointer(dst, value, expected) == expected;
+#else
+  return __sync_bool_compare_and_swap(dst, expected, value);
+#endif
+}
+
+//! \internal
+//!
+//! Atomically increment `*dst` and return the incremented value.
+static ASMJIT_INLINE uint32_t vMemAtomicInc(volatile uint32_t* dst) noexcept {
+#if ASMJIT_CC_MSC
+  return static_cast<uint32_t>(::InterlockedIncrement(reinterpret_cast<volatile LONG*>(dst)));
+#else
+  return __sync_add_and_fetch(dst, 1);
+#endif
+}
+
+//! \internal
+//!
+//! Atomically decrement `*dst` and return the decremented value.
+static ASMJIT_INLINE uint32_t vMemAtomicDec(volatile uint32_t* dst) noexcept {
+#if ASMJIT_CC_MSC
+  return static_cast<uint32_t>(::InterlockedDecrement(reinterpret_cast<volatile LONG*>(dst)));
+#else
+  return __sync_sub_and_fetch(dst, 1);
+#endif
+}
+
 // ============================================================================
 // [asmjit::VMemMgr::TypeDefs]
 // ============================================================================
@@ -266,6 +733,12 @@ static void _SetBits(size_t* buf, size_t index, size_t len) noexcept {
 typedef VMemMgr::RbNode RbNode;
 typedef VMemMgr::MemNode MemNode;
 typedef VMemMgr::PermanentNode PermanentNode;
+typedef VMemMgr::ArenaChunk ArenaChunk;
+typedef VMemMgr::ArenaTable ArenaTable;
+typedef VMemMgr::PendingRelease PendingRelease;
+typedef VMemMgr::Bins Bins;
+typedef VMemMgr::MovableBlock MovableBlock;
+typedef VMemMgr::Region Region;
 
 // ============================================================================
 // [asmjit::VMemMgr::RbNode]
@@ -362,12 +835,15 @@ struct VMemMgr::MemNode : public RbNode {
 
   ASMJIT_INLINE void fillData(MemNode* other) noexcept {
     mem = other->mem;
+    rwMem = other->rwMem;
+    hugePages = other->hugePages;
 
     size = other->size;
     used = other->used;
     blocks = other->blocks;
     density = other->density;
     largestBlock = other->largestBlock;
+    binned = other->binned;
 
     baUsed = other->baUsed;
     baCont = other->baCont;
@@ -380,11 +856,15 @@ struct VMemMgr::MemNode : public RbNode {
   MemNode* prev;         // Prev node in list.
   MemNode* next;         // Next node in list.
 
+  uint8_t* rwMem;        // Writable view of `mem` if dual mapped, otherwise nullptr.
+  uint32_t hugePages;    // Huge pages backing the node, see \ref VMemHugePages.
+
   size_t size;           // How many bytes contain this node.
   size_t used;           // How many bytes are used in this node.
   size_t blocks;         // How many blocks are here.
   size_t density;        // Minimum count of allocated bytes in this node (also alignment).
   size_t largestBlock;   // Contains largest block that can be allocated.
+  size_t binned;         // How many used bytes are cached by size-class bins.
 
   size_t* baUsed;        // Contains bits about used blocks       (0 = unused, 1 = used).
   size_t* baCont;        // Contains bits about continuous blocks (0 = stop  , 1 = continue).
@@ -413,52 +893,308 @@ struct VMemMgr::PermanentNode {
 
   PermanentNode* prev;   // Pointer to prev chunk or nullptr.
   uint8_t* mem;          // Base pointer (virtual memory address).
+  uint8_t* rwMem;        // Writable view of `mem` if dual mapped, otherwise nullptr.
   size_t size;           // Count of bytes allocated.
   size_t used;           // Count of bytes used.
 };
 
 // ============================================================================
-// [asmjit::VMemMgr - Private]
+// [asmjit::VMemMgr::ArenaChunk]
 // ============================================================================
 
 //! \internal
 //!
-//! Helper to avoid `#ifdef`s in the code.
-ASMJIT_INLINE uint8_t* vMemMgrAllocVMem(VMemMgr* self, size_t size, size_t* vSize) noexcept {
-  uint32_t flags = kVMemFlagWritable | kVMemFlagExecutable;
-#if !ASMJIT_OS_WINDOWS
-  return static_cast<uint8_t*>(VMemUtil::alloc(size, vSize, flags));
-#else
-  return static_cast<uint8_t*>(VMemUtil::allocProcessMemory(self->_hProcess, size, vSize, flags));
-#endif
-}
+//! Chunk of virtual memory that belongs to an arena, used to find the arena
+//! that owns a pointer released by a different thread.
+struct VMemMgr::ArenaChunk {
+  uint8_t* mem;          // Base pointer (virtual memory address).
+  size_t size;           // Count of bytes allocated (zero if unmapped).
+  VMemMgr* arena;        // Arena that owns the chunk.
+};
+
+// ============================================================================
+// [asmjit::VMemMgr::ArenaTable]
+// ============================================================================
 
 //! \internal
 //!
-//! Helper to avoid `#ifdef`s in the code.
-ASMJIT_INLINE Error vMemMgrReleaseVMem(VMemMgr* self, void* p, size_t vSize) noexcept {
-#if !ASMJIT_OS_WINDOWS
-  return VMemUtil::release(p, vSize);
-#else
-  return VMemUtil::releaseProcessMemory(self->_hProcess, p, vSize);
-#endif
-}
+//! Immutable table of `ArenaChunk`s sorted by address.
+//!
+//! The table is copied when a chunk is mapped or unmapped and the copy is
+//! published atomically, so threads can find the arena of a pointer without
+//! taking the lock of the owner. A replaced table is retired and released
+//! once no thread reads it.
+struct VMemMgr::ArenaTable {
+  ArenaTable* retired;   // Next retired table or nullptr.
+  size_t count;          // Count of chunks.
+  ArenaChunk chunks[1];  // Chunks, sorted by address.
+};
+
+// ============================================================================
+// [asmjit::VMemMgr::PendingRelease]
+// ============================================================================
 
 //! \internal
 //!
-//! Check whether the Red-Black tree is valid.
-static bool vMemMgrCheckTree(VMemMgr* self) noexcept {
-  return rbAssert(self->_root) > 0;
-}
+//! Release sent to an arena by a thread that doesn't own it.
+struct VMemMgr::PendingRelease {
+  PendingRelease* next;  // Next pending release or nullptr.
+  void* p;               // Pointer to release.
+};
+
+// ============================================================================
+// [asmjit::VMemMgr::Bins]
+// ============================================================================
+
+//! \internal
+enum {
+  //! Alignment of permanent allocations.
+  kVMemPermanentAlignment = 32,
+  //! Size of a virtual memory chunk holding permanent allocations.
+  kVMemPermanentNodeSize = 32768,
+
+  //! Count of size-class bins, bin `i` caches blocks of `i + 1` density units
+  //! (64 bytes to 1kB by default).
+  kVMemBinCount = 16,
+  //! Maximum count of blocks cached by a single bin.
+  kVMemBinCapacity = 32
+};
 
 //! \internal
 //!
-//! Alloc virtual memory including a heap memory needed for `MemNode` data.
-//!
-//! Returns set-up `MemNode*` or nullptr if allocation failed.
-static MemNode* vMemMgrCreateNode(VMemMgr* self, size_t size, size_t density) noexcept {
-  size_t vSize;
-  uint8_t* vmem = vMemMgrAllocVMem(self, size, &vSize);
+//! Size-class bins, small released blocks are cached here and reused by the
+//! next allocation of the same size without scanning bit arrays. Each block
+//! is kept with its node, so neither caching nor reusing it searches the tree.
+struct VMemMgr::Bins {
+  struct Item {
+    uint8_t* p;            // Address of the block.
+    MemNode* node;         // Node of the block.
+  };
+
+  size_t count[kVMemBinCount];
+  Item items[kVMemBinCount][kVMemBinCapacity];
+};
+
+// ============================================================================
+// [asmjit::VMemMgr::MovableBlock]
+// ============================================================================
+
+//! \internal
+//!
+//! Block that can be moved by `VMemMgr::compact()`.
+struct VMemMgr::MovableBlock {
+  uint8_t* p;            // Address of the block.
+  void* userData;        // User data passed to `VMemMover::move()`.
+};
+
+// ============================================================================
+// [asmjit::VMemMgr::Region]
+// ============================================================================
+
+//! \internal
+//!
+//! Address space reserved by `VMemMgr::setReservedRegion()`, chunks are
+//! committed from its free ranges (sorted by address).
+struct VMemMgr::Region {
+  struct FreeRange {
+    uint8_t* mem;        // Start of the range.
+    size_t size;         // Size of the range.
+  };
+
+  //! Get whether `p` is within the region.
+  ASMJIT_INLINE bool contains(const void* p) const noexcept {
+    return static_cast<const uint8_t*>(p) >= mem && static_cast<const uint8_t*>(p) < mem + size;
+  }
+
+  //! Get whether nothing is committed.
+  ASMJIT_INLINE bool isEmpty() const noexcept {
+    return rangeCount == 1 && ranges[0].size == size;
+  }
+
+  Lock lock;             // Lock, the region is shared by all arenas.
+  Allocator* allocator;  // Allocator of `ranges`.
+  uint8_t* mem;          // Base pointer (virtual memory address).
+  size_t size;           // Count of bytes reserved.
+
+  FreeRange* ranges;     // Free ranges.
+  size_t rangeCount;     // Count of free ranges.
+  size_t rangeCapacity;  // Capacity of `ranges`.
+};
+
+//! \internal
+//!
+//! Commit `size` bytes of `region`, returns nullptr if the region is full.
+static uint8_t* vMemRegionAlloc(Region* region, size_t size, size_t* vSize) noexcept {
+  size = Utils::alignTo<size_t>(size, VMemUtil::getPageSize());
+  AutoLock locked(region->lock);
+
+  Region::FreeRange* ranges = region->ranges;
+  size_t count = region->rangeCount;
+
+  for (size_t i = 0; i < count; i++) {
+    Region::FreeRange& range = ranges[i];
+    if (range.size < size)
+      continue;
+
+    uint8_t* p = range.mem;
+    if (VMemUtil::commit(p, size, kVMemFlagWritable | kVMemFlagExecutable) != kErrorOk)
+      return nullptr;
+
+    range.mem += size;
+    range.size -= size;
+
+    if (range.size == 0) {
+      ::memmove(&ranges[i], &ranges[i + 1], (count - i - 1) * sizeof(Region::FreeRange));
+      region->rangeCount = count - 1;
+    }
+
+    *vSize = size;
+    return p;
+  }
+
+  return nullptr;
+}
+
+//! \internal
+//!
+//! Decommit `size` bytes at `p` previously committed by `vMemRegionAlloc()`.
+static Error vMemRegionRelease(Region* region, uint8_t* p, size_t size) noexcept {
+  AutoLock locked(region->lock);
+
+  Region::FreeRange* ranges = region->ranges;
+  size_t count = region->rangeCount;
+  size_t i = 0;
+
+  while (i < count && ranges[i].mem < p)
+    i++;
+
+  bool joinPrev = i > 0 && ranges[i - 1].mem + ranges[i - 1].size == p;
+  bool joinNext = i < count && p + size == ranges[i].mem;
+
+  if (!joinPrev && !joinNext && count == region->rangeCapacity) {
+    size_t capacity = count * 2;
+    ranges = static_cast<Region::FreeRange*>(
+      MemUtil::realloc(region->allocator, ranges, capacity * sizeof(Region::FreeRange)));
+
+    // Out of memory, keep the memory committed rather than losing track of it.
+    if (ranges == nullptr)
+      return kErrorNoHeapMemory;
+
+    region->ranges = ranges;
+    region->rangeCapacity = capacity;
+  }
+
+  ASMJIT_PROPAGATE_ERROR(VMemUtil::decommit(p, size));
+
+  if (joinPrev && joinNext) {
+    ranges[i - 1].size += size + ranges[i].size;
+    ::memmove(&ranges[i], &ranges[i + 1], (count - i - 1) * sizeof(Region::FreeRange));
+    region->rangeCount = count - 1;
+  }
+  else if (joinPrev) {
+    ranges[i - 1].size += size;
+  }
+  else if (joinNext) {
+    ranges[i].mem = p;
+    ranges[i].size += size;
+  }
+  else {
+    ::memmove(&ranges[i + 1], &ranges[i], (count - i) * sizeof(Region::FreeRange));
+    ranges[i].mem = p;
+    ranges[i].size = size;
+    region->rangeCount = count + 1;
+  }
+
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::VMemMgr - Private]
+// ============================================================================
+
+//! \internal
+//!
+//! Helper to avoid `#ifdef`s in the code.
+//!
+//! If dual mapping is enabled `rwMem` receives a writable view of the memory
+//! returned, otherwise it's set to nullptr. If `hugePages` is not null and
+//! huge pages are enabled the memory is allocated by `allocHugePages()`.
+ASMJIT_INLINE uint8_t* vMemMgrAllocVMem(VMemMgr* self, size_t size, size_t* vSize, uint8_t** rwMem, uint32_t* hugePages) noexcept {
+  // Arenas always use the configuration of their owner.
+  const VMemMgr* config = self->_owner ? self->_owner : self;
+  *rwMem = nullptr;
+
+  if (hugePages != nullptr)
+    *hugePages = kVMemHugePagesNone;
+
+  if (config->_dualMapping)
+    return static_cast<uint8_t*>(VMemUtil::allocDualMapping(size, vSize, reinterpret_cast<void**>(rwMem)));
+
+  // Chunks are carved out of the reserved region while it has space.
+  if (config->_region != nullptr) {
+    uint8_t* p = vMemRegionAlloc(config->_region, size, vSize);
+    if (p != nullptr)
+      return p;
+  }
+
+  uint32_t flags = kVMemFlagWritable | kVMemFlagExecutable;
+#if ASMJIT_OS_WINDOWS
+  if (hugePages != nullptr && config->_hugePages && self->_hProcess == vMemGet().hProcess)
+#else
+  if (hugePages != nullptr && config->_hugePages)
+#endif // ASMJIT_OS_WINDOWS
+    return static_cast<uint8_t*>(VMemUtil::allocHugePages(size, vSize, flags, hugePages));
+
+#if !ASMJIT_OS_WINDOWS
+  return static_cast<uint8_t*>(VMemUtil::alloc(size, vSize, flags));
+#else
+  return static_cast<uint8_t*>(VMemUtil::allocProcessMemory(self->_hProcess, size, vSize, flags));
+#endif
+}
+
+//! \internal
+//!
+//! Get a writable view of `p` that is within memory `mem` mapped also at `rwMem`.
+static ASMJIT_INLINE void* vMemMgrGetRwPtr(uint8_t* mem, uint8_t* rwMem, uint8_t* p) noexcept {
+  return rwMem != nullptr ? static_cast<void*>(rwMem + (size_t)(p - mem)) : static_cast<void*>(p);
+}
+
+//! \internal
+//!
+//! Helper to avoid `#ifdef`s in the code.
+ASMJIT_INLINE Error vMemMgrReleaseVMem(VMemMgr* self, void* p, void* rwMem, size_t vSize) noexcept {
+  const VMemMgr* config = self->_owner ? self->_owner : self;
+
+  if (rwMem != nullptr)
+    return VMemUtil::releaseDualMapping(p, rwMem, vSize);
+
+  if (config->_region != nullptr && config->_region->contains(p))
+    return vMemRegionRelease(config->_region, static_cast<uint8_t*>(p), vSize);
+
+#if !ASMJIT_OS_WINDOWS
+  return VMemUtil::release(p, vSize);
+#else
+  return VMemUtil::releaseProcessMemory(self->_hProcess, p, vSize);
+#endif
+}
+
+//! \internal
+//!
+//! Check whether the Red-Black tree is valid.
+static bool vMemMgrCheckTree(VMemMgr* self) noexcept {
+  return rbAssert(self->_root) > 0;
+}
+
+//! \internal
+//!
+//! Alloc virtual memory including a heap memory needed for `MemNode` data.
+//!
+//! Returns set-up `MemNode*` or nullptr if allocation failed.
+static MemNode* vMemMgrCreateNode(VMemMgr* self, size_t size, size_t density) noexcept {
+  size_t vSize;
+  uint8_t* rwMem;
+  uint32_t hugePages;
+  uint8_t* vmem = vMemMgrAllocVMem(self, size, &vSize, &rwMem, &hugePages);
 
   // Out of memory.
   if (vmem == nullptr)
@@ -467,14 +1203,14 @@ static MemNode* vMemMgrCreateNode(VMemMgr* self, size_t size, size_t density) no
   size_t blocks = (vSize / density);
   size_t bsize = (((blocks + 7) >> 3) + sizeof(size_t) - 1) & ~(size_t)(sizeof(size_t) - 1);
 
-  MemNode* node = static_cast<MemNode*>(ASMJIT_ALLOC(sizeof(MemNode)));
-  uint8_t* data = static_cast<uint8_t*>(ASMJIT_ALLOC(bsize * 2));
+  MemNode* node = static_cast<MemNode*>(MemUtil::alloc(self->_allocator, sizeof(MemNode)));
+  uint8_t* data = static_cast<uint8_t*>(MemUtil::alloc(self->_allocator, bsize * 2));
 
   // Out of memory.
   if (node == nullptr || data == nullptr) {
-    vMemMgrReleaseVMem(self, vmem, vSize);
-    if (node) ASMJIT_FREE(node);
-    if (data) ASMJIT_FREE(data);
+    vMemMgrReleaseVMem(self, vmem, rwMem, vSize);
+    if (node) MemUtil::release(self->_allocator, node);
+    if (data) MemUtil::release(self->_allocator, data);
     return nullptr;
   }
 
@@ -487,12 +1223,15 @@ static MemNode* vMemMgrCreateNode(VMemMgr* self, size_t size, size_t density) no
   // Initialize MemNode data.
   node->prev = nullptr;
   node->next = nullptr;
+  node->rwMem = rwMem;
+  node->hugePages = hugePages;
 
   node->size = vSize;
   node->used = 0;
   node->blocks = blocks;
   node->density = density;
   node->largestBlock = vSize;
+  node->binned = 0;
 
   ::memset(data, 0, bsize * 2);
   node->baUsed = reinterpret_cast<size_t*>(data);
@@ -709,280 +1448,306 @@ static MemNode* vMemMgrFindNodeByPtr(VMemMgr* self, uint8_t* mem) noexcept {
   return node;
 }
 
-static void* vMemMgrAllocPermanent(VMemMgr* self, size_t vSize) noexcept {
-  static const size_t permanentAlignment = 32;
-  static const size_t permanentNodeSize  = 32768;
-
-  vSize = Utils::alignTo<size_t>(vSize, permanentAlignment);
+//! \internal
+//!
+//! Release all retired tables of `self`, no thread can read them anymore.
+static void vMemMgrReleaseRetiredTables(VMemMgr* self) noexcept {
+  ArenaTable* table = self->_arenaRetired;
+  self->_arenaRetired = nullptr;
+
+  while (table != nullptr) {
+    ArenaTable* next = table->retired;
+    MemUtil::release(self->_allocator, table);
+    table = next;
+  }
+}
 
-  AutoLock locked(self->_lock);
-  PermanentNode* node = self->_permanent;
+//! \internal
+//!
+//! Replace the arena table of `self` by a copy that contains `added` (if not
+//! nullptr) and doesn't contain a chunk at `removed` (if not nullptr), the
+//! lock of `self` must be held. Returns false if out of memory.
+static bool vMemMgrUpdateArenaTable(VMemMgr* self, const ArenaChunk* added, const uint8_t* removed) noexcept {
+  ArenaTable* prev = self->_arenaTable;
+  size_t prevCount = prev ? prev->count : static_cast<size_t>(0);
+  size_t capacity = prevCount + (added != nullptr);
+
+  ArenaTable* table = nullptr;
+  if (capacity != 0) {
+    table = static_cast<ArenaTable*>(MemUtil::alloc(self->_allocator,
+      sizeof(ArenaTable) + (capacity - 1) * sizeof(ArenaChunk)));
+
+    if (table == nullptr)
+      return false;
+
+    size_t count = 0;
+    for (size_t i = 0; i < prevCount; i++) {
+      const ArenaChunk& chunk = prev->chunks[i];
+
+      if (added != nullptr && added->mem < chunk.mem) {
+        table->chunks[count++] = *added;
+        added = nullptr;
+      }
 
-  // Try to find space in allocated chunks.
-  while (node && vSize > node->getAvailable())
-    node = node->prev;
+      // Chunks unmapped when out of memory have zero size, drop them now.
+      if (chunk.mem != removed && chunk.size != 0)
+        table->chunks[count++] = chunk;
+    }
 
-  // Or allocate new node.
-  if (node == nullptr) {
-    size_t nodeSize = permanentNodeSize;
+    if (added != nullptr)
+      table->chunks[count++] = *added;
 
-    if (nodeSize < vSize)
-      nodeSize = vSize;
+    table->retired = nullptr;
+    table->count = count;
+  }
 
-    node = static_cast<PermanentNode*>(ASMJIT_ALLOC(sizeof(PermanentNode)));
+  // The CAS is a full barrier. A thread that starts reading after the count
+  // of readers is checked below sees the new table, so all retired tables can
+  // be released if there are no readers at that moment. Otherwise they are
+  // released by a later update or when the arenas are destroyed.
+  vMemAtomicCas(reinterpret_cast<void* volatile*>(&self->_arenaTable), prev, table);
+  self->_arenaChunkCount = table ? table->count : static_cast<size_t>(0);
 
-    // Out of memory.
-    if (node == nullptr)
-      return nullptr;
+  if (prev != nullptr) {
+    prev->retired = self->_arenaRetired;
+    self->_arenaRetired = prev;
+  }
 
-    node->mem = vMemMgrAllocVMem(self, nodeSize, &node->size);
+  if (self->_arenaReaders == 0)
+    vMemMgrReleaseRetiredTables(self);
 
-    // Out of memory.
-    if (node->mem == nullptr) {
-      ASMJIT_FREE(node);
-      return nullptr;
-    }
+  return true;
+}
 
-    node->used = 0;
-    node->prev = self->_permanent;
-    self->_permanent = node;
+//! \internal
+//!
+//! Release the arena table and all retired tables of `self`, no thread can
+//! read them anymore.
+static void vMemMgrResetArenaTable(VMemMgr* self) noexcept {
+  ArenaTable* table = self->_arenaTable;
+  if (table != nullptr) {
+    table->retired = self->_arenaRetired;
+    self->_arenaRetired = table;
   }
 
-  // Finally, copy function code to our space we reserved for.
-  uint8_t* result = node->mem + node->used;
-
-  // Update Statistics.
-  node->used += vSize;
-  self->_usedBytes += vSize;
-
-  // Code can be null to only reserve space for code.
-  return static_cast<void*>(result);
+  vMemMgrReleaseRetiredTables(self);
+  self->_arenaTable = nullptr;
+  self->_arenaChunkCount = 0;
 }
 
-static void* vMemMgrAllocFreeable(VMemMgr* self, size_t vSize) noexcept {
-  // Current index.
-  size_t i;
+//! \internal
+//!
+//! Register a chunk of virtual memory allocated by `arena`.
+static bool vMemMgrRegisterChunk(VMemMgr* self, uint8_t* mem, size_t size, VMemMgr* arena) noexcept {
+  AutoLock locked(self->_lock);
 
-  // How many we need to be freed.
-  size_t need;
-  size_t minVSize;
+  ArenaChunk chunk;
+  chunk.mem = mem;
+  chunk.size = size;
+  chunk.arena = arena;
 
-  // Align to 32 bytes by default.
-  vSize = Utils::alignTo<size_t>(vSize, 32);
-  if (vSize == 0)
-    return nullptr;
+  return vMemMgrUpdateArenaTable(self, &chunk, nullptr);
+}
 
+//! \internal
+//!
+//! Unregister a chunk of virtual memory previously registered by
+//! `vMemMgrRegisterChunk()`.
+static void vMemMgrUnregisterChunk(VMemMgr* self, uint8_t* mem) noexcept {
   AutoLock locked(self->_lock);
-  MemNode* node = self->_optimal;
-  minVSize = self->_blockSize;
 
-  // Try to find memory block in existing nodes.
-  while (node) {
-    // Skip this node?
-    if ((node->getAvailable() < vSize) || (node->largestBlock < vSize && node->largestBlock != 0)) {
-      MemNode* next = node->next;
+  if (vMemMgrUpdateArenaTable(self, nullptr, mem))
+    return;
 
-      if (node->getAvailable() < minVSize && node == self->_optimal && next)
-        self->_optimal = next;
+  // Out of memory - keep the chunk in the table, but make it never match. It's
+  // dropped by the next update.
+  ArenaTable* table = self->_arenaTable;
+  ASMJIT_ASSERT(table != nullptr);
 
-      node = next;
-      continue;
+  for (size_t i = 0; i < table->count; i++) {
+    if (table->chunks[i].mem == mem) {
+      table->chunks[i].size = 0;
+      return;
     }
+  }
 
-    size_t* up = node->baUsed;     // Current ubits address.
-    size_t ubits;                  // Current ubits[0] value.
-    size_t bit;                    // Current bit mask.
-    size_t blocks = node->blocks;  // Count of blocks in node.
-    size_t cont = 0;               // How many bits are currently freed in find loop.
-    size_t maxCont = 0;            // Largest continuous block (bits count).
-    size_t j;
-
-    need = M_DIV((vSize + node->density - 1), node->density);
-    i = 0;
-
-    // Try to find node that is large enough.
-    while (i < blocks) {
-      ubits = *up++;
-
-      // Fast skip used blocks.
-      if (ubits == ~(size_t)0) {
-        if (cont > maxCont)
-          maxCont = cont;
-        cont = 0;
+  ASMJIT_ASSERT(!"Chunk not registered");
+}
 
-        i += kBitsPerEntity;
-        continue;
+//! \internal
+//!
+//! Find the arena that owns `p`, returns nullptr if there is no such arena.
+//!
+//! Doesn't lock, the table read is kept alive by the count of readers.
+static VMemMgr* vMemMgrFindArenaByPtr(VMemMgr* self, uint8_t* p) noexcept {
+  VMemMgr* arena = nullptr;
+  vMemAtomicInc(&self->_arenaReaders);
+
+  const ArenaTable* table = self->_arenaTable;
+  if (table != nullptr) {
+    size_t lo = 0;
+    size_t hi = table->count;
+
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      const ArenaChunk& chunk = table->chunks[mid];
+
+      if (p < chunk.mem) {
+        hi = mid;
       }
+      else if (p >= chunk.mem + chunk.size) {
+        lo = mid + 1;
+      }
+      else {
+        arena = chunk.arena;
+        break;
+      }
+    }
+  }
 
-      size_t max = kBitsPerEntity;
-      if (i + max > blocks)
-        max = blocks - i;
-
-      for (j = 0, bit = 1; j < max; bit <<= 1) {
-        j++;
-        if ((ubits & bit) == 0) {
-          if (++cont == need) {
-            i += j;
-            i -= cont;
-            goto L_Found;
-          }
-
-          continue;
-        }
+  vMemAtomicDec(&self->_arenaReaders);
+  return arena;
+}
 
-        if (cont > maxCont) maxCont = cont;
-        cont = 0;
-      }
+//! \internal
+//!
+//! Thread ordinal, assigned on the first use of arenas by the thread.
+static ASMJIT_VMEM_TLS uint32_t vMemThreadOrdinal;
+//! \internal
+//!
+//! Count of thread ordinals assigned so far.
+static volatile uint32_t vMemThreadCount;
 
-      i += kBitsPerEntity;
-    }
+//! \internal
+//!
+//! Get the arena of the current thread.
+static ASMJIT_INLINE VMemMgr* vMemMgrGetArena(VMemMgr* self) noexcept {
+  uint32_t ordinal = vMemThreadOrdinal;
+  if (ordinal == 0)
+    vMemThreadOrdinal = ordinal = vMemAtomicInc(&vMemThreadCount);
+  return &self->_arenas[(ordinal - 1) % self->_arenaCount];
+}
 
-    // Because we traversed the entire node, we can set largest node size that
-    // will be used to cache next traversing.
-    node->largestBlock = maxCont * node->density;
+//! \internal
+//!
+//! Get the count of blocks allocated at `bitpos`, stops counting at `limit`.
+static ASMJIT_INLINE size_t vMemMgrGetBlockCount(const MemNode* node, size_t bitpos, size_t limit) noexcept {
+  size_t count = 1;
+  while (count < limit) {
+    size_t i = bitpos / kBitsPerEntity;
+    size_t bit = (size_t)1 << (bitpos % kBitsPerEntity);
+
+    if ((node->baCont[i] & bit) == 0)
+      break;
 
-    node = node->next;
+    bitpos++;
+    count++;
   }
+  return count;
+}
 
-  // If we are here, we failed to find existing memory block and we must
-  // allocate a new one.
-  {
-    size_t blockSize = self->_blockSize;
-    if (blockSize < vSize)
-      blockSize = vSize;
-
-    node = vMemMgrCreateNode(self, blockSize, self->_blockDensity);
-    if (node == nullptr)
-      return nullptr;
+//! \internal
+//!
+//! Pop a cached block of `blockCount` blocks from size-class bins.
+static ASMJIT_INLINE void* vMemMgrBinPop(VMemMgr* self, size_t blockCount, void** rwPtr) noexcept {
+  Bins* bins = self->_bins;
+  size_t binIndex = blockCount - 1;
 
-    // Update binary tree.
-    vMemMgrInsertNode(self, node);
-    ASMJIT_ASSERT(vMemMgrCheckTree(self));
+  if (bins == nullptr || binIndex >= kVMemBinCount || bins->count[binIndex] == 0)
+    return nullptr;
 
-    // Alloc first node at start.
-    i = 0;
-    need = (vSize + node->density - 1) / node->density;
+  const Bins::Item& item = bins->items[binIndex][--bins->count[binIndex]];
+  MemNode* node = item.node;
 
-    // Update statistics.
-    self->_allocatedBytes += node->size;
-  }
+  node->binned -= blockCount * node->density;
 
-L_Found:
-  // Update bits.
-  _SetBits(node->baUsed, i, need);
-  _SetBits(node->baCont, i, need - 1);
+  *rwPtr = vMemMgrGetRwPtr(node->mem, node->rwMem, item.p);
+  return item.p;
+}
 
-  // Update statistics.
-  {
-    size_t u = need * node->density;
-    node->used += u;
-    node->largestBlock = 0;
-    self->_usedBytes += u;
+//! \internal
+//!
+//! Push a block `p` of `blockCount` blocks of `node` to size-class bins,
+//! returns `false` if the block is too large or the bin is full.
+static ASMJIT_INLINE bool vMemMgrBinPush(VMemMgr* self, MemNode* node, void* p, size_t blockCount) noexcept {
+  Bins* bins = self->_bins;
+  size_t binIndex = blockCount - 1;
+
+  if (binIndex >= kVMemBinCount)
+    return false;
+
+  if (bins == nullptr) {
+    bins = static_cast<Bins*>(MemUtil::alloc(self->_allocator, sizeof(Bins)));
+    if (bins == nullptr)
+      return false;
+
+    ::memset(bins->count, 0, sizeof(bins->count));
+    self->_bins = bins;
   }
 
-  // And return pointer to allocated memory.
-  uint8_t* result = node->mem + i * node->density;
-  ASMJIT_ASSERT(result >= node->mem && result <= node->mem + node->size - vSize);
-  return result;
+  if (bins->count[binIndex] == kVMemBinCapacity)
+    return false;
+
+  Bins::Item& item = bins->items[binIndex][bins->count[binIndex]++];
+  item.p = static_cast<uint8_t*>(p);
+  item.node = node;
+  return true;
 }
 
 //! \internal
 //!
-//! Reset the whole `VMemMgr` instance, freeing all heap memory allocated an
-//! virtual memory allocated unless `keepVirtualMemory` is true (and this is
-//! only used when writing data to a remote process).
-static void vMemMgrReset(VMemMgr* self, bool keepVirtualMemory) noexcept {
-  MemNode* node = self->_first;
+//! Replace `from` by `to` in size-class bins, called when data of node `from`
+//! is moved to `to` by `vMemMgrRemoveNode()`.
+static void vMemMgrBinReplaceNode(VMemMgr* self, MemNode* from, MemNode* to) noexcept {
+  Bins* bins = self->_bins;
+  if (bins == nullptr)
+    return;
 
-  while (node != nullptr) {
-    MemNode* next = node->next;
+  for (size_t binIndex = 0; binIndex < kVMemBinCount; binIndex++) {
+    Bins::Item* items = bins->items[binIndex];
+    size_t count = bins->count[binIndex];
 
-    if (!keepVirtualMemory)
-      vMemMgrReleaseVMem(self, node->mem, node->size);
-
-    ASMJIT_FREE(node->baUsed);
-    ASMJIT_FREE(node);
-
-    node = next;
+    for (size_t j = 0; j < count; j++) {
+      if (items[j].node == from)
+        items[j].node = to;
+    }
   }
-
-  self->_allocatedBytes = 0;
-  self->_usedBytes = 0;
-
-  self->_root = nullptr;
-  self->_first = nullptr;
-  self->_last = nullptr;
-  self->_optimal = nullptr;
-}
-
-// ============================================================================
-// [asmjit::VMemMgr - Construction / Destruction]
-// ============================================================================
-
-#if !ASMJIT_OS_WINDOWS
-VMemMgr::VMemMgr() noexcept
-#else
-VMemMgr::VMemMgr(HANDLE hProcess) noexcept
-  : _hProcess(vMemGet().getSafeProcessHandle(hProcess))
-#endif // ASMJIT_OS_WINDOWS
-{
-  _blockSize = VMemUtil::getPageGranularity();
-  _blockDensity = 64;
-
-  _allocatedBytes = 0;
-  _usedBytes = 0;
-
-  _root = nullptr;
-  _first = nullptr;
-  _last = nullptr;
-  _optimal = nullptr;
-
-  _permanent = nullptr;
-  _keepVirtualMemory = false;
 }
 
-VMemMgr::~VMemMgr() noexcept {
-  // Freeable memory cleanup - Also frees the virtual memory if configured to.
-  vMemMgrReset(this, _keepVirtualMemory);
+//! \internal
+//!
+//! Unmap `node` and remove it from `self`, the lock of `self` must be held.
+static void vMemMgrReleaseNode(VMemMgr* self, MemNode* node) noexcept {
+  // Unregister the chunk before it's unmapped if this is an arena.
+  if (self->_owner != nullptr)
+    vMemMgrUnregisterChunk(self->_owner, node->mem);
 
-  // Permanent memory cleanup - Never frees the virtual memory.
-  PermanentNode* node = _permanent;
-  while (node) {
-    PermanentNode* prev = node->prev;
-    ASMJIT_FREE(node);
-    node = prev;
-  }
-}
+  // Free memory associated with node (this memory is not accessed
+  // anymore so it's safe).
+  vMemMgrReleaseVMem(self, node->mem, node->rwMem, node->size);
+  MemUtil::release(self->_allocator, node->baUsed);
 
-// ============================================================================
-// [asmjit::VMemMgr - Reset]
-// ============================================================================
+  node->baUsed = nullptr;
+  node->baCont = nullptr;
 
-void VMemMgr::reset() noexcept {
-  vMemMgrReset(this, false);
-}
+  // Statistics.
+  self->_allocatedBytes -= node->size;
 
-// ============================================================================
-// [asmjit::VMemMgr - Alloc / Release]
-// ============================================================================
+  // Remove node. This function can return different node than
+  // passed into, but data is copied into previous node if needed.
+  MemNode* removed = vMemMgrRemoveNode(self, node);
+  if (removed != node)
+    vMemMgrBinReplaceNode(self, removed, node);
 
-void* VMemMgr::alloc(size_t size, uint32_t type) noexcept {
-  if (type == kVMemAllocPermanent)
-    return vMemMgrAllocPermanent(this, size);
-  else
-    return vMemMgrAllocFreeable(this, size);
+  MemUtil::release(self->_allocator, removed);
+  ASMJIT_ASSERT(vMemMgrCheckTree(self));
 }
 
-Error VMemMgr::release(void* p) noexcept {
-  if (p == nullptr)
-    return kErrorOk;
-
-  AutoLock locked(_lock);
-  MemNode* node = vMemMgrFindNodeByPtr(this, static_cast<uint8_t*>(p));
-
-  if (node == nullptr)
-    return kErrorInvalidArgument;
-
+//! \internal
+//!
+//! Clear blocks of `p` in `node`, the lock of `self` must be held. The node
+//! is kept even if it becomes empty.
+static void vMemMgrClearBlocks(VMemMgr* self, MemNode* node, void* p) noexcept {
   size_t offset = (size_t)((uint8_t*)p - (uint8_t*)node->mem);
   size_t bitpos = M_DIV(offset, node->density);
   size_t i = (bitpos / kBitsPerEntity);
@@ -1019,12 +1784,12 @@ Error VMemMgr::release(void* p) noexcept {
   // If the freed block is fully allocated node then it's needed to
   // update 'optimal' pointer in memory manager.
   if (node->used == node->size) {
-    MemNode* cur = _optimal;
+    MemNode* cur = self->_optimal;
 
     do {
       cur = cur->prev;
       if (cur == node) {
-        _optimal = node;
+        self->_optimal = node;
         break;
       }
     } while (cur);
@@ -1036,40 +1801,193 @@ Error VMemMgr::release(void* p) noexcept {
     node->largestBlock = cont;
 
   node->used -= cont;
-  _usedBytes -= cont;
+  self->_usedBytes -= cont;
+}
+
+//! \internal
+//!
+//! Free blocks of `p` in `node`, the lock of `self` must be held.
+//!
+//! Returns `true` if the node became empty and was released.
+static bool vMemMgrFreeBlocks(VMemMgr* self, MemNode* node, void* p) noexcept {
+  vMemMgrClearBlocks(self, node, p);
 
   // If page is empty, we can free it.
-  if (node->used == 0) {
-    // Free memory associated with node (this memory is not accessed
-    // anymore so it's safe).
-    vMemMgrReleaseVMem(this, node->mem, node->size);
-    ASMJIT_FREE(node->baUsed);
+  if (node->used != 0)
+    return false;
+
+  vMemMgrReleaseNode(self, node);
+  return true;
+}
 
-    node->baUsed = nullptr;
-    node->baCont = nullptr;
+//! \internal
+//!
+//! Return all blocks of `node` cached by size-class bins to its bit arrays,
+//! the lock of `self` must be held. The node is released if it becomes empty.
+static void vMemMgrEvictNode(VMemMgr* self, MemNode* node) noexcept {
+  Bins* bins = self->_bins;
+
+  for (size_t binIndex = 0; binIndex < kVMemBinCount; binIndex++) {
+    Bins::Item* items = bins->items[binIndex];
+    size_t j = 0;
+
+    while (j < bins->count[binIndex]) {
+      if (items[j].node != node) {
+        j++;
+        continue;
+      }
+
+      uint8_t* p = items[j].p;
+      items[j] = items[--bins->count[binIndex]];
 
-    // Statistics.
-    _allocatedBytes -= node->size;
+      // Freeing blocks expects them to be accounted as used.
+      size_t size = (binIndex + 1) * node->density;
+      node->binned -= size;
+      self->_usedBytes += size;
 
-    // Remove node. This function can return different node than
-    // passed into, but data is copied into previous node if needed.
-    ASMJIT_FREE(vMemMgrRemoveNode(this, node));
-    ASMJIT_ASSERT(vMemMgrCheckTree(this));
+      // The node is released by the last call, don't touch it after.
+      if (vMemMgrFreeBlocks(self, node, p))
+        return;
+    }
   }
+}
 
-  return kErrorOk;
+//! \internal
+//!
+//! Get the index of the first movable block at or after `p`.
+static size_t vMemMgrLowerMovable(const VMemMgr* self, const uint8_t* p) noexcept {
+  const MovableBlock* movables = self->_movables;
+  size_t lo = 0;
+  size_t hi = self->_movableCount;
+
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (movables[mid].p < p)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
 }
 
-Error VMemMgr::shrink(void* p, size_t used) noexcept {
-  if (p == nullptr)
+//! \internal
+//!
+//! Add or update a movable block `p`.
+static bool vMemMgrAddMovable(VMemMgr* self, uint8_t* p, void* userData) noexcept {
+  size_t count = self->_movableCount;
+  size_t i = vMemMgrLowerMovable(self, p);
+
+  if (i < count && self->_movables[i].p == p) {
+    self->_movables[i].userData = userData;
+    return true;
+  }
+
+  if (count == self->_movableCapacity) {
+    size_t capacity = count ? count * 2 : 64;
+    MovableBlock* movables = static_cast<MovableBlock*>(
+      MemUtil::realloc(self->_allocator, self->_movables, capacity * sizeof(MovableBlock)));
+
+    // Out of memory.
+    if (movables == nullptr)
+      return false;
+
+    self->_movables = movables;
+    self->_movableCapacity = capacity;
+  }
+
+  MovableBlock* movables = self->_movables;
+  ::memmove(&movables[i + 1], &movables[i], (count - i) * sizeof(MovableBlock));
+
+  movables[i].p = p;
+  movables[i].userData = userData;
+
+  self->_movableCount = count + 1;
+  return true;
+}
+
+//! \internal
+//!
+//! Remove a movable block `p`, does nothing if `p` is not movable.
+static void vMemMgrRemoveMovable(VMemMgr* self, uint8_t* p) noexcept {
+  size_t count = self->_movableCount;
+  size_t i = vMemMgrLowerMovable(self, p);
+
+  if (i == count || self->_movables[i].p != p)
+    return;
+
+  MovableBlock* movables = self->_movables;
+  ::memmove(&movables[i], &movables[i + 1], (count - i - 1) * sizeof(MovableBlock));
+  self->_movableCount = count - 1;
+}
+
+//! \internal
+//!
+//! Release `p`, the lock of `self` must be held.
+//!
+//! Small blocks are kept in size-class bins (still marked as used in bit
+//! arrays) so the next allocation of the same size doesn't have to scan them.
+static Error vMemMgrReleaseLocked(VMemMgr* self, void* p) noexcept {
+  MemNode* node = vMemMgrFindNodeByPtr(self, static_cast<uint8_t*>(p));
+
+  if (node == nullptr)
+    return kErrorInvalidArgument;
+
+  if (self->_movableCount != 0)
+    vMemMgrRemoveMovable(self, static_cast<uint8_t*>(p));
+
+  self->_releaseCount++;
+
+  size_t bitpos = M_DIV((size_t)((uint8_t*)p - node->mem), node->density);
+  size_t blockCount = vMemMgrGetBlockCount(node, bitpos, kVMemBinCount + 1);
+
+  if (vMemMgrBinPush(self, node, p, blockCount)) {
+    size_t size = blockCount * node->density;
+    node->binned += size;
+    self->_usedBytes -= size;
+  }
+  else if (vMemMgrFreeBlocks(self, node, p)) {
     return kErrorOk;
+  }
 
-  if (used == 0)
-    return release(p);
+  // Don't let the bins keep a chunk that is otherwise unused.
+  if (node->binned == node->used)
+    vMemMgrEvictNode(self, node);
+
+  return kErrorOk;
+}
+
+//! \internal
+//!
+//! Return all blocks cached by size-class bins to bit arrays, the lock of
+//! `self` must be held.
+static void vMemMgrTrimLocked(VMemMgr* self) noexcept {
+  Bins* bins = self->_bins;
+  if (bins == nullptr)
+    return;
 
-  AutoLock locked(_lock);
+  // Blocks are popped one by one, releasing a node updates nodes of blocks
+  // that are still in bins.
+  for (size_t binIndex = 0; binIndex < kVMemBinCount; binIndex++) {
+    while (bins->count[binIndex] != 0) {
+      const Bins::Item& item = bins->items[binIndex][--bins->count[binIndex]];
+      uint8_t* p = item.p;
+      MemNode* node = item.node;
+
+      // Freeing blocks expects them to be accounted as used.
+      size_t size = (binIndex + 1) * node->density;
+      node->binned -= size;
+      self->_usedBytes += size;
+      vMemMgrFreeBlocks(self, node, p);
+    }
+  }
+}
 
-  MemNode* node = vMemMgrFindNodeByPtr(this, (uint8_t*)p);
+//! \internal
+//!
+//! Shrink `p` to `used` bytes, the lock of `self` must be held.
+static Error vMemMgrShrinkLocked(VMemMgr* self, void* p, size_t used) noexcept {
+  MemNode* node = vMemMgrFindNodeByPtr(self, (uint8_t*)p);
   if (node == nullptr)
     return kErrorInvalidArgument;
 
@@ -1137,125 +2055,1275 @@ _EnterFreeLoop:
     node->largestBlock = cont;
 
   node->used -= cont;
-  _usedBytes -= cont;
+  self->_usedBytes -= cont;
 
   return kErrorOk;
 }
 
-// ============================================================================
-// [asmjit::VMem - Test]
-// ============================================================================
-
-#if defined(ASMJIT_TEST)
-static void VMemTest_fill(void* a, void* b, int i) noexcept {
-  int pattern = rand() % 256;
-  *(int *)a = i;
-  *(int *)b = i;
-  ::memset((char*)a + sizeof(int), pattern, i - sizeof(int));
-  ::memset((char*)b + sizeof(int), pattern, i - sizeof(int));
-}
-
-static void VMemTest_verify(void* a, void* b) noexcept {
-  int ai = *(int*)a;
-  int bi = *(int*)b;
+//! \internal
+//!
+//! Release all pointers sent to the arena `self` by other threads, the lock
+//! of `self` must be held.
+static void vMemMgrDrainPending(VMemMgr* self) noexcept {
+  PendingRelease* pending = self->_pending;
+  if (pending == nullptr)
+    return;
 
-  EXPECT(ai == bi,
-    "The length of 'a' (%d) and 'b' (%d) should be same", ai, bi);
+  // Detach the whole list, other threads can push to it concurrently.
+  while (!vMemAtomicCas(reinterpret_cast<void* volatile*>(&self->_pending), pending, nullptr))
+    pending = self->_pending;
 
-  EXPECT(::memcmp(a, b, ai) == 0,
-    "Pattern (%p) doesn't match", a);
-}
+  while (pending != nullptr) {
+    PendingRelease* next = pending->next;
+    vMemMgrReleaseLocked(self, pending->p);
+    MemUtil::release(self->_allocator, pending);
 
-static void VMemTest_stats(VMemMgr& memmgr) noexcept {
-  INFO("Used     : %u", static_cast<unsigned int>(memmgr.getUsedBytes()));
-  INFO("Allocated: %u", static_cast<unsigned int>(memmgr.getAllocatedBytes()));
+    // Each deferred release means that the lock was contended.
+    self->_lockContentionCount++;
+    pending = next;
+  }
 }
 
-static void VMemTest_shuffle(void** a, void** b, size_t count) noexcept {
-  for (size_t i = 0; i < count; ++i) {
-    size_t si = (size_t)rand() % count;
-
-    void* ta = a[i];
-    void* tb = b[i];
-
-    a[i] = a[si];
-    b[i] = b[si];
+//! \internal
+//!
+//! Unlock `self` and drain releases sent to it while it was locked. A thread
+//! that failed to lock `self` before sending a release could have left it in
+//! the queue, which would otherwise wait for the next lock of `self`.
+static void vMemMgrUnlock(VMemMgr* self) noexcept {
+  for (;;) {
+    self->_lock.unlock();
 
-    a[si] = ta;
-    b[si] = tb;
+    if (self->_pending == nullptr || !self->_lock.tryLock())
+      break;
+    vMemMgrDrainPending(self);
   }
 }
 
-UNIT(base_vmem) {
-  VMemMgr memmgr;
+//! \internal
+//!
+//! Scoped lock of `VMemMgr` that counts contention, used by paths that
+//! allocate and release memory, see `vMemMgrUnlock()`.
+struct VMemMgrAutoLock {
+  ASMJIT_NO_COPY(VMemMgrAutoLock)
+
+  ASMJIT_INLINE VMemMgrAutoLock(VMemMgr* self) noexcept : _self(self) {
+    if (!self->_lock.tryLock()) {
+      self->_lock.lock();
+      self->_lockContentionCount++;
+    }
+  }
 
-  // Should be predictible.
-  srand(100);
+  ASMJIT_INLINE ~VMemMgrAutoLock() noexcept {
+    vMemMgrUnlock(_self);
+  }
 
-  int i;
-  int kCount = 200000;
+  VMemMgr* _self;
+};
 
-  INFO("Memory alloc/free test - %d allocations.", static_cast<int>(kCount));
+//! \internal
+//!
+//! Release `p` allocated by one of the arenas of `self`.
+static Error vMemMgrArenaRelease(VMemMgr* self, void* p) noexcept {
+  // Fast path - the memory is owned by the current thread's arena.
+  VMemMgr* arena = vMemMgrGetArena(self);
+  {
+    VMemMgrAutoLock locked(arena);
+    vMemMgrDrainPending(arena);
 
-  void** a = (void**)ASMJIT_ALLOC(sizeof(void*) * kCount);
-  void** b = (void**)ASMJIT_ALLOC(sizeof(void*) * kCount);
+    if (vMemMgrFindNodeByPtr(arena, static_cast<uint8_t*>(p)) != nullptr)
+      return vMemMgrReleaseLocked(arena, p);
+  }
 
-  EXPECT(a != nullptr && b != nullptr,
-    "Couldn't allocate %u bytes on heap.", kCount * 2);
+  // Slow path - the memory is owned by another arena.
+  arena = vMemMgrFindArenaByPtr(self, static_cast<uint8_t*>(p));
+  if (arena == nullptr)
+    return kErrorInvalidArgument;
 
-  INFO("Allocating virtual memory...");
-  for (i = 0; i < kCount; i++) {
-    int r = (rand() % 1000) + 4;
+  if (arena->_lock.tryLock()) {
+    vMemMgrDrainPending(arena);
+    Error err = vMemMgrReleaseLocked(arena, p);
 
-    a[i] = memmgr.alloc(r);
-    EXPECT(a[i] != nullptr,
-      "Couldn't allocate %d bytes of virtual memory", r);
-    ::memset(a[i], 0, r);
+    vMemMgrUnlock(arena);
+    return err;
   }
-  VMemTest_stats(memmgr);
 
-  INFO("Freeing virtual memory...");
-  for (i = 0; i < kCount; i++) {
-    EXPECT(memmgr.release(a[i]) == kErrorOk,
-      "Failed to free %p.", b[i]);
+  // The arena is busy, send `p` to its pending list. The chunk that contains
+  // `p` can't be unmapped until it's released, so it's safe to defer it. The
+  // list is drained by the thread that holds the lock when it unlocks.
+  PendingRelease* pending = static_cast<PendingRelease*>(MemUtil::alloc(arena->_allocator, sizeof(PendingRelease)));
+  if (pending == nullptr) {
+    VMemMgrAutoLock locked(arena);
+    return vMemMgrReleaseLocked(arena, p);
   }
-  VMemTest_stats(memmgr);
-
-  INFO("Verified alloc/free test - %d allocations.", static_cast<int>(kCount));
-  for (i = 0; i < kCount; i++) {
-    int r = (rand() % 1000) + 4;
-
-    a[i] = memmgr.alloc(r);
-    EXPECT(a[i] != nullptr,
-      "Couldn't allocate %d bytes of virtual memory.", r);
 
-    b[i] = ASMJIT_ALLOC(r);
-    EXPECT(b[i] != nullptr,
-      "Couldn't allocate %d bytes on heap.", r);
+  pending->p = p;
+  do {
+    pending->next = arena->_pending;
+  } while (!vMemAtomicCas(reinterpret_cast<void* volatile*>(&arena->_pending), pending->next, pending));
 
-    VMemTest_fill(a[i], b[i], r);
+  // The lock could have been released before `p` was queued, drain it here if
+  // nobody holds the lock now.
+  if (arena->_lock.tryLock()) {
+    vMemMgrDrainPending(arena);
+    vMemMgrUnlock(arena);
   }
-  VMemTest_stats(memmgr);
 
-  INFO("Shuffling...");
-  VMemTest_shuffle(a, b, kCount);
+  return kErrorOk;
+}
 
-  INFO("Verify and free...");
-  for (i = 0; i < kCount / 2; i++) {
-    VMemTest_verify(a[i], b[i]);
-    EXPECT(memmgr.release(a[i]) == kErrorOk,
-      "Failed to free %p.", a[i]);
-    ASMJIT_FREE(b[i]);
+//! \internal
+//!
+//! Shrink `p` allocated by one of the arenas of `self`.
+static Error vMemMgrArenaShrink(VMemMgr* self, void* p, size_t used) noexcept {
+  VMemMgr* arena = vMemMgrGetArena(self);
+  {
+    VMemMgrAutoLock locked(arena);
+    if (vMemMgrFindNodeByPtr(arena, static_cast<uint8_t*>(p)) != nullptr)
+      return vMemMgrShrinkLocked(arena, p, used);
   }
-  VMemTest_stats(memmgr);
 
-  INFO("Alloc again.");
-  for (i = 0; i < kCount / 2; i++) {
-    int r = (rand() % 1000) + 4;
+  arena = vMemMgrFindArenaByPtr(self, static_cast<uint8_t*>(p));
+  if (arena == nullptr)
+    return kErrorInvalidArgument;
 
-    a[i] = memmgr.alloc(r);
-    EXPECT(a[i] != nullptr,
-      "Couldn't allocate %d bytes of virtual memory.", r);
+  VMemMgrAutoLock locked(arena);
+  return vMemMgrShrinkLocked(arena, p, used);
+}
+
+static void* vMemMgrAllocPermanent(VMemMgr* self, size_t vSize, void** rwPtr) noexcept {
+  vSize = Utils::alignTo<size_t>(vSize, kVMemPermanentAlignment);
+
+  VMemMgrAutoLock locked(self);
+  PermanentNode* node = self->_permanent;
+
+  // Try to find space in allocated chunks.
+  while (node && vSize > node->getAvailable())
+    node = node->prev;
+
+  // Or allocate new node.
+  if (node == nullptr) {
+    size_t nodeSize = kVMemPermanentNodeSize;
+
+    if (nodeSize < vSize)
+      nodeSize = vSize;
+
+    node = static_cast<PermanentNode*>(MemUtil::alloc(self->_allocator, sizeof(PermanentNode)));
+
+    // Out of memory.
+    if (node == nullptr)
+      return nullptr;
+
+    node->mem = vMemMgrAllocVMem(self, nodeSize, &node->size, &node->rwMem, nullptr);
+
+    // Out of memory.
+    if (node->mem == nullptr) {
+      MemUtil::release(self->_allocator, node);
+      return nullptr;
+    }
+
+    node->used = 0;
+    node->prev = self->_permanent;
+    self->_permanent = node;
+  }
+
+  // Finally, copy function code to our space we reserved for.
+  uint8_t* result = node->mem + node->used;
+
+  // Update Statistics.
+  node->used += vSize;
+  self->_usedBytes += vSize;
+  self->_allocCount++;
+
+  // Code can be null to only reserve space for code.
+  *rwPtr = vMemMgrGetRwPtr(node->mem, node->rwMem, result);
+  return static_cast<void*>(result);
+}
+
+//! \internal
+//!
+//! Find `need` continuous free blocks in `node`.
+//!
+//! Returns the index of the first block or `kInvalidIndex` if there is no
+//! space, in that case the `largestBlock` of `node` is updated.
+static size_t vMemMgrFindBlocks(MemNode* node, size_t need) noexcept {
+  size_t* up = node->baUsed;     // Current ubits address.
+  size_t ubits;                  // Current ubits[0] value.
+  size_t bit;                    // Current bit mask.
+  size_t blocks = node->blocks;  // Count of blocks in node.
+  size_t cont = 0;               // How many bits are currently freed in find loop.
+  size_t maxCont = 0;            // Largest continuous block (bits count).
+  size_t i = 0;
+  size_t j;
+
+  // Try to find node that is large enough.
+  while (i < blocks) {
+    ubits = *up++;
+
+    // Fast skip used blocks.
+    if (ubits == ~(size_t)0) {
+      if (cont > maxCont)
+        maxCont = cont;
+      cont = 0;
+
+      i += kBitsPerEntity;
+      continue;
+    }
+
+    size_t max = kBitsPerEntity;
+    if (i + max > blocks)
+      max = blocks - i;
+
+    for (j = 0, bit = 1; j < max; bit <<= 1) {
+      j++;
+      if ((ubits & bit) == 0) {
+        if (++cont == need)
+          return i + j - cont;
+        continue;
+      }
+
+      if (cont > maxCont) maxCont = cont;
+      cont = 0;
+    }
+
+    i += kBitsPerEntity;
+  }
+
+  // Because we traversed the entire node, we can set largest node size that
+  // will be used to cache next traversing.
+  if (cont > maxCont)
+    maxCont = cont;
+
+  node->largestBlock = maxCont * node->density;
+  return kInvalidIndex;
+}
+
+//! \internal
+//!
+//! Mark `need` blocks starting at `i` in `node` as used and return their
+//! address.
+static uint8_t* vMemMgrMarkBlocks(VMemMgr* self, MemNode* node, size_t i, size_t need) noexcept {
+  // Update bits.
+  _SetBits(node->baUsed, i, need);
+  _SetBits(node->baCont, i, need - 1);
+
+  // Update statistics.
+  size_t u = need * node->density;
+  node->used += u;
+  node->largestBlock = 0;
+  self->_usedBytes += u;
+
+  return node->mem + i * node->density;
+}
+
+static void* vMemMgrAllocFreeable(VMemMgr* self, size_t vSize, void** rwPtr) noexcept {
+  // Current index.
+  size_t i;
+
+  // How many we need to be freed.
+  size_t need;
+  size_t minVSize;
+
+  // Align to 32 bytes by default.
+  vSize = Utils::alignTo<size_t>(vSize, 32);
+  if (vSize == 0)
+    return nullptr;
+
+  VMemMgrAutoLock locked(self);
+  vMemMgrDrainPending(self);
+
+  // Try size-class bins first, they don't need to scan bit arrays.
+  {
+    size_t blockCount = (vSize + self->_blockDensity - 1) / self->_blockDensity;
+    void* p = vMemMgrBinPop(self, blockCount, rwPtr);
+
+    if (p != nullptr) {
+      self->_usedBytes += blockCount * self->_blockDensity;
+      self->_allocCount++;
+      return p;
+    }
+  }
+
+  MemNode* node = self->_optimal;
+  minVSize = self->_blockSize;
+
+  // Try to find memory block in existing nodes.
+  while (node) {
+    // Skip this node?
+    if ((node->getAvailable() < vSize) || (node->largestBlock < vSize && node->largestBlock != 0)) {
+      MemNode* next = node->next;
+
+      if (node->getAvailable() < minVSize && node == self->_optimal && next)
+        self->_optimal = next;
+
+      node = next;
+      continue;
+    }
+
+    need = M_DIV((vSize + node->density - 1), node->density);
+    i = vMemMgrFindBlocks(node, need);
+
+    if (i != kInvalidIndex)
+      goto L_Found;
+
+    node = node->next;
+  }
+
+  // If we are here, we failed to find existing memory block and we must
+  // allocate a new one.
+  {
+    size_t blockSize = self->_blockSize;
+    if (blockSize < vSize)
+      blockSize = vSize;
+
+    node = vMemMgrCreateNode(self, blockSize, self->_blockDensity);
+    if (node == nullptr)
+      return nullptr;
+
+    // Arenas have to register the chunk so other threads can release it.
+    if (self->_owner != nullptr && !vMemMgrRegisterChunk(self->_owner, node->mem, node->size, self)) {
+      vMemMgrReleaseVMem(self, node->mem, node->rwMem, node->size);
+      MemUtil::release(self->_allocator, node->baUsed);
+      MemUtil::release(self->_allocator, node);
+      return nullptr;
+    }
+
+    // Update binary tree.
+    vMemMgrInsertNode(self, node);
+    ASMJIT_ASSERT(vMemMgrCheckTree(self));
+
+    // Alloc first node at start.
+    i = 0;
+    need = (vSize + node->density - 1) / node->density;
+
+    // Update statistics.
+    self->_allocatedBytes += node->size;
+  }
+
+L_Found:
+  {
+    // And return pointer to allocated memory.
+    uint8_t* result = vMemMgrMarkBlocks(self, node, i, need);
+    ASMJIT_ASSERT(result >= node->mem && result <= node->mem + node->size - vSize);
+
+    self->_allocCount++;
+
+    *rwPtr = vMemMgrGetRwPtr(node->mem, node->rwMem, result);
+    return result;
+  }
+}
+
+//! \internal
+//!
+//! Move of a movable block planned by `vMemMgrPlanEvacuation()`.
+struct VMemMgrMove {
+  uint8_t* src;          // Address of the block.
+  uint8_t* dst;          // Address reserved for the block.
+  void* dstRw;           // Address reserved for the block (RW).
+  size_t size;           // Size of the block.
+  void* userData;        // User data passed to `VMemMover::move()`.
+  bool moved;            // Whether `VMemMover::move()` succeeded.
+};
+
+//! \internal
+//!
+//! Reserve a target for every movable block of `node`, the lock of `self`
+//! must be held. `node` must contain nothing but `count` movable blocks.
+//!
+//! Returns `false` and reserves nothing if any block has no target, so a node
+//! is either evacuated entirely or not at all. Blocks are only reserved in
+//! nodes that are used at least as much as `node` was, so two nodes never
+//! exchange their blocks.
+static bool vMemMgrPlanEvacuation(VMemMgr* self, MemNode* node, VMemMgrMove* moves, size_t count) noexcept {
+  size_t minUsed = node->used;
+  size_t index = vMemMgrLowerMovable(self, node->mem);
+
+  for (size_t m = 0; m < count; m++, index++) {
+    const MovableBlock& block = self->_movables[index];
+    size_t bitpos = M_DIV((size_t)(block.p - node->mem), node->density);
+    size_t need = vMemMgrGetBlockCount(node, bitpos, node->blocks - bitpos);
+    size_t size = need * node->density;
+
+    MemNode* target;
+    size_t i = kInvalidIndex;
+
+    for (target = self->_first; target != nullptr; target = target->next) {
+      if (target == node || target->used < minUsed || target->getAvailable() < size)
+        continue;
+
+      if (target->largestBlock < size && target->largestBlock != 0)
+        continue;
+
+      i = vMemMgrFindBlocks(target, need);
+      if (i != kInvalidIndex)
+        break;
+    }
+
+    if (target == nullptr) {
+      while (m != 0) {
+        m--;
+        vMemMgrClearBlocks(self, vMemMgrFindNodeByPtr(self, moves[m].dst), moves[m].dst);
+      }
+      return false;
+    }
+
+    uint8_t* dst = vMemMgrMarkBlocks(self, target, i, need);
+
+    moves[m].src = block.p;
+    moves[m].dst = dst;
+    moves[m].dstRw = vMemMgrGetRwPtr(target->mem, target->rwMem, dst);
+    moves[m].size = size;
+    moves[m].userData = block.userData;
+    moves[m].moved = false;
+  }
+
+  return true;
+}
+
+//! \internal
+//!
+//! Finish moves planned by `vMemMgrPlanEvacuation()`, the lock of `self` must
+//! be held. Blocks that were moved are released, targets of blocks that were
+//! not moved (or released while they were being moved) are released instead.
+static void vMemMgrCommitEvacuation(VMemMgr* self, const VMemMgrMove* moves, size_t count) noexcept {
+  for (size_t m = 0; m < count; m++) {
+    const VMemMgrMove& move = moves[m];
+    size_t index = vMemMgrLowerMovable(self, move.src);
+    bool present = index < self->_movableCount && self->_movables[index].p == move.src;
+
+    if (!move.moved || !present) {
+      vMemMgrClearBlocks(self, vMemMgrFindNodeByPtr(self, move.dst), move.dst);
+      continue;
+    }
+
+    vMemMgrClearBlocks(self, vMemMgrFindNodeByPtr(self, move.src), move.src);
+
+    // Removing first guarantees that adding doesn't need to grow the array.
+    vMemMgrRemoveMovable(self, move.src);
+    vMemMgrAddMovable(self, move.dst, move.userData);
+  }
+}
+
+//! \internal
+//!
+//! Get the count of movable blocks of `node` if it contains nothing else,
+//! otherwise zero. The lock of `self` must be held.
+static size_t vMemMgrGetEvacuableCount(VMemMgr* self, MemNode* node) noexcept {
+  size_t movableBytes = 0;
+  size_t index = vMemMgrLowerMovable(self, node->mem);
+  size_t first = index;
+
+  while (index < self->_movableCount && self->_movables[index].p < node->mem + node->size) {
+    size_t bitpos = M_DIV((size_t)(self->_movables[index].p - node->mem), node->density);
+    movableBytes += vMemMgrGetBlockCount(node, bitpos, node->blocks - bitpos) * node->density;
+    index++;
+  }
+
+  return movableBytes == node->used ? index - first : 0;
+}
+
+//! \internal
+//!
+//! Compact memory of `self`, locks `self` and returns the count of nodes
+//! released.
+//!
+//! Moves of a node are planned with the lock held, targets are reserved so
+//! other threads can't use them. The lock is released while `mover` is called,
+//! so it can allocate and release memory of `self`, and the moves are finished
+//! once the lock is held again. Nodes are referenced by their address while the
+//! lock is not held, because other threads can release them.
+static size_t vMemMgrCompact(VMemMgr* self, VMemMover* mover) noexcept {
+  self->_lock.lock();
+
+  if (self->_compacting) {
+    vMemMgrUnlock(self);
+    return 0;
+  }
+
+  vMemMgrDrainPending(self);
+  vMemMgrTrimLocked(self);
+
+  size_t nodeCount = 0;
+  MemNode* node;
+
+  for (node = self->_first; node != nullptr; node = node->next)
+    nodeCount++;
+
+  if (self->_movableCount == 0 || nodeCount < 2) {
+    vMemMgrUnlock(self);
+    return 0;
+  }
+
+  struct Candidate {
+    uint8_t* mem;
+    size_t used;
+  };
+
+  Candidate* candidates = static_cast<Candidate*>(MemUtil::alloc(self->_allocator, nodeCount * sizeof(Candidate)));
+  if (candidates == nullptr) {
+    vMemMgrUnlock(self);
+    return 0;
+  }
+
+  // Only nodes that contain nothing but movable blocks can be released, the
+  // least used nodes are evacuated first.
+  size_t candidateCount = 0;
+  for (node = self->_first; node != nullptr; node = node->next) {
+    if (vMemMgrGetEvacuableCount(self, node) == 0)
+      continue;
+
+    size_t i = candidateCount++;
+    while (i > 0 && candidates[i - 1].used > node->used) {
+      candidates[i] = candidates[i - 1];
+      i--;
+    }
+    candidates[i].mem = node->mem;
+    candidates[i].used = node->used;
+  }
+
+  self->_compacting = true;
+
+  for (size_t c = 0; c < candidateCount; c++) {
+    node = vMemMgrFindNodeByPtr(self, candidates[c].mem);
+    if (node == nullptr || node->mem != candidates[c].mem)
+      continue;
+
+    size_t count = vMemMgrGetEvacuableCount(self, node);
+    if (count == 0)
+      continue;
+
+    VMemMgrMove* moves = static_cast<VMemMgrMove*>(MemUtil::alloc(self->_allocator, count * sizeof(VMemMgrMove)));
+    if (moves == nullptr)
+      break;
+
+    if (!vMemMgrPlanEvacuation(self, node, moves, count)) {
+      MemUtil::release(self->_allocator, moves);
+      continue;
+    }
+
+    vMemMgrUnlock(self);
+    for (size_t m = 0; m < count; m++) {
+      VMemMgrMove& move = moves[m];
+      move.moved = mover->move(move.dst, move.dstRw, move.src, move.size, move.userData);
+    }
+    self->_lock.lock();
+
+    vMemMgrCommitEvacuation(self, moves, count);
+    MemUtil::release(self->_allocator, moves);
+  }
+
+  self->_compacting = false;
+  MemUtil::release(self->_allocator, candidates);
+
+  // Release nodes that became empty, removing a node can move data of
+  // another node so the list has to be scanned again after each removal.
+  size_t released = 0;
+  node = self->_first;
+
+  while (node != nullptr) {
+    if (node->used != 0) {
+      node = node->next;
+      continue;
+    }
+
+    vMemMgrReleaseNode(self, node);
+    released++;
+    node = self->_first;
+  }
+
+  vMemMgrUnlock(self);
+  return released;
+}
+
+//! \internal
+//!
+//! Reset the whole `VMemMgr` instance, freeing all heap memory allocated an
+//! virtual memory allocated unless `keepVirtualMemory` is true (and this is
+//! only used when writing data to a remote process).
+static void vMemMgrReset(VMemMgr* self, bool keepVirtualMemory) noexcept {
+  // Pending releases are meaningless as all the memory is going away.
+  PendingRelease* pending = self->_pending;
+  while (pending != nullptr) {
+    PendingRelease* next = pending->next;
+    MemUtil::release(self->_allocator, pending);
+    pending = next;
+  }
+  self->_pending = nullptr;
+
+  // Cached blocks are released together with their nodes.
+  MemUtil::release(self->_allocator, self->_bins);
+  self->_bins = nullptr;
+
+  MemUtil::release(self->_allocator, self->_movables);
+  self->_movables = nullptr;
+  self->_movableCount = 0;
+  self->_movableCapacity = 0;
+
+  MemNode* node = self->_first;
+
+  while (node != nullptr) {
+    MemNode* next = node->next;
+
+    if (!keepVirtualMemory)
+      vMemMgrReleaseVMem(self, node->mem, node->rwMem, node->size);
+
+    MemUtil::release(self->_allocator, node->baUsed);
+    MemUtil::release(self->_allocator, node);
+
+    node = next;
+  }
+
+  self->_allocatedBytes = 0;
+  self->_usedBytes = 0;
+
+  self->_root = nullptr;
+  self->_first = nullptr;
+  self->_last = nullptr;
+  self->_optimal = nullptr;
+
+  for (uint32_t i = 0; i < self->_arenaCount; i++)
+    vMemMgrReset(&self->_arenas[i], keepVirtualMemory);
+  vMemMgrResetArenaTable(self);
+}
+
+//! \internal
+//!
+//! Destroy all arenas of `self`.
+static void vMemMgrDestroyArenas(VMemMgr* self) noexcept {
+  VMemMgr* arenas = self->_arenas;
+  uint32_t count = self->_arenaCount;
+
+  for (uint32_t i = 0; i < count; i++) {
+    arenas[i].setKeepVirtualMemory(self->getKeepVirtualMemory());
+    arenas[i].~VMemMgr();
+  }
+
+  MemUtil::release(self->_allocator, arenas);
+  vMemMgrResetArenaTable(self);
+
+  self->_arenas = nullptr;
+  self->_arenaCount = 0;
+}
+
+//! \internal
+//!
+//! Destroy the reserved region of `self`.
+//!
+//! The address space is only released if nothing is committed, memory that
+//! is kept (permanent memory or `setKeepVirtualMemory()`) stays reserved.
+static void vMemMgrDestroyRegion(VMemMgr* self) noexcept {
+  Region* region = self->_region;
+  if (region == nullptr)
+    return;
+
+  if (region->isEmpty())
+    VMemUtil::release(region->mem, region->size);
+
+  MemUtil::release(self->_allocator, region->ranges);
+  region->~Region();
+  MemUtil::release(self->_allocator, region);
+
+  self->_region = nullptr;
+}
+
+// ============================================================================
+// [asmjit::VMemMgr - Construction / Destruction]
+// ============================================================================
+
+#if !ASMJIT_OS_WINDOWS
+VMemMgr::VMemMgr() noexcept
+#else
+VMemMgr::VMemMgr(HANDLE hProcess) noexcept
+  : _hProcess(vMemGet().getSafeProcessHandle(hProcess))
+#endif // ASMJIT_OS_WINDOWS
+{
+  _blockSize = VMemUtil::getPageGranularity();
+  _blockDensity = 64;
+
+  _allocatedBytes = 0;
+  _usedBytes = 0;
+
+  _allocCount = 0;
+  _releaseCount = 0;
+  _lockContentionCount = 0;
+
+  _root = nullptr;
+  _first = nullptr;
+  _last = nullptr;
+  _optimal = nullptr;
+
+  _permanent = nullptr;
+  _keepVirtualMemory = false;
+
+  _arenas = nullptr;
+  _arenaCount = 0;
+
+  _arenaTable = nullptr;
+  _arenaRetired = nullptr;
+  _arenaReaders = 0;
+  _arenaChunkCount = 0;
+
+  _owner = nullptr;
+  _pending = nullptr;
+  _bins = nullptr;
+
+  _movables = nullptr;
+  _movableCount = 0;
+  _movableCapacity = 0;
+  _compacting = false;
+
+  _region = nullptr;
+  _allocator = nullptr;
+
+  _dualMapping = false;
+  _hugePages = false;
+}
+
+VMemMgr::~VMemMgr() noexcept {
+  // Freeable memory cleanup - Also frees the virtual memory if configured to.
+  vMemMgrReset(this, _keepVirtualMemory);
+  vMemMgrDestroyArenas(this);
+
+  // Permanent memory cleanup - Never frees the virtual memory.
+  PermanentNode* node = _permanent;
+  while (node) {
+    PermanentNode* prev = node->prev;
+    MemUtil::release(_allocator, node);
+    node = prev;
+  }
+
+  vMemMgrDestroyRegion(this);
+}
+
+// ============================================================================
+// [asmjit::VMemMgr - Reset]
+// ============================================================================
+
+void VMemMgr::reset() noexcept {
+  vMemMgrReset(this, false);
+}
+
+// ============================================================================
+// [asmjit::VMemMgr - Trim]
+// ============================================================================
+
+void VMemMgr::trim() noexcept {
+  for (uint32_t i = 0; i < _arenaCount; i++)
+    _arenas[i].trim();
+
+  _lock.lock();
+  vMemMgrDrainPending(this);
+  vMemMgrTrimLocked(this);
+  vMemMgrUnlock(this);
+}
+
+// ============================================================================
+// [asmjit::VMemMgr - Accessors]
+// ============================================================================
+
+size_t VMemMgr::getAllocatedBytes() const noexcept {
+  size_t allocatedBytes = _allocatedBytes;
+  for (uint32_t i = 0; i < _arenaCount; i++)
+    allocatedBytes += _arenas[i]._allocatedBytes;
+  return allocatedBytes;
+}
+
+size_t VMemMgr::getUsedBytes() const noexcept {
+  size_t usedBytes = _usedBytes;
+  for (uint32_t i = 0; i < _arenaCount; i++)
+    usedBytes += _arenas[i]._usedBytes;
+  return usedBytes;
+}
+
+Error VMemMgr::setAllocator(Allocator* allocator) noexcept {
+  if (_first != nullptr || _permanent != nullptr || _bins != nullptr || _movables != nullptr ||
+      _arenas != nullptr || _region != nullptr)
+    return kErrorInvalidState;
+
+  _allocator = allocator;
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::VMemMgr - Dual Mapping]
+// ============================================================================
+
+Error VMemMgr::setDualMapping(bool dualMapping) noexcept {
+  // Reserved region is never dual mapped.
+  if (dualMapping && _region != nullptr)
+    return kErrorInvalidState;
+
+#if ASMJIT_OS_WINDOWS
+  // Views of a remote process can't be mapped to the current process.
+  if (dualMapping && _hProcess != vMemGet().hProcess)
+    return kErrorInvalidState;
+#endif // ASMJIT_OS_WINDOWS
+
+  _dualMapping = dualMapping;
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::VMemMgr - Reserved Region]
+// ============================================================================
+
+Error VMemMgr::setReservedRegion(const void* target, size_t size, size_t maxDistance) noexcept {
+  // The region can't be changed while it's in use.
+  if (_first != nullptr || _arenaChunkCount != 0 || _permanent != nullptr)
+    return kErrorInvalidState;
+
+  if (size != 0 && _dualMapping)
+    return kErrorInvalidState;
+
+#if ASMJIT_OS_WINDOWS
+  // Memory of a remote process can't be reserved near a local address.
+  if (size != 0 && _hProcess != vMemGet().hProcess)
+    return kErrorInvalidState;
+#endif // ASMJIT_OS_WINDOWS
+
+  vMemMgrDestroyRegion(this);
+  if (size == 0)
+    return kErrorOk;
+
+  Region* region = static_cast<Region*>(MemUtil::alloc(_allocator, sizeof(Region)));
+  Region::FreeRange* ranges = static_cast<Region::FreeRange*>(MemUtil::alloc(_allocator, 16 * sizeof(Region::FreeRange)));
+
+  if (region == nullptr || ranges == nullptr) {
+    MemUtil::release(_allocator, ranges);
+    MemUtil::release(_allocator, region);
+    return kErrorNoHeapMemory;
+  }
+
+  size_t reserved;
+  uint8_t* mem = static_cast<uint8_t*>(VMemUtil::reserveNear(target, maxDistance, size, &reserved));
+
+  if (mem == nullptr) {
+    MemUtil::release(_allocator, ranges);
+    MemUtil::release(_allocator, region);
+    return kErrorNoVirtualMemory;
+  }
+
+  new(region) Region();
+  region->allocator = _allocator;
+  region->mem = mem;
+  region->size = reserved;
+
+  ranges[0].mem = mem;
+  ranges[0].size = reserved;
+
+  region->ranges = ranges;
+  region->rangeCount = 1;
+  region->rangeCapacity = 16;
+
+  _region = region;
+  return kErrorOk;
+}
+
+void* VMemMgr::getReservedRegion(size_t* size) const noexcept {
+  if (size != nullptr)
+    *size = _region ? _region->size : 0;
+  return _region ? _region->mem : nullptr;
+}
+
+// ============================================================================
+// [asmjit::VMemMgr - Chunks]
+// ============================================================================
+
+static size_t vMemMgrGetChunks(const VMemMgr* self, VMemChunkInfo* dst, size_t maxCount, size_t index) noexcept {
+  for (const MemNode* node = self->_first; node != nullptr; node = node->next, index++) {
+    if (index >= maxCount)
+      continue;
+
+    VMemChunkInfo& info = dst[index];
+    info.address = node->mem;
+    info.size = node->size;
+    info.used = node->used - node->binned;
+    info.hugePages = node->hugePages;
+  }
+  return index;
+}
+
+size_t VMemMgr::getChunks(VMemChunkInfo* dst, size_t maxCount) const noexcept {
+  size_t count;
+
+  {
+    AutoLock locked(const_cast<VMemMgr*>(this)->_lock);
+    count = vMemMgrGetChunks(this, dst, maxCount, 0);
+  }
+
+  // Draining an arena on unlock can unmap a chunk, which takes the lock of
+  // `this`, so it's not held here.
+  for (uint32_t i = 0; i < _arenaCount; i++) {
+    VMemMgr& arena = _arenas[i];
+    arena._lock.lock();
+    count = vMemMgrGetChunks(&arena, dst, maxCount, count);
+    vMemMgrUnlock(&arena);
+  }
+
+  // Check which advised chunks are backed by transparent huge pages, it's
+  // done without holding the locks as it's slow.
+  size_t filled = Utils::iMin<size_t>(count, maxCount);
+  for (size_t i = 0; i < filled; i++) {
+    VMemChunkInfo& info = dst[i];
+    if (info.hugePages == kVMemHugePagesAdvised && VMemUtil::getTransparentHugePagesSize(info.address, info.size) != 0)
+      info.hugePages = kVMemHugePagesTransparent;
+  }
+
+  return count;
+}
+
+// ============================================================================
+// [asmjit::VMemMgr - Stats]
+// ============================================================================
+
+//! \internal
+//!
+//! Add a continuous free block of `count` density units to `stats`.
+static ASMJIT_INLINE void vMemMgrAddFreeBlock(VMemStats* stats, size_t count, size_t density) noexcept {
+  if (count == 0)
+    return;
+
+  size_t bucket = 0;
+  while (bucket < kVMemStatsBucketCount - 1 && (count >> (bucket + 1)) != 0)
+    bucket++;
+
+  stats->freeBlocks[bucket]++;
+  if (stats->largestFreeBlock < count * density)
+    stats->largestFreeBlock = count * density;
+}
+
+//! \internal
+//!
+//! Add free blocks of `node` to `stats`.
+static void vMemMgrScanFreeBlocks(const MemNode* node, VMemStats* stats) noexcept {
+  const size_t* up = node->baUsed;
+  size_t blocks = node->blocks;
+  size_t cont = 0;
+
+  for (size_t i = 0; i < blocks; i += kBitsPerEntity) {
+    size_t ubits = *up++;
+    size_t max = kBitsPerEntity;
+
+    if (i + max > blocks)
+      max = blocks - i;
+
+    // Fast path - the whole entity is free or used.
+    if (ubits == 0 && max == kBitsPerEntity) {
+      cont += kBitsPerEntity;
+      continue;
+    }
+
+    if (ubits == ~(size_t)0) {
+      vMemMgrAddFreeBlock(stats, cont, node->density);
+      cont = 0;
+      continue;
+    }
+
+    for (size_t j = 0; j < max; j++, ubits >>= 1) {
+      if ((ubits & 1) == 0) {
+        cont++;
+        continue;
+      }
+
+      vMemMgrAddFreeBlock(stats, cont, node->density);
+      cont = 0;
+    }
+  }
+
+  vMemMgrAddFreeBlock(stats, cont, node->density);
+}
+
+//! \internal
+//!
+//! Add statistics of `self` to `stats`, the lock of `self` must be held.
+static void vMemMgrAddStats(const VMemMgr* self, VMemStats* stats, bool scanFreeBlocks) noexcept {
+  for (const MemNode* node = self->_first; node != nullptr; node = node->next) {
+    stats->chunkCount++;
+    stats->hugePageChunkCount += node->hugePages != kVMemHugePagesNone;
+    stats->allocatedBytes += node->size;
+    stats->usedBytes += node->used - node->binned;
+    stats->cachedBytes += node->binned;
+
+    // Cached blocks are counted as used, they are not available to `alloc()`
+    // before they are evicted from bins.
+    if (scanFreeBlocks)
+      vMemMgrScanFreeBlocks(node, stats);
+  }
+
+  for (const PermanentNode* node = self->_permanent; node != nullptr; node = node->prev) {
+    stats->permanentChunkCount++;
+    stats->permanentAllocatedBytes += node->size;
+    stats->permanentUsedBytes += node->used;
+  }
+
+  stats->allocCount += self->_allocCount;
+  stats->releaseCount += self->_releaseCount;
+  stats->lockContentionCount += self->_lockContentionCount;
+}
+
+void VMemMgr::getStats(VMemStats* stats, bool scanFreeBlocks) const noexcept {
+  ::memset(stats, 0, sizeof(VMemStats));
+  stats->blockDensity = _blockDensity;
+
+  {
+    AutoLock locked(const_cast<VMemMgr*>(this)->_lock);
+    vMemMgrAddStats(this, stats, scanFreeBlocks);
+  }
+
+  for (uint32_t i = 0; i < _arenaCount; i++) {
+    VMemMgr& arena = _arenas[i];
+    arena._lock.lock();
+    vMemMgrAddStats(&arena, stats, scanFreeBlocks);
+    vMemMgrUnlock(&arena);
+  }
+}
+
+// ============================================================================
+// [asmjit::VMemMgr - Arenas]
+// ============================================================================
+
+Error VMemMgr::setArenaCount(uint32_t count) noexcept {
+  if (count <= 1)
+    count = 0;
+
+  if (count == _arenaCount)
+    return kErrorOk;
+
+  // Permanent memory is always allocated by the owner, so it doesn't matter.
+  if (_first != nullptr || _arenaChunkCount != 0)
+    return kErrorInvalidState;
+
+  vMemMgrDestroyArenas(this);
+  if (count == 0)
+    return kErrorOk;
+
+  VMemMgr* arenas = static_cast<VMemMgr*>(MemUtil::alloc(_allocator, count * sizeof(VMemMgr)));
+  if (arenas == nullptr)
+    return kErrorNoHeapMemory;
+
+  for (uint32_t i = 0; i < count; i++) {
+#if !ASMJIT_OS_WINDOWS
+    VMemMgr* arena = new(&arenas[i]) VMemMgr();
+#else
+    VMemMgr* arena = new(&arenas[i]) VMemMgr(_hProcess);
+#endif // ASMJIT_OS_WINDOWS
+
+    arena->_blockSize = _blockSize;
+    arena->_blockDensity = _blockDensity;
+    arena->_owner = this;
+    arena->_allocator = _allocator;
+  }
+
+  _arenas = arenas;
+  _arenaCount = count;
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::VMemMgr - Compaction]
+// ============================================================================
+
+Error VMemMgr::setMovable(void* p, bool movable, void* userData) noexcept {
+  VMemMgr* self = this;
+
+  if (_arenaCount != 0) {
+    self = vMemMgrFindArenaByPtr(this, static_cast<uint8_t*>(p));
+    if (self == nullptr)
+      return kErrorInvalidArgument;
+  }
+
+  VMemMgrAutoLock locked(self);
+  if (vMemMgrFindNodeByPtr(self, static_cast<uint8_t*>(p)) == nullptr)
+    return kErrorInvalidArgument;
+
+  if (!movable) {
+    vMemMgrRemoveMovable(self, static_cast<uint8_t*>(p));
+    return kErrorOk;
+  }
+
+  if (!vMemMgrAddMovable(self, static_cast<uint8_t*>(p), userData))
+    return kErrorNoHeapMemory;
+
+  return kErrorOk;
+}
+
+size_t VMemMgr::compact(VMemMover* mover) noexcept {
+  VMemMover defaultMover;
+  if (mover == nullptr)
+    mover = &defaultMover;
+
+  size_t released = 0;
+  for (uint32_t i = 0; i < _arenaCount; i++)
+    released += vMemMgrCompact(&_arenas[i], mover);
+
+  released += vMemMgrCompact(this, mover);
+  return released;
+}
+
+// ============================================================================
+// [asmjit::VMemMgr - Alloc / Release]
+// ============================================================================
+
+void* VMemMgr::alloc(size_t size, uint32_t type, void** rwPtr) noexcept {
+  void* rw;
+  void* p;
+
+  if (type == kVMemAllocPermanent)
+    p = vMemMgrAllocPermanent(this, size, &rw);
+  else if (_arenaCount != 0)
+    p = vMemMgrAllocFreeable(vMemMgrGetArena(this), size, &rw);
+  else
+    p = vMemMgrAllocFreeable(this, size, &rw);
+
+  if (rwPtr != nullptr)
+    *rwPtr = p != nullptr ? rw : nullptr;
+  return p;
+}
+
+size_t VMemMgr::getAlignment(uint32_t type) const noexcept {
+  // Freeable blocks start at a multiple of the block density of a chunk that
+  // is page aligned, arenas use the same density.
+  return type == kVMemAllocPermanent ? static_cast<size_t>(kVMemPermanentAlignment) : _blockDensity;
+}
+
+Error VMemMgr::release(void* p) noexcept {
+  if (p == nullptr)
+    return kErrorOk;
+
+  if (_arenaCount != 0)
+    return vMemMgrArenaRelease(this, p);
+
+  VMemMgrAutoLock locked(this);
+  return vMemMgrReleaseLocked(this, p);
+}
+
+Error VMemMgr::shrink(void* p, size_t used) noexcept {
+  if (p == nullptr)
+    return kErrorOk;
+
+  if (used == 0)
+    return release(p);
+
+  if (_arenaCount != 0)
+    return vMemMgrArenaShrink(this, p, used);
+
+  VMemMgrAutoLock locked(this);
+  return vMemMgrShrinkLocked(this, p, used);
+}
+
+// ============================================================================
+// [asmjit::VMem - Test]
+// ============================================================================
+
+#if defined(ASMJIT_TEST)
+static void VMemTest_fill(void* a, void* b, int i) noexcept {
+  int pattern = rand() % 256;
+  *(int *)a = i;
+  *(int *)b = i;
+  ::memset((char*)a + sizeof(int), pattern, i - sizeof(int));
+  ::memset((char*)b + sizeof(int), pattern, i - sizeof(int));
+}
+
+static void VMemTest_verify(void* a, void* b) noexcept {
+  int ai = *(int*)a;
+  int bi = *(int*)b;
+
+  EXPECT(ai == bi,
+    "The length of 'a' (%d) and 'b' (%d) should be same", ai, bi);
+
+  EXPECT(::memcmp(a, b, ai) == 0,
+    "Pattern (%p) doesn't match", a);
+}
+
+static void VMemTest_stats(VMemMgr& memmgr) noexcept {
+  INFO("Used     : %u", static_cast<unsigned int>(memmgr.getUsedBytes()));
+  INFO("Allocated: %u", static_cast<unsigned int>(memmgr.getAllocatedBytes()));
+}
+
+static void VMemTest_shuffle(void** a, void** b, size_t count) noexcept {
+  for (size_t i = 0; i < count; ++i) {
+    size_t si = (size_t)rand() % count;
+
+    void* ta = a[i];
+    void* tb = b[i];
+
+    a[i] = a[si];
+    b[i] = b[si];
+
+    a[si] = ta;
+    b[si] = tb;
+  }
+}
+
+UNIT(base_vmem) {
+  VMemMgr memmgr;
+
+  // Should be predictible.
+  srand(100);
+
+  int i;
+  int kCount = 200000;
+
+  INFO("Memory alloc/free test - %d allocations.", static_cast<int>(kCount));
+
+  void** a = (void**)ASMJIT_ALLOC(sizeof(void*) * kCount);
+  void** b = (void**)ASMJIT_ALLOC(sizeof(void*) * kCount);
+
+  EXPECT(a != nullptr && b != nullptr,
+    "Couldn't allocate %u bytes on heap.", kCount * 2);
+
+  INFO("Allocating virtual memory...");
+  for (i = 0; i < kCount; i++) {
+    int r = (rand() % 1000) + 4;
+
+    a[i] = memmgr.alloc(r);
+    EXPECT(a[i] != nullptr,
+      "Couldn't allocate %d bytes of virtual memory", r);
+    ::memset(a[i], 0, r);
+  }
+  VMemTest_stats(memmgr);
+
+  INFO("Freeing virtual memory...");
+  for (i = 0; i < kCount; i++) {
+    EXPECT(memmgr.release(a[i]) == kErrorOk,
+      "Failed to free %p.", b[i]);
+  }
+  VMemTest_stats(memmgr);
+
+  INFO("Verified alloc/free test - %d allocations.", static_cast<int>(kCount));
+  for (i = 0; i < kCount; i++) {
+    int r = (rand() % 1000) + 4;
+
+    a[i] = memmgr.alloc(r);
+    EXPECT(a[i] != nullptr,
+      "Couldn't allocate %d bytes of virtual memory.", r);
+
+    b[i] = ASMJIT_ALLOC(r);
+    EXPECT(b[i] != nullptr,
+      "Couldn't allocate %d bytes on heap.", r);
+
+    VMemTest_fill(a[i], b[i], r);
+  }
+  VMemTest_stats(memmgr);
+
+  INFO("Shuffling...");
+  VMemTest_shuffle(a, b, kCount);
+
+  INFO("Verify and free...");
+  for (i = 0; i < kCount / 2; i++) {
+    VMemTest_verify(a[i], b[i]);
+    EXPECT(memmgr.release(a[i]) == kErrorOk,
+      "Failed to free %p.", a[i]);
+    ASMJIT_FREE(b[i]);
+  }
+  VMemTest_stats(memmgr);
+
+  INFO("Alloc again.");
+  for (i = 0; i < kCount / 2; i++) {
+    int r = (rand() % 1000) + 4;
+
+    a[i] = memmgr.alloc(r);
+    EXPECT(a[i] != nullptr,
+      "Couldn't allocate %d bytes of virtual memory.", r);
 
     b[i] = ASMJIT_ALLOC(r);
     EXPECT(b[i] != nullptr,
@@ -1274,9 +3342,641 @@ UNIT(base_vmem) {
   }
   VMemTest_stats(memmgr);
 
+  INFO("Trimming...");
+  memmgr.trim();
+  VMemTest_stats(memmgr);
+
+  EXPECT(memmgr.getAllocatedBytes() == 0,
+    "All chunks should be unmapped after trim.");
+
   ASMJIT_FREE(a);
   ASMJIT_FREE(b);
 }
+
+UNIT(base_vmem_bins) {
+  VMemMgr memmgr;
+  VMemStats stats;
+
+  // Blocks of `kSize` bytes are cached by bins, a chunk holds `kPerChunk`.
+  enum { kSize = 128, kChunks = 3 };
+  size_t kPerChunk = VMemUtil::getPageGranularity() / kSize;
+
+  INFO("Reusing a cached block...");
+  void* a = memmgr.alloc(kSize);
+  void* b = memmgr.alloc(kSize);
+
+  EXPECT(a != nullptr && b != nullptr,
+    "Couldn't allocate %d bytes of virtual memory.", static_cast<int>(kSize));
+  EXPECT(memmgr.release(a) == kErrorOk,
+    "Failed to free %p.", a);
+
+  memmgr.getStats(&stats, false);
+  EXPECT(stats.cachedBytes == kSize && stats.usedBytes == kSize,
+    "The released block should be cached.");
+
+  void* c = memmgr.alloc(kSize * 3 / 2);
+  EXPECT(c != nullptr && c != a,
+    "A block of another size shouldn't be taken from bins.");
+  EXPECT(memmgr.alloc(kSize) == a,
+    "The cached block should be reused.");
+
+  memmgr.getStats(&stats, false);
+  EXPECT(stats.cachedBytes == 0,
+    "Bins should be empty.");
+
+  INFO("Evicting cached blocks of a chunk that is otherwise unused...");
+  EXPECT(memmgr.release(a) == kErrorOk && memmgr.release(b) == kErrorOk && memmgr.release(c) == kErrorOk,
+    "Failed to free memory.");
+  EXPECT(memmgr.getUsedBytes() == 0 && memmgr.getAllocatedBytes() == 0,
+    "The chunk should be unmapped, not kept by bins.");
+
+  INFO("Releasing chunks while their neighbours have cached blocks...");
+  size_t count = kPerChunk * kChunks;
+  void** p = static_cast<void**>(ASMJIT_ALLOC(count * sizeof(void*)));
+
+  EXPECT(p != nullptr,
+    "Couldn't allocate %u bytes on heap.", static_cast<unsigned int>(count * sizeof(void*)));
+
+  size_t i;
+  for (i = 0; i < count; i++) {
+    p[i] = memmgr.alloc(kSize);
+    EXPECT(p[i] != nullptr,
+      "Couldn't allocate %d bytes of virtual memory.", static_cast<int>(kSize));
+  }
+
+  // Cache the last block of every chunk but the first, then release the
+  // first chunk, which moves data of another node in the tree.
+  for (i = 1; i < kChunks; i++) {
+    EXPECT(memmgr.release(p[i * kPerChunk + kPerChunk - 1]) == kErrorOk,
+      "Failed to free %p.", p[i * kPerChunk + kPerChunk - 1]);
+  }
+
+  for (i = 0; i < kPerChunk; i++) {
+    EXPECT(memmgr.release(p[i]) == kErrorOk,
+      "Failed to free %p.", p[i]);
+  }
+
+  EXPECT(memmgr.getAllocatedBytes() == (kChunks - 1) * VMemUtil::getPageGranularity(),
+    "The first chunk should be unmapped.");
+
+  for (i = 1; i < kChunks; i++) {
+    void* rw;
+    void* q = memmgr.alloc(kSize, kVMemAllocFreeable, &rw);
+
+    EXPECT(q != nullptr && rw != nullptr,
+      "Couldn't allocate %d bytes of virtual memory.", static_cast<int>(kSize));
+    ::memset(rw, 0xCC, kSize);
+  }
+
+  memmgr.getStats(&stats, false);
+  EXPECT(stats.cachedBytes == 0 && stats.usedBytes == (count - kPerChunk) * kSize,
+    "Cached blocks should be reused, %u bytes still cached.", static_cast<unsigned int>(stats.cachedBytes));
+
+  for (i = kPerChunk; i < count; i++) {
+    EXPECT(memmgr.release(p[i]) == kErrorOk,
+      "Failed to free %p.", p[i]);
+  }
+
+  EXPECT(memmgr.getAllocatedBytes() == 0,
+    "All chunks should be unmapped.");
+  ASMJIT_FREE(p);
+}
+
+UNIT(base_vmem_dual) {
+  VMemMgr memmgr;
+
+  if (memmgr.setDualMapping(true) != kErrorOk) {
+    INFO("Dual mapping not available.");
+    return;
+  }
+
+  INFO("Allocating dual mapped memory...");
+  void* rw[64];
+  void* rx[64];
+
+  for (int i = 0; i < 64; i++) {
+    size_t size = static_cast<size_t>(i) * 61 + 16;
+    rx[i] = memmgr.alloc(size, kVMemAllocFreeable, &rw[i]);
+
+    EXPECT(rx[i] != nullptr,
+      "Couldn't allocate %d bytes of dual mapped memory.", static_cast<int>(size));
+    EXPECT(rw[i] != rx[i],
+      "The writable view should differ from the executable one.");
+
+    ::memset(rw[i], i, size);
+    EXPECT(static_cast<uint8_t*>(rx[i])[size - 1] == static_cast<uint8_t>(i),
+      "Data written through the writable view not visible.");
+  }
+  VMemTest_stats(memmgr);
+
+#if ASMJIT_ARCH_X86 || ASMJIT_ARCH_X64
+  // Execute `mov eax, 42; ret` through the executable view.
+  static const uint8_t code[] = { 0xB8, 0x2A, 0x00, 0x00, 0x00, 0xC3 };
+  ::memcpy(rw[0], code, sizeof(code));
+
+  typedef int (*Func)(void);
+  int result = reinterpret_cast<Func>(rx[0])();
+  EXPECT(result == 42,
+    "Code executed through the executable view returned %d.", result);
+#endif // ASMJIT_ARCH_X86 || ASMJIT_ARCH_X64
+
+  INFO("Freeing dual mapped memory...");
+  for (int i = 0; i < 64; i++) {
+    EXPECT(memmgr.release(rx[i]) == kErrorOk,
+      "Failed to free %p.", rx[i]);
+  }
+  memmgr.trim();
+  VMemTest_stats(memmgr);
+
+  EXPECT(memmgr.getAllocatedBytes() == 0,
+    "All chunks should be unmapped.");
+}
+
+UNIT(base_vmem_region) {
+  VMemMgr memmgr;
+
+  // Any function of the test binary is good enough as a target.
+  const void* target = reinterpret_cast<const void*>(&VMemTest_stats);
+  size_t maxDistance = 0x70000000;
+
+  if (memmgr.setReservedRegion(target, 64 * 1024 * 1024, maxDistance) != kErrorOk) {
+    INFO("Reserved region not available.");
+    return;
+  }
+
+  size_t regionSize;
+  uint8_t* region = static_cast<uint8_t*>(memmgr.getReservedRegion(&regionSize));
+  INFO("Reserved %u bytes at %p near %p.", static_cast<unsigned int>(regionSize), region, target);
+
+  void* p[64];
+  for (int i = 0; i < 64; i++) {
+    size_t size = static_cast<size_t>(i) * 4093 + 16;
+    p[i] = memmgr.alloc(size, i == 63 ? kVMemAllocPermanent : kVMemAllocFreeable);
+
+    EXPECT(p[i] != nullptr,
+      "Couldn't allocate %d bytes of virtual memory.", static_cast<int>(size));
+    EXPECT(static_cast<uint8_t*>(p[i]) >= region && static_cast<uint8_t*>(p[i]) + size <= region + regionSize,
+      "Memory %p was not allocated from the reserved region.", p[i]);
+
+    intptr_t distance = static_cast<const uint8_t*>(p[i]) - static_cast<const uint8_t*>(target);
+    EXPECT(distance <= static_cast<intptr_t>(maxDistance) && -distance <= static_cast<intptr_t>(maxDistance),
+      "Memory %p is too far from %p.", p[i], target);
+
+    ::memset(p[i], i, size);
+  }
+  VMemTest_stats(memmgr);
+
+  for (int i = 0; i < 63; i++) {
+    EXPECT(memmgr.release(p[i]) == kErrorOk,
+      "Failed to free %p.", p[i]);
+  }
+  memmgr.trim();
+
+  EXPECT(memmgr.getAllocatedBytes() == 0,
+    "All chunks should be returned to the reserved region.");
+  EXPECT(memmgr.setReservedRegion(nullptr, 0) == kErrorInvalidState,
+    "Region holding permanent memory can't be released.");
+}
+
+struct VMemTest_Mover : public VMemMover {
+  virtual bool move(void* dst, void* dstRw, const void* src, size_t size, void* userData) noexcept {
+    ::memcpy(dstRw, src, size);
+    *static_cast<void**>(userData) = dst;
+    return true;
+  }
+};
+
+UNIT(base_vmem_compact) {
+  VMemMgr memmgr;
+  VMemTest_Mover mover;
+
+  enum { kCount = 256, kSize = 1536 };
+  void* p[kCount];
+
+  INFO("Allocating movable memory...");
+  for (int i = 0; i < kCount; i++) {
+    p[i] = memmgr.alloc(kSize);
+    EXPECT(p[i] != nullptr,
+      "Couldn't allocate %d bytes of virtual memory.", static_cast<int>(kSize));
+
+    ::memset(p[i], i, kSize);
+    EXPECT(memmgr.setMovable(p[i], true, &p[i]) == kErrorOk,
+      "Failed to make %p movable.", p[i]);
+  }
+
+  // Keep every 8th block so most chunks become sparse.
+  for (int i = 0; i < kCount; i++) {
+    if ((i % 8) != 0) {
+      EXPECT(memmgr.release(p[i]) == kErrorOk,
+        "Failed to free %p.", p[i]);
+      p[i] = nullptr;
+    }
+  }
+  VMemTest_stats(memmgr);
+
+  VMemStats stats;
+  memmgr.getStats(&stats);
+
+  size_t freeBlockCount = 0;
+  for (int i = 0; i < kVMemStatsBucketCount; i++)
+    freeBlockCount += stats.freeBlocks[i];
+
+  INFO("Chunks   : %u", static_cast<unsigned int>(stats.chunkCount));
+  INFO("Largest  : %u", static_cast<unsigned int>(stats.largestFreeBlock));
+
+  EXPECT(stats.usedBytes == (kCount / 8) * kSize && stats.allocatedBytes == memmgr.getAllocatedBytes(),
+    "Stats don't match the memory manager.");
+  EXPECT(stats.allocCount == kCount && stats.releaseCount == kCount - kCount / 8,
+    "Stats should count %d allocations and %d releases.", kCount, kCount - kCount / 8);
+  EXPECT(freeBlockCount >= stats.chunkCount && stats.largestFreeBlock >= kSize,
+    "Stats should report free blocks of every chunk.");
+
+  size_t allocatedBefore = memmgr.getAllocatedBytes();
+  size_t released = memmgr.compact(&mover);
+
+  INFO("Compacted, %u chunks released.", static_cast<unsigned int>(released));
+  VMemTest_stats(memmgr);
+
+  EXPECT(released != 0 && memmgr.getAllocatedBytes() < allocatedBefore,
+    "Compaction should release at least one chunk.");
+
+  for (int i = 0; i < kCount; i += 8) {
+    const uint8_t* data = static_cast<const uint8_t*>(p[i]);
+    EXPECT(data[0] == static_cast<uint8_t>(i) && data[kSize - 1] == static_cast<uint8_t>(i),
+      "Moved block %d doesn't match.", i);
+    EXPECT(memmgr.release(p[i]) == kErrorOk,
+      "Failed to free %p.", p[i]);
+  }
+
+  EXPECT(memmgr.getAllocatedBytes() == 0,
+    "All chunks should be unmapped.");
+}
+
+struct VMemTest_CountingMover : public VMemMover {
+  virtual bool move(void* dst, void* dstRw, const void* src, size_t size, void* userData) noexcept {
+    // Memory can be allocated and released while blocks are being moved.
+    void* p = memmgr->alloc(size);
+    if (p == nullptr || memmgr->release(p) != kErrorOk)
+      return false;
+
+    ::memcpy(dstRw, src, size);
+    *static_cast<void**>(userData) = dst;
+
+    count++;
+    return true;
+  }
+
+  VMemMgr* memmgr;
+  uint32_t count;
+};
+
+UNIT(base_vmem_compact_partial) {
+  VMemMgr memmgr;
+  VMemTest_CountingMover mover;
+
+  mover.memmgr = &memmgr;
+  mover.count = 0;
+
+  // Chunks are as large as the page granularity, two of them are filled by
+  // `kCount` blocks of `kSmall` bytes.
+  enum { kCount = 64 };
+  size_t kSmall = VMemUtil::getPageGranularity() / (kCount / 2);
+  size_t kLarge = VMemUtil::getPageGranularity() / 4;
+
+  void* p[kCount];
+  for (int i = 0; i < kCount; i++) {
+    p[i] = memmgr.alloc(kSmall);
+    EXPECT(p[i] != nullptr,
+      "Couldn't allocate %u bytes of virtual memory.", static_cast<unsigned int>(kSmall));
+  }
+
+  // Both blocks go to a third chunk, the large one doesn't fit into any hole
+  // made by releasing every other small block.
+  void* small = memmgr.alloc(kSmall);
+  void* large = memmgr.alloc(kLarge);
+
+  EXPECT(small != nullptr && large != nullptr,
+    "Couldn't allocate movable memory.");
+  EXPECT(memmgr.setMovable(small, true, &small) == kErrorOk && memmgr.setMovable(large, true, &large) == kErrorOk,
+    "Failed to make blocks movable.");
+
+  for (int i = 1; i < kCount; i += 2) {
+    EXPECT(memmgr.release(p[i]) == kErrorOk,
+      "Failed to free %p.", p[i]);
+  }
+
+  INFO("Compacting a chunk that can't be evacuated entirely...");
+  void* smallBefore = small;
+  size_t allocatedBefore = memmgr.getAllocatedBytes();
+
+  EXPECT(memmgr.compact(&mover) == 0 && mover.count == 0,
+    "Nothing should be moved if any block doesn't fit.");
+  EXPECT(small == smallBefore && memmgr.getAllocatedBytes() == allocatedBefore,
+    "Blocks shouldn't be moved.");
+
+  INFO("Compacting a chunk that can be evacuated...");
+  EXPECT(memmgr.release(large) == kErrorOk,
+    "Failed to free %p.", large);
+  ::memset(small, 0xAB, kSmall);
+
+  EXPECT(memmgr.compact(&mover) == 1 && mover.count == 1,
+    "The chunk should be evacuated.");
+  EXPECT(small != smallBefore && static_cast<uint8_t*>(small)[kSmall - 1] == 0xAB,
+    "The block should be moved.");
+
+  EXPECT(memmgr.release(small) == kErrorOk,
+    "Failed to free %p.", small);
+  for (int i = 0; i < kCount; i += 2) {
+    EXPECT(memmgr.release(p[i]) == kErrorOk,
+      "Failed to free %p.", p[i]);
+  }
+
+  EXPECT(memmgr.getAllocatedBytes() == 0,
+    "All chunks should be unmapped.");
+}
+
+UNIT(base_vmem_huge) {
+  VMemMgr memmgr;
+  memmgr.setHugePages(true);
+
+  size_t hugePageSize = VMemUtil::getHugePageSize();
+  INFO("Huge page size: %u", static_cast<unsigned int>(hugePageSize));
+
+  void* p = memmgr.alloc(1000);
+  EXPECT(p != nullptr,
+    "Couldn't allocate memory backed by huge pages.");
+  ::memset(p, 0, 1000);
+
+  VMemChunkInfo info;
+  EXPECT(memmgr.getChunks(&info, 1) == 1,
+    "There should be exactly one chunk.");
+  EXPECT(info.size >= hugePageSize,
+    "The chunk should be at least one huge page large.");
+  EXPECT(info.used == 1024,
+    "The chunk should have 1024 bytes used, not %u.", static_cast<unsigned int>(info.used));
+
+  static const char* hugePagesNames[] = { "none", "advised", "transparent", "explicit" };
+  INFO("Chunk %p of %u bytes, huge pages: %s", info.address,
+    static_cast<unsigned int>(info.size), hugePagesNames[info.hugePages]);
+
+  VMemStats stats;
+  memmgr.getStats(&stats, false);
+
+  if (info.hugePages != kVMemHugePagesNone) {
+    EXPECT(Utils::isAligned<size_t>((size_t)info.address, hugePageSize),
+      "The chunk should be aligned to the huge page size.");
+    EXPECT(stats.hugePageChunkCount == 1,
+      "The chunk should be counted as a huge page chunk.");
+  }
+
+  if (info.hugePages == kVMemHugePagesTransparent) {
+    EXPECT(VMemUtil::getTransparentHugePagesSize(info.address, info.size) >= hugePageSize,
+      "At least one transparent huge page should back the chunk.");
+  }
+
+  EXPECT(memmgr.release(p) == kErrorOk,
+    "Failed to free %p.", p);
+  EXPECT(memmgr.getAllocatedBytes() == 0,
+    "All chunks should be unmapped.");
+
+  INFO("Checking huge pages are not used by dual mapped chunks.");
+  VMemMgr dualmgr;
+  dualmgr.setHugePages(true);
+
+  if (dualmgr.setDualMapping(true) == kErrorOk) {
+    p = dualmgr.alloc(1000);
+    EXPECT(p != nullptr,
+      "Couldn't allocate dual mapped memory.");
+
+    dualmgr.getStats(&stats, false);
+    EXPECT(stats.chunkCount == 1 && stats.hugePageChunkCount == 0,
+      "Dual mapped chunk shouldn't be counted as a huge page chunk.");
+
+    EXPECT(dualmgr.release(p) == kErrorOk,
+      "Failed to free %p.", p);
+  }
+}
+
+#if ASMJIT_OS_POSIX
+struct VMemTest_ArenaThread {
+  VMemMgr* memmgr;
+  void** p;
+  int count;
+};
+
+static void* VMemTest_arenaThread(void* arg) noexcept {
+  VMemTest_ArenaThread* data = static_cast<VMemTest_ArenaThread*>(arg);
+
+  for (int i = 0; i < data->count; i++) {
+    size_t size = static_cast<size_t>((i * 37) % 500) + 16;
+    data->p[i] = data->memmgr->alloc(size);
+    if (data->p[i] != nullptr)
+      ::memset(data->p[i], 0xCC, size);
+
+    // Release every other block by the thread that allocated it.
+    if ((i & 1) == 1 && data->p[i - 1] != nullptr) {
+      data->memmgr->release(data->p[i - 1]);
+      data->p[i - 1] = nullptr;
+    }
+  }
+
+  return nullptr;
+}
+
+UNIT(base_vmem_arenas) {
+  enum { kThreadCount = 4, kCount = 2000 };
+
+  VMemMgr memmgr;
+  EXPECT(memmgr.setArenaCount(kThreadCount) == kErrorOk,
+    "Couldn't enable arenas.");
+  EXPECT(memmgr.getArenaCount() == kThreadCount,
+    "Arena count doesn't match.");
+
+  pthread_t threads[kThreadCount];
+  VMemTest_ArenaThread data[kThreadCount];
+
+  INFO("Allocating from %d threads...", static_cast<int>(kThreadCount));
+  for (int t = 0; t < kThreadCount; t++) {
+    data[t].memmgr = &memmgr;
+    data[t].p = static_cast<void**>(ASMJIT_ALLOC(sizeof(void*) * kCount));
+    data[t].count = kCount;
+    pthread_create(&threads[t], nullptr, VMemTest_arenaThread, &data[t]);
+  }
+
+  for (int t = 0; t < kThreadCount; t++)
+    pthread_join(threads[t], nullptr);
+  VMemTest_stats(memmgr);
+
+  EXPECT(memmgr.setArenaCount(0) == kErrorInvalidState,
+    "Arenas can't be disabled while memory is allocated.");
+
+  INFO("Freeing from the main thread...");
+  for (int t = 0; t < kThreadCount; t++) {
+    for (int i = 0; i < kCount; i++) {
+      if (data[t].p[i] == nullptr)
+        continue;
+      EXPECT(memmgr.release(data[t].p[i]) == kErrorOk,
+        "Failed to free %p.", data[t].p[i]);
+    }
+    ASMJIT_FREE(data[t].p);
+  }
+  VMemTest_stats(memmgr);
+
+  EXPECT(memmgr.getUsedBytes() == 0,
+    "All memory should be released.");
+
+  INFO("Trimming...");
+  memmgr.trim();
+  VMemTest_stats(memmgr);
+
+  EXPECT(memmgr.getAllocatedBytes() == 0,
+    "All chunks should be unmapped.");
+}
+
+struct VMemTest_LockHolder {
+  VMemMgr* target;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  bool locked;
+  bool done;
+};
+
+// Hold the lock of `target` until `done` is set, then unlock it like arenas
+// do, which drains releases queued in the meantime.
+static void* VMemTest_lockHolderThread(void* arg) noexcept {
+  VMemTest_LockHolder* data = static_cast<VMemTest_LockHolder*>(arg);
+  data->target->_lock.lock();
+
+  pthread_mutex_lock(&data->mutex);
+  data->locked = true;
+  pthread_cond_broadcast(&data->cond);
+  while (!data->done)
+    pthread_cond_wait(&data->cond, &data->mutex);
+  pthread_mutex_unlock(&data->mutex);
+
+  vMemMgrUnlock(data->target);
+  return nullptr;
+}
+
+static void VMemTest_holdLock(VMemTest_LockHolder& holder, VMemMgr* target) noexcept {
+  holder.target = target;
+  holder.locked = false;
+  holder.done = false;
+  pthread_mutex_init(&holder.mutex, nullptr);
+  pthread_cond_init(&holder.cond, nullptr);
+  pthread_create(&holder.thread, nullptr, VMemTest_lockHolderThread, &holder);
+
+  pthread_mutex_lock(&holder.mutex);
+  while (!holder.locked)
+    pthread_cond_wait(&holder.cond, &holder.mutex);
+  pthread_mutex_unlock(&holder.mutex);
+}
+
+static void VMemTest_unholdLock(VMemTest_LockHolder& holder) noexcept {
+  pthread_mutex_lock(&holder.mutex);
+  holder.done = true;
+  pthread_cond_broadcast(&holder.cond);
+  pthread_mutex_unlock(&holder.mutex);
+
+  pthread_join(holder.thread, nullptr);
+  pthread_cond_destroy(&holder.cond);
+  pthread_mutex_destroy(&holder.mutex);
+}
+
+UNIT(base_vmem_arenas_pending) {
+  enum { kCount = 64 };
+
+  VMemMgr memmgr;
+  EXPECT(memmgr.setArenaCount(2) == kErrorOk,
+    "Couldn't enable arenas.");
+
+  void* p[kCount * 2];
+  VMemTest_ArenaThread data;
+
+  data.memmgr = &memmgr;
+  data.p = p;
+  data.count = kCount * 2;
+
+  // Thread ordinals are assigned in sequence, so one of two threads created
+  // in a row uses the other arena than the main thread.
+  INFO("Allocating from a thread that uses another arena...");
+  VMemMgr* mainArena = vMemMgrGetArena(&memmgr);
+  VMemMgr* arena = mainArena;
+
+  for (int attempt = 0; attempt < 2 && arena == mainArena; attempt++) {
+    pthread_t thread;
+    pthread_create(&thread, nullptr, VMemTest_arenaThread, &data);
+    pthread_join(thread, nullptr);
+
+    arena = vMemMgrFindArenaByPtr(&memmgr, static_cast<uint8_t*>(p[1]));
+    if (arena == mainArena) {
+      for (int i = 1; i < kCount * 2; i += 2)
+        memmgr.release(p[i]);
+    }
+  }
+
+  EXPECT(arena != nullptr && arena != mainArena,
+    "Memory should be allocated by another arena.");
+
+  VMemStats stats;
+  memmgr.getStats(&stats, false);
+
+  uint64_t contentionCount = stats.lockContentionCount;
+  size_t usedBytes = memmgr.getUsedBytes();
+  VMemTest_LockHolder holder;
+
+  // Every other block was released by the thread that allocated it. The first
+  // half of the rest keeps the chunk mapped, so the lock of `memmgr` is not
+  // needed to unregister it.
+  INFO("Releasing while another thread holds the lock of the memory manager...");
+  VMemTest_holdLock(holder, &memmgr);
+
+  for (int i = 1; i < kCount; i += 2) {
+    EXPECT(memmgr.release(p[i]) == kErrorOk,
+      "Failed to free %p.", p[i]);
+  }
+
+  EXPECT(arena->_pending == nullptr && memmgr.getUsedBytes() < usedBytes,
+    "Releases to an unlocked arena shouldn't be queued.");
+
+  VMemTest_unholdLock(holder);
+  usedBytes = memmgr.getUsedBytes();
+
+  INFO("Releasing while another thread holds the lock of the arena...");
+  VMemTest_holdLock(holder, arena);
+
+  for (int i = kCount + 1; i < kCount * 2; i += 2) {
+    EXPECT(memmgr.release(p[i]) == kErrorOk,
+      "Failed to free %p.", p[i]);
+  }
+
+  size_t pendingCount = 0;
+  for (PendingRelease* pending = arena->_pending; pending != nullptr; pending = pending->next)
+    pendingCount++;
+
+  EXPECT(pendingCount == kCount / 2,
+    "Releases should be queued, %u of %u found.",
+    static_cast<unsigned int>(pendingCount), static_cast<unsigned int>(kCount / 2));
+  EXPECT(memmgr.getUsedBytes() == usedBytes,
+    "Queued releases shouldn't be applied while the arena is locked.");
+
+  INFO("Draining queued releases by the thread that holds the lock...");
+  VMemTest_unholdLock(holder);
+  VMemTest_stats(memmgr);
+
+  EXPECT(arena->_pending == nullptr && memmgr.getUsedBytes() == 0,
+    "Queued releases should be drained when the arena is unlocked.");
+
+  memmgr.getStats(&stats, false);
+  EXPECT(stats.lockContentionCount - contentionCount == kCount / 2,
+    "Each queued release should be counted as a lock contention.");
+
+  memmgr.trim();
+  EXPECT(memmgr.getAllocatedBytes() == 0,
+    "All chunks should be unmapped.");
+}
+#endif // ASMJIT_OS_POSIX
 #endif // ASMJIT_TEST
 
 } // asmjit namespace
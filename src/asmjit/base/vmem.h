@@ -43,6 +43,92 @@ ASMJIT_ENUM(VMemFlags) {
   kVMemFlagExecutable = 0x00000002
 };
 
+// ============================================================================
+// [asmjit::VMemHugePages]
+// ============================================================================
+
+//! Huge pages backing a chunk of virtual memory, see `VMemUtil::allocHugePages()`.
+ASMJIT_ENUM(VMemHugePages) {
+  //! Memory is backed by regular pages.
+  kVMemHugePagesNone = 0,
+  //! Memory is aligned to the huge page size and advised to be backed by
+  //! transparent huge pages, but no huge page backs it (yet). It's up to the
+  //! kernel whether it happens, usually when the memory is touched.
+  kVMemHugePagesAdvised = 1,
+  //! Memory is advised and at least partially backed by transparent huge
+  //! pages, see `VMemUtil::getTransparentHugePagesSize()`.
+  kVMemHugePagesTransparent = 2,
+  //! Memory is backed by explicitly reserved huge pages (`MAP_HUGETLB` or
+  //! `MEM_LARGE_PAGES`).
+  kVMemHugePagesExplicit = 3
+};
+
+// ============================================================================
+// [asmjit::VMemChunkInfo]
+// ============================================================================
+
+//! Information about a chunk of virtual memory managed by `VMemMgr`.
+struct VMemChunkInfo {
+  //! Address of the chunk.
+  void* address;
+  //! Size of the chunk in bytes.
+  size_t size;
+  //! How many bytes of the chunk are used.
+  size_t used;
+  //! Huge pages backing the chunk, see \ref VMemHugePages.
+  uint32_t hugePages;
+};
+
+// ============================================================================
+// [asmjit::VMemStats]
+// ============================================================================
+
+//! \internal
+ASMJIT_ENUM(VMemStatsLimits) {
+  //! Count of buckets of `VMemStats::freeBlocks`.
+  kVMemStatsBucketCount = 16
+};
+
+//! Snapshot of `VMemMgr` statistics, see `VMemMgr::getStats()`.
+struct VMemStats {
+  //! Count of chunks of freeable memory.
+  size_t chunkCount;
+  //! Count of chunks of freeable memory allocated with huge pages (advised,
+  //! transparent or explicit). Always zero if dual mapping is enabled, huge
+  //! pages are silently not used for dual mapped chunks.
+  size_t hugePageChunkCount;
+  //! Bytes of freeable memory allocated from the system.
+  size_t allocatedBytes;
+  //! Bytes of freeable memory used.
+  size_t usedBytes;
+  //! Bytes of freeable memory released, but cached by size-class bins.
+  size_t cachedBytes;
+
+  //! Count of chunks of permanent memory.
+  size_t permanentChunkCount;
+  //! Bytes of permanent memory allocated from the system.
+  size_t permanentAllocatedBytes;
+  //! Bytes of permanent memory used.
+  size_t permanentUsedBytes;
+
+  //! Size of a block of freeable memory (the unit of `freeBlocks`).
+  size_t blockDensity;
+  //! Size of the largest continuous free block in bytes.
+  size_t largestFreeBlock;
+  //! Histogram of free blocks, bucket `i` counts continuous free blocks of
+  //! `2^i` to `2^(i+1) - 1` block density units, the last bucket counts also
+  //! all larger blocks. Only filled if requested by `getStats()`.
+  size_t freeBlocks[kVMemStatsBucketCount];
+
+  //! Count of successful allocations (freeable and permanent).
+  uint64_t allocCount;
+  //! Count of successful releases.
+  uint64_t releaseCount;
+  //! Count of times a thread had to wait for a lock or had to defer a release
+  //! because the lock was held by another thread.
+  uint64_t lockContentionCount;
+};
+
 // ============================================================================
 // [asmjit::VMemUtil]
 // ============================================================================
@@ -74,6 +160,55 @@ struct VMemUtil {
   //! Free memory allocated by `alloc()`.
   static ASMJIT_API Error release(void* addr, size_t length) noexcept;
 
+  //! Get the size of a huge page, zero if huge pages are not supported.
+  //!
+  //! The size is queried from the system once (the size of a transparent huge
+  //! page or the default huge page size on Linux).
+  static ASMJIT_API size_t getHugePageSize() noexcept;
+
+  //! Get how many bytes of memory at `addr` of `length` bytes are backed by
+  //! transparent huge pages, zero if unknown or not supported.
+  //!
+  //! On Linux the `AnonHugePages` of all mappings in `/proc/self/smaps` that
+  //! overlap the range are summed, so mappings merged by the kernel with the
+  //! range are counted as a whole.
+  static ASMJIT_API size_t getTransparentHugePagesSize(void* addr, size_t length) noexcept;
+
+  //! Allocate virtual memory backed by huge pages.
+  //!
+  //! The length is aligned to `getHugePageSize()`. Explicit huge pages are
+  //! tried first, then a huge page aligned region advised to be backed by
+  //! transparent huge pages (Linux). If neither is possible the call falls
+  //! back to `alloc()`. What was obtained is stored to `hugePages`, see
+  //! \ref VMemHugePages, advised memory is reported as `kVMemHugePagesAdvised`
+  //! as it's not backed by any page yet. Memory is freed by `release()`.
+  static ASMJIT_API void* allocHugePages(size_t length, size_t* allocated, uint32_t flags, uint32_t* hugePages) noexcept;
+
+  //! Allocate virtual memory that is mapped twice.
+  //!
+  //! Returns a view of the memory that is readable and executable and stores
+  //! a view of the same memory that is readable and writable to `rw`. Neither
+  //! view is writable and executable at the same time, which makes it usable
+  //! on systems that refuse RWX pages. Uses `memfd_create()` (or `shm_open()`)
+  //! on POSIX and a page-file backed section on Windows. Returns `nullptr` on
+  //! failure.
+  static ASMJIT_API void* allocDualMapping(size_t length, size_t* allocated, void** rw) noexcept;
+  //! Free memory allocated by `allocDualMapping()`.
+  static ASMJIT_API Error releaseDualMapping(void* rx, void* rw, size_t length) noexcept;
+
+  //! Reserve address space of `length` bytes within `maxDistance` bytes of
+  //! `target`.
+  //!
+  //! The whole reserved range is within `maxDistance` bytes of `target`. The
+  //! memory is not accessible until committed by `commit()`. Returns the
+  //! address of reserved memory, or `nullptr` if there is no such space. The
+  //! reservation is freed by `release()`.
+  static ASMJIT_API void* reserveNear(const void* target, size_t maxDistance, size_t length, size_t* reserved) noexcept;
+  //! Commit `length` bytes at `addr` reserved by `reserveNear()`.
+  static ASMJIT_API Error commit(void* addr, size_t length, uint32_t flags) noexcept;
+  //! Decommit `length` bytes at `addr`, the address space stays reserved.
+  static ASMJIT_API Error decommit(void* addr, size_t length) noexcept;
+
 #if ASMJIT_OS_WINDOWS
   //! Allocate virtual memory of `hProcess` (Windows only).
   static ASMJIT_API void* allocProcessMemory(HANDLE hProcess, size_t length, size_t* allocated, uint32_t flags) noexcept;
@@ -83,6 +218,41 @@ struct VMemUtil {
 #endif // ASMJIT_OS_WINDOWS
 };
 
+// ============================================================================
+// [asmjit::VMemMover]
+// ============================================================================
+
+//! Moves code during `VMemMgr::compact()`.
+//!
+//! The default implementation only copies the code, which is correct for
+//! position independent code only. Reimplement `move()` to relocate the code
+//! to its new address (for example by relocating the code held by `Assembler`
+//! again) and to update all references to it.
+class ASMJIT_VIRTAPI VMemMover {
+ public:
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! Create a new `VMemMover` instance.
+  ASMJIT_API VMemMover() noexcept;
+  //! Destroy the `VMemMover` instance.
+  ASMJIT_API virtual ~VMemMover() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Move]
+  // --------------------------------------------------------------------------
+
+  //! Move `size` bytes of code at `src` to `dst`.
+  //!
+  //! The code must be written through `dstRw`, which differs from `dst` only
+  //! if the memory is dual mapped. `userData` is the value passed to
+  //! `VMemMgr::setMovable()`. Return `false` to keep the code at `src`.
+  //!
+  //! Called without the lock of `VMemMgr` held, see `VMemMgr::compact()`.
+  ASMJIT_API virtual bool move(void* dst, void* dstRw, const void* src, size_t size, void* userData) noexcept;
+};
+
 // ============================================================================
 // [asmjit::VMemMgr]
 // ============================================================================
@@ -117,6 +287,20 @@ class VMemMgr {
   //! Free all allocated memory.
   ASMJIT_API void reset() noexcept;
 
+  // --------------------------------------------------------------------------
+  // [Trim]
+  // --------------------------------------------------------------------------
+
+  //! Return all cached blocks back to the allocator.
+  //!
+  //! Small blocks (up to 16 times the block density, 1kB by default) are not
+  //! returned to the allocator when released, they are cached in size-class
+  //! bins instead so the next allocation of the same size is O(1). Cached
+  //! blocks are not counted by `getUsedBytes()` and a chunk that contains only
+  //! cached blocks is unmapped automatically, however, cached blocks still
+  //! fragment chunks that are in use, which is what `trim()` is for.
+  ASMJIT_API void trim() noexcept;
+
   // --------------------------------------------------------------------------
   // [Accessors]
   // --------------------------------------------------------------------------
@@ -129,14 +313,16 @@ class VMemMgr {
 #endif // ASMJIT_OS_WINDOWS
 
   //! Get how many bytes are currently allocated.
-  ASMJIT_INLINE size_t getAllocatedBytes() const noexcept {
-    return _allocatedBytes;
-  }
+  //!
+  //! NOTE: If per-thread arenas are enabled the result is a sum of all arenas.
+  ASMJIT_API size_t getAllocatedBytes() const noexcept;
 
   //! Get how many bytes are currently used.
-  ASMJIT_INLINE size_t getUsedBytes() const noexcept {
-    return _usedBytes;
-  }
+  //!
+  //! NOTE: If per-thread arenas are enabled the result is a sum of all arenas.
+  //! Memory released by a thread that doesn't own it is counted as used until
+  //! the owning arena processes the release.
+  ASMJIT_API size_t getUsedBytes() const noexcept;
 
   //! Get whether to keep allocated memory after the `VMemMgr` is destroyed.
   //!
@@ -161,6 +347,169 @@ class VMemMgr {
     _keepVirtualMemory = keepVirtualMemory;
   }
 
+  //! Get the allocator used for bookkeeping (nullptr if default).
+  ASMJIT_INLINE Allocator* getAllocator() const noexcept {
+    return _allocator;
+  }
+
+  //! Set the allocator used to allocate bookkeeping data (nodes, bitmaps,
+  //! arenas, etc...), the virtual memory itself is not affected.
+  //!
+  //! Returns `kErrorInvalidState` if the memory manager has already allocated
+  //! anything, arenas or a reserved region, so it has to be called first.
+  ASMJIT_API Error setAllocator(Allocator* allocator) noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Dual Mapping]
+  // --------------------------------------------------------------------------
+
+  //! Get whether new chunks are dual mapped (W^X).
+  ASMJIT_INLINE bool getDualMapping() const noexcept {
+    return _dualMapping;
+  }
+
+  //! Set whether new chunks are dual mapped (W^X).
+  //!
+  //! Dual mapped chunks are mapped twice by `VMemUtil::allocDualMapping()`,
+  //! the address returned by `alloc()` points to a readable and executable
+  //! view and a readable and writable view of the same memory is returned
+  //! through its `rwPtr` argument. The code has to be written through the
+  //! writable view, protection of pages never changes. The setting only
+  //! affects chunks mapped after the call.
+  //!
+  //! Dual mapping is not available when allocating memory of a remote process,
+  //! `kErrorInvalidState` is returned in that case.
+  ASMJIT_API Error setDualMapping(bool dualMapping) noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Huge Pages]
+  // --------------------------------------------------------------------------
+
+  //! Get whether new chunks are backed by huge pages.
+  ASMJIT_INLINE bool getHugePages() const noexcept {
+    return _hugePages;
+  }
+
+  //! Set whether new chunks are backed by huge pages.
+  //!
+  //! Chunks are allocated by `VMemUtil::allocHugePages()`, which means that
+  //! each chunk is at least one huge page large (usually 2MB on Linux) and
+  //! falls back to regular pages transparently. Use `getChunks()` to find out
+  //! which chunks were actually backed by huge pages.
+  //!
+  //! NOTE: Dual mapped chunks are never backed by huge pages, the setting is
+  //! ignored if dual mapping is enabled, see `VMemStats::hugePageChunkCount`.
+  //! The setting only affects chunks mapped after the call.
+  ASMJIT_INLINE void setHugePages(bool hugePages) noexcept {
+    _hugePages = hugePages;
+  }
+
+  // --------------------------------------------------------------------------
+  // [Reserved Region]
+  // --------------------------------------------------------------------------
+
+  //! Reserve a region of `size` bytes within `maxDistance` bytes of `target`
+  //! and carve all chunks out of it.
+  //!
+  //! This is mostly useful on X64 where code can only reach functions within
+  //! 2GB directly. Reserving the region near a function of the host binary
+  //! (for example near `main`) means that calls from generated code to the
+  //! host binary are encoded as `call rel32` and don't need trampolines. The
+  //! default `maxDistance` leaves 256MB for the host binary itself.
+  //!
+  //! When the region is full chunks are allocated anywhere again. The region
+  //! can only be set if no memory is allocated and cannot be combined with
+  //! dual mapping or memory of a remote process, `kErrorInvalidState` is
+  //! returned in such case. Passing zero `size` releases the region.
+  ASMJIT_API Error setReservedRegion(const void* target, size_t size, size_t maxDistance = 0x70000000) noexcept;
+
+  //! Get the address of the reserved region and store its size to `size`.
+  //!
+  //! Returns nullptr if there is no region.
+  ASMJIT_API void* getReservedRegion(size_t* size = nullptr) const noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Chunks]
+  // --------------------------------------------------------------------------
+
+  //! Get information about chunks of freeable memory.
+  //!
+  //! Stores information about at most `maxCount` chunks to `dst` and returns
+  //! the count of all chunks, which can be greater than `maxCount`. Chunks
+  //! advised to be backed by transparent huge pages are checked whether they
+  //! are backed by them, which may be slow.
+  ASMJIT_API size_t getChunks(VMemChunkInfo* dst, size_t maxCount) const noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Stats]
+  // --------------------------------------------------------------------------
+
+  //! Get a snapshot of statistics.
+  //!
+  //! If per-thread arenas are enabled the statistics of all arenas are summed,
+  //! arenas are locked one by one so the snapshot doesn't stall all threads at
+  //! once. Filling `largestFreeBlock` and `freeBlocks` requires scanning bit
+  //! arrays, pass `false` as `scanFreeBlocks` to only get counters, which is
+  //! proportional to the count of chunks only (they are zero in that case).
+  ASMJIT_API void getStats(VMemStats* stats, bool scanFreeBlocks = true) const noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Arenas]
+  // --------------------------------------------------------------------------
+
+  //! Get the count of per-thread arenas, zero if arenas are disabled.
+  ASMJIT_INLINE uint32_t getArenaCount() const noexcept {
+    return _arenaCount;
+  }
+
+  //! Set the count of per-thread arenas.
+  //!
+  //! When arenas are enabled each thread is assigned an arena (threads are
+  //! distributed in a round-robin fashion if there are more threads than
+  //! arenas) that has its own lock and its own chunks of virtual memory, so
+  //! threads that allocate and release code concurrently don't serialize on
+  //! a single lock. The lock of `VMemMgr` itself is only used when a chunk of
+  //! virtual memory is mapped or unmapped. A thread that releases memory it
+  //! doesn't own finds the owning arena without locking and sends the release
+  //! through a lock-free queue unless the arena can be locked without waiting.
+  //! The queue is drained by any thread that locks the arena, including the
+  //! thread that holds the lock when it unlocks it, so memory released to an
+  //! arena of an idle or exited thread doesn't wait for its next allocation.
+  //!
+  //! Passing zero or one disables arenas. Arenas can only be changed if there
+  //! is no freeable memory allocated, `kErrorInvalidState` is returned if there
+  //! is.
+  ASMJIT_API Error setArenaCount(uint32_t count) noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Compaction]
+  // --------------------------------------------------------------------------
+
+  //! Set whether freeable memory `p` can be moved by `compact()`.
+  //!
+  //! `userData` is passed to `VMemMover::move()` when `p` is moved. Memory is
+  //! not movable by default. Returns `kErrorInvalidArgument` if `p` was not
+  //! allocated by `alloc()` as freeable memory.
+  ASMJIT_API Error setMovable(void* p, bool movable, void* userData = nullptr) noexcept;
+
+  //! Compact freeable memory.
+  //!
+  //! Moves movable blocks out of the least used chunks into more used chunks
+  //! and unmaps chunks that become empty. A chunk is only evacuated if all of
+  //! its blocks are movable and each of them fits into the remaining chunks,
+  //! otherwise nothing is moved out of it. No chunk is mapped by compaction.
+  //! Uses the default `VMemMover` if `mover` is null. Returns the count of
+  //! chunks unmapped.
+  //!
+  //! `mover` is called without any lock held, so it can allocate and release
+  //! memory, but it must not release the blocks being moved. Memory that is
+  //! already being compacted by another thread is skipped.
+  //!
+  //! NOTE: Moved code is released immediately, the caller must guarantee that
+  //! no thread executes it or holds its address (see `JitRuntime::retire()`
+  //! for a way to find out when it's safe).
+  ASMJIT_API size_t compact(VMemMover* mover = nullptr) noexcept;
+
   // --------------------------------------------------------------------------
   // [Alloc / Release]
   // --------------------------------------------------------------------------
@@ -170,7 +519,15 @@ class VMemMgr {
   //! Note that if you are implementing your own virtual memory manager then you
   //! can quitly ignore type of allocation. This is mainly for AsmJit to memory
   //! manager that allocated memory will be never freed.
-  ASMJIT_API void* alloc(size_t size, uint32_t type = kVMemAllocFreeable) noexcept;
+  //!
+  //! If `rwPtr` is not null it receives the address the memory should be
+  //! written through, which differs from the returned address only if the
+  //! memory is dual mapped, see \ref setDualMapping.
+  ASMJIT_API void* alloc(size_t size, uint32_t type = kVMemAllocFreeable, void** rwPtr = nullptr) noexcept;
+
+  //! Get the alignment of memory returned by `alloc()` for allocations of
+  //! `type`, which is the block density for `kVMemAllocFreeable`.
+  ASMJIT_API size_t getAlignment(uint32_t type) const noexcept;
 
   //! Free previously allocated memory at a given `address`.
   ASMJIT_API Error release(void* p) noexcept;
@@ -203,12 +560,25 @@ class VMemMgr {
   //! How many bytes are currently used.
   size_t _usedBytes;
 
+  //! Count of successful allocations.
+  uint64_t _allocCount;
+  //! Count of successful releases.
+  uint64_t _releaseCount;
+  //! Count of contended locks and deferred releases.
+  uint64_t _lockContentionCount;
+
   //! \internal
   //! \{
 
   struct RbNode;
   struct MemNode;
   struct PermanentNode;
+  struct ArenaChunk;
+  struct ArenaTable;
+  struct PendingRelease;
+  struct Bins;
+  struct MovableBlock;
+  struct Region;
 
   // Memory nodes root.
   MemNode* _root;
@@ -219,6 +589,45 @@ class VMemMgr {
   // Permanent memory.
   PermanentNode* _permanent;
 
+  // Per-thread arenas (only used by the owner).
+  VMemMgr* _arenas;
+  uint32_t _arenaCount;
+  // Chunks allocated by arenas sorted by address, replaced when a chunk is
+  // mapped or unmapped and read without a lock (only used by the owner).
+  ArenaTable* volatile _arenaTable;
+  // Replaced tables that could still be read (only used by the owner).
+  ArenaTable* _arenaRetired;
+  // Count of threads reading `_arenaTable` (only used by the owner).
+  volatile uint32_t _arenaReaders;
+  // Count of chunks allocated by arenas (only used by the owner).
+  size_t _arenaChunkCount;
+
+  // Owner of this arena (only used by arenas).
+  VMemMgr* _owner;
+  // Releases sent to this arena by other threads (only used by arenas).
+  PendingRelease* volatile _pending;
+
+  // Size-class bins of small released blocks.
+  Bins* _bins;
+
+  // Movable blocks sorted by address.
+  MovableBlock* _movables;
+  size_t _movableCount;
+  size_t _movableCapacity;
+  // Whether `compact()` is moving blocks with the lock released.
+  bool _compacting;
+
+  // Reserved region chunks are carved from (only used by the owner).
+  Region* _region;
+
+  // Allocator of bookkeeping data (nullptr if default), shared by arenas.
+  Allocator* _allocator;
+
+  // Whether to map new chunks twice (RW + RX).
+  bool _dualMapping;
+  // Whether to back new chunks by huge pages.
+  bool _hugePages;
+
   //! \}
 };
 
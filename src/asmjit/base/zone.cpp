@@ -12,6 +12,10 @@
 #include "../base/zone.h"
 #include <stdarg.h>
 
+#if !ASMJIT_OS_WINDOWS
+# include <sched.h>
+#endif // !ASMJIT_OS_WINDOWS
+
 // [Api-Begin]
 #include "../apibegin.h"
 
@@ -22,13 +26,247 @@ static const Zone::Block Zone_zeroBlock = {
   nullptr, nullptr, nullptr, nullptr, { 0 }
 };
 
+// ============================================================================
+// [asmjit::Zone - Cache]
+// ============================================================================
+
+//! \internal
+//!
+//! Count of size classes of `ZoneCache`, one per bit of `size_t`.
+static const uint32_t kZoneCacheClassCount = static_cast<uint32_t>(sizeof(size_t) * 8);
+
+//! \internal
+//!
+//! Global cache of blocks released by `Zone`s.
+//!
+//! The cache is protected by a spin-lock instead of `Lock`, because it has to
+//! be usable by `Zone`s created and destroyed during static initialization and
+//! destruction. Blocks are kept in lists indexed by a size class (the index of
+//! the most significant bit of their size), so the lock is only held to link
+//! or unlink a single block and never to search for one. Members read without
+//! the lock are accessed by `zoneCacheLoad()` and `zoneCacheStore()`.
+struct ZoneCache {
+  //! Spin-lock.
+  volatile long lock;
+  //! Cached blocks linked by `Block::next`, indexed by a size class.
+  Zone::Block* volatile first[kZoneCacheClassCount];
+  //! How many bytes are cached.
+  volatile size_t bytes;
+  //! Maximum bytes to cache.
+  size_t maxBytes;
+  //! Maximum size of a block to cache.
+  size_t maxBlockSize;
+};
+static ZoneCache Zone_cache = {
+  0, { nullptr }, 0, 1024 * 1024, 256 * 1024
+};
+
+//! \internal
+//!
+//! Load `*src`, which can be modified by another thread.
+template<typename T>
+static ASMJIT_INLINE T zoneCacheLoad(T const volatile* src) noexcept {
+#if ASMJIT_CC_MSC
+  // Volatile reads have acquire semantics with MSC.
+  return *src;
+#else
+  return __atomic_load_n(src, __ATOMIC_ACQUIRE);
+#endif
+}
+
+//! \internal
+//!
+//! Store `value` to `*dst`, which can be read by another thread without a lock.
+template<typename T>
+static ASMJIT_INLINE void zoneCacheStore(T volatile* dst, T value) noexcept {
+#if ASMJIT_CC_MSC
+  // Volatile writes have release semantics with MSC.
+  *dst = value;
+#else
+  __atomic_store_n(dst, value, __ATOMIC_RELEASE);
+#endif
+}
+
+//! \internal
+//!
+//! Tell the CPU that the calling thread is spinning.
+static ASMJIT_INLINE void zoneCachePause() noexcept {
+#if ASMJIT_OS_WINDOWS
+  YieldProcessor();
+#elif (ASMJIT_ARCH_X86 || ASMJIT_ARCH_X64) && (ASMJIT_CC_GCC || ASMJIT_CC_CLANG)
+  __builtin_ia32_pause();
+#endif
+}
+
+//! \internal
+//!
+//! Give up the rest of the time slice of the calling thread.
+static ASMJIT_INLINE void zoneCacheYield() noexcept {
+#if ASMJIT_OS_WINDOWS
+  ::SwitchToThread();
+#else
+  ::sched_yield();
+#endif
+}
+
+static ASMJIT_INLINE void zoneCacheLock(ZoneCache* cache) noexcept {
+  uint32_t spins = 0;
+
+  for (;;) {
+#if ASMJIT_CC_MSC
+    if (::InterlockedExchange(&cache->lock, 1) == 0)
+      return;
+#else
+    if (__sync_lock_test_and_set(&cache->lock, 1) == 0)
+      return;
+#endif
+
+    // Wait until the lock looks free before trying to take it again. The
+    // holder only links or unlinks a block, so pause for a while and yield
+    // if it has been preempted.
+    do {
+      if (++spins < 64)
+        zoneCachePause();
+      else
+        zoneCacheYield();
+    } while (zoneCacheLoad(&cache->lock) != 0);
+  }
+}
+
+static ASMJIT_INLINE void zoneCacheUnlock(ZoneCache* cache) noexcept {
+#if ASMJIT_CC_MSC
+  ::InterlockedExchange(&cache->lock, 0);
+#else
+  __sync_lock_release(&cache->lock);
+#endif
+}
+
+//! \internal
+//!
+//! Get the size class of a block of `size` bytes.
+static ASMJIT_INLINE uint32_t zoneCacheClass(size_t size) noexcept {
+  uint32_t index = 0;
+  while ((size >>= 1) != 0)
+    index++;
+  return index;
+}
+
+//! \internal
+//!
+//! Unlink the first block of the size class `index` if its size is within
+//! `[minSize, maxSize]`, must be called with the lock held.
+static ASMJIT_INLINE Zone::Block* zoneCacheUnlink(ZoneCache* cache, uint32_t index, size_t minSize, size_t maxSize) noexcept {
+  Zone::Block* block = cache->first[index];
+  if (block == nullptr)
+    return nullptr;
+
+  size_t size = block->getBlockSize();
+  if (size < minSize || size > maxSize)
+    return nullptr;
+
+  zoneCacheStore(&cache->first[index], block->next);
+  zoneCacheStore(&cache->bytes, cache->bytes - size);
+  return block;
+}
+
+//! \internal
+//!
+//! Get a cached block that has at least `blockSize` bytes, but it's not more
+//! than twice as large.
+//!
+//! Only the first block of the size class of `blockSize` and of the next one
+//! is considered, blocks of the next class are never smaller than `blockSize`.
+static Zone::Block* zoneCacheAcquire(size_t blockSize) noexcept {
+  ZoneCache* cache = &Zone_cache;
+  uint32_t index = zoneCacheClass(blockSize);
+
+  if (index + 1 >= kZoneCacheClassCount)
+    return nullptr;
+
+  if (zoneCacheLoad(&cache->first[index]) == nullptr &&
+      zoneCacheLoad(&cache->first[index + 1]) == nullptr)
+    return nullptr;
+
+  size_t maxSize = blockSize * 2;
+  zoneCacheLock(cache);
+
+  Zone::Block* block = zoneCacheUnlink(cache, index + 1, blockSize, maxSize);
+  if (block == nullptr)
+    block = zoneCacheUnlink(cache, index, blockSize, maxSize);
+
+  zoneCacheUnlock(cache);
+  return block;
+}
+
+//! \internal
+//!
+//! Release `block` to the cache or free it if the cache is full.
+static void zoneCacheRelease(Zone::Block* block) noexcept {
+  ZoneCache* cache = &Zone_cache;
+  size_t size = block->getBlockSize();
+
+  if (size <= cache->maxBlockSize) {
+    uint32_t index = zoneCacheClass(size);
+    zoneCacheLock(cache);
+
+    if (cache->bytes + size <= cache->maxBytes) {
+      block->next = cache->first[index];
+      zoneCacheStore(&cache->first[index], block);
+      zoneCacheStore(&cache->bytes, cache->bytes + size);
+
+      zoneCacheUnlock(cache);
+      return;
+    }
+    zoneCacheUnlock(cache);
+  }
+
+  ASMJIT_FREE(block);
+}
+
+size_t Zone::getCachedBytes() noexcept {
+  return zoneCacheLoad(&Zone_cache.bytes);
+}
+
+void Zone::setCacheLimits(size_t maxBytes, size_t maxBlockSize) noexcept {
+  ZoneCache* cache = &Zone_cache;
+
+  zoneCacheLock(cache);
+  cache->maxBytes = maxBytes;
+  cache->maxBlockSize = maxBlockSize;
+  zoneCacheUnlock(cache);
+}
+
+void Zone::trimCache() noexcept {
+  ZoneCache* cache = &Zone_cache;
+
+  Block* blocks[kZoneCacheClassCount];
+
+  zoneCacheLock(cache);
+  for (uint32_t i = 0; i < kZoneCacheClassCount; i++) {
+    blocks[i] = cache->first[i];
+    zoneCacheStore<Block*>(&cache->first[i], nullptr);
+  }
+  zoneCacheStore<size_t>(&cache->bytes, 0);
+  zoneCacheUnlock(cache);
+
+  for (uint32_t i = 0; i < kZoneCacheClassCount; i++) {
+    Block* block = blocks[i];
+    while (block != nullptr) {
+      Block* next = block->next;
+      ASMJIT_FREE(block);
+      block = next;
+    }
+  }
+}
+
 // ============================================================================
 // [asmjit::Zone - Construction / Destruction]
 // ============================================================================
 
-Zone::Zone(size_t blockSize) noexcept {
+Zone::Zone(size_t blockSize, Allocator* allocator) noexcept {
   _block = const_cast<Zone::Block*>(&Zone_zeroBlock);
   _blockSize = blockSize;
+  _allocator = allocator;
 }
 
 Zone::~Zone() noexcept {
@@ -49,17 +287,25 @@ void Zone::reset(bool releaseMemory) noexcept {
   if (releaseMemory) {
     // Since cur can be in the middle of the double-linked list, we have to
     // traverse to both directions `prev` and `next` separately.
+    Allocator* allocator = _allocator;
     Block* next = cur->next;
+
     do {
       Block* prev = cur->prev;
-      ASMJIT_FREE(cur);
+      if (allocator != nullptr)
+        allocator->release(cur);
+      else
+        zoneCacheRelease(cur);
       cur = prev;
     } while (cur != nullptr);
 
     cur = next;
     while (cur != nullptr) {
       next = cur->next;
-      ASMJIT_FREE(cur);
+      if (allocator != nullptr)
+        allocator->release(cur);
+      else
+        zoneCacheRelease(cur);
       cur = next;
     }
 
@@ -74,6 +320,24 @@ void Zone::reset(bool releaseMemory) noexcept {
   }
 }
 
+// ============================================================================
+// [asmjit::Zone - State]
+// ============================================================================
+
+void Zone::restoreState(const State& state) noexcept {
+  Block* cur = state.block;
+
+  // The zone had no memory when the state was saved, rewind to the first block.
+  if (cur == &Zone_zeroBlock) {
+    reset(false);
+    return;
+  }
+
+  ASMJIT_ASSERT(state.pos >= cur->data && state.pos <= cur->end);
+  cur->pos = state.pos;
+  _block = cur;
+}
+
 // ============================================================================
 // [asmjit::Zone - Alloc]
 // ============================================================================
@@ -101,12 +365,16 @@ void* Zone::_alloc(size_t size) noexcept {
   if (blockSize > ~static_cast<size_t>(0) - sizeof(Block))
     return nullptr;
 
-  Block* newBlock = static_cast<Block*>(ASMJIT_ALLOC(sizeof(Block) - sizeof(void*) + blockSize));
-  if (newBlock == nullptr)
-    return nullptr;
+  // Reuse a block released by another `Zone` if possible, its `end` is kept.
+  Block* newBlock = _allocator ? static_cast<Block*>(nullptr) : zoneCacheAcquire(blockSize);
+  if (newBlock == nullptr) {
+    newBlock = static_cast<Block*>(MemUtil::alloc(_allocator, sizeof(Block) - sizeof(void*) + blockSize));
+    if (newBlock == nullptr)
+      return nullptr;
+    newBlock->end = newBlock->data + blockSize;
+  }
 
   newBlock->pos = newBlock->data + size;
-  newBlock->end = newBlock->data + blockSize;
   newBlock->prev = nullptr;
   newBlock->next = nullptr;
 
@@ -187,6 +455,151 @@ char* Zone::sformat(const char* fmt, ...) noexcept {
   return static_cast<char*>(dup(buf, len));
 }
 
+// ============================================================================
+// [asmjit::ZoneVectorBase - Helpers]
+// ============================================================================
+
+Error ZoneVectorBase::_grow(size_t n, size_t sizeOfT) noexcept {
+  size_t threshold = kMemAllocGrowMax / sizeOfT;
+  size_t capacity = _capacity;
+  size_t after = _length;
+
+  if (IntTraits<size_t>::maxValue() - n < after)
+    return kErrorNoHeapMemory;
+
+  after += n;
+
+  if (capacity >= after)
+    return kErrorOk;
+
+  if (capacity < 16)
+    capacity = 16;
+
+  while (capacity < after) {
+    if (capacity < threshold)
+      capacity *= 2;
+    else
+      capacity += threshold;
+  }
+
+  return _reserve(capacity, sizeOfT);
+}
+
+Error ZoneVectorBase::_reserve(size_t n, size_t sizeOfT) noexcept {
+  size_t oldCapacity = _capacity;
+  if (oldCapacity >= n)
+    return kErrorOk;
+
+  size_t nBytes = n * sizeOfT;
+  if (ASMJIT_UNLIKELY(nBytes / sizeOfT != n))
+    return kErrorNoHeapMemory;
+
+  // Grow in place if the buffer is the last allocation of the current block.
+  Zone::Block* block = _zone->_block;
+  uint8_t* oldEnd = static_cast<uint8_t*>(_data) + oldCapacity * sizeOfT;
+
+  if (_data != nullptr && oldEnd == block->pos) {
+    size_t extra = nBytes - oldCapacity * sizeOfT;
+    if (block->getRemainingSize() >= extra) {
+      block->pos += extra;
+      _capacity = n;
+      return kErrorOk;
+    }
+  }
+
+  void* newData = _zone->alloc(nBytes);
+  if (ASMJIT_UNLIKELY(newData == nullptr))
+    return kErrorNoHeapMemory;
+
+  if (_length != 0)
+    ::memcpy(newData, _data, _length * sizeOfT);
+
+  _data = newData;
+  _capacity = n;
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::Zone - Test]
+// ============================================================================
+
+#if defined(ASMJIT_TEST)
+UNIT(base_zone_cache) {
+  Zone::trimCache();
+
+  {
+    Zone zone(8192 - Zone::kZoneOverhead);
+    EXPECT(zone.alloc(100) != nullptr,
+      "Couldn't allocate zone memory.");
+  }
+
+  size_t cached = Zone::getCachedBytes();
+  INFO("Cached %u bytes.", static_cast<unsigned int>(cached));
+  EXPECT(cached >= 8192 - Zone::kZoneOverhead,
+    "Blocks of a destroyed zone should be cached.");
+
+  {
+    Zone zone(8192 - Zone::kZoneOverhead);
+    EXPECT(zone.alloc(100) != nullptr,
+      "Couldn't allocate zone memory.");
+    EXPECT(Zone::getCachedBytes() < cached,
+      "A cached block should be reused.");
+  }
+
+  INFO("Checking that only blocks up to twice the requested size are reused...");
+  Zone::trimCache();
+
+  {
+    Zone zone(16384 - Zone::kZoneOverhead);
+    EXPECT(zone.alloc(100) != nullptr,
+      "Couldn't allocate zone memory.");
+  }
+
+  cached = Zone::getCachedBytes();
+  {
+    Zone zone(4096 - Zone::kZoneOverhead);
+    EXPECT(zone.alloc(100) != nullptr,
+      "Couldn't allocate zone memory.");
+    EXPECT(Zone::getCachedBytes() == cached,
+      "A block more than twice as large shouldn't be reused.");
+  }
+
+  {
+    Zone zone(12288 - Zone::kZoneOverhead);
+    EXPECT(zone.alloc(100) != nullptr,
+      "Couldn't allocate zone memory.");
+    EXPECT(Zone::getCachedBytes() < cached,
+      "A block of a larger size class should be reused.");
+  }
+
+  Zone::trimCache();
+  EXPECT(Zone::getCachedBytes() == 0,
+    "All blocks should be released.");
+}
+
+UNIT(base_zone_containers) {
+  Zone zone(4096 - Zone::kZoneOverhead);
+  ZoneVector<uint32_t> vec(&zone);
+
+  uint32_t i;
+  uint32_t kCount = 1000;
+
+  INFO("Filling ZoneVector with %u items.", kCount);
+  for (i = 0; i < kCount; i++) {
+    EXPECT(vec.append(i) == kErrorOk,
+      "ZoneVector::append() failed.");
+  }
+
+  EXPECT(vec.getLength() == kCount,
+    "ZoneVector should contain %u items.", kCount);
+
+  for (i = 0; i < kCount; i++) {
+    EXPECT(vec[i] == i,
+      "ZoneVector[%u] should be %u.", i, i);
+  }
+}
+#endif // ASMJIT_TEST
+
 } // asmjit namespace
 
 // [Api-End]
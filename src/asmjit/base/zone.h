@@ -34,6 +34,13 @@ namespace asmjit {
 //! data used by `Assembler` and `Compiler` has a very short lifetime, thus, is
 //! allocated by `Zone`. The advantage is that `Zone` can free all of the data
 //! allocated at once by calling `reset()` or by `Zone` destructor.
+//!
+//! Blocks released by `reset(true)` or by `Zone` destructor are not freed
+//! immediately, they are kept by a global block cache shared by all `Zone`
+//! instances (and threads) and reused by the next `Zone` that needs a block,
+//! so creating and destroying `Assembler` and `Compiler` instances repeatedly
+//! doesn't call `malloc()` and `free()` every time. The cache is bounded, see
+//! `setCacheLimits()` and `trimCache()`.
 class Zone {
  public:
   //! \internal
@@ -72,6 +79,14 @@ class Zone {
     uint8_t data[sizeof(void*)];
   };
 
+  //! State of `Zone`, see \ref saveState() and \ref restoreState().
+  struct State {
+    //! Current block.
+    Block* block;
+    //! Current data pointer of `block`.
+    uint8_t* pos;
+  };
+
   enum {
     //! Zone allocator overhead.
     kZoneOverhead =
@@ -93,7 +108,10 @@ class Zone {
   //! It's not required, but it's good practice to set `blockSize` to a
   //! reasonable value that depends on the usage of `Zone`. Greater block sizes
   //! are generally safer and performs better than unreasonably low values.
-  ASMJIT_API Zone(size_t blockSize) noexcept;
+  //!
+  //! Blocks are allocated by `allocator` if it's not nullptr, such blocks are
+  //! never kept by the global block cache.
+  ASMJIT_API Zone(size_t blockSize, Allocator* allocator = nullptr) noexcept;
 
   //! Destroy the `Zone` instance.
   //!
@@ -110,6 +128,25 @@ class Zone {
   //! If `releaseMemory` is true all buffers will be released to the system.
   ASMJIT_API void reset(bool releaseMemory = false) noexcept;
 
+  // --------------------------------------------------------------------------
+  // [State]
+  // --------------------------------------------------------------------------
+
+  //! Save the current state of the `Zone`.
+  ASMJIT_INLINE State saveState() const noexcept {
+    State state;
+    state.block = _block;
+    state.pos = _block->pos;
+    return state;
+  }
+
+  //! Restore the `Zone` to `state` previously returned by `saveState()`,
+  //! invalidating all memory allocated since then.
+  //!
+  //! Blocks allocated since then are kept and reused by subsequent allocations.
+  //! The state is invalid after `reset()` has been called.
+  ASMJIT_API void restoreState(const State& state) noexcept;
+
   // --------------------------------------------------------------------------
   // [Accessors]
   // --------------------------------------------------------------------------
@@ -119,6 +156,17 @@ class Zone {
     return _blockSize;
   }
 
+  //! Get the allocator used to allocate blocks (nullptr if default).
+  ASMJIT_INLINE Allocator* getAllocator() const noexcept {
+    return _allocator;
+  }
+
+  //! Set the allocator used to allocate blocks, releases all blocks first.
+  ASMJIT_INLINE void setAllocator(Allocator* allocator) noexcept {
+    reset(true);
+    _allocator = allocator;
+  }
+
   // --------------------------------------------------------------------------
   // [Alloc]
   // --------------------------------------------------------------------------
@@ -199,6 +247,25 @@ class Zone {
   //! Helper to duplicate formatted string, maximum length is 256 bytes.
   ASMJIT_API char* sformat(const char* str, ...) noexcept;
 
+  // --------------------------------------------------------------------------
+  // [Cache]
+  // --------------------------------------------------------------------------
+
+  //! Get how many bytes are held by the global block cache.
+  static ASMJIT_API size_t getCachedBytes() noexcept;
+
+  //! Set limits of the global block cache.
+  //!
+  //! The cache holds at most `maxBytes` bytes and never caches blocks larger
+  //! than `maxBlockSize` bytes, such blocks are freed immediately. Passing zero
+  //! `maxBytes` disables the cache. Blocks already cached are not affected,
+  //! use `trimCache()` to release them. The cache holds up to 1MB of blocks up
+  //! to 256kB by default.
+  static ASMJIT_API void setCacheLimits(size_t maxBytes, size_t maxBlockSize) noexcept;
+
+  //! Release all blocks held by the global block cache.
+  static ASMJIT_API void trimCache() noexcept;
+
   // --------------------------------------------------------------------------
   // [Members]
   // --------------------------------------------------------------------------
@@ -207,6 +274,144 @@ class Zone {
   Block* _block;
   //! Default block size.
   size_t _blockSize;
+  //! Allocator used to allocate blocks (nullptr if default).
+  Allocator* _allocator;
+};
+
+// ============================================================================
+// [asmjit::ZoneVectorBase]
+// ============================================================================
+
+//! \internal
+class ZoneVectorBase {
+ public:
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! Create a new instance of `ZoneVectorBase`.
+  explicit ASMJIT_INLINE ZoneVectorBase(Zone* zone) noexcept
+    : _zone(zone),
+      _data(nullptr),
+      _length(0),
+      _capacity(0) {}
+
+  // --------------------------------------------------------------------------
+  // [Reset]
+  // --------------------------------------------------------------------------
+
+  //! Forget the vector buffer and set its `length` and `capacity` to zero.
+  //!
+  //! The buffer belongs to the `Zone`, it has to be reset whenever the `Zone`
+  //! is reset or restored to a state saved before the buffer was allocated.
+  ASMJIT_INLINE void reset() noexcept {
+    _data = nullptr;
+    _length = 0;
+    _capacity = 0;
+  }
+
+  // --------------------------------------------------------------------------
+  // [Grow / Reserve]
+  // --------------------------------------------------------------------------
+
+protected:
+  ASMJIT_API Error _grow(size_t n, size_t sizeOfT) noexcept;
+  ASMJIT_API Error _reserve(size_t n, size_t sizeOfT) noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+public:
+  //! Zone used to allocate the buffer.
+  Zone* _zone;
+  //! Vector buffer.
+  void* _data;
+  //! Length of the vector.
+  size_t _length;
+  //! Capacity of the vector.
+  size_t _capacity;
+};
+
+// ============================================================================
+// [asmjit::ZoneVector<T>]
+// ============================================================================
+
+//! Template used to store and manage array of POD data allocated by `Zone`.
+//!
+//! Works like `PodVector<T>`, but its buffer is allocated by `Zone` and freed
+//! in bulk with the zone. The buffer is grown in place if it's the last memory
+//! allocated by the zone, otherwise it's copied and the old one is abandoned.
+template <typename T>
+class ZoneVector : public ZoneVectorBase {
+ public:
+  ASMJIT_NO_COPY(ZoneVector<T>)
+
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! Create a new instance of `ZoneVector<T>` that allocates from `zone`.
+  explicit ASMJIT_INLINE ZoneVector(Zone* zone) noexcept : ZoneVectorBase(zone) {}
+
+  // --------------------------------------------------------------------------
+  // [Data]
+  // --------------------------------------------------------------------------
+
+  //! Get whether the vector is empty.
+  ASMJIT_INLINE bool isEmpty() const noexcept { return _length == 0; }
+  //! Get length.
+  ASMJIT_INLINE size_t getLength() const noexcept { return _length; }
+  //! Get capacity.
+  ASMJIT_INLINE size_t getCapacity() const noexcept { return _capacity; }
+  //! Get data.
+  ASMJIT_INLINE T* getData() noexcept { return static_cast<T*>(_data); }
+  //! \overload
+  ASMJIT_INLINE const T* getData() const noexcept { return static_cast<const T*>(_data); }
+
+  // --------------------------------------------------------------------------
+  // [Grow / Reserve]
+  // --------------------------------------------------------------------------
+
+  //! Called to grow the buffer to fit at least `n` elements more.
+  ASMJIT_INLINE Error _grow(size_t n) noexcept { return ZoneVectorBase::_grow(n, sizeof(T)); }
+  //! Realloc internal array to fit at least `n` items.
+  ASMJIT_INLINE Error _reserve(size_t n) noexcept { return ZoneVectorBase::_reserve(n, sizeof(T)); }
+
+  // --------------------------------------------------------------------------
+  // [Ops]
+  // --------------------------------------------------------------------------
+
+  //! Remove all items, but keep the buffer.
+  ASMJIT_INLINE void clear() noexcept { _length = 0; }
+
+  //! Append `item` to vector.
+  ASMJIT_INLINE Error append(const T& item) noexcept {
+    if (_length == _capacity)
+      ASMJIT_PROPAGATE_ERROR(_grow(1));
+
+    ::memcpy(static_cast<T*>(_data) + _length, &item, sizeof(T));
+    _length++;
+    return kErrorOk;
+  }
+
+  //! Truncate the vector to at most `n` items.
+  ASMJIT_INLINE void truncate(size_t n) noexcept {
+    if (n < _length)
+      _length = n;
+  }
+
+  //! Get item at index `i`.
+  ASMJIT_INLINE T& operator[](size_t i) noexcept {
+    ASMJIT_ASSERT(i < _length);
+    return getData()[i];
+  }
+
+  //! Get item at index `i`.
+  ASMJIT_INLINE const T& operator[](size_t i) const noexcept {
+    ASMJIT_ASSERT(i < _length);
+    return getData()[i];
+  }
 };
 
 //! \}
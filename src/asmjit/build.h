@@ -44,11 +44,13 @@
 // case that the auto-detection fails.
 //
 // Tracing is a feature that is never compiled by default and it's only used to
-// debug AsmJit itself.
+// debug AsmJit itself. Tracing of heap allocations is used by tests and
+// benchmarks to check that a code path doesn't allocate, see `MemUtil`.
 //
 // #define ASMJIT_DEBUG              // Define to enable debug-mode.
 // #define ASMJIT_RELEASE            // Define to enable release-mode.
 // #define ASMJIT_TRACE              // Define to enable tracing.
+// #define ASMJIT_TRACE_ALLOC        // Define to count heap allocations.
 
 // AsmJit Build Backends
 // ---------------------
@@ -868,9 +870,15 @@ typedef unsigned __int64 uint64_t;
 #endif
 
 #if !defined(ASMJIT_ALLOC) && !defined(ASMJIT_REALLOC) && !defined(ASMJIT_FREE)
-# define ASMJIT_ALLOC(size) ::malloc(size)
-# define ASMJIT_REALLOC(ptr, size) ::realloc(ptr, size)
-# define ASMJIT_FREE(ptr) ::free(ptr)
+# if defined(ASMJIT_TRACE_ALLOC)
+#  define ASMJIT_ALLOC(size) ::asmjit::MemUtil::alloc(size)
+#  define ASMJIT_REALLOC(ptr, size) ::asmjit::MemUtil::realloc(ptr, size)
+#  define ASMJIT_FREE(ptr) ::asmjit::MemUtil::release(ptr)
+# else
+#  define ASMJIT_ALLOC(size) ::malloc(size)
+#  define ASMJIT_REALLOC(ptr, size) ::realloc(ptr, size)
+#  define ASMJIT_FREE(ptr) ::free(ptr)
+# endif // ASMJIT_TRACE_ALLOC
 #else
 # if !defined(ASMJIT_ALLOC) || !defined(ASMJIT_REALLOC) || !defined(ASMJIT_FREE)
 #  error "[asmjit] You must provide ASMJIT_ALLOC, ASMJIT_REALLOC and ASMJIT_FREE."
@@ -371,10 +371,11 @@ Error X86Assembler::embedLabel(const Label& op) {
 
   rd.type = kRelocRelToAbs;
   rd.size = regSize;
+  rd.sectionId = _sectionId;
   rd.from = static_cast<Ptr>(getOffset());
   rd.data = 0;
 
-  if (label->offset != -1) {
+  if (_isBoundInSection(label)) {
     // Bound label.
     rd.data = static_cast<Ptr>(static_cast<SignedPtr>(label->offset));
   }
@@ -393,6 +394,9 @@ Error X86Assembler::embedLabel(const Label& op) {
   if (_relocations.append(rd) != kErrorOk)
     return setLastError(kErrorNoHeapMemory);
 
+  if (hasAsmOption(kOptionRelaxJumps))
+    ASMJIT_PROPAGATE_ERROR(_addRelaxItem(kRelaxReloc, 0, 0, op.getId(), static_cast<intptr_t>(rd.from), _relocations.getLength() - 1));
+
   // Emit dummy intptr_t (4 or 8 bytes; depends on the address size).
   EMIT_DWORD(0);
   if (regSize == 8)
@@ -406,35 +410,16 @@ Error X86Assembler::embedLabel(const Label& op) {
 // [asmjit::X86Assembler - Align]
 // ============================================================================
 
-Error X86Assembler::align(uint32_t alignMode, uint32_t offset) noexcept {
-#if !defined(ASMJIT_DISABLE_LOGGER)
-  if (_logger)
-    _logger->logFormat(Logger::kStyleDirective,
-      "%s.align %u\n", _logger->getIndentation(), static_cast<unsigned int>(offset));
-#endif // !ASMJIT_DISABLE_LOGGER
-
-  if (alignMode > kAlignZero)
-    return setLastError(kErrorInvalidArgument);
-
-  if (offset <= 1)
-    return kErrorOk;
-
-  if (!Utils::isPowerOf2(offset) || offset > 64)
-    return setLastError(kErrorInvalidArgument);
-
-  uint32_t i = static_cast<uint32_t>(Utils::alignDiff<size_t>(getOffset(), offset));
-  if (i == 0)
-    return kErrorOk;
-
-  if (getRemainingSpace() < i)
-    ASMJIT_PROPAGATE_ERROR(_grow(i));
-
-  uint8_t* cursor = getCursor();
+//! \internal
+//!
+//! Fill `i` bytes at `cursor` with a padding of `alignMode`, used by `align()`
+//! and `relax()`. Returns the cursor advanced by `i`.
+static uint8_t* X86Assembler_fillAlign(uint8_t* cursor, uint32_t alignMode, uint32_t i, bool optimized) noexcept {
   uint8_t pattern = 0x00;
 
   switch (alignMode) {
     case kAlignCode: {
-      if (hasAsmOption(kOptionOptimizedAlign)) {
+      if (optimized) {
         // Intel 64 and IA-32 Architectures Software Developer's Manual - Volume 2B (NOP).
         enum { kMaxNopSize = 9 };
 
@@ -450,7 +435,7 @@ Error X86Assembler::align(uint32_t alignMode, uint32_t offset) noexcept {
           { 0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 }
         };
 
-        do {
+        while (i) {
           uint32_t n = Utils::iMin<uint32_t>(i, kMaxNopSize);
           const uint8_t* p = nopData[n - 1];
 
@@ -458,7 +443,7 @@ Error X86Assembler::align(uint32_t alignMode, uint32_t offset) noexcept {
           do {
             EMIT_BYTE(*p++);
           } while (--n);
-        } while (i);
+        }
       }
 
       pattern = 0x90;
@@ -481,7 +466,271 @@ Error X86Assembler::align(uint32_t alignMode, uint32_t offset) noexcept {
     i--;
   }
 
-  setCursor(cursor);
+  return cursor;
+}
+
+Error X86Assembler::align(uint32_t alignMode, uint32_t offset) noexcept {
+#if !defined(ASMJIT_DISABLE_LOGGER)
+  if (_logger)
+    _logger->logFormat(Logger::kStyleDirective,
+      "%s.align %u\n", _logger->getIndentation(), static_cast<unsigned int>(offset));
+#endif // !ASMJIT_DISABLE_LOGGER
+
+  if (alignMode > kAlignZero)
+    return setLastError(kErrorInvalidArgument);
+
+  if (offset <= 1)
+    return kErrorOk;
+
+  if (!Utils::isPowerOf2(offset) || offset > 64)
+    return setLastError(kErrorInvalidArgument);
+
+  uint32_t i = static_cast<uint32_t>(Utils::alignDiff<size_t>(getOffset(), offset));
+
+  // Even an empty padding has to be recorded, relaxed code before it can
+  // move the align to an offset that is no longer aligned.
+  if (hasAsmOption(kOptionRelaxJumps))
+    ASMJIT_PROPAGATE_ERROR(_addRelaxItem(kRelaxAlign, i, alignMode, offset, static_cast<intptr_t>(getOffset()), 0));
+
+  if (i == 0)
+    return kErrorOk;
+
+  if (getRemainingSpace() < i)
+    ASMJIT_PROPAGATE_ERROR(_grow(i));
+
+  setCursor(X86Assembler_fillAlign(getCursor(), alignMode, i, hasAsmOption(kOptionOptimizedAlign)));
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::X86Assembler - Relax]
+// ============================================================================
+
+//! \internal
+//!
+//! Get the new offset of `offset` that is not a start of a `RelaxItem`,
+//! `delta` contains the number of bytes removed before each item.
+static intptr_t X86Assembler_relaxOffset(const RelaxItem* items, const intptr_t* delta, size_t count, intptr_t offset) noexcept {
+  // Find the first item that starts after `offset`.
+  size_t lo = 0;
+  size_t hi = count;
+
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (items[mid].offset <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return offset - delta[lo];
+}
+
+Error X86Assembler::relax() noexcept {
+  size_t count = _relaxItems.getLength();
+  if (count == 0)
+    return kErrorOk;
+
+  RelaxItem* items = _relaxItems.getData();
+  size_t labelsCount = _labels.getLength();
+  intptr_t codeSize = static_cast<intptr_t>(getOffset());
+
+  size_t i;
+
+  // Sections have to be merged first, see `layout()`.
+  if (!isMerged())
+    return setLastError(kErrorInvalidState);
+
+  // Items are recorded in emit order, which must also be the offset order.
+  for (i = 1; i < count; i++)
+    if (items[i].offset < items[i - 1].offset)
+      return setLastError(kErrorInvalidState);
+
+  intptr_t* delta = _zoneAllocator.allocT<intptr_t>((count + 1) * sizeof(intptr_t));
+  intptr_t* labelOffsets = _zoneAllocator.allocT<intptr_t>((labelsCount + 1) * sizeof(intptr_t));
+
+  if (delta == nullptr || labelOffsets == nullptr)
+    return setLastError(kErrorNoHeapMemory);
+
+  // Jumps to labels that are still not bound must stay long, the link
+  // patched by `bind()` expects a 32-bit displacement. All other jumps start
+  // short and become long only if their displacement doesn't fit into 8 bits.
+  for (i = 0; i < count; i++) {
+    RelaxItem& item = items[i];
+    if (item.type == kRelaxJump)
+      item.isLong = getLabelData(item.id)->offset == -1;
+  }
+
+  // [Layout]
+  //
+  // Shortening a jump can only bring other labels closer, so once a jump is
+  // long it stays long and the loop terminates.
+  for (;;) {
+    intptr_t d = 0;
+
+    for (i = 0; i < count; i++) {
+      const RelaxItem& item = items[i];
+      delta[i] = d;
+
+      if (item.type == kRelaxJump) {
+        if (!item.isLong)
+          d += static_cast<intptr_t>(item.size) - 2;
+      }
+      else if (item.type == kRelaxAlign) {
+        intptr_t newPad = Utils::alignDiff<intptr_t>(item.offset - d, static_cast<intptr_t>(item.id));
+        d += static_cast<intptr_t>(item.size) - newPad;
+      }
+    }
+    delta[count] = d;
+
+    for (i = 0; i < labelsCount; i++) {
+      intptr_t offset = _labels[i]->offset;
+      labelOffsets[i] = offset == -1 ? offset : X86Assembler_relaxOffset(items, delta, count, offset);
+    }
+
+    for (i = 0; i < count; i++) {
+      const RelaxItem& item = items[i];
+      if (item.type == kRelaxLabel)
+        labelOffsets[item.id] = item.offset - delta[i];
+    }
+
+    bool changed = false;
+    for (i = 0; i < count; i++) {
+      RelaxItem& item = items[i];
+      if (item.type != kRelaxJump || item.isLong)
+        continue;
+
+      intptr_t offs = labelOffsets[item.id] - (item.offset - delta[i] + 2);
+      if (!Utils::isInt8(offs)) {
+        item.isLong = true;
+        changed = true;
+      }
+    }
+
+    if (!changed)
+      break;
+  }
+
+  // [Move]
+  //
+  // Every item moves towards the start of the buffer, so the code can be
+  // moved in place from front to back.
+  uint8_t* buf = _buffer;
+  intptr_t src = 0;
+  intptr_t dst = 0;
+
+  for (i = 0; i < count; i++) {
+    const RelaxItem& item = items[i];
+
+    ::memmove(buf + dst, buf + src, static_cast<size_t>(item.offset - src));
+    dst += item.offset - src;
+    src = item.offset;
+
+    switch (item.type) {
+      case kRelaxJump: {
+        intptr_t target = labelOffsets[item.id];
+
+        if (target == -1) {
+          // Copied as is by the next item.
+          break;
+        }
+
+        uint8_t* cursor = buf + dst;
+        if (!item.isLong) {
+          EMIT_BYTE(item.info);
+          EMIT_BYTE(target - (dst + 2));
+        }
+        else if (item.info == 0xEB) {
+          EMIT_BYTE(0xE9);
+          EMIT_DWORD(static_cast<int32_t>(target - (dst + 5)));
+        }
+        else {
+          EMIT_BYTE(0x0F);
+          EMIT_BYTE(item.info + 0x10);
+          EMIT_DWORD(static_cast<int32_t>(target - (dst + 6)));
+        }
+
+        dst = (intptr_t)(cursor - buf);
+        src += item.size;
+        break;
+      }
+
+      case kRelaxDisp: {
+        intptr_t target = labelOffsets[item.id];
+
+        if (target == -1) {
+          // Patched by `bind()` through the moved link.
+          break;
+        }
+
+        intptr_t value = target - dst + item.displacement;
+        uint8_t* cursor = buf + dst;
+
+        if (item.size == 4) {
+          EMIT_DWORD(static_cast<int32_t>(value));
+        }
+        else {
+          if (!Utils::isInt8(value))
+            return setLastError(kErrorIllegalDisplacement);
+          EMIT_BYTE(value);
+        }
+
+        dst += item.size;
+        src += item.size;
+        break;
+      }
+
+      case kRelaxAlign: {
+        uint32_t newPad = static_cast<uint32_t>(Utils::alignDiff<intptr_t>(dst, static_cast<intptr_t>(item.id)));
+        X86Assembler_fillAlign(buf + dst, item.info, newPad, hasAsmOption(kOptionOptimizedAlign));
+
+        dst += newPad;
+        src += item.size;
+        break;
+      }
+
+      default:
+        break;
+    }
+  }
+
+  ::memmove(buf + dst, buf + src, static_cast<size_t>(codeSize - src));
+  dst += codeSize - src;
+
+  ASMJIT_ASSERT(dst == codeSize - delta[count]);
+  setCursor(buf + dst);
+
+  // [Relocations]
+  for (i = 0; i < count; i++) {
+    const RelaxItem& item = items[i];
+    if (item.type != kRelaxReloc || _labels[item.id]->offset == -1)
+      continue;
+
+    // `bind()` or the emitter already added the label offset to the data.
+    RelocData& rd = _relocations[static_cast<size_t>(item.displacement)];
+    rd.data += static_cast<SignedPtr>(labelOffsets[item.id] - _labels[item.id]->offset);
+  }
+
+  size_t relocCount = _relocations.getLength();
+  for (i = 0; i < relocCount; i++) {
+    RelocData& rd = _relocations[i];
+    rd.from = static_cast<Ptr>(X86Assembler_relaxOffset(items, delta, count, static_cast<intptr_t>(rd.from)));
+  }
+
+  // [Labels]
+  for (i = 0; i < labelsCount; i++) {
+    LabelData* label = _labels[i];
+
+    if (label->offset != -1) {
+      label->offset = labelOffsets[i];
+      continue;
+    }
+
+    for (LabelLink* link = label->links; link != nullptr; link = link->prev)
+      link->offset = X86Assembler_relaxOffset(items, delta, count, link->offset);
+  }
+
+  _relaxItems.reset();
   return kErrorOk;
 }
 
@@ -490,6 +739,10 @@ Error X86Assembler::align(uint32_t alignMode, uint32_t offset) noexcept {
 // ============================================================================
 
 size_t X86Assembler::_relocCode(void* _dst, Ptr baseAddress) const noexcept {
+  // Code and data in other sections would be lost, see `layout()`.
+  if (!isMerged())
+    return 0;
+
   uint32_t arch = getArch();
   uint8_t* dst = static_cast<uint8_t*>(_dst);
 
@@ -539,7 +792,7 @@ size_t X86Assembler::_relocCode(void* _dst, Ptr baseAddress) const noexcept {
       case kRelocTrampoline:
         ptr -= baseAddress + rd.from + 4;
         if (!Utils::isInt32(static_cast<SignedPtr>(ptr))) {
-          ptr = (Ptr)tramp - (baseAddress + rd.from + 4);
+          ptr = (Ptr)(tramp - dst) - (rd.from + 4);
           useTrampoline = true;
         }
         break;
@@ -773,7 +1026,8 @@ static void X86Assembler_dumpOperand(StringBuilder& sb, uint32_t arch, const Ope
 
       case kMemTypeLabel:
         // [label + index << shift + displacement]
-        sb.appendFormat("L%u", m->getBase());
+        sb.appendChar('L');
+        sb.appendUInt(m->getBase());
         break;
 
       case kMemTypeAbsolute:
@@ -837,7 +1091,8 @@ static void X86Assembler_dumpOperand(StringBuilder& sb, uint32_t arch, const Ope
       sb.appendInt(val, 10);
   }
   else if (op->isLabel()) {
-    sb.appendFormat("L%u", op->getId());
+    sb.appendChar('L');
+    sb.appendUInt(op->getId());
   }
   else {
     sb._appendString("None", 4);
@@ -966,6 +1221,8 @@ static ASMJIT_INLINE Error X86Assembler_emit(Assembler* self_, uint32_t code, co
 
   // Label.
   LabelData* label;
+  // Label id, used to record position dependent code for `relax()`.
+  uint32_t labelId;
   // Displacement offset
   int32_t dispOffset;
   // Displacement size.
@@ -973,6 +1230,11 @@ static ASMJIT_INLINE Error X86Assembler_emit(Assembler* self_, uint32_t code, co
   // Displacement relocation id.
   intptr_t relocId;
 
+  // Whether position dependent code has to be recorded for `relax()`.
+  bool relax = self->hasAsmOption(Assembler::kOptionRelaxJumps);
+  // Whether the jump has been recorded as `kRelaxJump`.
+  bool relaxJump = false;
+
   bool assertIllegal = false;
 
   const X86InstInfo& info = _x86InstInfo[code];
@@ -1270,14 +1532,18 @@ static ASMJIT_INLINE Error X86Assembler_emit(Assembler* self_, uint32_t code, co
       }
 
       if (encoded == ENC_OPS(Label, None, None)) {
-        label = self->getLabelData(static_cast<const Label*>(o0)->getId());
-        if (label->offset != -1) {
+        labelId = static_cast<const Label*>(o0)->getId();
+        label = self->getLabelData(labelId);
+        if (self->_isBoundInSection(label)) {
           // Bound label.
           static const intptr_t kRel32Size = 5;
           intptr_t offs = label->offset - (intptr_t)(cursor - self->_buffer);
 
           ASMJIT_ASSERT(offs <= 0);
           EMIT_BYTE(opCode);
+
+          if (relax)
+            ASMJIT_PROPAGATE_ERROR(self->_addRelaxItem(kRelaxDisp, 4, 0, labelId, (intptr_t)(cursor - self->_buffer), -4));
           EMIT_DWORD(static_cast<int32_t>(offs - kRel32Size));
         }
         else {
@@ -1442,7 +1708,8 @@ static ASMJIT_INLINE Error X86Assembler_emit(Assembler* self_, uint32_t code, co
 
     case kX86InstEncodingX86Jcc:
       if (encoded == ENC_OPS(Label, None, None)) {
-        label = self->getLabelData(static_cast<const Label*>(o0)->getId());
+        labelId = static_cast<const Label*>(o0)->getId();
+        label = self->getLabelData(labelId);
 
         if (self->hasAsmOption(Assembler::kOptionPredictedJumps)) {
           if (options & kInstOptionTaken)
@@ -1451,7 +1718,14 @@ static ASMJIT_INLINE Error X86Assembler_emit(Assembler* self_, uint32_t code, co
             EMIT_BYTE(0x2E);
         }
 
-        if (label->offset != -1) {
+        if (relax && (options & (kInstOptionShortForm | kInstOptionLongForm)) == 0) {
+          // Emit the long form, `relax()` shortens it if the target is close.
+          ASMJIT_PROPAGATE_ERROR(self->_addRelaxItem(kRelaxJump, 6, opCode, labelId, (intptr_t)(cursor - self->_buffer), 0));
+          options |= kInstOptionLongForm;
+          relaxJump = true;
+        }
+
+        if (self->_isBoundInSection(label)) {
           // Bound label.
           static const intptr_t kRel8Size = 2;
           static const intptr_t kRel32Size = 6;
@@ -1461,6 +1735,9 @@ static ASMJIT_INLINE Error X86Assembler_emit(Assembler* self_, uint32_t code, co
 
           if ((options & kInstOptionLongForm) == 0 && Utils::isInt8(offs - kRel8Size)) {
             EMIT_BYTE(opCode);
+
+            if (relax)
+              ASMJIT_PROPAGATE_ERROR(self->_addRelaxItem(kRelaxDisp, 1, 0, labelId, (intptr_t)(cursor - self->_buffer), -1));
             EMIT_BYTE(offs - kRel8Size);
 
             options |= kInstOptionShortForm;
@@ -1469,6 +1746,9 @@ static ASMJIT_INLINE Error X86Assembler_emit(Assembler* self_, uint32_t code, co
           else {
             EMIT_BYTE(0x0F);
             EMIT_BYTE(opCode + 0x10);
+
+            if (relax && !relaxJump)
+              ASMJIT_PROPAGATE_ERROR(self->_addRelaxItem(kRelaxDisp, 4, 0, labelId, (intptr_t)(cursor - self->_buffer), -4));
             EMIT_DWORD(static_cast<int32_t>(offs - kRel32Size));
 
             options &= ~kInstOptionShortForm;
@@ -1507,14 +1787,17 @@ static ASMJIT_INLINE Error X86Assembler_emit(Assembler* self_, uint32_t code, co
         }
 
         EMIT_BYTE(0xE3);
-        label = self->getLabelData(static_cast<const Label*>(o1)->getId());
+        labelId = static_cast<const Label*>(o1)->getId();
+        label = self->getLabelData(labelId);
 
-        if (label->offset != -1) {
+        if (self->_isBoundInSection(label)) {
           // Bound label.
           intptr_t offs = label->offset - (intptr_t)(cursor - self->_buffer) - 1;
           if (!Utils::isInt8(offs))
             goto _IllegalInst;
 
+          if (relax)
+            ASMJIT_PROPAGATE_ERROR(self->_addRelaxItem(kRelaxDisp, 1, 0, labelId, (intptr_t)(cursor - self->_buffer), -1));
           EMIT_BYTE(offs);
           goto _EmitDone;
         }
@@ -1548,8 +1831,17 @@ static ASMJIT_INLINE Error X86Assembler_emit(Assembler* self_, uint32_t code, co
       }
 
       if (encoded == ENC_OPS(Label, None, None)) {
-        label = self->getLabelData(static_cast<const Label*>(o0)->getId());
-        if (label->offset != -1) {
+        labelId = static_cast<const Label*>(o0)->getId();
+        label = self->getLabelData(labelId);
+
+        if (relax && (options & (kInstOptionShortForm | kInstOptionLongForm)) == 0) {
+          // Emit the long form, `relax()` shortens it if the target is close.
+          ASMJIT_PROPAGATE_ERROR(self->_addRelaxItem(kRelaxJump, 5, 0xEB, labelId, (intptr_t)(cursor - self->_buffer), 0));
+          options |= kInstOptionLongForm;
+          relaxJump = true;
+        }
+
+        if (self->_isBoundInSection(label)) {
           // Bound label.
           const intptr_t kRel8Size = 2;
           const intptr_t kRel32Size = 5;
@@ -1560,6 +1852,8 @@ static ASMJIT_INLINE Error X86Assembler_emit(Assembler* self_, uint32_t code, co
             options |= kInstOptionShortForm;
 
             EMIT_BYTE(0xEB);
+            if (relax)
+              ASMJIT_PROPAGATE_ERROR(self->_addRelaxItem(kRelaxDisp, 1, 0, labelId, (intptr_t)(cursor - self->_buffer), -1));
             EMIT_BYTE(offs - kRel8Size);
             goto _EmitDone;
           }
@@ -1567,6 +1861,8 @@ static ASMJIT_INLINE Error X86Assembler_emit(Assembler* self_, uint32_t code, co
             options &= ~kInstOptionShortForm;
 
             EMIT_BYTE(0xE9);
+            if (relax && !relaxJump)
+              ASMJIT_PROPAGATE_ERROR(self->_addRelaxItem(kRelaxDisp, 4, 0, labelId, (intptr_t)(cursor - self->_buffer), -4));
             EMIT_DWORD(static_cast<int32_t>(offs - kRel32Size));
             goto _EmitDone;
           }
@@ -3754,21 +4050,26 @@ _EmitSib:
     }
     else if (rmMem->getMemType() == kMemTypeLabel) {
       // Relative->Absolute [x86 mode].
-      label = self->getLabelData(rmMem->_vmem.base);
+      labelId = rmMem->_vmem.base;
+      label = self->getLabelData(labelId);
       relocId = self->_relocations.getLength();
 
       RelocData rd;
       rd.type = kRelocRelToAbs;
       rd.size = 4;
+      rd.sectionId = self->_sectionId;
       rd.from = static_cast<Ptr>((uintptr_t)(cursor - self->_buffer));
       rd.data = static_cast<SignedPtr>(dispOffset);
 
       if (self->_relocations.append(rd) != kErrorOk)
         return self->setLastError(kErrorNoHeapMemory);
 
-      if (label->offset != -1) {
+      if (self->_isBoundInSection(label)) {
         // Bound label.
         self->_relocations[relocId].data += static_cast<SignedPtr>(label->offset);
+
+        if (relax)
+          ASMJIT_PROPAGATE_ERROR(self->_addRelaxItem(kRelaxReloc, 0, 0, labelId, (intptr_t)(cursor - self->_buffer), relocId));
         EMIT_DWORD(0);
       }
       else {
@@ -3785,6 +4086,7 @@ _EmitSib:
       RelocData rd;
       rd.type = kRelocRelToAbs;
       rd.size = 4;
+      rd.sectionId = self->_sectionId;
       rd.from = static_cast<Ptr>((uintptr_t)(cursor - self->_buffer));
       rd.data = rd.from + static_cast<SignedPtr>(dispOffset);
 
@@ -3813,7 +4115,8 @@ _EmitSib:
     }
     else if (rmMem->getMemType() == kMemTypeLabel) {
       // [RIP + Disp32].
-      label = self->getLabelData(rmMem->_vmem.base);
+      labelId = rmMem->_vmem.base;
+      label = self->getLabelData(labelId);
 
       // Indexing is invalid.
       if (mIndex < kInvalidReg)
@@ -3822,8 +4125,10 @@ _EmitSib:
       EMIT_BYTE(x86EncodeMod(0, opReg, 5));
       dispOffset -= (4 + imLen);
 
-      if (label->offset != -1) {
+      if (self->_isBoundInSection(label)) {
         // Bound label.
+        if (relax)
+          ASMJIT_PROPAGATE_ERROR(self->_addRelaxItem(kRelaxDisp, 4, 0, labelId, (intptr_t)(cursor - self->_buffer), dispOffset));
         dispOffset += label->offset - static_cast<int32_t>((intptr_t)(cursor - self->_buffer));
         EMIT_DWORD(static_cast<int32_t>(dispOffset));
       }
@@ -4044,13 +4349,15 @@ _EmitAvxV:
         goto _IllegalAddr;
 
       // Relative->Absolute [x86 mode].
-      label = self->getLabelData(rmMem->_vmem.base);
+      labelId = rmMem->_vmem.base;
+      label = self->getLabelData(labelId);
       relocId = self->_relocations.getLength();
 
       {
         RelocData rd;
         rd.type = kRelocRelToAbs;
         rd.size = 4;
+        rd.sectionId = self->_sectionId;
         rd.from = static_cast<Ptr>((uintptr_t)(cursor - self->_buffer));
         rd.data = static_cast<SignedPtr>(dispOffset);
 
@@ -4058,9 +4365,12 @@ _EmitAvxV:
           return self->setLastError(kErrorNoHeapMemory);
       }
 
-      if (label->offset != -1) {
+      if (self->_isBoundInSection(label)) {
         // Bound label.
         self->_relocations[relocId].data += static_cast<SignedPtr>(label->offset);
+
+        if (relax)
+          ASMJIT_PROPAGATE_ERROR(self->_addRelaxItem(kRelaxReloc, 0, 0, labelId, (intptr_t)(cursor - self->_buffer), relocId));
         EMIT_DWORD(0);
       }
       else {
@@ -4174,6 +4484,7 @@ _EmitJmpOrCallAbs:
     RelocData rd;
     rd.type = kRelocAbsToRel;
     rd.size = 4;
+    rd.sectionId = self->_sectionId;
     rd.from = (intptr_t)(cursor - self->_buffer) + 1;
     rd.data = static_cast<SignedPtr>(imVal);
 
@@ -4216,7 +4527,7 @@ _EmitJmpOrCallAbs:
 
 _EmitDisplacement:
   {
-    ASMJIT_ASSERT(label->offset == -1);
+    ASMJIT_ASSERT(!self->_isBoundInSection(label));
     ASMJIT_ASSERT(dispSize == 1 || dispSize == 4);
 
     // Chain with label.
@@ -4227,6 +4538,13 @@ _EmitDisplacement:
     link->relocId = relocId;
     label->links = link;
 
+    if (relax && !relaxJump) {
+      if (relocId == -1)
+        ASMJIT_PROPAGATE_ERROR(self->_addRelaxItem(kRelaxDisp, dispSize, 0, labelId, link->offset, dispOffset));
+      else
+        ASMJIT_PROPAGATE_ERROR(self->_addRelaxItem(kRelaxReloc, 0, 0, labelId, link->offset, relocId));
+    }
+
     // Emit label size as dummy data.
     if (dispSize == 1)
       EMIT_BYTE(0x01);
@@ -4248,7 +4566,9 @@ _EmitDone:
     uint32_t loggerOptions = 0;
 
     if (self->_logger) {
-      sb.appendString(self->_logger->getIndentation());
+      const char* indentation = self->_logger->getIndentation();
+      if (indentation[0] != '\0')
+        sb.appendString(indentation);
       loggerOptions = self->_logger->getOptions();
     }
 
@@ -4295,6 +4615,259 @@ Error X86Assembler::_emit(uint32_t code, const Operand& o0, const Operand& o1, c
 #endif
 }
 
+// ============================================================================
+// [asmjit::X86Assembler - Test]
+// ============================================================================
+
+#if defined(ASMJIT_TEST)
+static void X86Assembler_generateRelaxFunc(X86Assembler& a) noexcept {
+  Label L_Loop = a.newLabel();
+  Label L_Skip = a.newLabel();
+  Label L_Far = a.newLabel();
+  Label L_Ok = a.newLabel();
+  Label L_Data = a.newLabel();
+  Label L_Table = a.newLabel();
+
+  a.mov(x86::eax, 0);
+  a.mov(x86::ecx, 10);
+
+  a.bind(L_Loop);
+  a.add(x86::eax, x86::ecx);
+  a.dec(x86::ecx);
+  a.jnz(L_Loop);
+  a.jmp(L_Skip);
+  a.mov(x86::eax, 999);
+
+  a.align(kAlignCode, 16);
+  a.bind(L_Skip);
+  a.test(x86::eax, x86::eax);
+  a.jz(L_Far);
+  a.add(x86::eax, 1);
+  a.cmp(x86::eax, 56);
+  a.je(L_Ok);
+  a.mov(x86::eax, 999);
+  a.bind(L_Ok);
+
+  // Too far for a short jump.
+  for (uint32_t i = 0; i < 200; i++)
+    a.nop();
+
+  a.bind(L_Far);
+  a.lea(a.zdx, x86::ptr(L_Data));
+  a.add(x86::eax, x86::dword_ptr(a.zdx));
+  a.lea(a.zdx, x86::ptr(L_Table));
+  a.mov(a.zdx, x86::ptr(a.zdx));
+  a.add(x86::eax, x86::dword_ptr(a.zdx));
+  a.ret();
+
+  a.bind(L_Data);
+  a.dint32(5);
+  a.bind(L_Table);
+  a.embedLabel(L_Data);
+}
+
+UNIT(x86_assembler_relax) {
+  JitRuntime runtime;
+  X86Assembler a(&runtime);
+
+  INFO("Relaxing a forward jump over a single instruction.");
+  {
+    Label L = a.newLabel();
+
+    a.addAsmOptions(Assembler::kOptionRelaxJumps);
+    a.jmp(L);
+    a.nop();
+    a.bind(L);
+    a.ret();
+
+    EXPECT(a.getCodeSize() == 7,
+      "Jump should be emitted in its long form, code size is %u.", static_cast<unsigned int>(a.getCodeSize()));
+    EXPECT(a.relax() == kErrorOk,
+      "X86Assembler::relax() failed.");
+    EXPECT(a.getCodeSize() == 4 && a.getBuffer()[0] == 0xEB && a.getBuffer()[1] == 0x01,
+      "Jump should be relaxed to `jmp short`.");
+    a.reset();
+  }
+
+  typedef int (*Func)(void);
+
+  X86Assembler_generateRelaxFunc(a);
+  size_t plainSize = a.getCodeSize();
+  Func plainFunc = asmjit_cast<Func>(a.make());
+  a.reset();
+
+  a.addAsmOptions(Assembler::kOptionRelaxJumps);
+  X86Assembler_generateRelaxFunc(a);
+  Func relaxedFunc = asmjit_cast<Func>(a.make());
+  size_t relaxedSize = a.getCodeSize();
+  a.reset();
+
+  INFO("Code size is %u bytes without relaxation and %u bytes with relaxation.",
+    static_cast<unsigned int>(plainSize),
+    static_cast<unsigned int>(relaxedSize));
+
+  EXPECT(plainFunc != nullptr && relaxedFunc != nullptr,
+    "X86Assembler::make() failed.");
+  EXPECT(relaxedSize < plainSize,
+    "Relaxed code should be smaller.");
+
+  int plainResult = plainFunc();
+  int relaxedResult = relaxedFunc();
+
+  EXPECT(plainResult == 66 && relaxedResult == 66,
+    "Functions should return 66, returned %d and %d.", plainResult, relaxedResult);
+
+  runtime.release((void*)plainFunc);
+  runtime.release((void*)relaxedFunc);
+}
+
+UNIT(x86_assembler_sections) {
+  JitRuntime runtime;
+  X86Assembler a(&runtime);
+
+  uint32_t rodata = a.newSection(".rodata", kSectionFlagConst, 64);
+  uint32_t unlikely = a.newSection(".text.unlikely", kSectionFlagExec, 16);
+
+  EXPECT(rodata == 1 && unlikely == 2 && a.getSectionsCount() == 3,
+    "Sections should be created after `.text`.");
+
+  // Sections are kept by `reset(false)`.
+  for (uint32_t relax = 0; relax < 2; relax++) {
+    INFO("Merging sections %s jump relaxation.", relax ? "with" : "without");
+
+    if (relax)
+      a.addAsmOptions(Assembler::kOptionRelaxJumps);
+
+    EXPECT(a.findSection(".rodata") == rodata && a.findSection(".text.unlikely") == unlikely,
+      "Sections should be found by name.");
+
+    Label L_A = a.newLabel();
+    Label L_B = a.newLabel();
+    Label L_Cold = a.newLabel();
+    Label L_Back = a.newLabel();
+    Label L_Table = a.newLabel();
+
+    // Data bound before it's used.
+    a.switchSection(rodata);
+    a.bind(L_A);
+    a.dint32(40);
+
+    a.switchSection(0);
+    a.lea(a.zdx, x86::ptr(L_A));
+    a.mov(x86::eax, x86::dword_ptr(a.zdx));
+    a.lea(a.zdx, x86::ptr(L_B));
+    a.add(x86::eax, x86::dword_ptr(a.zdx));
+    a.test(x86::eax, x86::eax);
+    a.jnz(L_Cold);
+    a.bind(L_Back);
+    a.ret();
+
+    a.switchSection(unlikely);
+    a.bind(L_Cold);
+    a.add(x86::eax, 1);
+    a.jmp(L_Back);
+
+    // Data bound after it's used and a table pointing to another section.
+    a.switchSection(rodata);
+    a.bind(L_B);
+    a.dint32(2);
+    a.align(kAlignData, 8);
+    a.bind(L_Table);
+    a.embedLabel(L_Cold);
+
+    typedef int (*Func)(void);
+    Func func = asmjit_cast<Func>(a.make());
+
+    EXPECT(func != nullptr,
+      "X86Assembler::make() failed.");
+    EXPECT(a.isMerged() && a.getSectionId() == 0,
+      "All sections should be merged into `.text`.");
+
+    intptr_t offsetA = a.getLabelOffset(L_A);
+    intptr_t offsetCold = a.getLabelOffset(L_Cold);
+    intptr_t offsetTable = a.getLabelOffset(L_Table);
+
+    EXPECT(offsetA != 0 && (offsetA & 63) == 0 && offsetCold > offsetTable && (offsetCold & 15) == 0,
+      "Sections should be aligned and merged in the order of creation.");
+
+    int result = func();
+    void* coldPtr = *reinterpret_cast<void**>((uint8_t*)func + offsetTable);
+
+    EXPECT(result == 43,
+      "Function should return 43, returned %d.", result);
+    EXPECT(coldPtr == (uint8_t*)func + offsetCold,
+      "Embedded label should point to `.text.unlikely`.");
+
+    runtime.release((void*)func);
+    a.reset();
+  }
+}
+
+UNIT(x86_assembler_batch) {
+  enum { kCount = 4, kAlignment = 32 };
+
+  JitRuntime runtime;
+  X86Assembler a0(&runtime);
+  X86Assembler a1(&runtime);
+  X86Assembler a2(&runtime);
+  X86Assembler a3(&runtime);
+
+  Assembler* assemblers[kCount] = { &a0, &a1, &a2, &a3 };
+  void* funcs[kCount];
+  uint32_t i, j;
+
+  // Functions of different sizes, the function `i` returns `i + 1`.
+  for (i = 0; i < kCount; i++) {
+    X86Assembler& a = *static_cast<X86Assembler*>(assemblers[i]);
+
+    a.mov(x86::eax, static_cast<int32_t>(i + 1));
+    for (j = 0; j < i * 3; j++)
+      a.nop();
+    a.ret();
+  }
+
+  INFO("Checking alignments not guaranteed by VMemMgr are rejected.");
+  EXPECT(runtime.addBatch(funcs, assemblers, kCount, 24) == kErrorInvalidArgument,
+    "Alignment that is not a power of 2 should be rejected.");
+  EXPECT(runtime.addBatch(funcs, assemblers, kCount, 4096) == kErrorInvalidArgument,
+    "Alignment greater than the block density should be rejected.");
+
+  runtime.setAllocType(kVMemAllocPermanent);
+  EXPECT(runtime.addBatch(funcs, assemblers, kCount, 64) == kErrorInvalidArgument,
+    "Alignment greater than the alignment of permanent memory should be rejected.");
+  runtime.setAllocType(kVMemAllocFreeable);
+
+  INFO("Publishing %u functions aligned to %u bytes.", kCount, kAlignment);
+  EXPECT(runtime.addBatch(funcs, assemblers, kCount, kAlignment) == kErrorOk,
+    "JitRuntime::addBatch() failed.");
+
+  for (i = 0; i < kCount; i++) {
+    uint8_t* p = static_cast<uint8_t*>(funcs[i]);
+
+    EXPECT(((uintptr_t)p & (kAlignment - 1)) == 0,
+      "Function %u at %p should be aligned to %u bytes.", i, p, kAlignment);
+
+    if (i + 1 < kCount) {
+      uint8_t* end = p + assemblers[i]->getOffset();
+      uint8_t* next = static_cast<uint8_t*>(funcs[i + 1]);
+
+      EXPECT((uintptr_t)next == Utils::alignTo<uintptr_t>((uintptr_t)end, kAlignment),
+        "Function %u should directly follow function %u.", i + 1, i);
+
+      for (; end != next; end++)
+        EXPECT(*end == 0xCC,
+          "Padding after function %u should be filled by int3.", i);
+    }
+
+    int result = asmjit_cast<int (*)(void)>(funcs[i])();
+    EXPECT(result == static_cast<int>(i + 1),
+      "Function %u should return %u, returned %d.", i, i + 1, result);
+  }
+
+  runtime.release(funcs[0]);
+}
+#endif // ASMJIT_TEST
+
 } // asmjit namespace
 
 // [Api-End]
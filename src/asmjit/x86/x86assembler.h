@@ -500,6 +500,12 @@ class ASMJIT_VIRTAPI X86Assembler : public Assembler {
 
   ASMJIT_API virtual size_t _relocCode(void* dst, Ptr baseAddress) const noexcept;
 
+  // --------------------------------------------------------------------------
+  // [Relax]
+  // --------------------------------------------------------------------------
+
+  ASMJIT_API virtual Error relax() noexcept;
+
   // --------------------------------------------------------------------------
   // [Emit]
   // --------------------------------------------------------------------------
@@ -247,6 +247,281 @@ void X86Compiler::reset(bool releaseMemory) noexcept {
   zdi = x86::noGpReg;
 }
 
+// ============================================================================
+// [asmjit::X86Compiler - Embed]
+// ============================================================================
+
+//! \internal
+//!
+//! Embed all deferred constant pools into the `.rodata` section of the attached
+//! assembler, so the constants get their own cache lines instead of sitting
+//! between functions.
+static Error X86Compiler_embedDeferredPools(X86Compiler* self, X86Assembler* assembler) noexcept {
+  // Pools are linked in reverse order of their creation.
+  Compiler::DeferredPool* pool = self->getDeferredPools();
+  Compiler::DeferredPool* prev = nullptr;
+
+  if (pool == nullptr)
+    return kErrorOk;
+
+  self->_deferredPools = nullptr;
+  while (pool != nullptr) {
+    Compiler::DeferredPool* next = pool->next;
+    pool->next = prev;
+    prev = pool;
+    pool = next;
+  }
+
+  uint32_t sectionId = assembler->findSection(".rodata");
+  if (sectionId == kInvalidValue) {
+    sectionId = assembler->newSection(".rodata", kSectionFlagConst, 64);
+    if (sectionId == kInvalidValue)
+      return assembler->getLastError();
+  }
+
+  uint32_t prevSectionId = assembler->getSectionId();
+  ASMJIT_PROPAGATE_ERROR(assembler->switchSection(sectionId));
+
+  for (pool = prev; pool != nullptr; pool = pool->next) {
+    size_t size = pool->size;
+
+    ASMJIT_PROPAGATE_ERROR(assembler->align(kAlignData, pool->alignment));
+    ASMJIT_PROPAGATE_ERROR(assembler->bind(Label(pool->labelId)));
+    ASMJIT_PROPAGATE_ERROR(assembler->embed(pool->data, static_cast<uint32_t>(size)));
+  }
+
+  return assembler->switchSection(prevSectionId);
+}
+
+// ============================================================================
+// [asmjit::X86Compiler - Profile]
+// ============================================================================
+
+//! \internal
+//!
+//! Negated conditional jumps, indexed by `instId - kX86InstIdJa`.
+static const uint16_t X86Compiler_negatedJcc[] = {
+  kX86InstIdJbe, // ja
+  kX86InstIdJb , // jae
+  kX86InstIdJae, // jb
+  kX86InstIdJa , // jbe
+  kX86InstIdJnc, // jc
+  kX86InstIdJne, // je
+  kX86InstIdJle, // jg
+  kX86InstIdJl , // jge
+  kX86InstIdJge, // jl
+  kX86InstIdJg , // jle
+  kX86InstIdJa , // jna
+  kX86InstIdJae, // jnae
+  kX86InstIdJb , // jnb
+  kX86InstIdJbe, // jnbe
+  kX86InstIdJc , // jnc
+  kX86InstIdJe , // jne
+  kX86InstIdJg , // jng
+  kX86InstIdJge, // jnge
+  kX86InstIdJl , // jnl
+  kX86InstIdJle, // jnle
+  kX86InstIdJo , // jno
+  kX86InstIdJp , // jnp
+  kX86InstIdJs , // jns
+  kX86InstIdJz , // jnz
+  kX86InstIdJno, // jo
+  kX86InstIdJnp, // jp
+  kX86InstIdJpo, // jpe
+  kX86InstIdJpe, // jpo
+  kX86InstIdJns, // js
+  kX86InstIdJnz  // jz
+};
+
+//! \internal
+//!
+//! Get the first conditional jump of a function body starting at `node`.
+//!
+//! Code outside of functions can't use variables, so it's never instrumented.
+//! `funcEnd` keeps the end of the current function between calls.
+static HLJump* X86Compiler_nextJcc(HLNode* node, HLNode*& funcEnd) noexcept {
+  while (node != nullptr) {
+    if (node->getType() == HLNode::kTypeFunc)
+      funcEnd = static_cast<HLFunc*>(node)->getEnd();
+    else if (node == funcEnd)
+      funcEnd = nullptr;
+    else if (funcEnd != nullptr && node->hasFlag(HLNode::kFlagIsJcc))
+      return static_cast<HLJump*>(node);
+
+    node = node->getNext();
+  }
+
+  return nullptr;
+}
+
+//! \internal
+//!
+//! Get count of conditional jumps in all function bodies.
+static uint32_t X86Compiler_countJcc(X86Compiler* self) noexcept {
+  HLNode* funcEnd = nullptr;
+  HLJump* jcc = X86Compiler_nextJcc(self->getFirstNode(), funcEnd);
+  uint32_t count = 0;
+
+  while (jcc != nullptr) {
+    count++;
+    jcc = X86Compiler_nextJcc(jcc->getNext(), funcEnd);
+  }
+
+  return count;
+}
+
+//! \internal
+//!
+//! Increment `counter` at the cursor.
+//!
+//! Only `mov` and `lea` are used, they don't modify flags, which can still be
+//! consumed by the conditional jump or the code that follows it.
+static void X86Compiler_emitCounter(X86Compiler* self, uintptr_t* counter) noexcept {
+  X86GpVar p = self->newUIntPtr("counter");
+  X86GpVar t = self->newUIntPtr("count");
+
+  self->mov(p, imm_ptr(counter));
+  self->mov(t, x86::ptr(p));
+  self->lea(t, x86::ptr(t, 1));
+  self->mov(x86::ptr(p), t);
+}
+
+//! \internal
+//!
+//! Instrument all conditional jumps by counters stored to `profile`.
+static Error X86Compiler_instrumentEdges(X86Compiler* self, EdgeProfile* profile) noexcept {
+  Runtime* runtime = self->getAssembler()->getRuntime();
+  if (profile == nullptr || runtime == nullptr || runtime->getRuntimeType() != Runtime::kTypeJit)
+    return kErrorInvalidState;
+
+  profile->reset();
+
+  uint32_t count = X86Compiler_countJcc(self);
+  if (count == 0)
+    return kErrorOk;
+
+  JitRuntime* jitRuntime = static_cast<JitRuntime*>(runtime);
+  uintptr_t* counters = jitRuntime->newCounters(static_cast<size_t>(count) * 2);
+
+  if (counters == nullptr)
+    return kErrorNoHeapMemory;
+
+  profile->_runtime = jitRuntime;
+  profile->_counters = counters;
+  profile->_jccCount = count;
+
+  HLNode* cursor = self->getCursor();
+  HLNode* funcEnd = nullptr;
+  HLJump* jcc = X86Compiler_nextJcc(self->getFirstNode(), funcEnd);
+
+  for (uint32_t i = 0; jcc != nullptr; i++) {
+    // Count executions before the jump and fall-throughs after it, the count
+    // of taken jumps is the difference.
+    self->_setCursor(jcc->getPrev());
+    X86Compiler_emitCounter(self, counters + i * 2 + 0);
+
+    self->_setCursor(jcc);
+    X86Compiler_emitCounter(self, counters + i * 2 + 1);
+
+    jcc = X86Compiler_nextJcc(jcc->getNext(), funcEnd);
+  }
+
+  self->_setCursor(cursor);
+  return kErrorOk;
+}
+
+//! \internal
+//!
+//! Flip `jcc L` that jumps over a block falling through to `L` into a negated
+//! jump to the block hinted as not taken, followed by `jmp L`.
+//!
+//! The block can't be entered by a fall-through anymore, so it's moved to the
+//! cold section by `X86Context::serialize()`, which also drops the `jmp L`
+//! that becomes a jump to the next instruction. Returns the label of the block
+//! or nullptr if the jump can't be flipped.
+static HLLabel* X86Compiler_flipJcc(X86Compiler* self, HLJump* jcc) noexcept {
+  uint32_t instId = jcc->getInstId();
+  HLLabel* target = jcc->getTarget();
+
+  if (target == nullptr || !Utils::inInterval<uint32_t>(instId, kX86InstIdJa, kX86InstIdJz))
+    return nullptr;
+
+  // The block must be entered only by the fall-through of `jcc`.
+  HLNode* node = jcc->getNext();
+  if (node == target)
+    return nullptr;
+
+  do {
+    if (node == nullptr)
+      return nullptr;
+
+    uint32_t type = node->getType();
+    if (type == HLNode::kTypeLabel || type == HLNode::kTypeSentinel || type == HLNode::kTypeFunc)
+      return nullptr;
+
+    node = node->getNext();
+  } while (node != target);
+
+  HLLabel* blockLabel = self->newLabelNode();
+  if (blockLabel == nullptr)
+    return nullptr;
+
+  self->_setCursor(jcc);
+  self->setInstOptions(kInstOptionNotTaken);
+  self->emit(X86Compiler_negatedJcc[instId - kX86InstIdJa], blockLabel->getLabel());
+  self->jmp(target->getLabel());
+  self->addNode(blockLabel);
+  self->removeNode(jcc);
+
+  return blockLabel;
+}
+
+//! \internal
+//!
+//! Hint conditional jumps by counters of `profile`.
+static Error X86Compiler_applyProfile(X86Compiler* self, EdgeProfile* profile) noexcept {
+  if (X86Compiler_countJcc(self) != profile->getJccCount())
+    return kErrorInvalidState;
+
+  HLNode* cursor = self->getCursor();
+  HLNode* funcEnd = nullptr;
+  HLJump* jcc = X86Compiler_nextJcc(self->getFirstNode(), funcEnd);
+
+  for (uint32_t i = 0; jcc != nullptr; i++) {
+    HLNode* next = jcc->getNext();
+
+    uintptr_t execCount = profile->getExecCount(i);
+    uintptr_t takenCount = profile->getTakenCount(i);
+    uintptr_t rareCount = execCount >> EdgeProfile::kRareShift;
+
+    if (execCount >= EdgeProfile::kMinExecCount && (jcc->getOptions() & (kInstOptionTaken | kInstOptionNotTaken)) == 0) {
+      if (takenCount <= rareCount) {
+        jcc->addOptions(kInstOptionNotTaken);
+      }
+      else if (execCount - takenCount <= rareCount) {
+        // Continue after the flipped jump, it's not in the profile. Flipping
+        // only pays off if the block is moved to the cold section.
+        HLLabel* blockLabel = self->hasFeature(kCompilerFeatureColdSection)
+          ? X86Compiler_flipJcc(self, jcc)
+          : static_cast<HLLabel*>(nullptr);
+
+        if (blockLabel != nullptr) {
+          next = blockLabel;
+        }
+        else {
+          jcc->addOptions(kInstOptionTaken);
+          jcc->orFlags(HLNode::kFlagIsTaken);
+        }
+      }
+    }
+
+    jcc = X86Compiler_nextJcc(next, funcEnd);
+  }
+
+  self->_setCursor(cursor);
+  return kErrorOk;
+}
+
 // ============================================================================
 // [asmjit::X86Compiler - Finalize]
 // ============================================================================
@@ -256,19 +531,31 @@ Error X86Compiler::finalize() noexcept {
   if (assembler == nullptr)
     return kErrorOk;
 
-  // Flush the global constant pool.
+  // Flush the global constant pool, it's embedded after all local pools.
   if (_globalConstPoolLabel.isInitialized()) {
-    embedConstPool(_globalConstPoolLabel, _globalConstPool);
+    ASMJIT_PROPAGATE_ERROR(hasFeature(kCompilerFeatureConstSection)
+      ? deferConstPool(_globalConstPoolLabel, _globalConstPool)
+      : embedConstPool(_globalConstPoolLabel, _globalConstPool));
 
     _globalConstPoolLabel.reset();
     _globalConstPool.reset();
   }
 
   if (_firstNode == nullptr)
-    return kErrorOk;
+    return X86Compiler_embedDeferredPools(this, assembler);
 
-  X86Context context(this);
   Error error = kErrorOk;
+  EdgeProfile* profile = getProfile();
+
+  if (hasFeature(kCompilerFeatureInstrumentEdges))
+    error = X86Compiler_instrumentEdges(this, profile);
+  else if (profile != nullptr && profile->hasCounters())
+    error = X86Compiler_applyProfile(this, profile);
+
+  if (error != kErrorOk)
+    return error;
+
+  X86Context context(this);
 
   HLNode* node = _firstNode;
   HLNode* start;
@@ -298,6 +585,9 @@ Error X86Compiler::finalize() noexcept {
       break;
   } while (node != nullptr);
 
+  if (error == kErrorOk)
+    error = X86Compiler_embedDeferredPools(this, assembler);
+
   reset(false);
   return error;
 }
@@ -311,12 +601,14 @@ static ASMJIT_INLINE size_t X86Compiler_getInstSize(uint32_t code) noexcept {
   return Utils::inInterval<uint32_t>(code, _kX86InstIdJbegin, _kX86InstIdJend) ? sizeof(HLJump) : sizeof(HLInst);
 }
 
-static HLInst* X86Compiler_newInst(X86Compiler* self, void* p, uint32_t code, uint32_t options, Operand* opList, uint32_t opCount) noexcept {
+//! Create an instruction node at `p`, which is followed by `opCount` operands.
+static HLInst* X86Compiler_newInst(X86Compiler* self, void* p, uint32_t code, uint32_t options, uint32_t opCount) noexcept {
   if (Utils::inInterval<uint32_t>(code, _kX86InstIdJbegin, _kX86InstIdJend)) {
-    HLJump* node = new(p) HLJump(self, code, options, opList, opCount);
+    HLJump* node = new(p) HLJump(self, code, options, opCount);
     HLLabel* jTarget = nullptr;
 
     if ((options & kInstOptionUnfollow) == 0) {
+      Operand* opList = node->getOpList();
       if (opList[0].isLabel())
         jTarget = self->getHLLabel(static_cast<Label&>(opList[0]));
       else
@@ -343,7 +635,7 @@ static HLInst* X86Compiler_newInst(X86Compiler* self, void* p, uint32_t code, ui
     return node;
   }
   else {
-    HLInst* node = new(p) HLInst(self, code, options, opList, opCount);
+    HLInst* node = new(p) HLInst(self, code, options, opCount);
     node->addOptions(options);
     return node;
   }
@@ -356,7 +648,7 @@ HLInst* X86Compiler::newInst(uint32_t code) noexcept {
   if (inst == nullptr)
     goto _NoMemory;
 
-  return X86Compiler_newInst(this, inst, code, getInstOptionsAndReset(), nullptr, 0);
+  return X86Compiler_newInst(this, inst, code, getInstOptionsAndReset(), 0);
 
 _NoMemory:
   setLastError(kErrorNoHeapMemory);
@@ -374,7 +666,7 @@ HLInst* X86Compiler::newInst(uint32_t code, const Operand& o0) noexcept {
     Operand* opList = reinterpret_cast<Operand*>(reinterpret_cast<uint8_t*>(inst) + size);
     opList[0] = o0;
     ASMJIT_ASSERT_OPERAND(o0);
-    return X86Compiler_newInst(this, inst, code, getInstOptionsAndReset(), opList, 1);
+    return X86Compiler_newInst(this, inst, code, getInstOptionsAndReset(), 1);
   }
 
 _NoMemory:
@@ -395,7 +687,7 @@ HLInst* X86Compiler::newInst(uint32_t code, const Operand& o0, const Operand& o1
     opList[1] = o1;
     ASMJIT_ASSERT_OPERAND(o0);
     ASMJIT_ASSERT_OPERAND(o1);
-    return X86Compiler_newInst(this, inst, code, getInstOptionsAndReset(), opList, 2);
+    return X86Compiler_newInst(this, inst, code, getInstOptionsAndReset(), 2);
   }
 
 _NoMemory:
@@ -418,7 +710,7 @@ HLInst* X86Compiler::newInst(uint32_t code, const Operand& o0, const Operand& o1
     ASMJIT_ASSERT_OPERAND(o0);
     ASMJIT_ASSERT_OPERAND(o1);
     ASMJIT_ASSERT_OPERAND(o2);
-    return X86Compiler_newInst(this, inst, code, getInstOptionsAndReset(), opList, 3);
+    return X86Compiler_newInst(this, inst, code, getInstOptionsAndReset(), 3);
   }
 
 _NoMemory:
@@ -443,7 +735,7 @@ HLInst* X86Compiler::newInst(uint32_t code, const Operand& o0, const Operand& o1
     ASMJIT_ASSERT_OPERAND(o1);
     ASMJIT_ASSERT_OPERAND(o2);
     ASMJIT_ASSERT_OPERAND(o3);
-    return X86Compiler_newInst(this, inst, code, getInstOptionsAndReset(), opList, 4);
+    return X86Compiler_newInst(this, inst, code, getInstOptionsAndReset(), 4);
   }
 
 _NoMemory:
@@ -470,7 +762,7 @@ HLInst* X86Compiler::newInst(uint32_t code, const Operand& o0, const Operand& o1
     ASMJIT_ASSERT_OPERAND(o2);
     ASMJIT_ASSERT_OPERAND(o3);
     ASMJIT_ASSERT_OPERAND(o4);
-    return X86Compiler_newInst(this, inst, code, getInstOptionsAndReset(), opList, 5);
+    return X86Compiler_newInst(this, inst, code, getInstOptionsAndReset(), 5);
   }
 
 _NoMemory:
@@ -650,13 +942,19 @@ HLSentinel* X86Compiler::endFunc() noexcept {
   X86FuncNode* func = getFunc();
   ASMJIT_ASSERT(func != nullptr);
 
-  // Add local constant pool at the end of the function (if exist).
+  // Add local constant pool (if exist) at the end of the function, or defer
+  // it to `finalize()`, which embeds it into `.rodata`.
   setCursor(func->getExitNode());
 
   if (_localConstPoolLabel.isInitialized()) {
-    embedConstPool(_localConstPoolLabel, _localConstPool);
+    Error error = hasFeature(kCompilerFeatureConstSection) && getAssembler() != nullptr
+      ? deferConstPool(_localConstPoolLabel, _localConstPool)
+      : embedConstPool(_localConstPoolLabel, _localConstPool);
+
+    if (error != kErrorOk)
+      setLastError(error);
+
     _localConstPoolLabel.reset();
-    _localConstPool.reset();
   }
 
   // Finalize.
@@ -832,6 +1130,11 @@ Error X86Compiler::_newConst(BaseMem* mem, uint32_t scope, const void* data, siz
     goto _OnError;
   }
 
+  // The pool is reset lazily, the content of a flushed pool is kept, because
+  // `restoreState()` can restore its label.
+  if (dstLabel->getId() == kInvalidValue)
+    dstPool->reset();
+
   error = dstPool->add(data, size, offset);
   if (error != kErrorOk)
     goto _OnError;
@@ -851,6 +1154,613 @@ _OnError:
   return error;
 }
 
+// ============================================================================
+// [asmjit::X86Compiler - Test]
+// ============================================================================
+
+#if defined(ASMJIT_TEST)
+static void X86Compiler_generateTestFunc(X86Compiler& c) noexcept {
+  c.addFunc(FuncBuilder2<int, int*, int>(kCallConvHost));
+
+  X86GpVar src = c.newIntPtr("src");
+  X86GpVar cnt = c.newInt32("cnt");
+  X86GpVar sum = c.newInt32("sum");
+  X86XmmVar tmp = c.newXmm("tmp");
+
+  Label L_Loop = c.newLabel();
+  Label L_Exit = c.newLabel();
+
+  c.setArg(0, src);
+  c.setArg(1, cnt);
+  c.xor_(sum, sum);
+  c.movd(tmp, sum);
+
+  c.test(cnt, cnt);
+  c.jz(L_Exit);
+
+  c.bind(L_Loop);
+  c.add(sum, x86::dword_ptr(src));
+  c.add(src, 4);
+  c.dec(cnt);
+  c.jnz(L_Loop);
+
+  c.bind(L_Exit);
+  c.movd(cnt, tmp);
+  c.add(sum, cnt);
+  c.ret(sum);
+  c.endFunc();
+}
+
+UNIT(x86_compiler_reuse) {
+  JitRuntime runtime;
+  X86Assembler a(&runtime);
+  X86Compiler c;
+
+  uint32_t i;
+  uint32_t kCount = 10;
+
+  // The first compilation allocates zones and buffers that are reused.
+  INFO("Warming up X86Assembler and X86Compiler.");
+  c.attach(&a);
+  X86Compiler_generateTestFunc(c);
+  EXPECT(c.finalize() == kErrorOk,
+    "X86Compiler::finalize() failed.");
+  a.reset();
+
+  INFO("Reusing X86Assembler and X86Compiler %u times.", kCount);
+  uint64_t allocCount = MemUtil::getAllocCount();
+
+  for (i = 0; i < kCount; i++) {
+    c.attach(&a);
+    X86Compiler_generateTestFunc(c);
+    EXPECT(c.finalize() == kErrorOk,
+      "X86Compiler::finalize() failed.");
+    a.reset();
+  }
+
+  allocCount = MemUtil::getAllocCount() - allocCount;
+  EXPECT(allocCount == 0,
+    "Reusing X86Assembler and X86Compiler shouldn't allocate, %u allocations made.",
+    static_cast<unsigned int>(allocCount));
+}
+
+struct X86CompilerTestAllocator : public Allocator {
+  X86CompilerTestAllocator() noexcept : allocCount(0), allocSize(0), releaseCount(0) {}
+
+  virtual void* alloc(size_t size) noexcept {
+    allocCount++;
+    allocSize += size;
+    return ::malloc(size);
+  }
+
+  virtual void* realloc(void* p, size_t size) noexcept {
+    if (p == nullptr)
+      allocCount++;
+    allocSize += size;
+    return ::realloc(p, size);
+  }
+
+  virtual void release(void* p) noexcept {
+    releaseCount++;
+    ::free(p);
+  }
+
+  size_t allocCount;
+  size_t allocSize;
+  size_t releaseCount;
+};
+
+UNIT(x86_compiler_allocator) {
+  JitRuntime runtime;
+  X86CompilerTestAllocator allocator;
+
+  uint64_t defaultCount = MemUtil::getAllocCount();
+  {
+    X86Assembler a(&runtime);
+    X86Compiler c;
+
+    EXPECT(a.setAllocator(&allocator) == kErrorOk && c.setAllocator(&allocator) == kErrorOk,
+      "Couldn't set the allocator.");
+
+    c.attach(&a);
+    X86Compiler_generateTestFunc(c);
+    EXPECT(c.finalize() == kErrorOk,
+      "X86Compiler::finalize() failed.");
+  }
+  defaultCount = MemUtil::getAllocCount() - defaultCount;
+
+  INFO("Allocator made %u allocations and %u releases.",
+    static_cast<unsigned int>(allocator.allocCount),
+    static_cast<unsigned int>(allocator.releaseCount));
+
+  EXPECT(allocator.allocCount != 0 && allocator.allocCount == allocator.releaseCount,
+    "All memory should be allocated and released by the allocator.");
+  EXPECT(defaultCount == 0,
+    "Nothing should be allocated by the default allocator, %u allocations made.",
+    static_cast<unsigned int>(defaultCount));
+}
+
+UNIT(x86_compiler_constpool) {
+  JitRuntime runtime;
+  X86Assembler a(&runtime);
+  X86Compiler c(&a);
+
+  X86Compiler::State state;
+  int32_t discarded = 0x13579BDF;
+
+  c.setFeature(kCompilerFeatureConstSection, true);
+
+  INFO("Discarding a function that uses the local constant pool.");
+  c.saveState(&state);
+  c.addFunc(FuncBuilder0<int>(kCallConvHost));
+
+  X86GpVar w = c.newInt32("w");
+  c.mov(w, c.newInt32Const(kConstScopeLocal, discarded));
+  c.ret(w);
+  c.endFunc();
+
+  EXPECT(c.restoreState(state) == kErrorOk,
+    "X86Compiler::restoreState() failed.");
+
+  INFO("Generating the function again with other constants.");
+  c.addFunc(FuncBuilder0<int>(kCallConvHost));
+
+  X86GpVar v = c.newInt32("v");
+  c.mov(v, c.newInt32Const(kConstScopeLocal, 1234567));
+  c.add(v, c.newInt32Const(kConstScopeGlobal, 1000));
+  c.ret(v);
+  c.endFunc();
+
+  INFO("Publishing the code by JitRuntime::add().");
+  EXPECT(c.finalize() == kErrorOk,
+    "X86Compiler::finalize() failed.");
+
+  typedef int (*Func)(void);
+  void* p;
+
+  EXPECT(runtime.add(&p, &a) == kErrorOk,
+    "JitRuntime::add() failed.");
+
+  const uint8_t* code = static_cast<const uint8_t*>(p);
+  size_t codeSize = a.getOffset();
+
+  for (size_t i = 0; i + sizeof(discarded) <= codeSize; i++)
+    EXPECT(::memcmp(code + i, &discarded, sizeof(discarded)) != 0,
+      "Constant of the discarded function found at offset %u.", static_cast<unsigned int>(i));
+
+  int result = asmjit_cast<Func>(p)();
+  EXPECT(result == 1235567,
+    "Function should return 1235567, not %d.", result);
+  runtime.release(p);
+
+  INFO("Relocating code with an embedded constant pool manually.");
+  X86Assembler a2(&runtime);
+  X86Compiler c2(&a2);
+
+  double constant = 1.5;
+  c2.addFunc(FuncBuilder0<double>(kCallConvHost));
+
+  X86XmmVar x = c2.newXmmSd("x");
+  c2.movsd(x, c2.newDoubleConst(kConstScopeLocal, constant));
+  c2.ret(x);
+  c2.endFunc();
+
+  EXPECT(c2.finalize() == kErrorOk,
+    "X86Compiler::finalize() failed.");
+  EXPECT(a2.getSectionsCount() == 1,
+    "Constant pool shouldn't be placed into '.rodata' by default.");
+
+  codeSize = a2.getCodeSize();
+  uint8_t* buf = static_cast<uint8_t*>(::malloc(codeSize));
+
+  EXPECT(buf != nullptr,
+    "Couldn't allocate %u bytes.", static_cast<unsigned int>(codeSize));
+  EXPECT(a2.relocCode(buf) == codeSize,
+    "X86Assembler::relocCode() should relocate all %u bytes.", static_cast<unsigned int>(codeSize));
+
+  bool found = false;
+  for (size_t i = 0; i + sizeof(constant) <= codeSize; i++)
+    found |= ::memcmp(buf + i, &constant, sizeof(constant)) == 0;
+
+  EXPECT(found,
+    "Constant should be relocated with the code.");
+  ::free(buf);
+}
+
+UNIT(x86_compiler_liveness) {
+  JitRuntime runtime;
+  X86CompilerTestAllocator allocator;
+
+  // Each variable is alive only between two instructions, dense liveness of
+  // all nodes would take `kVarCount * 2 * kVarCount / 8` bytes, which is more
+  // than everything else the compiler allocates.
+  uint32_t i;
+  uint32_t kVarCount = 4096;
+  size_t denseSize = static_cast<size_t>(kVarCount) * 2 * kVarCount / 8;
+
+  X86Assembler a(&runtime);
+  X86Compiler c;
+
+  EXPECT(c.setAllocator(&allocator) == kErrorOk,
+    "Couldn't set the allocator.");
+
+  INFO("Compiling a function that uses %u variables.", kVarCount);
+  c.attach(&a);
+  c.addFunc(FuncBuilder1<int, int*>(kCallConvHost));
+
+  X86GpVar src = c.newIntPtr("src");
+  X86GpVar sum = c.newInt32("sum");
+
+  c.setArg(0, src);
+  c.xor_(sum, sum);
+
+  for (i = 0; i < kVarCount; i++) {
+    X86GpVar var = c.newInt32();
+    c.mov(var, x86::dword_ptr(src, static_cast<int32_t>((i % 16) * 4)));
+    c.add(sum, var);
+  }
+
+  c.ret(sum);
+  c.endFunc();
+
+  EXPECT(c.finalize() == kErrorOk,
+    "X86Compiler::finalize() failed.");
+
+  INFO("Allocated %u bytes, dense liveness would take %u bytes.",
+    static_cast<unsigned int>(allocator.allocSize),
+    static_cast<unsigned int>(denseSize));
+  EXPECT(allocator.allocSize < denseSize,
+    "Liveness of short-lived variables should be sparse.");
+
+  typedef int (*Func)(int*);
+  Func func = asmjit_cast<Func>(a.make());
+
+  int data[16];
+  int expected = 0;
+
+  for (i = 0; i < 16; i++)
+    data[i] = static_cast<int>(i);
+  for (i = 0; i < kVarCount; i++)
+    expected += data[i % 16];
+
+  EXPECT(func != nullptr && func(data) == expected,
+    "Function doesn't return the expected value.");
+  runtime.release((void*)func);
+}
+
+static HLFunc* X86Compiler_generateColdFunc(X86Compiler& c, Label& L_Err) noexcept {
+  HLFunc* funcNode = c.addFunc(FuncBuilder2<int, int*, int>(kCallConvHost));
+
+  X86GpVar src = c.newIntPtr("src");
+  X86GpVar cnt = c.newInt32("cnt");
+  X86GpVar sum = c.newInt32("sum");
+  X86GpVar val = c.newInt32("val");
+
+  Label L_Loop = c.newLabel();
+  Label L_Next = c.newLabel();
+  L_Err = c.newLabel();
+
+  c.setArg(0, src);
+  c.setArg(1, cnt);
+  c.xor_(sum, sum);
+
+  c.bind(L_Loop);
+  c.mov(val, x86::dword_ptr(src));
+  c.test(val, val);
+  c.notTaken().js(L_Err);
+
+  c.bind(L_Next);
+  c.add(sum, val);
+  c.add(src, 4);
+  c.dec(cnt);
+  c.jnz(L_Loop);
+  c.ret(sum);
+
+  // Cold block, falls through back to the loop.
+  c.bind(L_Err);
+  c.neg(val);
+  c.jmp(L_Next);
+  c.endFunc();
+
+  return funcNode;
+}
+
+UNIT(x86_compiler_cold) {
+  typedef int (*Func)(int*, int);
+
+  int data[4] = { 1, -2, 3, -4 };
+  int result;
+
+  {
+    JitRuntime runtime;
+    X86Assembler a(&runtime);
+    X86Compiler c(&a);
+
+    INFO("Keeping a block reached by a jump hinted as not taken in place by default.");
+    Label L_Err;
+    X86Compiler_generateColdFunc(c, L_Err);
+
+    EXPECT(c.finalize() == kErrorOk,
+      "X86Compiler::finalize() failed.");
+    EXPECT(a.getSectionsCount() == 1,
+      "Section '.text.unlikely' shouldn't be created.");
+
+    size_t codeSize = a.getCodeSize();
+    void* p = runtime.getMemMgr()->alloc(codeSize);
+
+    EXPECT(p != nullptr && a.relocCode(p) == codeSize,
+      "X86Assembler::relocCode() should relocate all %u bytes.", static_cast<unsigned int>(codeSize));
+
+    result = asmjit_cast<Func>(p)(data, 4);
+    EXPECT(result == 10,
+      "Function should return 10, not %d.", result);
+    runtime.getMemMgr()->release(p);
+  }
+
+  {
+    JitRuntime runtime;
+    X86Assembler a(&runtime);
+    X86Compiler c(&a);
+
+    c.setFeature(kCompilerFeatureColdSection, true);
+
+    INFO("Moving a block reached by a jump hinted as not taken to '.text.unlikely'.");
+    Label L_Err;
+    HLFunc* funcNode = X86Compiler_generateColdFunc(c, L_Err);
+
+    EXPECT(c.finalize() == kErrorOk,
+      "X86Compiler::finalize() failed.");
+    EXPECT(a.findSection(".text.unlikely") != kInvalidValue,
+      "Section '.text.unlikely' should be created.");
+
+    Func func = asmjit_cast<Func>(a.make());
+
+    EXPECT(func != nullptr,
+      "X86Assembler::make() failed.");
+    EXPECT(a.getLabelOffset(L_Err) > a.getLabelOffset(funcNode->getExitLabel()),
+      "Cold block should be placed after the function's epilog.");
+
+    result = func(data, 4);
+    EXPECT(result == 10,
+      "Function should return 10, not %d.", result);
+    runtime.release((void*)func);
+  }
+
+  {
+    JitRuntime runtime;
+    X86Assembler a(&runtime);
+    X86Compiler c(&a);
+
+    c.setFeature(kCompilerFeatureColdSection, true);
+
+    INFO("Publishing the cold block by JitRuntime::add().");
+    Label L_Err;
+    X86Compiler_generateColdFunc(c, L_Err);
+
+    EXPECT(c.finalize() == kErrorOk,
+      "X86Compiler::finalize() failed.");
+
+    void* p;
+    EXPECT(runtime.add(&p, &a) == kErrorOk,
+      "JitRuntime::add() failed.");
+
+    result = asmjit_cast<Func>(p)(data, 4);
+    EXPECT(result == 10,
+      "Function should return 10, not %d.", result);
+    runtime.release(p);
+  }
+}
+
+UNIT(x86_compiler_loops) {
+  JitRuntime runtime;
+  X86Assembler a(&runtime);
+  X86Compiler c(&a);
+  StringLogger logger;
+
+  a.setLogger(&logger);
+
+  INFO("Allocating registers of nested loops under register pressure.");
+  c.addFunc(FuncBuilder1<int, int>(kCallConvHost));
+
+  enum { kNumVars = 12 };
+
+  X86GpVar n = c.newInt32("n");
+  X86GpVar i = c.newInt32("i");
+  X86GpVar j = c.newInt32("j");
+  X86GpVar sum = c.newInt32("sum");
+  X86GpVar vars[kNumVars];
+
+  Label L_Outer = c.newLabel();
+  Label L_Inner = c.newLabel();
+
+  c.setArg(0, n);
+  c.xor_(sum, sum);
+
+  // Variables not used by loops, they should be spilled before entering them.
+  for (uint32_t k = 0; k < kNumVars; k++) {
+    vars[k] = c.newInt32("v%u", k);
+    c.lea(vars[k], x86::ptr(n, static_cast<int32_t>(k)));
+  }
+
+  c.mov(i, n);
+  c.bind(L_Outer);
+  c.mov(j, n);
+
+  c.bind(L_Inner);
+  c.add(sum, j);
+  c.dec(j);
+  c.jnz(L_Inner);
+
+  c.add(sum, i);
+  c.dec(i);
+  c.jnz(L_Outer);
+
+  for (uint32_t k = 0; k < kNumVars; k++)
+    c.add(sum, vars[k]);
+
+  c.ret(sum);
+  c.endFunc();
+
+  EXPECT(c.finalize() == kErrorOk,
+    "X86Compiler::finalize() failed.");
+
+  INFO("Checking there is no spill or reload code within the outer loop.");
+  const char* log = logger.getString();
+  char pattern[32];
+
+  snprintf(pattern, ASMJIT_ARRAY_SIZE(pattern), "\nL%u:", L_Outer.getId());
+  const char* loopBegin = ::strstr(log, pattern);
+
+  snprintf(pattern, ASMJIT_ARRAY_SIZE(pattern), "jnz L%u ", L_Outer.getId());
+  const char* loopEnd = loopBegin ? ::strstr(loopBegin, pattern) : static_cast<const char*>(nullptr);
+
+  EXPECT(loopBegin != nullptr && loopEnd != nullptr,
+    "The outer loop should be logged.");
+
+  for (const char* p = loopBegin; p < loopEnd; p++) {
+    EXPECT(::strncmp(p, "[Spill]", 7) != 0 && ::strncmp(p, "[Alloc]", 7) != 0,
+      "The outer loop shouldn't spill or reload variables:\n%.*s", static_cast<int>(loopEnd - loopBegin), loopBegin);
+  }
+
+  typedef int (*Func)(int);
+  Func func = asmjit_cast<Func>(a.make());
+
+  EXPECT(func != nullptr,
+    "X86Assembler::make() failed.");
+
+  int result = func(5);
+  EXPECT(result == 216,
+    "Function should return 216, not %d.", result);
+  runtime.release((void*)func);
+}
+
+static void X86Compiler_generateProfileFunc(X86Compiler& c) noexcept {
+  c.addFunc(FuncBuilder2<int, int*, int>(kCallConvHost));
+
+  X86GpVar src = c.newIntPtr("src");
+  X86GpVar cnt = c.newInt32("cnt");
+  X86GpVar sum = c.newInt32("sum");
+  X86GpVar val = c.newInt32("val");
+
+  Label L_Loop = c.newLabel();
+  Label L_Pos = c.newLabel();
+  Label L_Big = c.newLabel();
+  Label L_Next = c.newLabel();
+
+  c.setArg(0, src);
+  c.setArg(1, cnt);
+  c.xor_(sum, sum);
+
+  c.bind(L_Loop);
+  c.mov(val, x86::dword_ptr(src));
+
+  // Mostly taken, flipped so `neg` is moved out of the loop.
+  c.test(val, val);
+  c.jns(L_Pos);
+  c.neg(val);
+
+  // Rarely taken, hinted as not taken.
+  c.bind(L_Pos);
+  c.cmp(val, 1000);
+  c.jg(L_Big);
+
+  c.bind(L_Next);
+  c.add(sum, val);
+  c.add(src, 4);
+  c.dec(cnt);
+  c.jnz(L_Loop);
+  c.ret(sum);
+
+  c.bind(L_Big);
+  c.mov(val, 1000);
+  c.jmp(L_Next);
+  c.endFunc();
+}
+
+UNIT(x86_compiler_profile) {
+  JitRuntime runtime;
+  EdgeProfile profile;
+
+  typedef int (*Func)(int*, int);
+
+  uint32_t i;
+  int data[256];
+  int expected = 0;
+
+  for (i = 0; i < 256; i++) {
+    int val = static_cast<int>(i);
+    if (i == 100) val = -val;
+    if (i == 200) val = 5000;
+
+    data[i] = val;
+    expected += val < 0 ? -val : val > 1000 ? 1000 : val;
+  }
+
+  INFO("Compiling a function instrumented by edge counters.");
+  {
+    X86Assembler a(&runtime);
+    X86Compiler c(&a);
+
+    c.setFeature(kCompilerFeatureInstrumentEdges, true);
+    c.setProfile(&profile);
+    X86Compiler_generateProfileFunc(c);
+
+    EXPECT(c.finalize() == kErrorOk,
+      "X86Compiler::finalize() failed.");
+    EXPECT(profile.hasCounters() && profile.getJccCount() == 3,
+      "Profile should have 3 conditional jumps, not %u.", profile.getJccCount());
+
+    Func func = asmjit_cast<Func>(a.make());
+    EXPECT(func != nullptr && func(data, 256) == expected,
+      "Instrumented function doesn't return the expected value.");
+    runtime.release((void*)func);
+  }
+
+  EXPECT(profile.getExecCount(0) == 256 && profile.getTakenCount(0) == 255,
+    "The first jump should be executed 256 times and taken 255 times.");
+  EXPECT(profile.getExecCount(1) == 256 && profile.getTakenCount(1) == 1,
+    "The second jump should be executed 256 times and taken once.");
+  EXPECT(profile.getExecCount(2) == 256 && profile.getTakenCount(2) == 255,
+    "The loop should be executed 256 times.");
+
+  INFO("Compiling the function guided by the profile.");
+  {
+    X86Assembler a(&runtime);
+    X86Compiler c(&a);
+
+    c.setFeature(kCompilerFeatureColdSection, true);
+    c.setProfile(&profile);
+    X86Compiler_generateProfileFunc(c);
+
+    EXPECT(c.finalize() == kErrorOk,
+      "X86Compiler::finalize() failed.");
+    EXPECT(a.findSection(".text.unlikely") != kInvalidValue,
+      "Rare blocks should be moved to '.text.unlikely'.");
+
+    Func func = asmjit_cast<Func>(a.make());
+    EXPECT(func != nullptr && func(data, 256) == expected,
+      "Function doesn't return the expected value.");
+    runtime.release((void*)func);
+  }
+
+  INFO("Compiling a different function with the profile.");
+  {
+    X86Assembler a(&runtime);
+    X86Compiler c(&a);
+
+    c.setProfile(&profile);
+    X86Compiler_generateTestFunc(c);
+
+    EXPECT(c.finalize() == kErrorInvalidState,
+      "Profile that doesn't match the code should be refused.");
+  }
+
+  profile.reset();
+  EXPECT(!profile.hasCounters() && runtime._counters == nullptr,
+    "Counters should be released.");
+}
+#endif // ASMJIT_TEST
+
 } // asmjit namespace
 
 // [Api-End]
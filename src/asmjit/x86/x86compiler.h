@@ -678,6 +678,17 @@ class X86CallNode : public HLCall {
 //! This section provided information of how the state-change works. The
 //! behavior is deterministic and can be overridden manually if needed.
 //!
+//! If `kCompilerFeatureColdSection` is enabled the `kInstOptionNotTaken` hint
+//! is also used to place cold code. A block that
+//! starts with a label, can't be entered by a fall-through, and is referenced
+//! only by conditional jumps hinted as not taken (error and slow paths) is moved
+//! to the assembler's `.text.unlikely` section. If such block falls through to
+//! the next label the compiler appends `jmp` to it, so the hot code stays dense
+//! and continues by fall-through on the likely path.
+//!
+//! Hints don't have to be written by hand, `EdgeProfile` can provide them from
+//! counters collected by code compiled with `kCompilerFeatureInstrumentEdges`.
+//!
 //! Advanced Code Generation
 //! ------------------------
 //!
@@ -1105,6 +1116,10 @@ class ASMJIT_VIRTAPI X86Compiler : public Compiler {
   ASMJIT_API virtual Error _newConst(BaseMem* mem, uint32_t scope, const void* data, size_t size) noexcept;
 
   //! Put data to a constant-pool and get a memory reference to it.
+  //!
+  //! Constant-pools are embedded into the code, or placed into the `.rodata`
+  //! section of the attached assembler if `kCompilerFeatureConstSection` is
+  //! enabled.
   ASMJIT_INLINE X86Mem newConst(uint32_t scope, const void* data, size_t size) noexcept {
     X86Mem m(NoInit);
     _newConst(&m, scope, data, size);
@@ -81,7 +81,8 @@ static void X86Context_annotateOperand(X86Context* self,
 
       case kMemTypeLabel:
         // [label + index << shift + displacement]
-        sb.appendFormat("L%u", m->getBase());
+        sb.appendChar('L');
+        sb.appendUInt(m->getBase());
         break;
 
       case kMemTypeAbsolute:
@@ -133,7 +134,8 @@ static void X86Context_annotateOperand(X86Context* self,
       sb.appendInt(val, 10);
   }
   else if (op->isLabel()) {
-    sb.appendFormat("L%u", op->getId());
+    sb.appendChar('L');
+    sb.appendUInt(op->getId());
   }
   else {
     sb.appendString("None", 4);
@@ -3382,6 +3384,47 @@ ASMJIT_INLINE void X86VarAlloc::cleanup() {
   X86BaseAlloc::cleanup();
 }
 
+// ============================================================================
+// [asmjit::X86Context - Spill Cost]
+// ============================================================================
+
+//! \internal
+//!
+//! Get registers of `regs` that hold variables that are the cheapest to spill.
+//!
+//! The cost is the variable's weight (count of uses weighted by loop depth,
+//! see `Context::loopAnalysis()`) multiplied by its priority. A modified
+//! variable has to be saved, which costs one more use.
+template<int C>
+static ASMJIT_INLINE uint32_t X86Context_getCheapestRegs(X86VarState* state, uint32_t regs) {
+  VarData** sVars = state->getListByClass(C);
+  uint32_t modified = state->_modified.get(C);
+
+  uint32_t result = 0;
+  uint64_t minCost = ~static_cast<uint64_t>(0);
+
+  while (regs != 0) {
+    uint32_t regIndex = Utils::findFirstBit(regs);
+    uint32_t regMask = Utils::mask(regIndex);
+
+    VarData* vd = sVars[regIndex];
+    ASMJIT_ASSERT(vd != nullptr);
+
+    uint64_t cost = static_cast<uint64_t>(vd->getWeight() + ((modified & regMask) != 0)) * vd->getPriority();
+    if (cost < minCost) {
+      minCost = cost;
+      result = regMask;
+    }
+    else if (cost == minCost) {
+      result |= regMask;
+    }
+
+    regs ^= regMask;
+  }
+
+  return result;
+}
+
 // ============================================================================
 // [asmjit::X86VarAlloc - Plan / Spill / Alloc]
 // ============================================================================
@@ -3562,11 +3605,10 @@ ASMJIT_INLINE void X86VarAlloc::plan() {
       uint32_t regIndex;
       uint32_t regMask;
 
-      if (candidateRegs == 0) {
-        candidateRegs = m & occupied & ~state->_modified.get(C);
-        if (candidateRegs == 0)
-          candidateRegs = m;
-      }
+      // All registers are occupied, spill the cheapest variable, which is
+      // the one that is not used in a loop, if possible.
+      if (candidateRegs == 0)
+        candidateRegs = X86Context_getCheapestRegs<C>(state, m);
 
       // printf("CANDIDATE: %s %08X\n", vd->getName(), homeMask);
       if (candidateRegs & homeMask)
@@ -3990,7 +4032,7 @@ ASMJIT_INLINE uint32_t X86VarAlloc::guessAlloc(VarData* vd, uint32_t allocableRe
   // Look ahead and calculate mask of special registers on both - input/output.
   HLNode* node = _node;
   for (i = 0; i < maxLookAhead; i++) {
-    BitArray* liveness = node->getLiveness();
+    HybridBitArray* liveness = node->getLiveness();
 
     // If the variable becomes dead it doesn't make sense to continue.
     if (liveness != nullptr && !liveness->getBit(localId))
@@ -4063,6 +4105,63 @@ template<int C>
 ASMJIT_INLINE uint32_t X86VarAlloc::guessSpill(VarData* vd, uint32_t allocableRegs) {
   ASMJIT_ASSERT(allocableRegs != 0);
 
+  uint32_t localId = vd->getLocalId();
+  uint32_t i;
+  uint32_t maxLookAhead = _compiler->getMaxLookAhead();
+
+  // Look ahead on the likely path and move the variable to another register
+  // instead of spilling it if it's read again, a move is cheaper than a spill
+  // followed by a reload. Conditional jumps are followed only if they have a
+  // hint, which is provided by the user or by the `EdgeProfile`.
+  HLNode* node = _node;
+  for (i = 0; i < maxLookAhead; i++) {
+    HybridBitArray* liveness = node->getLiveness();
+
+    // If the variable becomes dead it doesn't have to be kept at all.
+    if (liveness != nullptr && !liveness->getBit(localId))
+      return 0;
+
+    // Stop on `HLSentinel` and `HLRet`.
+    if (node->hasFlag(HLNode::kFlagIsRet))
+      return 0;
+
+    if (node->hasFlag(HLNode::kFlagIsJmp | HLNode::kFlagIsJcc)) {
+      uint32_t options = static_cast<HLJump*>(node)->getOptions();
+
+      if (node->hasFlag(HLNode::kFlagIsTaken)) {
+        node = static_cast<HLJump*>(node)->getTarget();
+        // Stop on jump that is not followed.
+        if (node == nullptr)
+          return 0;
+      }
+      else if ((options & kInstOptionNotTaken) == 0) {
+        return 0;
+      }
+    }
+
+    node = node->getNext();
+    ASMJIT_ASSERT(node != nullptr);
+
+    X86VarMap* map = node->getMap<X86VarMap>();
+    if (map != nullptr) {
+      VarAttr* va = map->findVaByClass(C, vd);
+      if (va != nullptr) {
+        // Keep the variable only if it's read from a register.
+        if (!va->hasFlag(kVarAttrRReg))
+          return 0;
+
+        uint32_t mask = va->getAllocableRegs();
+        if (mask != 0)
+          allocableRegs &= mask;
+        return allocableRegs;
+      }
+
+      allocableRegs &= ~(map->_inRegs.get(C) | map->_outRegs.get(C) | map->_clobberedRegs.get(C));
+      if (allocableRegs == 0)
+        return 0;
+    }
+  }
+
   return 0;
 }
 
@@ -5306,6 +5405,158 @@ static Error X86Context_translatePrologEpilog(X86Context* self, X86FuncNode* fun
   return kErrorOk;
 }
 
+// ============================================================================
+// [asmjit::X86Context - Translate - Loop]
+// ============================================================================
+
+//! \internal
+//!
+//! Variable is referenced inside of the loop.
+static const uint8_t kX86LoopVarUsed = 0x01;
+//! \internal
+//!
+//! Variable is read inside of the loop.
+static const uint8_t kX86LoopVarRead = 0x02;
+
+template<int C>
+static ASMJIT_INLINE void X86Context_prepareLoopRegs(X86Context* self,
+  HLLabel* head, const uint8_t* loopVars, uint32_t usedCount, uint32_t fixedRegs) {
+
+  X86VarState* state = self->getState();
+  VarData** sVars = state->getListByClass(C);
+  HybridBitArray* liveness = head->getLiveness();
+
+  uint32_t gaRegs = self->_gaRegs[C];
+  uint32_t regCount = Utils::bitCount(gaRegs);
+
+  // Spill variables the loop doesn't use if the loop needs their registers,
+  // otherwise they would be spilled inside and reloaded by every back edge.
+  uint32_t passengerRegs = 0;
+  uint32_t regs = state->_occupied.get(C);
+
+  while (regs != 0) {
+    uint32_t regIndex = Utils::findFirstBit(regs);
+    uint32_t regMask = Utils::mask(regIndex);
+
+    if (loopVars[sVars[regIndex]->getLocalId()] == 0)
+      passengerRegs |= regMask;
+    regs ^= regMask;
+  }
+
+  uint32_t passengerCount = Utils::bitCount(passengerRegs);
+  while (passengerRegs != 0 && usedCount + passengerCount > regCount) {
+    uint32_t regIndex = Utils::findFirstBit(X86Context_getCheapestRegs<C>(state, passengerRegs));
+    VarData* vd = sVars[regIndex];
+
+    if (liveness != nullptr && !liveness->getBit(vd->getLocalId()))
+      self->unuse<C>(vd);
+    else
+      self->spill<C>(vd);
+
+    passengerRegs ^= Utils::mask(regIndex);
+    passengerCount--;
+  }
+
+  // Load variables the loop reads if all of them fit into registers, so they
+  // are not reloaded by every back edge.
+  if (usedCount > regCount)
+    return;
+
+  uint32_t freeRegs = gaRegs & ~(state->_occupied.get(C) | fixedRegs);
+  if (freeRegs == 0)
+    return;
+
+  VarData** vdArray = self->_contextVd.getData();
+  size_t vdLength = self->_contextVd.getLength();
+
+  for (size_t i = 0; i < vdLength && freeRegs != 0; i++) {
+    VarData* vd = vdArray[i];
+
+    if (vd->getClass() != C || vd->getState() != kVarStateMem || (loopVars[i] & kX86LoopVarRead) == 0)
+      continue;
+
+    if (liveness == nullptr || !liveness->getBit(i))
+      continue;
+
+    uint32_t candidateRegs = freeRegs;
+    if (candidateRegs & vd->getHomeMask())
+      candidateRegs &= vd->getHomeMask();
+
+    uint32_t regIndex = Utils::findFirstBit(candidateRegs);
+    self->load<C>(vd, regIndex);
+    freeRegs ^= Utils::mask(regIndex);
+  }
+}
+
+//! \internal
+//!
+//! Prepare the state at the head of a loop entered by a fall-through.
+//!
+//! The state of the head is used by all back edges, so the code placed before
+//! the head runs only once per loop entry. Variables not used by the loop are
+//! spilled here and variables read by the loop are loaded here when possible.
+static Error X86Context_prepareLoop(X86Context* self, HLLabel* head) {
+  LoopData* loop = self->getLoop(head);
+  if (loop == nullptr)
+    return kErrorOk;
+
+  // The head must be reached by the fall-through of the previous node, the
+  // code placed between them is not executed by jumps.
+  HLNode* prev = head->getPrev();
+  if (!prev->isTranslated() || prev->hasFlag(HLNode::kFlagIsJmp | HLNode::kFlagIsRet))
+    return kErrorOk;
+
+  if (prev->isJcc() && static_cast<HLJump*>(prev)->getTarget() == head)
+    return kErrorOk;
+
+  size_t vdLength = self->_contextVd.getLength();
+  uint8_t* loopVars = static_cast<uint8_t*>(self->_zoneAllocator.allocZeroed(vdLength));
+
+  if (loopVars == nullptr)
+    return self->setLastError(kErrorNoHeapMemory);
+
+  X86RegMask fixedRegs;
+  uint32_t usedCount[_kX86RegClassManagedCount] = { 0 };
+
+  fixedRegs.reset();
+  for (HLNode* node = head; ; node = node->getNext()) {
+    X86VarMap* map = node->getMap<X86VarMap>();
+
+    if (map != nullptr) {
+      VarAttr* vaList = map->getVaList();
+      uint32_t vaCount = map->getVaCount();
+
+      fixedRegs.or_(map->_inRegs);
+      fixedRegs.or_(map->_outRegs);
+      fixedRegs.or_(map->_clobberedRegs);
+
+      for (uint32_t i = 0; i < vaCount; i++) {
+        VarAttr* va = &vaList[i];
+        VarData* vd = va->getVd();
+        uint32_t localId = vd->getLocalId();
+
+        if (loopVars[localId] == 0 && vd->getClass() < _kX86RegClassManagedCount)
+          usedCount[vd->getClass()]++;
+
+        loopVars[localId] |= kX86LoopVarUsed;
+        if (va->hasFlag(kVarAttrRAll))
+          loopVars[localId] |= kX86LoopVarRead;
+      }
+    }
+
+    if (node == loop->tail)
+      break;
+  }
+
+  X86Compiler* compiler = self->getCompiler();
+  compiler->_setCursor(prev);
+
+  X86Context_prepareLoopRegs<kX86RegClassGp>(self, head, loopVars, usedCount[kX86RegClassGp], fixedRegs.get(kX86RegClassGp));
+  X86Context_prepareLoopRegs<kX86RegClassXyz>(self, head, loopVars, usedCount[kX86RegClassXyz], fixedRegs.get(kX86RegClassXyz));
+
+  return kErrorOk;
+}
+
 // ============================================================================
 // [asmjit::X86Context - Translate - Jump]
 // ============================================================================
@@ -5333,7 +5584,7 @@ static void X86Context_translateJump(X86Context* self, HLJump* jNode, HLLabel* j
 
     // Finally, patch the jump target.
     ASMJIT_ASSERT(jNode->getOpCount() > 0);
-    jNode->_opList[0] = jTrampolineTarget->getLabel();
+    jNode->getOpList()[0] = jTrampolineTarget->getLabel();
     jNode->_target = jTrampolineTarget;
   }
 
@@ -5497,6 +5748,8 @@ _NextGroup:
       case HLNode::kTypeLabel: {
         HLLabel* node = static_cast<HLLabel*>(node_);
         ASMJIT_ASSERT(!node->hasState());
+
+        ASMJIT_PROPAGATE_ERROR(X86Context_prepareLoop(this, node));
         node->setState(saveState());
         break;
       }
@@ -5511,7 +5764,7 @@ _NextGroup:
         // Update VarAttr's unuse flags based on liveness of the next node.
         if (!node_->isJcc()) {
           X86VarMap* map = static_cast<X86VarMap*>(node_->getMap());
-          BitArray* liveness;
+          HybridBitArray* liveness;
 
           if (map != nullptr && next != nullptr && (liveness = next->getLiveness()) != nullptr) {
             VarAttr* vaList = map->getVaList();
@@ -5679,9 +5932,220 @@ _Done:
 // [asmjit::X86Context - Serialize]
 // ============================================================================
 
+//! \internal
+//!
+//! Block moved to the cold section by `X86Context::serialize()`.
+struct X86ColdBlock {
+  //! First node of the block, always a label.
+  HLNode* first;
+  //! Last node of the block.
+  HLNode* last;
+  //! Label the block falls through to, nullptr if it ends by `jmp` or `ret`.
+  HLLabel* next;
+};
+
+//! \internal
+//!
+//! State of a label used by `X86Context_findColdBlocks()`.
+ASMJIT_ENUM(X86ColdRef) {
+  //! Label is referenced by a conditional jump hinted by `kInstOptionNotTaken`.
+  kX86ColdRefUnlikely = 0x01,
+  //! Label is referenced by any other instruction.
+  kX86ColdRefOther = 0x02
+};
+
+//! \internal
+//!
+//! Find blocks that are only reachable through conditional jumps hinted as not
+//! taken. Such block can't be entered by a fall-through and it ends by the
+//! first unconditional jump, return, or the next label it falls through to.
+static Error X86Context_findColdBlocks(X86Context* self, Assembler* assembler,
+  HLNode* start, HLNode* stop, ZoneVector<X86ColdBlock>& blocks) {
+
+  size_t labelsCount = assembler->getLabelsCount();
+  uint8_t* refs = static_cast<uint8_t*>(self->_zoneAllocator.allocZeroed(labelsCount));
+
+  if (refs == nullptr)
+    return kErrorNoHeapMemory;
+
+  HLNode* node_;
+  bool hasUnlikely = false;
+
+  for (node_ = start; node_ != stop; node_ = node_->getNext()) {
+    if (node_->getType() == HLNode::kTypeInst) {
+      HLInst* node = static_cast<HLInst*>(node_);
+      const Operand* opList = node->getOpList();
+      uint32_t opCount = node->getOpCount();
+
+      for (uint32_t i = 0; i < opCount; i++) {
+        const Operand& op = opList[i];
+        uint32_t id;
+
+        if (op.isLabel())
+          id = op.getId();
+        else if (op.isMem() && static_cast<const X86Mem&>(op).getMemType() == kMemTypeLabel)
+          id = static_cast<const X86Mem&>(op)._vmem.base;
+        else
+          continue;
+
+        if (id >= labelsCount)
+          continue;
+
+        if (i == 0 && node->isJcc() && (node->getOptions() & kInstOptionNotTaken) != 0) {
+          refs[id] |= kX86ColdRefUnlikely;
+          hasUnlikely = true;
+        }
+        else {
+          refs[id] |= kX86ColdRefOther;
+        }
+      }
+    }
+    else if (node_->getType() == HLNode::kTypeCall) {
+      const Operand& target = static_cast<X86CallNode*>(node_)->_target;
+      if (target.isLabel() && target.getId() < labelsCount)
+        refs[target.getId()] |= kX86ColdRefOther;
+    }
+  }
+
+  if (!hasUnlikely)
+    return kErrorOk;
+
+  X86ColdBlock block;
+  bool inBlock = false;
+  bool fallsThrough = true;
+
+  for (node_ = start; node_ != stop; node_ = node_->getNext()) {
+    switch (node_->getType()) {
+      case HLNode::kTypeLabel: {
+        HLLabel* node = static_cast<HLLabel*>(node_);
+        uint32_t id = node->getLabelId();
+
+        if (inBlock) {
+          block.next = node;
+          ASMJIT_PROPAGATE_ERROR(blocks.append(block));
+          inBlock = false;
+        }
+
+        if (!fallsThrough && id < labelsCount && refs[id] == kX86ColdRefUnlikely) {
+          block.first = node;
+          block.last = node;
+          inBlock = true;
+        }
+        break;
+      }
+
+      case HLNode::kTypeInst: {
+        uint32_t instId = static_cast<HLInst*>(node_)->getInstId();
+        fallsThrough = instId != kX86InstIdJmp && instId != kX86InstIdRet;
+
+        if (inBlock) {
+          block.last = node_;
+
+          if (!fallsThrough) {
+            block.next = nullptr;
+            ASMJIT_PROPAGATE_ERROR(blocks.append(block));
+            inBlock = false;
+          }
+        }
+        break;
+      }
+
+      case HLNode::kTypeCall: {
+        fallsThrough = true;
+        if (inBlock)
+          block.last = node_;
+        break;
+      }
+
+      default: {
+        if (inBlock)
+          block.last = node_;
+        break;
+      }
+    }
+  }
+
+  // A block that falls out of the serialized range stays where it is.
+  return kErrorOk;
+}
+
 Error X86Context::serialize(Assembler* assembler_, HLNode* start, HLNode* stop) {
   X86Assembler* assembler = static_cast<X86Assembler*>(assembler_);
-  HLNode* node_ = start;
+  ZoneVector<X86ColdBlock> coldBlocks(&_zoneAllocator);
+
+  if (getCompiler()->hasFeature(kCompilerFeatureColdSection))
+    ASMJIT_PROPAGATE_ERROR(X86Context_findColdBlocks(this, assembler, start, stop, coldBlocks));
+
+  Error error = kErrorOk;
+  size_t coldCount = coldBlocks.getLength();
+
+  if (coldCount == 0) {
+    error = serializeNodes(assembler, start, stop);
+  }
+  else {
+    // Hot code is serialized without cold blocks, which keeps the likely path
+    // dense, cold blocks are then serialized into `.text.unlikely`.
+    HLNode* node = start;
+    size_t i;
+
+    for (i = 0; i < coldCount && error == kErrorOk; i++) {
+      const X86ColdBlock& block = coldBlocks[i];
+      HLNode* end = block.first;
+      HLNode* resume = block.last->getNext();
+
+      // Drop `jmp L` that jumps over the cold block to `L`, which becomes the
+      // next hot node. This happens when the block is reached by a flipped
+      // conditional jump, see `X86Compiler_flipJcc()`.
+      HLNode* prev = end->getPrev();
+      if (prev != node && prev->getType() == HLNode::kTypeInst && resume != nullptr &&
+          resume->getType() == HLNode::kTypeLabel &&
+          (i + 1 >= coldCount || coldBlocks[i + 1].first != resume)) {
+        HLInst* jNode = static_cast<HLInst*>(prev);
+        if (jNode->getInstId() == kX86InstIdJmp && jNode->getOpCount() == 1 &&
+            jNode->getOpList()[0].isLabel() &&
+            jNode->getOpList()[0].getId() == static_cast<HLLabel*>(resume)->getLabelId()) {
+          end = prev;
+        }
+      }
+
+      if (node != end)
+        error = serializeNodes(assembler, node, end);
+      node = resume;
+    }
+
+    if (error == kErrorOk && node != stop)
+      error = serializeNodes(assembler, node, stop);
+
+    if (error == kErrorOk) {
+      uint32_t prevSectionId = assembler->getSectionId();
+      uint32_t coldSectionId = assembler->findSection(".text.unlikely");
+
+      if (coldSectionId == kInvalidValue)
+        coldSectionId = assembler->newSection(".text.unlikely", kSectionFlagExec, 16);
+
+      if (coldSectionId == kInvalidValue)
+        error = assembler->getLastError();
+      else
+        error = assembler->switchSection(coldSectionId);
+
+      for (i = 0; i < coldCount && error == kErrorOk; i++) {
+        const X86ColdBlock& block = coldBlocks[i];
+        error = serializeNodes(assembler, block.first, block.last->getNext());
+
+        if (error == kErrorOk && block.next != nullptr)
+          error = assembler->jmp(block.next->getLabel());
+      }
+
+      if (error == kErrorOk)
+        error = assembler->switchSection(prevSectionId);
+    }
+  }
+
+  return error;
+}
+
+Error X86Context::serializeNodes(X86Assembler* assembler, HLNode* first, HLNode* stop) {
+  HLNode* node_ = first;
 
 #if !defined(ASMJIT_DISABLE_LOGGER)
   Logger* logger = assembler->getLogger();
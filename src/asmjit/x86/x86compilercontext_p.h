@@ -668,6 +668,9 @@ struct X86Context : public Context {
 
   virtual Error serialize(Assembler* assembler, HLNode* start, HLNode* stop);
 
+  //! Serialize nodes from `first` up to `stop` (exclusive) in their order.
+  Error serializeNodes(X86Assembler* assembler, HLNode* first, HLNode* stop);
+
   // --------------------------------------------------------------------------
   // [Members]
   // --------------------------------------------------------------------------
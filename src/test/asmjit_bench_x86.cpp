@@ -19,6 +19,7 @@
 
 static const uint32_t kNumRepeats = 10;
 static const uint32_t kNumIterations = 5000;
+static const uint32_t kNumNodeFunctions = 20000;
 
 // ============================================================================
 // [TestRuntime]
@@ -138,9 +139,15 @@ static void benchX86(uint32_t arch, uint32_t callConv) {
   size_t asmOutputSize = 0;
   size_t cmpOutputSize = 0;
 
+  // Heap allocations made by the last repeat, should be zero as everything is
+  // reused after the first one.
+  uint64_t asmAllocCount = 0;
+  uint64_t cmpAllocCount = 0;
+
   perf.reset();
   for (r = 0; r < kNumRepeats; r++) {
     asmOutputSize = 0;
+    asmAllocCount = MemUtil::getAllocCount();
     perf.start();
     for (i = 0; i < kNumIterations; i++) {
       asmgen::opcode(a);
@@ -152,10 +159,12 @@ static void benchX86(uint32_t arch, uint32_t callConv) {
       a.reset();
     }
     perf.end();
+    asmAllocCount = MemUtil::getAllocCount() - asmAllocCount;
   }
 
-  printf("%-12s (%s) | Time: %-6u [ms] | Speed: %7.3f [MB/s]\n",
-    "X86Assembler", archName, perf.best, mbps(perf.best, asmOutputSize));
+  printf("%-12s (%s) | Time: %-6u [ms] | Speed: %7.3f [MB/s] | Allocs: %u\n",
+    "X86Assembler", archName, perf.best, mbps(perf.best, asmOutputSize),
+    static_cast<unsigned int>(asmAllocCount));
 
   // --------------------------------------------------------------------------
   // [Bench - Blend]
@@ -164,6 +173,7 @@ static void benchX86(uint32_t arch, uint32_t callConv) {
   perf.reset();
   for (r = 0; r < kNumRepeats; r++) {
     cmpOutputSize = 0;
+    cmpAllocCount = MemUtil::getAllocCount();
     perf.start();
     for (i = 0; i < kNumIterations; i++) {
       c.attach(&a);
@@ -177,13 +187,181 @@ static void benchX86(uint32_t arch, uint32_t callConv) {
       a.reset();
     }
     perf.end();
+    cmpAllocCount = MemUtil::getAllocCount() - cmpAllocCount;
+  }
+
+  printf("%-12s (%s) | Time: %-6u [ms] | Speed: %7.3f [MB/s] | Allocs: %u\n",
+    "X86Compiler", archName, perf.best, mbps(perf.best, cmpOutputSize),
+    static_cast<unsigned int>(cmpAllocCount));
+
+  // --------------------------------------------------------------------------
+  // [Bench - Logging]
+  // --------------------------------------------------------------------------
+
+  StringLogger logger;
+  a.setLogger(&logger);
+
+  perf.reset();
+  for (r = 0; r < kNumRepeats; r++) {
+    asmOutputSize = 0;
+    asmAllocCount = MemUtil::getAllocCount();
+    perf.start();
+    for (i = 0; i < kNumIterations; i++) {
+      asmgen::opcode(a);
+
+      void *p = a.make();
+      runtime.release(p);
+
+      asmOutputSize += a.getCodeSize();
+      a.reset();
+      logger.clearString();
+    }
+    perf.end();
+    asmAllocCount = MemUtil::getAllocCount() - asmAllocCount;
   }
 
-  printf("%-12s (%s) | Time: %-6u [ms] | Speed: %7.3f [MB/s]\n",
-    "X86Compiler", archName, perf.best, mbps(perf.best, cmpOutputSize));
+  printf("%-12s (%s) | Time: %-6u [ms] | Speed: %7.3f [MB/s] | Allocs: %u (Logging)\n",
+    "X86Assembler", archName, perf.best, mbps(perf.best, asmOutputSize),
+    static_cast<unsigned int>(asmAllocCount));
+
+  perf.reset();
+  for (r = 0; r < kNumRepeats; r++) {
+    cmpOutputSize = 0;
+    cmpAllocCount = MemUtil::getAllocCount();
+    perf.start();
+    for (i = 0; i < kNumIterations; i++) {
+      c.attach(&a);
+      asmgen::blend(c);
+      c.finalize();
+
+      void* p = a.make();
+      runtime.release(p);
+
+      cmpOutputSize += a.getCodeSize();
+      a.reset();
+      logger.clearString();
+    }
+    perf.end();
+    cmpAllocCount = MemUtil::getAllocCount() - cmpAllocCount;
+  }
+
+  printf("%-12s (%s) | Time: %-6u [ms] | Speed: %7.3f [MB/s] | Allocs: %u (Logging)\n",
+    "X86Compiler", archName, perf.best, mbps(perf.best, cmpOutputSize),
+    static_cast<unsigned int>(cmpAllocCount));
+
+  a.setLogger(NULL);
+
+  // --------------------------------------------------------------------------
+  // [Bench - Nodes]
+  // --------------------------------------------------------------------------
+
+  // Walk a node stream that doesn't fit into caches the way `fetch()` does,
+  // reading only members every pass needs. The time depends mostly on how
+  // many cache lines a node spans.
+  c.attach(&a);
+  for (i = 0; i < kNumNodeFunctions; i++)
+    asmgen::blend(c);
+
+  size_t nodeCount = 0;
+  size_t nodeBytes = 0;
+  uint32_t checksum = 0;
+
+  perf.reset();
+  for (r = 0; r < kNumRepeats; r++) {
+    nodeCount = 0;
+    nodeBytes = 0;
+
+    perf.start();
+    for (HLNode* node = c.getFirstNode(); node != NULL; node = node->getNext()) {
+      checksum += node->getType() + node->getFlags() + node->getFlowId() + node->hasMap();
+
+      if (node->getType() == HLNode::kTypeInst) {
+        HLInst* inst = static_cast<HLInst*>(node);
+        const Operand* opList = inst->getOpList();
+        uint32_t opCount = inst->getOpCount();
+
+        checksum += inst->getInstId() + inst->getOptions();
+        for (uint32_t j = 0; j < opCount; j++)
+          checksum += opList[j].getOp();
+
+        nodeBytes += (size_t)(reinterpret_cast<const uint8_t*>(opList + opCount) -
+                              reinterpret_cast<const uint8_t*>(inst));
+      }
+      else {
+        nodeBytes += sizeof(HLNode);
+      }
+      nodeCount++;
+    }
+    perf.end();
+  }
+  c.reset(false);
+
+  printf("%-12s (%s) | Time: %-6u [ms] | Nodes: %u | Bytes/Node: %.1f | Checksum: %u\n",
+    "HLNode Walk", archName, perf.best, static_cast<unsigned int>(nodeCount),
+    static_cast<double>(nodeBytes) / static_cast<double>(nodeCount), checksum);
 }
 #endif
 
+// ============================================================================
+// [BitArray]
+// ============================================================================
+
+// Liveness sets of a function with 16384 variables.
+static const uint32_t kBitArrayLength = 16384 / asmjit::BitArray::kEntityBits;
+static const uint32_t kBitArrayIterations = 200000;
+
+static void benchBitArray() {
+  using namespace asmjit;
+
+  static const char* implNames[] = { "Scalar", "SSE2", "AVX2" };
+
+  Performance perf;
+  uintptr_t* data = static_cast<uintptr_t*>(::malloc(kBitArrayLength * 3 * sizeof(uintptr_t)));
+  if (data == NULL)
+    return;
+
+  uintptr_t* dst = data;
+  uintptr_t* s0 = data + kBitArrayLength;
+  uintptr_t* s1 = data + kBitArrayLength * 2;
+
+  for (uint32_t impl = 0; impl < BitArray::kImplCount; impl++) {
+    const BitArrayFuncs* funcs = BitArray::getFuncs(impl);
+    if (funcs == NULL)
+      continue;
+
+    uint32_t i, r;
+    uint32_t nonZero = 0;
+    uint32_t opTime[4];
+
+    for (uint32_t op = 0; op < 4; op++) {
+      perf.reset();
+      for (r = 0; r < kNumRepeats; r++) {
+        for (i = 0; i < kBitArrayLength; i++) {
+          s0[i] = static_cast<uintptr_t>(i * 0x9E3779B1U);
+          s1[i] = static_cast<uintptr_t>(i * 0x85EBCA6BU);
+        }
+
+        perf.start();
+        for (i = 0; i < kBitArrayIterations; i++) {
+          switch (op) {
+            case 0: nonZero += funcs->addBits(dst, s0, s1, kBitArrayLength); break;
+            case 1: nonZero += funcs->andBits(dst, s0, s1, kBitArrayLength); break;
+            case 2: nonZero += funcs->delBits(dst, s0, s1, kBitArrayLength); break;
+            case 3: nonZero += funcs->addBitsDelSource(dst, s0, s1, kBitArrayLength); break;
+          }
+        }
+        perf.end();
+      }
+      opTime[op] = perf.best;
+    }
+
+    printf("%-12s (%-6s) | Add: %-4u [ms] | And: %-4u [ms] | Del: %-4u [ms] | AddDelSource: %-4u [ms] | NonZero: %u\n",
+      "BitArray", implNames[impl], opTime[0], opTime[1], opTime[2], opTime[3], nonZero);
+  }
+
+  ::free(data);
+}
+
 int main(int argc, char* argv[]) {
 #if defined(ASMJIT_BUILD_X86)
   benchX86(asmjit::kArchX86, asmjit::kCallConvX86CDecl);
@@ -192,5 +370,7 @@ int main(int argc, char* argv[]) {
   benchX86(asmjit::kArchX64, asmjit::kCallConvX64Unix);
 #endif
 
+  benchBitArray();
+
   return 0;
 }
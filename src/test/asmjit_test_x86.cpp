@@ -438,6 +438,62 @@ struct X86Test_AllocBase : public X86Test {
   }
 };
 
+// ============================================================================
+// [X86Test_AllocRestoreState]
+// ============================================================================
+
+struct X86Test_AllocRestoreState : public X86Test {
+  X86Test_AllocRestoreState() : X86Test("[Alloc] Restore state") {}
+
+  static void add(PodVector<X86Test*>& tests) {
+    tests.append(new X86Test_AllocRestoreState());
+  }
+
+  virtual void compile(X86Compiler& c) {
+    c.addFunc(FuncBuilder0<int>(kCallConvHost));
+
+    Label L_Exit = c.newLabel();
+    X86GpVar v0 = c.newInt32("v0");
+    c.mov(v0, 1);
+
+    // Speculatively generated code that is discarded.
+    X86Compiler::State state;
+    c.saveState(&state);
+
+    Label L_Spec = c.newLabel();
+    X86GpVar v1 = c.newInt32("v1");
+
+    c.mov(v1, 100);
+    c.bind(L_Spec);
+    c.add(v0, v1);
+    c.cmp(v0, 1000);
+    c.jl(L_Spec);
+    c.jmp(L_Exit);
+
+    if (c.restoreState(state) != kErrorOk)
+      c.mov(v0, 0);
+
+    c.add(v0, 2);
+    c.bind(L_Exit);
+
+    c.ret(v0);
+    c.endFunc();
+  }
+
+  virtual bool run(void* _func, StringBuilder& result, StringBuilder& expect) {
+    typedef int (*Func)(void);
+    Func func = asmjit_cast<Func>(_func);
+
+    int resultRet = func();
+    int expectRet = 3;
+
+    result.setFormat("ret=%d", resultRet);
+    expect.setFormat("ret=%d", expectRet);
+
+    return resultRet == expectRet;
+  }
+};
+
 // ============================================================================
 // [X86Test_AllocManual]
 // ============================================================================
@@ -3142,6 +3198,7 @@ X86TestSuite::X86TestSuite() :
 
   // Alloc.
   ADD_TEST(X86Test_AllocBase);
+  ADD_TEST(X86Test_AllocRestoreState);
   ADD_TEST(X86Test_AllocManual);
   ADD_TEST(X86Test_AllocUseMem);
   ADD_TEST(X86Test_AllocMany1);